@@ -11,6 +11,7 @@
 #define INV_DEP_SIZE 1
 #define POS_SIZE 3
 #define ROTMAT_SIZE 9
+#define SESSION_ID_SHIFT 40 //Keyframes of previous sessions have the session in the high bits of their ids
 using namespace Eigen;
 
 namespace D2Common {
@@ -22,6 +23,10 @@ typedef SparseMatrix<state_type> SparseMat;
 typedef std::vector<cv::Point3f> Point3fVector;
 typedef std::vector<cv::Point2f> Point2fVector;
 
+inline bool isPreviousSessionFrame(FrameIdType frame_id) {
+    return frame_id >= ((FrameIdType) 1 << SESSION_ID_SHIFT);
+}
+
 enum PGO_MODE {
     PGO_MODE_NON_DIST = 0,
     PGO_MODE_DISTRIBUTED_AROCK
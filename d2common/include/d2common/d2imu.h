@@ -3,6 +3,7 @@
 #include "swarm_msgs/Pose.h"
 #include <swarm_msgs/Odometry.h>
 #include <mutex>
+#include <atomic>
 #include <swarm_msgs/lcm_gen/IMUData_t.hpp>
 #include <swarm_msgs/swarm_lcm_converter.hpp>
 
@@ -55,7 +56,7 @@ class IMUBuffer {
 protected:
     size_t searchClosest(double t) const;
     //Search [i0, i1)
-    size_t searchClosest(double t, int i0, int i1) const;
+    size_t searchClosest(double t, size_t i0, size_t i1) const;
     IMUBuffer slice(int i0, int i1) const;
     mutable std::recursive_mutex buf_lock;
 public:
@@ -97,7 +98,7 @@ public:
 
     Swarm::Odometry propagation(const Swarm::Odometry & odom, const Vector3d & Ba, const Vector3d & Bg) const;
     Swarm::Odometry propagation(const VINSFrame & baseframe) const;
-    IMUData operator[](int i) const {
+    const IMUData & operator[](int i) const {
         return buf.at(i);
     }
     
@@ -105,4 +106,84 @@ public:
         return buf.at(i);
     }
 };
+
+class IMURingBuffer;
+
+//Non-owning view of the samples [i0, i1) of a IMURingBuffer.
+class IMUBufferView {
+    const IMURingBuffer * ring = nullptr;
+    size_t i0 = 0;
+    size_t i1 = 0;
+public:
+    IMUBufferView() {}
+    IMUBufferView(const IMURingBuffer * _ring, size_t _i0, size_t _i1):
+        ring(_ring), i0(_i0), i1(std::max(_i0, _i1)) {}
+
+    size_t size() const {
+        return i1 - i0;
+    }
+
+    const IMUData & operator[](int i) const;
+
+    Vector3d mean_acc() const;
+
+    Vector3d mean_gyro() const;
+
+    Swarm::Odometry propagation(const Swarm::Odometry & odom, const Vector3d & Ba, const Vector3d & Bg) const;
+    Swarm::Odometry propagation(const VINSFrame & baseframe) const;
+
+    //Copy of the samples, e.g. for broadcasting
+    IMUBuffer toBuffer() const;
+};
+
+//Single-producer ring buffer of IMU samples.
+//Samples are addressed by absolute index (the number of samples added before it), so the indices kept in frames
+//stay valid while the buffer wraps. Only one thread may add(); readers never lock nor wait, they see all the samples
+//published before the call. A slot is overwritten CAPACITY samples after it was added and readers can only address the
+//latest CAPACITY - GUARD samples, so a view must be consumed before GUARD more samples arrive (10s at 400Hz).
+class IMURingBuffer {
+public:
+    enum {
+        CAPACITY = 1 << 15,
+        GUARD = 1 << 12
+    };
+protected:
+    std::vector<IMUData> buf;
+    std::atomic<size_t> head;
+    //Search [i0, i1)
+    size_t searchClosest(double t, size_t i0, size_t i1) const;
+public:
+    IMURingBuffer(): buf(CAPACITY), head(0) {}
+    IMURingBuffer(const IMURingBuffer &) = delete;
+    IMURingBuffer & operator=(const IMURingBuffer &) = delete;
+
+    //Producer only
+    void add(const IMUData & data);
+
+    //Absolute index of the oldest addressable sample
+    size_t begin() const;
+
+    //Absolute index after the latest sample
+    size_t end() const {
+        return head.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return end() - begin();
+    }
+
+    const IMUData & operator[](size_t i) const {
+        return buf[i & (CAPACITY - 1)];
+    }
+
+    IMUData back() const;
+
+    bool available(double t) const;
+
+    IMUBufferView tail(double t) const;
+
+    //Return imu buf and last data's index, as IMUBuffer::periodIMU
+    std::pair<IMUBufferView, int> periodIMU(double t0, double t1) const;
+    std::pair<IMUBufferView, int> periodIMU(int i0, double t1) const;
+};
 }
\ No newline at end of file
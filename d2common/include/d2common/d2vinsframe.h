@@ -19,6 +19,7 @@ struct VINSFrame: public D2BaseFrame {
     
     VINSFrame(const VisualImageDescArray & frame, const IMUBuffer & buf, const VINSFrame & prev_frame);
     VINSFrame(const VisualImageDescArray & frame, const std::pair<IMUBuffer, int> & buf, const VINSFrame & prev_frame);
+    VINSFrame(const VisualImageDescArray & frame, const std::pair<IMUBufferView, int> & buf, const VINSFrame & prev_frame);
     
     VINSFrame(const VisualImageDescArray & frame, const Vector3d & _Ba, const Vector3d & _Bg);
     VINSFrame(const VisualImageDescArray & frame);
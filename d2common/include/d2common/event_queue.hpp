@@ -0,0 +1,187 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+namespace D2Common {
+//Histogram of latencies in ms with log spaced bins (10 per decade from 0.01ms to 100s), thread safe.
+class LatencyHistogram {
+    static constexpr int BINS_PER_DECADE = 10;
+    static constexpr double MIN_MS = 0.01;
+    static constexpr int NUM_BINS = 7 * BINS_PER_DECADE + 1; //Last bin upper edge MIN_MS*1e7 = 100s
+    mutable std::mutex lock;
+    std::vector<uint64_t> bins = std::vector<uint64_t>(NUM_BINS, 0);
+    uint64_t count = 0;
+    double sum = 0;
+    double max = 0;
+    std::string name;
+
+    static double binUpper(int bin) {
+        return MIN_MS * pow(10.0, (double) bin / BINS_PER_DECADE);
+    }
+public:
+    LatencyHistogram(std::string _name = ""): name(_name) {}
+
+    void setName(std::string _name) {
+        std::lock_guard<std::mutex> guard(lock);
+        name = _name;
+    }
+
+    void add(double ms) {
+        int bin = ms <= MIN_MS ? 0 : (int) ceil(log10(ms / MIN_MS) * BINS_PER_DECADE);
+        std::lock_guard<std::mutex> guard(lock);
+        bins[std::min(bin, NUM_BINS - 1)] ++;
+        count ++;
+        sum += ms;
+        max = std::max(max, ms);
+    }
+
+    //Upper edge of the bin holding the quantile q in [0, 1]
+    double quantile(double q) const {
+        std::lock_guard<std::mutex> guard(lock);
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t target = std::max<uint64_t>(1, ceil(q * count)), acc = 0;
+        for (int i = 0; i < NUM_BINS; i ++) {
+            acc += bins[i];
+            if (acc >= target) {
+                return std::min(binUpper(i), max);
+            }
+        }
+        return max;
+    }
+
+    uint64_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return count;
+    }
+
+    std::string toStr() const {
+        double p50 = quantile(0.5), p95 = quantile(0.95), p99 = quantile(0.99);
+        std::lock_guard<std::mutex> guard(lock);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s: n %lu avg %.2fms p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms", name.c_str(),
+            count, count > 0 ? sum / count : 0.0, p50, p95, p99, max);
+        return std::string(buf);
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        std::fill(bins.begin(), bins.end(), 0);
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+};
+
+//Queue handing events from producer threads to a consumer thread blocked on a condition variable.
+//The backpressure policy decides what happens to pending events when new ones arrive:
+//KEEP_ALL queues everything, DROP_OLDEST drops the oldest beyond capacity,
+//COALESCE replaces all pending events by the newest one (e.g. requests to solve).
+//The time each event waits in the queue is recorded in waitLatency().
+template <typename T>
+class EventQueue {
+public:
+    enum Policy {
+        KEEP_ALL,
+        DROP_OLDEST,
+        COALESCE
+    };
+protected:
+    typedef std::chrono::steady_clock Clock;
+    std::deque<std::pair<T, Clock::time_point>> queue;
+    mutable std::mutex lock;
+    std::condition_variable cond;
+    Policy policy;
+    size_t capacity;
+    uint64_t dropped_num = 0;
+    bool is_shutdown = false;
+    LatencyHistogram wait_latency;
+public:
+    EventQueue(Policy _policy = KEEP_ALL, size_t _capacity = 0):
+        policy(_policy), capacity(_capacity) {}
+
+    void setPolicy(Policy _policy, size_t _capacity = 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        policy = _policy;
+        capacity = _capacity;
+    }
+
+    //Returns false if pending events are dropped for it
+    bool push(const T & event) {
+        bool dropped = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (policy == COALESCE) {
+                dropped = !queue.empty();
+                dropped_num += queue.size();
+                queue.clear();
+            } else if (policy == DROP_OLDEST && capacity > 0) {
+                while (queue.size() >= capacity) {
+                    queue.pop_front();
+                    dropped_num ++;
+                    dropped = true;
+                }
+            }
+            queue.emplace_back(event, Clock::now());
+        }
+        cond.notify_one();
+        return !dropped;
+    }
+
+    //Wait at most timeout_ms (forever if negative) for an event. Returns false on timeout or shutdown.
+    bool pop(T & event, double timeout_ms = -1) {
+        std::unique_lock<std::mutex> guard(lock);
+        auto ready = [&] {
+            return !queue.empty() || is_shutdown;
+        };
+        if (timeout_ms < 0) {
+            cond.wait(guard, ready);
+        } else if (!cond.wait_for(guard, std::chrono::duration<double, std::milli>(timeout_ms), ready)) {
+            return false;
+        }
+        if (queue.empty()) {
+            return false;
+        }
+        event = std::move(queue.front().first);
+        auto stamp = queue.front().second;
+        queue.pop_front();
+        guard.unlock();
+        wait_latency.add(std::chrono::duration<double, std::milli>(Clock::now() - stamp).count());
+        return true;
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            is_shutdown = true;
+        }
+        cond.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return queue.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    uint64_t dropped() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return dropped_num;
+    }
+
+    LatencyHistogram & waitLatency() {
+        return wait_latency;
+    }
+};
+}
@@ -36,6 +36,10 @@ class IntegrationBase
 {
   public:
     static Eigen::Matrix<double, 18, 18> noise;
+    //repropagate() re-integrates the samples only when the bias moves further than these from the linearization point,
+    //smaller changes are corrected to first order with the bias Jacobians in evaluate().
+    static double repropagate_ba_thres;
+    static double repropagate_bg_thres;
     IntegrationBase() = delete;
     IntegrationBase(const Eigen::Vector3d &_acc_0, const Eigen::Vector3d &_gyr_0,
                     const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg)
@@ -47,14 +51,19 @@ class IntegrationBase
 
     }
 
-    IntegrationBase(const IMUBuffer & buf, const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg):
+    //Buf: IMUBuffer or IMUBufferView
+    template <typename Buf>
+    IntegrationBase(const Buf & buf, const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg):
         acc_0{buf[0].acc}, gyr_0{buf[0].gyro}, linearized_acc{buf[0].acc}, linearized_gyr{buf[0].gyro},
         linearized_ba{_linearized_ba}, linearized_bg{_linearized_bg},
         jacobian{Eigen::Matrix<double, 15, 15>::Identity()}, covariance{Eigen::Matrix<double, 15, 15>::Zero()},
         sum_dt{0.0}, delta_p{Eigen::Vector3d::Zero()}, delta_q{Eigen::Quaterniond::Identity()}, delta_v{Eigen::Vector3d::Zero()}
     {
-        for (auto & imu : buf.buf) {
-            push_back(imu.dt, imu.acc, imu.gyro);
+        dt_buf.reserve(buf.size());
+        acc_buf.reserve(buf.size());
+        gyr_buf.reserve(buf.size());
+        for (size_t i = 0; i < buf.size(); i ++) {
+            push_back(buf[i].dt, buf[i].acc, buf[i].gyro);
         }
     }
 
@@ -68,6 +77,9 @@ class IntegrationBase
 
     void push_back(IntegrationBase * other) 
     {
+        dt_buf.reserve(dt_buf.size() + other->dt_buf.size());
+        acc_buf.reserve(acc_buf.size() + other->acc_buf.size());
+        gyr_buf.reserve(gyr_buf.size() + other->gyr_buf.size());
         for (size_t i = 0; i < other->dt_buf.size(); i ++ ) {
             auto dt = other->dt_buf[i];
             auto acc = other->acc_buf[i];
@@ -76,8 +88,13 @@ class IntegrationBase
         }
     }
 
-    void repropagate(const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg)
+    //Returns true if the samples are re-integrated
+    bool repropagate(const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg, bool force = false)
     {
+        if (!force && (_linearized_ba - linearized_ba).norm() < repropagate_ba_thres &&
+                (_linearized_bg - linearized_bg).norm() < repropagate_bg_thres) {
+            return false;
+        }
         sum_dt = 0.0;
         acc_0 = linearized_acc;
         gyr_0 = linearized_gyr;
@@ -90,6 +107,34 @@ class IntegrationBase
         covariance.setZero();
         for (int i = 0; i < static_cast<int>(dt_buf.size()); i++)
             propagate(dt_buf[i], acc_buf[i], gyr_buf[i]);
+        updateSqrtInfo();
+        return true;
+    }
+
+    //Deltas at bias (ba, bg), corrected to first order from the linearization point
+    void correctedDelta(const Eigen::Vector3d &ba, const Eigen::Vector3d &bg,
+            Eigen::Vector3d &corrected_delta_p, Eigen::Quaterniond &corrected_delta_q, Eigen::Vector3d &corrected_delta_v) const
+    {
+        Eigen::Vector3d dba = ba - linearized_ba;
+        Eigen::Vector3d dbg = bg - linearized_bg;
+        corrected_delta_q = delta_q * Utility::deltaQ(jacobian.block<3, 3>(O_R, O_BG) * dbg);
+        corrected_delta_v = delta_v + jacobian.block<3, 3>(O_V, O_BA) * dba + jacobian.block<3, 3>(O_V, O_BG) * dbg;
+        corrected_delta_p = delta_p + jacobian.block<3, 3>(O_P, O_BA) * dba + jacobian.block<3, 3>(O_P, O_BG) * dbg;
+    }
+
+    //Square root information of the covariance, shared by the factors built on this integration.
+    //Call updateSqrtInfo() after pushing samples.
+    const Eigen::Matrix<double, 15, 15> & sqrtInfo() const
+    {
+        return sqrt_info;
+    }
+
+    void updateSqrtInfo()
+    {
+        if (sqrt_info_dirty) {
+            sqrt_info = Eigen::LLT<Eigen::Matrix<double, 15, 15>>(covariance.inverse()).matrixL().transpose();
+            sqrt_info_dirty = false;
+        }
     }
 
     void midPointIntegration(double _dt, 
@@ -128,7 +173,7 @@ class IntegrationBase
                 a_1_x(2), 0, -a_1_x(0),
                 -a_1_x(1), a_1_x(0), 0;
 
-            MatrixXd F = MatrixXd::Zero(15, 15);
+            Eigen::Matrix<double, 15, 15> F = Eigen::Matrix<double, 15, 15>::Zero();
             F.block<3, 3>(0, 0) = Matrix3d::Identity();
             F.block<3, 3>(0, 3) = -0.25 * delta_q.toRotationMatrix() * R_a_0_x * _dt * _dt + 
                                   -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt * _dt;
@@ -146,7 +191,7 @@ class IntegrationBase
             F.block<3, 3>(12, 12) = Matrix3d::Identity();
             //cout<<"A"<<endl<<A<<endl;
 
-            MatrixXd V = MatrixXd::Zero(15,18);
+            Eigen::Matrix<double, 15, 18> V = Eigen::Matrix<double, 15, 18>::Zero();
             V.block<3, 3>(0, 0) =  0.25 * delta_q.toRotationMatrix() * _dt * _dt;
             V.block<3, 3>(0, 3) =  0.25 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * _dt * 0.5 * _dt;
             V.block<3, 3>(0, 6) =  0.25 * result_delta_q.toRotationMatrix() * _dt * _dt;
@@ -193,6 +238,7 @@ class IntegrationBase
         linearized_bg = result_linearized_bg;
         delta_q.normalize();
         sum_dt += dt;
+        sqrt_info_dirty = true;
         acc_0 = acc_1;
         gyr_0 = gyr_1;  
      
@@ -203,20 +249,9 @@ class IntegrationBase
     {
         Eigen::Matrix<double, 15, 1> residuals;
 
-        Eigen::Matrix3d dp_dba = jacobian.block<3, 3>(O_P, O_BA);
-        Eigen::Matrix3d dp_dbg = jacobian.block<3, 3>(O_P, O_BG);
-
-        Eigen::Matrix3d dq_dbg = jacobian.block<3, 3>(O_R, O_BG);
-
-        Eigen::Matrix3d dv_dba = jacobian.block<3, 3>(O_V, O_BA);
-        Eigen::Matrix3d dv_dbg = jacobian.block<3, 3>(O_V, O_BG);
-
-        Eigen::Vector3d dba = Bai - linearized_ba;
-        Eigen::Vector3d dbg = Bgi - linearized_bg;
-
-        Eigen::Quaterniond corrected_delta_q = delta_q * Utility::deltaQ(dq_dbg * dbg);
-        Eigen::Vector3d corrected_delta_v = delta_v + dv_dba * dba + dv_dbg * dbg;
-        Eigen::Vector3d corrected_delta_p = delta_p + dp_dba * dba + dp_dbg * dbg;
+        Eigen::Vector3d corrected_delta_p, corrected_delta_v;
+        Eigen::Quaterniond corrected_delta_q;
+        correctedDelta(Bai, Bgi, corrected_delta_p, corrected_delta_q, corrected_delta_v);
 
         residuals.block<3, 1>(O_P, 0) = Qi.inverse() * (0.5 * IMUData::Gravity * sum_dt * sum_dt + Pj - Pi - Vi * sum_dt) - corrected_delta_p;
         residuals.block<3, 1>(O_R, 0) = 2 * (corrected_delta_q.inverse() * (Qi.inverse() * Qj)).vec();
@@ -234,6 +269,8 @@ class IntegrationBase
     Eigen::Vector3d linearized_ba, linearized_bg;
 
     Eigen::Matrix<double, 15, 15> jacobian, covariance;
+    Eigen::Matrix<double, 15, 15> sqrt_info;
+    bool sqrt_info_dirty = true;
     Eigen::Matrix<double, 15, 15> step_jacobian;
     Eigen::Matrix<double, 15, 18> step_V;
 
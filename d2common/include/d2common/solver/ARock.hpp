@@ -1,6 +1,8 @@
 #pragma once
 
 #include "SolverWrapper.hpp"
+#include <unordered_map>
+#include <d2common/event_queue.hpp>
 
 namespace D2Common {
 struct ARockSolverConfig {
@@ -15,23 +17,88 @@ struct ARockSolverConfig {
     int skip_iteration_usec = 10000;
     bool verbose = false;
     bool dual_state_init_to_zero = false;
+    //Adaptive steps: keep stepping without new remote data while the relative change of the cost (or state)
+    //and the duals is above step_changes_thres, and broadcast duals only when they changed above it.
+    bool adaptive_steps = true;
+    double step_changes_thres = 1e-3;
     ceres::Solver::Options ceres_options;
 };
 
+//Dual states of the parameters shared with one remote drone. The local and remote duals of all parameters
+//are stored contiguously, parameters are indexed in the order their duals are created.
+class DualStates {
+    std::vector<state_type*> params;
+    std::vector<int> offsets;
+    std::vector<int> sizes;
+    std::unordered_map<state_type*, int> index;
+    std::vector<double> local_states;
+    std::vector<double> remote_states;
+public:
+    int find(state_type* param) const {
+        auto it = index.find(param);
+        return it == index.end() ? -1 : it->second;
+    }
+
+    bool has(state_type* param) const {
+        return index.find(param) != index.end();
+    }
+
+    int add(state_type* param, int size, bool init_to_zero) {
+        int idx = params.size();
+        params.push_back(param);
+        offsets.push_back(local_states.size());
+        sizes.push_back(size);
+        index[param] = idx;
+        for (int i = 0; i < size; i ++) {
+            local_states.push_back(init_to_zero ? 0 : param[i]);
+            remote_states.push_back(init_to_zero ? 0 : param[i]);
+        }
+        return idx;
+    }
+
+    int size() const {
+        return params.size();
+    }
+
+    state_type* param(int idx) const {
+        return params[idx];
+    }
+
+    //Maps are invalidated when a dual is added.
+    Map<VectorXd> local(int idx) {
+        return Map<VectorXd>(local_states.data() + offsets[idx], sizes[idx]);
+    }
+
+    Map<VectorXd> remote(int idx) {
+        return Map<VectorXd>(remote_states.data() + offsets[idx], sizes[idx]);
+    }
+
+    Map<VectorXd> local(state_type* param) {
+        return local(index.at(param));
+    }
+
+    Map<VectorXd> remote(state_type* param) {
+        return remote(index.at(param));
+    }
+};
+
 class ARockBase {
 protected:
     D2State * state;
     bool updated = false;
+    bool need_scan = true; //Residuals changed, the dual states need to be scanned
+    bool dual_created = false; //New dual states not broadcasted yet
     ARockSolverConfig config;
     int iteration_count = 0;
     int self_id = 0;
-    std::map<int, std::map<state_type*, VectorXd>> dual_states_local;
-    std::map<int, std::map<state_type*, VectorXd>> dual_states_remote;
+    std::map<int, DualStates> dual_states; //Remote drone id -> duals shared with it
     std::map<state_type*, ParamInfo> all_estimating_params;
+    EventQueue<int> dual_events{EventQueue<int>::COALESCE}; //Wakes solve_arock when remote data arrives
     void addParam(const ParamInfo & param_info);
-    void updateDualStates();
+    double updateDualStates();
     bool hasDualState(state_type* param, int drone_id);
     void createDualState(const ParamInfo & param_info, int drone_id, bool init_to_zero = false);
+    void notifyDualData();
     virtual bool isRemoteParam(const ParamInfo & param);
     virtual int solverId(const ParamInfo & param);
     
@@ -59,6 +126,9 @@ protected:
     void setDualStateFactors() override;
     virtual void prepareSolverInIter(bool final_iter) override;
     std::vector<ceres::CostFunction*> dual_factors;
+    std::vector<ceres::ResidualBlockId> dual_residual_blocks;
+    bool problem_ready = false; //The problem is kept between the steps of a solve, only the dual factors change
+    void removeDualStateFactors();
     virtual void clearSolver(bool final_substep) override;
 public:
     ARockSolver(D2State * _state, ARockSolverConfig _config):
@@ -2,6 +2,7 @@
 #include <d2common/d2basetypes.h>
 #include "../d2state.hpp"
 #include <ceres/ceres.h>
+#include "FactorPool.hpp"
 
 namespace D2Common {
 enum ParamsType {
@@ -50,7 +51,7 @@ enum ResidualType {
     GravityPriorResidual //11
 };
 
-class ResidualInfo {
+class ResidualInfo : public PoolAllocated {
 public:
     ResidualType residual_type;
     ceres::CostFunction * cost_function = nullptr;
@@ -60,6 +61,7 @@ public:
     ResidualInfo(ResidualType type) : residual_type(type) {} 
     virtual void Evaluate(D2State * state);
     virtual void Evaluate(const std::vector<ParamInfo> & param_infos, bool use_copied=false);
+    void applyLossFunction(); //Rescale residuals and jacobians evaluated from cost_function by the robust loss
     virtual bool relavant(const std::set<FrameIdType> & frame_id) const = 0;
     virtual std::vector<ParamInfo> paramsList(D2State * state) const = 0;
     virtual std::vector<state_type*> paramsPointerList(D2State * state) const {
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <ceres/ceres.h>
+
+namespace D2Common {
+struct FactorPoolStats {
+    uint64_t allocs = 0; //All allocations through the pool
+    uint64_t heap_allocs = 0; //Allocations not served by the free lists (refills and oversized objects)
+    uint64_t frees = 0;
+    uint64_t live = 0;
+    size_t reserved_bytes = 0; //Bytes held by the pool chunks
+};
+
+//Free-list allocator of the objects created on every solve: cost functions and residual infos.
+//Objects are recycled by size class, chunks are never returned to the system so the pool stays at the peak window size.
+//Thread safe, objects may be freed on another thread than the one allocating them.
+class FactorPool {
+    static const size_t ALIGN = 64;
+    static const size_t MAX_OBJECT_SIZE = 4096;
+    static const size_t SLOTS_PER_CHUNK = 64;
+    std::mutex pool_mutex;
+    std::vector<std::vector<void*>> free_lists; //By size class
+    std::vector<void*> chunks;
+    FactorPoolStats _stats;
+    FactorPool();
+    ~FactorPool();
+public:
+    static FactorPool & instance();
+    void * allocate(size_t size);
+    void release(void * ptr, size_t size);
+    FactorPoolStats stats();
+};
+
+//Inherit to allocate a class (and its subclasses) from FactorPool.
+//The deleting destructor passes the size of the dynamic type, so classes deleted by base pointer must have a virtual destructor
+//(e.g. ceres::CostFunction and ResidualInfo).
+class PoolAllocated {
+public:
+    static void * operator new(size_t size) {
+        return FactorPool::instance().allocate(size);
+    }
+    static void operator delete(void * ptr, size_t size) {
+        FactorPool::instance().release(ptr, size);
+    }
+};
+
+template <typename CostFunctor, int... Ns>
+class PooledAutoDiffCostFunction : public ceres::AutoDiffCostFunction<CostFunctor, Ns...>, public PoolAllocated {
+public:
+    explicit PooledAutoDiffCostFunction(CostFunctor * functor): 
+        ceres::AutoDiffCostFunction<CostFunctor, Ns...>(functor) {}
+};
+}
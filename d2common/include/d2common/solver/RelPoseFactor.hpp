@@ -194,19 +194,82 @@ private:
     const Eigen::Quaterniond qb0;
 };
 
-class RelPoseFactor4D {
+class RelPoseFactorPerturb : public ceres::SizedCostFunction<6, 6, 6> { //Analytic RelPoseFactorPerturbAD
+    Matrix6d sqrt_info;
+    Vector3d t_rel;
+    Quaterniond q_rel;
+    Quaterniond qa0;
+    Quaterniond qb0;
+public:
+    RelPoseFactorPerturb(const Swarm::Pose & relative_pose, const Matrix6d & _sqrt_info,
+            const Quaterniond & q0, const Quaterniond & q1):
+        sqrt_info(_sqrt_info), qa0(q0), qb0(q1) {
+        t_rel = relative_pose.pos();
+        q_rel = relative_pose.att();
+    }
+
+    bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        Map<const Vector3d> p_a(parameters[0]);
+        Map<const Vector3d> theta_a(parameters[0] + 3);
+        Map<const Vector3d> p_b(parameters[1]);
+        Map<const Vector3d> theta_b(parameters[1] + 3);
+        //Exact exponential map: the first order quaternion used by the AD version below 1e-2 rad is not a rotation
+        Quaterniond q_a = qa0*Utility::quatfromRotationVector(theta_a, 1e-8);
+        Quaterniond q_b = qb0*Utility::quatfromRotationVector(theta_b, 1e-8);
+        Quaterniond q_a_inv = q_a.conjugate();
+        Quaterniond q_ba = q_b.conjugate()*q_a;
+        Vector3d p_ab_est = q_a_inv*(p_b - p_a);
+        Quaterniond q_err = q_rel*q_ba; //q_rel*q_ab_est^-1
+        Map<Matrix<double, 6, 1>> res(residuals);
+        res.segment<3>(0) = p_ab_est - t_rel;
+        res.segment<3>(3) = 2.0*q_err.vec();
+        res.applyOnTheLeft(sqrt_info);
+        if (jacobians) {
+            //The perturbations enter as q*Exp(theta), d(theta) is mapped by the right Jacobian of SO(3)
+            Matrix3d R_a_inv = q_a_inv.toRotationMatrix();
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> jacobian_pose_0(jacobians[0]);
+                Matrix3d Jr_a = Utility::rightJacobianSO3(theta_a);
+                Matrix6d J = Matrix6d::Zero();
+                J.block<3, 3>(0, 0) = -R_a_inv;
+                J.block<3, 3>(0, 3) = Utility::skewSymmetric(p_ab_est)*Jr_a;
+                J.block<3, 3>(3, 3) = (q_err.w()*Matrix3d::Identity() + Utility::skewSymmetric(q_err.vec()))*Jr_a;
+                jacobian_pose_0 = sqrt_info*J;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> jacobian_pose_1(jacobians[1]);
+                Matrix3d Jr_b = Utility::rightJacobianSO3(theta_b);
+                //vec(q_rel*[0, u]*q_ba) = M*u
+                Matrix3d M = (q_rel.w()*Matrix3d::Identity() + Utility::skewSymmetric(q_rel.vec()))*
+                    (q_ba.w()*Matrix3d::Identity() - Utility::skewSymmetric(q_ba.vec())) - q_rel.vec()*q_ba.vec().transpose();
+                Matrix6d J = Matrix6d::Zero();
+                J.block<3, 3>(0, 0) = R_a_inv;
+                J.block<3, 3>(3, 3) = -M*Jr_b;
+                jacobian_pose_1 = sqrt_info*J;
+            }
+        }
+        return true;
+    }
+
+    static ceres::CostFunction* Create(const Swarm::LoopEdge & loop, const Eigen::Quaterniond & q0, const Eigen::Quaterniond & q1) {
+        return new RelPoseFactorPerturb(loop.relative_pose, loop.getSqrtInfoMat(), q0, q1);
+    }
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+class RelPoseFactor4DAD {
     Swarm::Pose relative_pose;
     Eigen::Vector3d relative_pos;
     double relative_yaw;
     Eigen::Matrix4d sqrt_inf;
 public:
-    RelPoseFactor4D(const Swarm::Pose & _relative_pose, const Eigen::Matrix4d & _sqrt_inf):
+    RelPoseFactor4DAD(const Swarm::Pose & _relative_pose, const Eigen::Matrix4d & _sqrt_inf):
         relative_pose(_relative_pose), sqrt_inf(_sqrt_inf) {
         relative_pos = relative_pose.pos();
         relative_yaw = relative_pose.yaw();
     }
 
-    RelPoseFactor4D(const Swarm::Pose & _relative_pose, const Eigen::Matrix3d & _sqrt_inf_pos, double sqrt_info_yaw):
+    RelPoseFactor4DAD(const Swarm::Pose & _relative_pose, const Eigen::Matrix3d & _sqrt_inf_pos, double sqrt_info_yaw):
         relative_pose(_relative_pose) {
         relative_pos = relative_pose.pos();
         relative_yaw = relative_pose.yaw();
@@ -228,21 +291,82 @@ public:
     }
 
     static ceres::CostFunction* Create(const Swarm::LoopEdge & loop) {
-        return new ceres::AutoDiffCostFunction<RelPoseFactor4D, 4, 4, 4>(
-            new RelPoseFactor4D(loop.relative_pose, loop.getSqrtInfoMat4D()));
+        return new ceres::AutoDiffCostFunction<RelPoseFactor4DAD, 4, 4, 4>(
+            new RelPoseFactor4DAD(loop.relative_pose, loop.getSqrtInfoMat4D()));
     }
 
     static ceres::CostFunction * Create(const Swarm::Pose & _relative_pose, const Eigen::Matrix3d & _sqrt_inf_pos, double sqrt_info_yaw) {
-        return new ceres::AutoDiffCostFunction<RelPoseFactor4D, 4, 4, 4>(
-            new RelPoseFactor4D(_relative_pose, _sqrt_inf_pos, sqrt_info_yaw));
+        return new ceres::AutoDiffCostFunction<RelPoseFactor4DAD, 4, 4, 4>(
+            new RelPoseFactor4DAD(_relative_pose, _sqrt_inf_pos, sqrt_info_yaw));
     }
 };
 
-class RelRotFactor9D {
+class RelPoseFactor4D : public ceres::SizedCostFunction<4, 4, 4> { //Analytic RelPoseFactor4DAD
+    Eigen::Vector3d relative_pos;
+    double relative_yaw;
+    Eigen::Matrix4d sqrt_inf;
+public:
+    RelPoseFactor4D(const Swarm::Pose & _relative_pose, const Eigen::Matrix4d & _sqrt_inf):
+        sqrt_inf(_sqrt_inf) {
+        relative_pos = _relative_pose.pos();
+        relative_yaw = _relative_pose.yaw();
+    }
+
+    RelPoseFactor4D(const Swarm::Pose & _relative_pose, const Eigen::Matrix3d & _sqrt_inf_pos, double sqrt_info_yaw) {
+        relative_pos = _relative_pose.pos();
+        relative_yaw = _relative_pose.yaw();
+        sqrt_inf.setZero();
+        sqrt_inf.block<3, 3>(0, 0) = _sqrt_inf_pos;
+        sqrt_inf(3, 3) = sqrt_info_yaw;
+    }
+
+    bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        Map<const Vector3d> pos_a(parameters[0]);
+        Map<const Vector3d> pos_b(parameters[1]);
+        double yaw_a = parameters[0][3];
+        Vector3d dpos = pos_b - pos_a;
+        Matrix3d R_a_inv = Utility::yawRotMat(-yaw_a);
+        Vector3d relpos_est = R_a_inv*dpos;
+        double relyaw_est = Utility::NormalizeAngle(parameters[1][3] - yaw_a);
+        Utility::poseError4D<double>(relpos_est, relyaw_est, relative_pos, relative_yaw, sqrt_inf, residuals);
+        if (jacobians) {
+            //Unweighted error is [relative_pos - R(-yaw_a)*(pos_b - pos_a); relative_yaw - (yaw_b - yaw_a)]
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> jacobian_pose_0(jacobians[0]);
+                double c = cos(yaw_a), s = sin(yaw_a);
+                Matrix4d J = Matrix4d::Zero();
+                J.block<3, 3>(0, 0) = R_a_inv;
+                J(0, 3) = s*dpos.x() - c*dpos.y();
+                J(1, 3) = c*dpos.x() + s*dpos.y();
+                J(3, 3) = 1.0;
+                jacobian_pose_0 = sqrt_inf*J;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> jacobian_pose_1(jacobians[1]);
+                Matrix4d J = Matrix4d::Zero();
+                J.block<3, 3>(0, 0) = -R_a_inv;
+                J(3, 3) = -1.0;
+                jacobian_pose_1 = sqrt_inf*J;
+            }
+        }
+        return true;
+    }
+
+    static ceres::CostFunction* Create(const Swarm::LoopEdge & loop) {
+        return new RelPoseFactor4D(loop.relative_pose, loop.getSqrtInfoMat4D());
+    }
+
+    static ceres::CostFunction * Create(const Swarm::Pose & _relative_pose, const Eigen::Matrix3d & _sqrt_inf_pos, double sqrt_info_yaw) {
+        return new RelPoseFactor4D(_relative_pose, _sqrt_inf_pos, sqrt_info_yaw);
+    }
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+class RelRotFactor9DAD {
     Matrix3d R_sqrt_info;
     Matrix3d R_rel;
 public:
-    RelRotFactor9D(Swarm::Pose relative_pose, Matrix6d sqrt_info): 
+    RelRotFactor9DAD(Swarm::Pose relative_pose, Matrix6d sqrt_info): 
         R_sqrt_info(sqrt_info.block<3,3>(3,3)) {
         R_rel = relative_pose.R();
     }
@@ -257,8 +381,8 @@ public:
     }
 
     static ceres::CostFunction * Create(const Swarm::Pose & _relative_pose, const Eigen::Matrix6d & _sqrt_inf) {
-        return new ceres::AutoDiffCostFunction<RelRotFactor9D, 9, 9, 9>(
-                new RelRotFactor9D(_relative_pose, _sqrt_inf));
+        return new ceres::AutoDiffCostFunction<RelRotFactor9DAD, 9, 9, 9>(
+                new RelRotFactor9DAD(_relative_pose, _sqrt_inf));
     }
     
     static ceres::CostFunction* Create(const Swarm::GeneralMeasurement2Drones* _loc) {
@@ -267,9 +391,64 @@ public:
     }
 
     static ceres::CostFunction* Create(const Swarm::LoopEdge & loop) {
-        return new ceres::AutoDiffCostFunction<RelRotFactor9D, 9, 9, 9>(
-            new RelRotFactor9D(loop.relative_pose, loop.getSqrtInfoMat()));
+        return new ceres::AutoDiffCostFunction<RelRotFactor9DAD, 9, 9, 9>(
+            new RelRotFactor9DAD(loop.relative_pose, loop.getSqrtInfoMat()));
+    }
+};
+
+class RelRotFactor9D : public ceres::SizedCostFunction<9, 9, 9> { //Analytic RelRotFactor9DAD
+    Matrix3d R_sqrt_info;
+    Matrix3d R_rel;
+    //The residual is linear in the row major rotation matrices, so the Jacobians are constant
+    Matrix<double, 9, 9, RowMajor> jacobian_a;
+    Matrix<double, 9, 9, RowMajor> jacobian_b;
+public:
+    RelRotFactor9D(Swarm::Pose relative_pose, Matrix6d sqrt_info): 
+        R_sqrt_info(sqrt_info.block<3,3>(3,3)) {
+        R_rel = relative_pose.R();
+        Matrix3d M = R_sqrt_info*R_rel.transpose();
+        jacobian_a.setZero();
+        jacobian_b.setZero();
+        //res(r, c) = M(r, :)*Ri(c, :)^T - R_sqrt_info(r, :)*Rj(c, :)^T
+        for (int r = 0; r < 3; r ++) {
+            for (int c = 0; c < 3; c ++) {
+                jacobian_a.block<1, 3>(3*r + c, 3*c) = M.row(r);
+                jacobian_b.block<1, 3>(3*r + c, 3*c) = -R_sqrt_info.row(r);
+            }
+        }
     }
+
+    bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        Map<const Matrix<double, 3, 3, RowMajor>> Ri(parameters[0]);
+        Map<const Matrix<double, 3, 3, RowMajor>> Rj(parameters[1]);
+        Map<Matrix<double, 3, 3, RowMajor>> R_res(residuals);
+        R_res = R_sqrt_info*(R_rel.transpose()*Ri.transpose() - Rj.transpose());
+        if (jacobians) {
+            if (jacobians[0]) {
+                Map<Matrix<double, 9, 9, RowMajor>> jacobian_rot_0(jacobians[0]);
+                jacobian_rot_0 = jacobian_a;
+            }
+            if (jacobians[1]) {
+                Map<Matrix<double, 9, 9, RowMajor>> jacobian_rot_1(jacobians[1]);
+                jacobian_rot_1 = jacobian_b;
+            }
+        }
+        return true;
+    }
+
+    static ceres::CostFunction * Create(const Swarm::Pose & _relative_pose, const Eigen::Matrix6d & _sqrt_inf) {
+        return new RelRotFactor9D(_relative_pose, _sqrt_inf);
+    }
+    
+    static ceres::CostFunction* Create(const Swarm::GeneralMeasurement2Drones* _loc) {
+        auto loop = static_cast<const Swarm::LoopEdge*>(_loc);
+        return Create(*loop);
+    }
+
+    static ceres::CostFunction* Create(const Swarm::LoopEdge & loop) {
+        return new RelRotFactor9D(loop.relative_pose, loop.getSqrtInfoMat());
+    }
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
 class RelRot9DResInfo : public ResidualInfo {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <set>
+#include <algorithm>
 #include <ceres/ceres.h>
 #include <d2common/d2state.hpp>
 #include <d2common/solver/BaseParamResInfo.hpp>
@@ -37,23 +39,35 @@ struct SolverReport {
 class SolverWrapper {
 protected:
     ceres::Problem * problem = nullptr;
+    ceres::Problem::Options problem_options;
     D2State * state;
     std::vector<ResidualInfo*> residuals;
     virtual void setStateProperties() {}
 public:
-    SolverWrapper(D2State * _state): state(_state) {
-        problem = new ceres::Problem();
+    SolverWrapper(D2State * _state, ceres::Problem::Options _problem_options = ceres::Problem::Options()): 
+            state(_state), problem_options(_problem_options) {
+        problem = new ceres::Problem(problem_options);
     }
     virtual void addResidual(ResidualInfo*residual_info) {
         residuals.push_back(residual_info);
     }
+    //Remove residuals from the problem and delete them, the other residuals are kept.
+    virtual void removeResiduals(const std::vector<ResidualInfo*> & infos) {
+        std::set<ResidualInfo*> removing(infos.begin(), infos.end());
+        residuals.erase(std::remove_if(residuals.begin(), residuals.end(), [&](ResidualInfo* info) {
+            return removing.find(info) != removing.end();
+        }), residuals.end());
+        for (auto info : removing) {
+            delete info;
+        }
+    }
     virtual SolverReport solve() = 0;
     ceres::Problem & getProblem() {
         return *problem;
     }
     virtual void reset() {
         delete problem;
-        problem = new ceres::Problem();
+        problem = new ceres::Problem(problem_options);
         for (auto residual : residuals) {
             delete residual;
         }
@@ -64,10 +78,14 @@ public:
 class CeresSolver : public SolverWrapper {
 protected:
     ceres::Solver::Options options;
+    std::map<ResidualInfo*, ceres::ResidualBlockId> residual_blocks;
 public:
-    CeresSolver(D2State * _state, ceres::Solver::Options _options): 
-            SolverWrapper(_state), options(_options)  {}
+    CeresSolver(D2State * _state, ceres::Solver::Options _options, 
+            ceres::Problem::Options _problem_options = ceres::Problem::Options()): 
+            SolverWrapper(_state, _problem_options), options(_options)  {}
     virtual void addResidual(ResidualInfo*residual_info) override;
+    virtual void removeResiduals(const std::vector<ResidualInfo*> & infos) override;
+    virtual void reset() override;
     SolverReport solve() override;
 };
 
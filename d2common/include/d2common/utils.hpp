@@ -53,6 +53,24 @@ Eigen::Quaternion<typename Derived::Scalar> quatfromRotationVector(const Eigen::
     return Eigen::Quaternion<Scalar_t>::Identity();
 }
 
+//Right Jacobian of SO(3): Exp(theta + dtheta) = Exp(theta)*Exp(Jr(theta)*dtheta)
+template <typename Derived>
+Eigen::Matrix<typename Derived::Scalar, 3, 3> rightJacobianSO3(const Eigen::MatrixBase<Derived> &theta, double eps=1e-2)
+{
+    typedef typename Derived::Scalar Scalar_t;
+    Eigen::Matrix<Scalar_t, 3, 3> W;
+    W << Scalar_t(0), -theta(2), theta(1),
+        theta(2), Scalar_t(0), -theta(0),
+        -theta(1), theta(0), Scalar_t(0);
+    Scalar_t angle = theta.norm();
+    if (angle < eps) {
+        return Eigen::Matrix<Scalar_t, 3, 3>::Identity() - W / static_cast<Scalar_t>(2.0) + W * W / static_cast<Scalar_t>(6.0);
+    }
+    Scalar_t angle2 = angle * angle;
+    return Eigen::Matrix<Scalar_t, 3, 3>::Identity() - (static_cast<Scalar_t>(1.0) - cos(angle)) / angle2 * W
+        + (angle - sin(angle)) / (angle2 * angle) * W * W;
+}
+
 template <typename Derived>
 static Eigen::Quaternion<typename Derived::Scalar> positify(const Eigen::QuaternionBase<Derived> &q)
 {
@@ -5,6 +5,38 @@ namespace D2Common {
 
 Vector3d IMUData::Gravity = Vector3d(0., 0., 9.805);
 Eigen::Matrix<double, 18, 18> IntegrationBase::noise = Eigen::Matrix<double, 18, 18>::Zero();
+double IntegrationBase::repropagate_ba_thres = 0.1;
+double IntegrationBase::repropagate_bg_thres = 0.01;
+
+//Largest i in [i0, i1) with t_i <= t - eps, i0 if there is none.
+template <typename Buf>
+size_t searchClosestImpl(const Buf & buf, double t, size_t i0, size_t i1) {
+    const double eps = 5e-4;
+    while (i1 > i0 + 1) {
+        size_t i = i0 + (i1 - i0) / 2;
+        if (buf[i].t > t - eps) {
+            i1 = i;
+        } else {
+            i0 = i;
+        }
+    }
+    return i0;
+}
+
+template <typename Buf>
+Swarm::Odometry propagationImpl(const Buf & buf, size_t size, const Swarm::Odometry & prev_odom, const Vector3d & Ba, const Vector3d & Bg) {
+    if (size == 0) {
+        return prev_odom;
+    }
+    Swarm::Odometry odom = prev_odom;
+    IMUData imu_last = buf[0];
+    for (size_t i = 0; i < size; i ++) {
+        buf[i].propagation(odom, Ba, Bg, imu_last);
+        imu_last = buf[i];
+    }
+    return odom;
+}
+
 size_t IMUBuffer::searchClosest(double t) const {
     const Guard lock(buf_lock);
     if (buf.size() == 0) {
@@ -17,22 +49,9 @@ size_t IMUBuffer::searchClosest(double t) const {
     return searchClosest(t, 0, buf.size());
 }
 
-size_t IMUBuffer::searchClosest(double t, int i0, int i1) const {
-    const double eps = 5e-4;
+size_t IMUBuffer::searchClosest(double t, size_t i0, size_t i1) const {
     const Guard lock(buf_lock);
-    // printf("IMUBuffer::searchClosest: t=%f, i0=%d, i1=%d\n", t, i0, i1);
-    if (i1 - i0 == 1) {
-        return i0;
-    }
-    int i = (i0 + i1) / 2;
-    if (i > buf.size()) {
-        return i0;
-    }
-    if (buf[i].t > t - eps) {
-        return searchClosest(t, i0, i);
-    } else {
-        return searchClosest(t, i, i1);
-    }
+    return searchClosestImpl(buf, t, i0, i1);
 }
 
 IMUBuffer IMUBuffer::slice(int i0, int i1) const {
@@ -135,19 +154,105 @@ Swarm::Odometry IMUBuffer::propagation(const VINSFrame & baseframe) const {
 
 Swarm::Odometry IMUBuffer::propagation(const Swarm::Odometry & prev_odom, const Vector3d & Ba, const Vector3d & Bg) const {
     const Guard lock(buf_lock);
-    if(buf.size() == 0) {
-        return prev_odom;
+    return propagationImpl(buf, buf.size(), prev_odom, Ba, Bg);
+}
+
+const IMUData & IMUBufferView::operator[](int i) const {
+    return (*ring)[i0 + i];
+}
+
+Vector3d IMUBufferView::mean_acc() const {
+    Vector3d acc_sum(0, 0, 0);
+    for (size_t i = i0; i < i1; i ++) {
+        acc_sum += (*ring)[i].acc;
     }
-    Vector3d acc_last = buf[0].acc;
-    Vector3d gyro_last = buf[0].gyro;
+    return acc_sum/size();
+}
 
-    Swarm::Odometry odom = prev_odom;
-    IMUData imu_last = buf[0];
-    for (auto & imu: buf) {
-        imu.propagation(odom, Ba, Bg, imu_last);
-        imu_last = imu;
+Vector3d IMUBufferView::mean_gyro() const {
+    Vector3d gyro_sum(0, 0, 0);
+    for (size_t i = i0; i < i1; i ++) {
+        gyro_sum += (*ring)[i].gyro;
     }
-    return odom;
+    return gyro_sum/size();
+}
+
+Swarm::Odometry IMUBufferView::propagation(const VINSFrame & baseframe) const {
+    return propagation(baseframe.odom, baseframe.Ba, baseframe.Bg);
+}
+
+Swarm::Odometry IMUBufferView::propagation(const Swarm::Odometry & prev_odom, const Vector3d & Ba, const Vector3d & Bg) const {
+    return propagationImpl(*this, size(), prev_odom, Ba, Bg);
+}
+
+IMUBuffer IMUBufferView::toBuffer() const {
+    IMUBuffer ret;
+    ret.buf.reserve(size());
+    for (size_t i = i0; i < i1; i ++) {
+        ret.add((*ring)[i]);
+    }
+    return ret;
+}
+
+void IMURingBuffer::add(const IMUData & data) {
+    size_t i = head.load(std::memory_order_relaxed);
+    buf[i & (CAPACITY - 1)] = data;
+    head.store(i + 1, std::memory_order_release);
+}
+
+size_t IMURingBuffer::begin() const {
+    size_t i1 = end();
+    return i1 > CAPACITY - GUARD ? i1 - (CAPACITY - GUARD) : 0;
+}
+
+size_t IMURingBuffer::searchClosest(double t, size_t i0, size_t i1) const {
+    return searchClosestImpl(*this, t, i0, i1);
+}
+
+IMUData IMURingBuffer::back() const {
+    size_t i1 = end();
+    if (i1 == 0) {
+        return IMUData();
+    }
+    return (*this)[i1 - 1];
+}
+
+bool IMURingBuffer::available(double t) const {
+    return end() > 0 && back().t > t;
+}
+
+IMUBufferView IMURingBuffer::tail(double t) const {
+    size_t i1 = end();
+    if (i1 == 0) {
+        return IMUBufferView();
+    }
+    auto i0 = searchClosest(t, begin(), i1);
+    return IMUBufferView(this, i0, i1);
+}
+
+std::pair<IMUBufferView, int> IMURingBuffer::periodIMU(double t0, double t1) const {
+    size_t end_ = end();
+    if (end_ == 0) {
+        return std::make_pair(IMUBufferView(), 0);
+    }
+    size_t begin_ = begin();
+    auto i0 = searchClosest(t0, begin_, end_);
+    auto i1 = searchClosest(t1, begin_, end_);
+    return std::make_pair(IMUBufferView(this, std::min(i0 + 1, end_), std::min(i1 + 2, end_)), i1 + 1);
+}
+
+std::pair<IMUBufferView, int> IMURingBuffer::periodIMU(int i0, double t1) const {
+    size_t end_ = end();
+    if (end_ == 0) {
+        return std::make_pair(IMUBufferView(), 0);
+    }
+    size_t _i0 = std::max<size_t>(i0 + 1, begin());
+    if (_i0 >= end_) {
+        //No new samples since i0
+        return std::make_pair(IMUBufferView(), i0);
+    }
+    auto i1 = searchClosest(t1, _i0, end_);
+    return std::make_pair(IMUBufferView(this, _i0, std::min(i1 + 2, end_)), i1 + 1);
 }
 
 void IMUData::propagation(Swarm::Odometry & odom, const Vector3d & Ba, const Vector3d & Bg, const IMUData & imu_last) const {
@@ -24,6 +24,17 @@ VINSFrame::VINSFrame(const VisualImageDescArray & frame, const std::pair<IMUBuff
     }
 }
 
+VINSFrame::VINSFrame(const VisualImageDescArray & frame, const std::pair<IMUBufferView, int> & buf, const VINSFrame & prev_frame):
+    D2BaseFrame(frame.stamp, frame.frame_id, frame.drone_id, frame.reference_frame_id, frame.is_keyframe, frame.pose_drone),
+    Ba(prev_frame.Ba), Bg(prev_frame.Bg),
+    prev_frame_id(prev_frame.frame_id),
+    imu_buf_index(buf.second) {
+    pre_integrations = new IntegrationBase(buf.first, Ba, Bg);
+    if (t0 == 0) {
+        t0 = stamp;
+    }
+}
+
 VINSFrame::VINSFrame(const VisualImageDescArray & frame, const Vector3d & _Ba, const Vector3d & _Bg):
         D2BaseFrame(frame.stamp, frame.frame_id, frame.drone_id, frame.reference_frame_id, frame.is_keyframe, frame.pose_drone),
         Ba(_Ba), Bg(_Bg) {
@@ -6,9 +6,9 @@
 namespace D2Common {
 
 void ARockBase::reset() {
-    dual_states_local.clear();
-    dual_states_remote.clear();
+    dual_states.clear();
     all_estimating_params.clear();
+    need_scan = true;
 }
 
 void ARockBase::addParam(const ParamInfo & param_info) {
@@ -18,19 +18,21 @@ void ARockBase::addParam(const ParamInfo & param_info) {
     all_estimating_params[param_info.pointer] = param_info;
 }
 
-void ARockBase::updateDualStates() {
-    for (auto & param_pair : dual_states_local) {
-        auto remote_drone_id = param_pair.first;
+//Returns the relative change of the local duals.
+double ARockBase::updateDualStates() {
+    double delta_sqr = 0, dual_sqr = 0;
+    for (auto & param_pair : dual_states) {
         auto & duals = param_pair.second;
-        for (auto & it: duals) {
-            auto * state_pointer = it.first;
-            auto param_info = all_estimating_params.at(state_pointer);
-            auto & dual_state_local = it.second;
+        for (int i = 0; i < duals.size(); i ++) {
+            auto * state_pointer = duals.param(i);
+            auto & param_info = all_estimating_params.at(state_pointer);
+            auto dual_state_local = duals.local(i);
+            auto dual_state_remote = duals.remote(i);
             //Now we need to average the remote and the local dual state.
             if (IsSE3(param_info.type)) {
                //Use pose average.
-                Swarm::Pose dual_pose_local(dual_state_local);
-                Swarm::Pose dual_pose_remote(dual_states_remote.at(remote_drone_id).at(state_pointer));
+                Swarm::Pose dual_pose_local(dual_state_local.data());
+                Swarm::Pose dual_pose_remote(dual_state_remote.data());
                 std::vector<Swarm::Pose> poses{dual_pose_remote, dual_pose_local};
                 Swarm::Pose avg_pose = Swarm::Pose::averagePoses(poses);
                 Swarm::Pose cur_est_pose = Swarm::Pose(state_pointer);
@@ -42,21 +44,23 @@ void ARockBase::updateDualStates() {
                 Swarm::Pose dual_pose_local_new = dual_pose_local * 
                     Swarm::Pose::fromTangentSpace(-delta_state);
                 dual_pose_local_new.to_vector(dual_state_local.data());
+                delta_sqr += delta_state.squaredNorm();
+                dual_sqr += dual_pose_local_new.tangentSpace().squaredNorm();
             } else if (IsPose4D(param_info.type)) {
-                VectorXd dual_state_remote = dual_states_remote.at(remote_drone_id).at(state_pointer);
                 VectorXd avg_state = (dual_state_local + dual_state_remote)/2;
                 Map<VectorXd> cur_est_state(state_pointer, param_info.size);
                 VectorXd delta = (avg_state - cur_est_state)*config.eta_k;
-                dual_state_local = dual_state_local - delta;
+                dual_state_local -= delta;
                 if (dual_state_local(3) > M_PI || dual_state_local(3) < -M_PI) {
                     ROS_WARN("Note: [ARockSolver] Dual state %ld has angle %f\n", param_info.id, dual_state_local(3));
                     dual_state_local(3) = Utility::NormalizeAngle(dual_state_local(3));
                     ROS_WARN("Normed angle: %f", dual_state_local(3));
                 }
+                delta_sqr += delta.squaredNorm();
+                dual_sqr += dual_state_local.squaredNorm();
             } else {
                 // printf("[ARockSolver@%d] type %d frame_id %d\n", self_id, param_info.type, param_info.id);
                 //Is a vector.
-                VectorXd dual_state_remote = dual_states_remote.at(remote_drone_id).at(state_pointer);
                 // printf("\nFrame %d \n", param_info.id);
                 // std::cout << "Dual state remote:\n" << dual_state_remote.transpose() << std::endl;
                 // std::cout << "Dual state local :\n" << dual_state_local.transpose() << std::endl;
@@ -67,9 +71,15 @@ void ARockBase::updateDualStates() {
                 // std::cout << "cur_est_state: \n" << cur_est_state.transpose() << std::endl;
                 // std::cout << "delta: \n" << delta.transpose() << std::endl;
                 dual_state_local -= delta;
+                delta_sqr += delta.squaredNorm();
+                dual_sqr += dual_state_local.squaredNorm();
             }
         }
     }
+    if (dual_sqr <= 0) {
+        return delta_sqr > 0 ? 1 : 0;
+    }
+    return sqrt(delta_sqr/dual_sqr);
 }
 
 bool ARockBase::isRemoteParam(const ParamInfo & param_info) {
@@ -93,27 +103,18 @@ int ARockBase::solverId(const ParamInfo & param_info) {
 }
 
 bool ARockBase::hasDualState(state_type* param, int drone_id) {
-    if (dual_states_remote.find(drone_id) != dual_states_remote.end()) {
-        if (dual_states_remote[drone_id].find(param) != dual_states_remote[drone_id].end()) {
-            return true;
-        }
-    }
-    return false;
+    auto it = dual_states.find(drone_id);
+    return it != dual_states.end() && it->second.has(param);
 }
 
 void ARockBase::createDualState(const ParamInfo & param_info, int drone_id, bool init_to_zero) {
-    if (dual_states_remote.find(drone_id) == dual_states_remote.end()) {
-        dual_states_remote[drone_id] = std::map<state_type*, VectorXd>();
-        dual_states_local[drone_id] = std::map<state_type*, VectorXd>();
-    }
-    if (init_to_zero) {
-        dual_states_remote[drone_id][param_info.pointer] = VectorXd::Zero(param_info.size);
-        dual_states_local[drone_id][param_info.pointer] = VectorXd::Zero(param_info.size);
-    } else {
-        dual_states_remote[drone_id][param_info.pointer] = Map<VectorXd>(param_info.pointer, param_info.size);
-        dual_states_local[drone_id][param_info.pointer] = Map<VectorXd>(param_info.pointer, param_info.size);
-    }
+    dual_states[drone_id].add(param_info.pointer, param_info.size, init_to_zero);
     updated = true;
+    dual_created = true;
+}
+
+void ARockBase::notifyDualData() {
+    dual_events.push(0);
 }
 
 SolverReport ARockBase::solve_arock() {
@@ -122,13 +123,21 @@ SolverReport ARockBase::solve_arock() {
     Utility::TicToc tic;
     int iter_cnt = 0;
     int total_cnt = 0;
+    int broadcast_cnt = 0;
+    bool broadcast_pending = false;
+    double step_changes = 0;
     while (iter_cnt < config.max_steps) {
-        //If sync mode.
+        //Data arriving after this point wakes the wait below.
+        int event;
+        dual_events.pop(event, 0);
         receiveAll();
-        if (!updated) {
+        bool has_new_data = updated;
+        //Asynchronous steps on the stale remote duals are run while the local problem is still changing.
+        bool keep_stepping = config.adaptive_steps && iter_cnt > 0 && step_changes > config.step_changes_thres;
+        if (!has_new_data && !keep_stepping) {
             if (config.verbose)
                 printf("[ARock@%d] No new data, skip this step: %d total_cnt %d.\n", self_id, iter_cnt, total_cnt);
-            usleep(config.skip_iteration_usec);
+            dual_events.pop(event, config.skip_iteration_usec/1000.0);
             total_cnt ++;
             if (total_cnt > config.max_wait_steps + config.max_steps) {
                 if (config.verbose)
@@ -138,26 +147,48 @@ SolverReport ARockBase::solve_arock() {
                 continue;
             }
         }
-        prepareSolverInIter(total_cnt == config.max_steps - 1);
-        scanAndCreateDualStates();
+        prepareSolverInIter(iter_cnt == config.max_steps - 1);
+        if (need_scan) {
+            scanAndCreateDualStates();
+            need_scan = false;
+        }
         setDualStateFactors();
         auto _report = solveLocalStep();
-        updateDualStates();
-        broadcastData();
-        clearSolver(iter_cnt == config.max_steps - 1);
+        double dual_changes = updateDualStates();
+        //Steps with new data broadcast as before unless the duals barely moved,
+        //the changes of extra steps are sent with the next broadcast.
+        bool dual_changed = !config.adaptive_steps || dual_created || dual_changes > config.step_changes_thres;
+        if (has_new_data && dual_changed) {
+            broadcastData();
+            dual_created = false;
+            broadcast_pending = false;
+            broadcast_cnt ++;
+        } else if (dual_changed) {
+            broadcast_pending = true;
+        }
+        clearSolver(false);
         report.compose(_report);
-        float changes = (_report.initial_cost-_report.final_cost)/_report.initial_cost;
+        float changes = _report.initial_cost > 0 ? (_report.initial_cost-_report.final_cost)/_report.initial_cost : _report.state_changes;
+        step_changes = std::max<double>(fabs(changes), dual_changes);
         if (iter_cnt == 0) {
             report.initial_cost = _report.initial_cost;
         }
         if (config.verbose)
-            printf("[ARock@%d] substeps: %d/%d total_iterations: %d initial_cost: %.2e final_cost: %.2e changes: %02.2f%% state_changes: %02.2f%%  time: %.2fms steps: %d\n", 
+            printf("[ARock@%d] substeps: %d/%d total_iterations: %d initial_cost: %.2e final_cost: %.2e changes: %02.2f%% state_changes: %02.2f%% dual_changes: %02.2f%% time: %.2fms steps: %d\n", 
                     self_id, iter_cnt, config.max_steps, report.total_iterations, report.initial_cost, report.final_cost, changes*100, _report.state_changes,
-                    _report.total_time * 1000, report.total_iterations);
+                    dual_changes*100, _report.total_time * 1000, report.total_iterations);
         iter_cnt ++;
         total_cnt ++;
     }
+    if (broadcast_pending) {
+        broadcastData();
+        dual_created = false;
+        broadcast_cnt ++;
+    }
+    clearSolver(true);
     report.total_time = tic.toc()/1000;
+    if (config.verbose)
+        printf("[ARock@%d] steps %d waits %d broadcasts %d time %.1fms\n", self_id, iter_cnt, total_cnt - iter_cnt, broadcast_cnt, tic.toc());
     return report;
 }
 
@@ -179,6 +210,8 @@ void ARockSolver::scanAndCreateDualStates() {
 }
 
 void ARockSolver::reset() {
+    removeDualStateFactors();
+    problem_ready = false;
     SolverWrapper::reset();
     ARockBase::reset();
 }
@@ -189,74 +222,102 @@ void ARockSolver::addResidual(ResidualInfo*residual_info) {
     }
     SolverWrapper::addResidual(residual_info);
     updated = true;
+    need_scan = true;
 }
 
 void ARockSolver::resetResiduals() {
     residuals.clear();
+    need_scan = true;
 }
 
 void ARockSolver::prepareSolverInIter(bool final_iter) {
-    ceres::Problem::Options problem_options;
-    if (!final_iter) {
-        problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
-        problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    if (problem_ready) {
+        return;
     }
+    //The residuals are only released at the end of the solve, see clearSolver.
+    ceres::Problem::Options problem_options;
+    problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    problem_options.enable_fast_removal = true;
+    delete problem;
     problem = new ceres::Problem(problem_options);
     for (auto residual_info : residuals) {
         problem->AddResidualBlock(residual_info->cost_function, residual_info->loss_function,
             residual_info->paramsPointerList(SolverWrapper::state));
     }
     setStateProperties();
+    problem_ready = true;
 }
 
 SolverReport ARockSolver::solve() {
     return ARockBase::solve_arock();
 }
 
-void ARockSolver::clearSolver(bool final_substep) {
+void ARockSolver::removeDualStateFactors() {
     if (problem != nullptr) {
-        delete problem;
+        for (auto block : dual_residual_blocks) {
+            problem->RemoveResidualBlock(block);
+        }
     }
+    dual_residual_blocks.clear();
+    for (auto factor : dual_factors) {
+        delete factor;
+    }
+    dual_factors.clear();
+}
+
+void ARockSolver::clearSolver(bool final_substep) {
+    if (!final_substep) {
+        return;
+    }
+    //End of the solve: release the problem and the cost functions of the residuals.
+    removeDualStateFactors();
+    delete problem;
     problem = nullptr;
-    // if (!final_substep) {
-    //     //We need to clear dual factors manually.
-    //     for (auto factor : dual_factors) {
-    //         delete factor;
-    //     }
-    //     dual_factors.clear();
-    // }
+    problem_ready = false;
+    std::set<ceres::CostFunction*> cost_functions;
+    std::set<ceres::LossFunction*> loss_functions;
+    for (auto residual_info : residuals) {
+        cost_functions.insert(residual_info->cost_function);
+        loss_functions.insert(residual_info->loss_function);
+        residual_info->cost_function = nullptr;
+        residual_info->loss_function = nullptr;
+    }
+    for (auto cost_function : cost_functions) {
+        delete cost_function;
+    }
+    for (auto loss_function : loss_functions) {
+        delete loss_function;
+    }
 }
 
 void ARockSolver::setDualStateFactors() {
-    for (auto & param_pair : dual_states_remote) {
-        for (auto it : param_pair.second) {
-            auto state_pointer = it.first;
-            auto param_info = all_estimating_params.at(state_pointer);
-            auto dual_state = it.second;
+    removeDualStateFactors();
+    for (auto & param_pair : dual_states) {
+        auto & duals = param_pair.second;
+        for (int i = 0; i < duals.size(); i ++) {
+            auto state_pointer = duals.param(i);
+            auto & param_info = all_estimating_params.at(state_pointer);
+            VectorXd dual_state = duals.remote(i);
+            ceres::CostFunction * factor = nullptr;
             if (IsSE3(param_info.type)) {
                 //Is SE(3) pose.
                 Swarm::Pose pose_dual(dual_state);
-                auto factor = new ConsenusPoseFactor(pose_dual.pos(), pose_dual.att(), 
+                factor = new ConsenusPoseFactor(pose_dual.pos(), pose_dual.att(), 
                         Vector3d::Zero(), Vector3d::Zero(), rho_T, rho_theta);
                 // printf("[ARockSolver] ConsenusPoseFactor param %ld, drone_id %d pose_dual %s pose_cur %s\n", 
                 //     param_info.id, param_pair.first, pose_dual.toStr().c_str(), Swarm::Pose(state_pointer).toStr().c_str());
-                problem->AddResidualBlock(factor, nullptr, state_pointer);
-                dual_factors.push_back(factor);
             } else if (IsPose4D(param_info.type)) {
                 Swarm::Pose pose_dual(dual_state);
                 // printf("[ARockSolver] ConsenusPoseFactor4D param %ld, drone_id %d pose_dual %s pose_cur %s\n", 
                 //     param_info.id, param_pair.first, pose_dual.toStr().c_str(), Swarm::Pose(state_pointer, true).toStr().c_str());
-                auto factor = ConsenusPoseFactor4D::Create(pose_dual, rho_T, rho_theta, true);
-                problem->AddResidualBlock(factor, nullptr, state_pointer);
-                dual_factors.push_back(factor);
+                factor = ConsenusPoseFactor4D::Create(pose_dual, rho_T, rho_theta, true);
             } else if (param_info.type == D2Common::POSE_PERTURB_6D) {
                 MatrixXd A(param_info.size, param_info.size);
                 A.setIdentity();
                 A.block<3, 3>(0, 0) *= sqrt(rho_T);
                 A.block<3, 3>(3, 3) *= sqrt(rho_theta);
-                auto factor = new ceres::NormalPrior(A, dual_state);
-                problem->AddResidualBlock(factor, nullptr, state_pointer);
-                dual_factors.push_back(factor);
+                factor = new ceres::NormalPrior(A, dual_state);
                 // if (self_id == 0) {
                 //     printf("[ARockSolver] ConsenusPosePerturbFactor param %ld, drone_id %d A:\n", 
                 //         param_info.id, param_pair.first);
@@ -271,10 +332,10 @@ void ARockSolver::setDualStateFactors() {
                 } else {
                     //Not implement yet
                 }
-                auto factor = new ceres::NormalPrior(A, dual_state);
-                problem->AddResidualBlock(factor, nullptr, state_pointer);
-                dual_factors.push_back(factor);
+                factor = new ceres::NormalPrior(A, dual_state);
             }
+            dual_residual_blocks.push_back(problem->AddResidualBlock(factor, nullptr, state_pointer));
+            dual_factors.push_back(factor);
         }
     }
 }
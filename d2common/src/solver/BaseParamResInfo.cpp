@@ -66,6 +66,10 @@ void ResidualInfo::Evaluate(const std::vector<ParamInfo> & param_infos, bool use
         raw_jacobians[i] = jacobians[i].data();
     }
     cost_function->Evaluate(params.data(), residuals.data(), raw_jacobians.data());
+    applyLossFunction();
+}
+
+void ResidualInfo::applyLossFunction() {
     if (loss_function)
     {
         double residual_scaling_, alpha_sq_norm_;
@@ -82,7 +86,7 @@ void ResidualInfo::Evaluate(const std::vector<ParamInfo> & param_infos, bool use
             residual_scaling_ = sqrt_rho1_ / (1 - alpha);
             alpha_sq_norm_ = alpha / sq_norm;
         }
-        for (int i = 0; i < static_cast<int>(params.size()); i++) {
+        for (int i = 0; i < static_cast<int>(jacobians.size()); i++) {
             jacobians[i] = sqrt_rho1_ * (jacobians[i] - alpha_sq_norm_ * residuals * (residuals.transpose() * jacobians[i]));
         }
         residuals *= residual_scaling_;
@@ -5,12 +5,28 @@ namespace D2Common {
 void CeresSolver::addResidual(ResidualInfo*residual_info) {
     auto pointers = residual_info->paramsPointerList(state);
     // printf("Add residual info %d", residual_info->residual_type);
-    problem->AddResidualBlock(residual_info->cost_function,
+    residual_blocks[residual_info] = problem->AddResidualBlock(residual_info->cost_function,
                              residual_info->loss_function,
                              pointers);
     SolverWrapper::addResidual(residual_info);
 }
 
+void CeresSolver::removeResiduals(const std::vector<ResidualInfo*> & infos) {
+    for (auto info : infos) {
+        auto it = residual_blocks.find(info);
+        if (it != residual_blocks.end()) {
+            problem->RemoveResidualBlock(it->second);
+            residual_blocks.erase(it);
+        }
+    }
+    SolverWrapper::removeResiduals(infos);
+}
+
+void CeresSolver::reset() {
+    residual_blocks.clear();
+    SolverWrapper::reset();
+}
+
 SolverReport CeresSolver::solve() {
     ceres::Solver::Summary summary;
     ceres::Solve(options, problem, &summary);
@@ -0,0 +1,72 @@
+#include <d2common/solver/FactorPool.hpp>
+#include <cstdlib>
+#include <new>
+
+namespace D2Common {
+FactorPool::FactorPool(): free_lists(MAX_OBJECT_SIZE / ALIGN) {
+}
+
+FactorPool::~FactorPool() {
+    for (auto chunk : chunks) {
+        free(chunk);
+    }
+}
+
+FactorPool & FactorPool::instance() {
+    //Never destroyed, objects may be freed by static destructors of other units
+    static FactorPool * pool = new FactorPool;
+    return *pool;
+}
+
+void * FactorPool::allocate(size_t size) {
+    if (size > MAX_OBJECT_SIZE) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        _stats.allocs ++;
+        _stats.heap_allocs ++;
+        _stats.live ++;
+        return ::operator new(size);
+    }
+    size_t size_class = size == 0 ? 0 : (size - 1) / ALIGN;
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto & free_list = free_lists[size_class];
+    if (free_list.empty()) {
+        size_t slot_size = (size_class + 1) * ALIGN;
+        //Slots are aligned for the vectorized Eigen members of factors
+        char * chunk = (char*) aligned_alloc(ALIGN, slot_size * SLOTS_PER_CHUNK);
+        if (chunk == nullptr) {
+            throw std::bad_alloc();
+        }
+        chunks.emplace_back(chunk);
+        for (size_t i = SLOTS_PER_CHUNK; i > 0; i--) {
+            free_list.emplace_back(chunk + (i - 1) * slot_size);
+        }
+        _stats.heap_allocs ++;
+        _stats.reserved_bytes += slot_size * SLOTS_PER_CHUNK;
+    }
+    void * ptr = free_list.back();
+    free_list.pop_back();
+    _stats.allocs ++;
+    _stats.live ++;
+    return ptr;
+}
+
+void FactorPool::release(void * ptr, size_t size) {
+    if (ptr == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    _stats.frees ++;
+    _stats.live --;
+    if (size > MAX_OBJECT_SIZE) {
+        ::operator delete(ptr);
+        return;
+    }
+    size_t size_class = size == 0 ? 0 : (size - 1) / ALIGN;
+    free_lists[size_class].emplace_back(ptr);
+}
+
+FactorPoolStats FactorPool::stats() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return _stats;
+}
+}
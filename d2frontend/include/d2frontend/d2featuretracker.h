@@ -2,8 +2,13 @@
 
 #include "d2frontend_params.h"
 #include "d2landmark_manager.h"
+#include "utils.h"
 #include <unordered_map>
 #include <mutex>
+#include <thread>
+#include <deque>
+#include <functional>
+#include <condition_variable>
 #include <d2common/d2frontend_types.h>
 
 using namespace Eigen;
@@ -26,6 +31,8 @@ struct D2FTConfig {
     bool check_essential = false;
     bool enable_lk_optical_flow = true;
     bool lk_use_fast = false;
+    bool enable_cuda = true; //If false, LK tracking and feature detection run on CPU
+    bool enable_parallel_tracking = true; //Track the cameras of quadcam concurrently
     double ransacReprojThreshold = 10;
     double max_pts_velocity_time=0.3;
     int remote_min_match_num = 30;
@@ -35,7 +42,7 @@ struct D2FTConfig {
     bool enable_knn_match = true;
     bool enable_search_local_aera = true;
     bool enable_motion_prediction_local = false;
-    bool enable_search_local_aera_remote = false; //Enable motion prediction searching for remote drones.
+    bool enable_search_local_aera_remote = true; //Enable motion prediction searching for remote drones.
     double search_local_max_dist = 0.04; //To multiply with width
     double knn_match_ratio = 0.8;
     std::string output_folder = "/root/output/";
@@ -67,11 +74,13 @@ struct TrackReport {
 };
 
 struct LKImageInfo {
-    FrameIdType frame_id;
+    FrameIdType frame_id = -1;
     std::vector<cv::Point2f> lk_pts;
     std::vector<LandmarkIdType> lk_ids;
     cv::Mat image;
     std::vector<cv::cuda::GpuMat> pyr;
+    std::vector<cv::Mat> cpu_pyr; //Pyramid with gradients of image, used when cuda is disabled
+    FeatureGrid grid; //Occupancy grid for detecting new points, kept to reuse its buffers
 };
 
 class SuperGlueOnnx;
@@ -90,6 +99,24 @@ protected:
         bool prediction_using_extrinsic = false;
     };
 
+    //Landmark changes made by one tracking task of trackLocalFrames.
+    //Tasks of a frame may run concurrently, so they only read the landmark manager and record their changes here.
+    //The changes are committed in a fixed order afterwards, which keeps the landmark ids reproducible.
+    //A direct task runs alone and applies its changes to the landmark manager and frame immediately instead.
+    struct PendingLandmarks {
+        bool direct = false;
+        int camera_index = 0;
+        VisualImageDesc * frame = nullptr; //Frame receiving matched and appended, i.e. the right frame of stereo tracking
+        std::vector<LandmarkPerFrame> updated; //New observations of existing landmarks
+        std::vector<LandmarkPerFrame> created; //New landmarks with provisional ids
+        std::vector<std::pair<int, LandmarkPerFrame>> matched; //Index in frame and the matched landmark
+        std::vector<LandmarkPerFrame> appended; //LK landmarks to append to frame
+        LandmarkIdType nextProvisionalId() const {
+            //-1 is reserved for untracked landmarks
+            return -2 - camera_index*static_cast<LandmarkIdType>(MAX_FEATURE_NUM) - static_cast<LandmarkIdType>(created.size());
+        }
+    };
+
     D2FTConfig _config;
     double image_width = 0.0;
     double search_radius = 0.0;
@@ -101,6 +128,7 @@ protected:
     int frame_count = 0;
     bool inited = false;
     std::map<int, LKImageInfo> prev_lk_info; //frame.camera_index->image
+    int detect_threads = 0; //Threads of the CPU FAST detector, 0 for the hardware concurrency
     std::pair<bool, LandmarkPerFrame> createLKLandmark(const VisualImageDesc & frame, cv::Point2f pt, LandmarkIdType landmark_id = -1);
     std::recursive_mutex track_lock;
     std::recursive_mutex keyframe_lock;
@@ -108,11 +136,25 @@ protected:
     
     std::map<int, std::vector<cv::Point2f>> landmark_predictions_viz;
     std::map<int, std::vector<cv::Point2f>> landmark_predictions_matched_viz;
-
-    TrackReport trackLK(VisualImageDesc & frame);
-    TrackReport track(const VisualImageDesc & left_frame, VisualImageDesc & right_frame, bool enable_lk=true, TrackLRType type=WHOLE_IMG_MATCH);
-    TrackReport trackLK(const VisualImageDesc & frame, VisualImageDesc & right_frame, TrackLRType type=WHOLE_IMG_MATCH);
-    TrackReport track(VisualImageDesc & frame, const Swarm::Pose & motion_prediction=Swarm::Pose());
+    std::mutex predictions_viz_lock;
+
+    //Persistent workers of trackLocalFramesParallel, one per camera
+    std::vector<std::thread> track_workers;
+    std::deque<std::function<void()>> track_tasks;
+    std::mutex track_tasks_mutex;
+    std::condition_variable track_tasks_cond;
+    bool track_workers_stop = false;
+    void trackWorker();
+    void pushTrackTask(std::function<void()> task);
+
+    TrackReport trackLK(VisualImageDesc & frame, PendingLandmarks & pending);
+    TrackReport track(const VisualImageDesc & left_frame, const VisualImageDesc & right_frame, PendingLandmarks & pending,
+            bool enable_lk=true, TrackLRType type=WHOLE_IMG_MATCH);
+    TrackReport trackLK(const VisualImageDesc & frame, const VisualImageDesc & right_frame, PendingLandmarks & pending, 
+            TrackLRType type=WHOLE_IMG_MATCH);
+    TrackReport track(VisualImageDesc & frame, PendingLandmarks & pending, const Swarm::Pose & motion_prediction=Swarm::Pose());
+    void trackLocalFramesParallel(VisualImageDescArray & frames, std::vector<TrackReport> & reports, std::vector<PendingLandmarks> & pendings);
+    void commitLandmarks(VisualImageDescArray & frames, std::vector<PendingLandmarks> & pendings);
     TrackReport trackRemote(VisualImageDesc & frame, const VisualImageDesc & prev_frame, 
             bool use_motion_predict=false, const Swarm::Pose & motion_prediction=Swarm::Pose());
     bool getMatchedPrevKeyframe(const VisualImageDescArray & frame_a, VisualImageDescArray& prev, int & dir_a, int & dir_b);
@@ -137,6 +179,7 @@ protected:
             const Swarm::Pose & cam_pose_a, const Swarm::Pose & cam_pose_b, bool use_extrinsic=false) const;
 public:
     D2FeatureTracker(D2FTConfig config);
+    ~D2FeatureTracker();
     bool trackLocalFrames(VisualImageDescArray & frames);
     bool trackRemoteFrames(VisualImageDescArray & frames);
     void updatebySldWin(const std::vector<VINSFrame*> sld_win);
@@ -11,6 +11,7 @@
 #include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/Image.h>
 #include "d2common/d2frontend_types.h"
+#include <d2common/event_queue.hpp>
 #include "d2frontend_params.h"
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
@@ -39,8 +40,9 @@ protected:
     Eigen::Vector3d last_keyframe_position = Eigen::Vector3d(10000, 10000, 10000);
 
     std::set<ros::Time> received_keyframe_stamps;
-    std::queue<VisualImageDescArray> loop_queue;
-    std::mutex loop_lock;
+    EventQueue<VisualImageDescArray> loop_queue; //Keyframes wait here for loop detection, none of them is dropped
+    LatencyHistogram loop_latency{"loop_detection"};
+    EventQueue<VisualImageDescArray> remote_image_queue; //Remote frames from the network callbacks, tracked in remoteImageThread
     image_transport::ImageTransport * it_;
 
     virtual void backendFrameCallback(const VisualImageDescArray & viokf) {};
@@ -67,6 +69,7 @@ protected:
 
     void processStereoframe(const StereoFrame & stereoframe);
     void loopDetectionThread();
+    void remoteImageThread();
 
     void addToLoopQueue(const VisualImageDescArray & viokf);
 
@@ -80,7 +83,7 @@ protected:
     message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image> * sync;
     image_transport::Subscriber image_sub_single;
 
-    std::thread th, th_loop_det;
+    std::thread th, th_loop_det, th_remote_image;
     bool received_image = false;
     ros::Timer timer, loop_timer;
 public:
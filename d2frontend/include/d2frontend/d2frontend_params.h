@@ -60,6 +60,10 @@ struct D2FrontendParams {
     double recv_msg_duration = 0.5;
     double feature_min_dist = 20;
     int total_feature_num = 150;
+    bool enable_int8_match = true; //Use the int8 brute-force matcher in matchKNN instead of cv::BFMatcher
+    bool enable_guided_match = true; //With a search radius and enable_int8_match, matchKNN compares only the keypoints within it
+    bool enable_prosac_pnp = true; //PROSAC+SPRT for the non-central PnP instead of opengv RANSAC
+    int feature_budget_grid = 8; //Image is split to feature_budget_grid^2 cells for budgeting new features, 0 to disable
     double track_remote_netvlad_thres = 0.3;
     size_t superpoint_dims = 256;
     size_t netvlad_dims = 4096;
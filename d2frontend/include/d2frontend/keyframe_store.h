@@ -0,0 +1,93 @@
+#pragma once
+#include <d2common/d2frontend_types.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+namespace D2FrontEnd {
+using D2Common::FrameIdType;
+using D2Common::VisualImageDescArray;
+
+//A file mapped read-only and appended with write(), so the mapping is always coherent with the appends.
+class MappedFile {
+    int fd = -1;
+    char * base = nullptr;
+    size_t mapped = 0; //Length of the mapping, may be beyond the end of file
+    size_t file_size = 0;
+    bool remap();
+public:
+    ~MappedFile();
+    bool open(const std::string & path, bool truncate);
+    void close();
+    size_t size() const {
+        return file_size;
+    }
+    bool append(const void * buf, size_t len);
+    bool write(size_t offset, const void * buf, size_t len);
+    bool truncate(size_t len);
+    //Valid until the next append
+    const char * data();
+    //Drop the resident pages, they are read back from the file on the next access.
+    void evict();
+};
+
+//Append-only, memory-mapped keyframe database of LoopDetector for warm starting from disk.
+//Each column is a file in the directory:
+//  meta         magic, version, NetVLAD dims and session count
+//  frames.log   LCM encoded ImageArrayDescriptor_t of keyframes (full float descriptors), append only
+//  frames.idx   FrameRecord of each record in frames.log
+//  netvlad.f32  NetVLAD descriptors in the insertion order of the faiss indices
+//  netvlad.idx  DescRecord of each row of netvlad.f32
+//A torn append (e.g. crash) is truncated when the store is opened.
+//Keyframe ids restart with each session, so keyframes of previous sessions are given ids with the session
+//in the high bits (see storeFrameId) and their landmark ids are cleared as they are not in this session's landmark_db.
+class KeyframeStore {
+public:
+    struct FrameRecord {
+        int64_t frame_id;
+        int32_t drone_id;
+        int32_t session;
+        double stamp;
+        double pose[7]; //x y z qw qx qy qz, updated in place by updatePose
+        uint64_t offset;
+        uint64_t size;
+    };
+    struct DescRecord {
+        int64_t frame_id;
+        int32_t dir;
+        int32_t drone_id;
+        int32_t session;
+    };
+protected:
+    std::string path;
+    int netvlad_dims;
+    size_t max_resident_bytes;
+    size_t resident_bytes = 0; //Bytes of frames.log read since the last eviction
+    int session = 0;
+    MappedFile log, frame_idx, desc, desc_idx;
+    std::map<FrameIdType, size_t> frame_records; //frame_id to the latest record
+    std::recursive_mutex store_mutex;
+    const FrameRecord & frameRecord(size_t i);
+public:
+    KeyframeStore(const std::string & path, int netvlad_dims, size_t max_resident_bytes);
+    //Open or create the store, with warm_start false the existing data is dropped.
+    bool open(bool warm_start);
+    void append(const VisualImageDescArray & frame);
+    void appendDescriptor(FrameIdType frame_id, int dir, int drone_id, const float * netvlad);
+    void updatePose(FrameIdType frame_id, const Swarm::Pose & pose);
+    bool load(FrameIdType frame_id, VisualImageDescArray & frame);
+    bool hasFrame(FrameIdType frame_id);
+    FrameIdType storeFrameId(FrameIdType frame_id, int session) const;
+    bool isPreviousSession(FrameIdType frame_id) const;
+    int droneId(FrameIdType frame_id);
+    size_t frameNum();
+    size_t descriptorNum();
+    //Zero copy views of the NetVLAD column, valid until the next appendDescriptor
+    const float * descriptors();
+    const DescRecord * descriptorRecords();
+    //Drop resident pages of all columns
+    void evict();
+};
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+namespace D2FrontEnd {
+//Descriptors quantized to int8 with one scale per row (max abs of the row maps to 127). VisualImageDesc::toLCM
+//instead scales all descriptors of an image by one global max and truncates, so its int8 values differ from these.
+//Rows are zero padded to a multiple of 32 bytes for SIMD.
+struct QuantizedDescriptors {
+    int rows = 0;
+    int dims = 0;
+    int stride = 0;
+    std::vector<int8_t> data;
+    std::vector<float> scales; //desc[i] ~= data[i] * scales[row]
+    std::vector<float> sqr_norms; //Squared norm of the float descriptor
+    QuantizedDescriptors() {}
+    QuantizedDescriptors(const cv::Mat & desc) {
+        quantize(desc);
+    }
+    void quantize(const cv::Mat & desc); //desc: CV_32F, one descriptor per row
+    const int8_t * row(int i) const {
+        return data.data() + i * stride;
+    }
+};
+
+int32_t dotInt8(const int8_t * a, const int8_t * b, int n);
+
+//2-D spatial hash of point indices with cells of the search radius, a query of that radius visits the 3x3 neighbour cells only.
+class PointHash2D {
+    float inv_cell_size = 0;
+    std::unordered_map<int64_t, std::vector<int>> cells;
+    static int64_t key(int64_t cx, int64_t cy) {
+        return (cx << 32) ^ (cy & 0xffffffff);
+    }
+    bool cellOf(const cv::Point2f & pt, int64_t & cx, int64_t & cy) const;
+public:
+    PointHash2D(const std::vector<cv::Point2f> & pts, float radius);
+    //Indices of points within radius of pt are appended to ret
+    void query(const cv::Point2f & pt, float radius, const std::vector<cv::Point2f> & pts, std::vector<int> & ret) const;
+};
+
+//Brute-force 2-NN matching on quantized descriptors with the ratio test fused in.
+//Returns the same matches as cv::BFMatcher(cv::NORM_L2)::knnMatch(k=2) followed by the ratio test, up to the quantization error.
+std::vector<cv::DMatch> matchKNNInt8(const QuantizedDescriptors & desc_a, const QuantizedDescriptors & desc_b, double knn_match_ratio);
+
+//Guided matching: each descriptor of a is compared only with keypoints of b within radius of its (predicted) position.
+//A lone candidate takes its second best from within 2x radius, or from all of b if there is none.
+std::vector<cv::DMatch> matchKNNGuided(const QuantizedDescriptors & desc_a, const QuantizedDescriptors & desc_b, double knn_match_ratio,
+        const std::vector<cv::Point2f> & pts_a, const std::vector<cv::Point2f> & pts_b, double radius);
+}
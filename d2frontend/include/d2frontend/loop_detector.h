@@ -4,11 +4,17 @@
 #include <cv_bridge/cv_bridge.h>
 #include <swarm_msgs/LoopEdge.h>
 #include <d2frontend/d2frontend_params.h>
+#include <d2frontend/keyframe_store.h>
 #include <functional>
 #include <swarm_msgs/Pose.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
 #include <swarm_msgs/drone_trajectory.hpp>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 
 using namespace swarm_msgs;
 #define REMOTE_MAGIN_NUMBER 1000000
@@ -32,6 +38,11 @@ using D2Common::Point2fVector;
 
 class LoopCam;
 
+enum LoopIndexType {
+    LOOP_INDEX_FLAT = 0, //Exact linear scan
+    LOOP_INDEX_HNSW //Approximate graph index, incremental insertion without training
+};
+
 struct LoopDetectorConfig {
     int match_index_dist;
     int match_index_dist_remote;
@@ -57,8 +68,22 @@ struct LoopDetectorConfig {
     double knn_match_ratio = 0.8;
     double gravity_check_thres = 0.06;
     std::string superglue_model_path;
+    LoopIndexType index_type = LOOP_INDEX_FLAT;
+    int hnsw_m = 32; //Neighbors per node of HNSW graph
+    int hnsw_ef_construction = 40;
+    int hnsw_ef_search = 64;
+    int verify_threads = 2; //Threads for geometric verification of loop candidates, 0 to verify in processImageArray
+    int verify_queue_size = 8; //Max pending candidates, the oldest is dropped when full
+    double verify_max_age = 2.0; //Candidates waiting longer than this (seconds) are dropped
+    std::string keyframe_store_path = ""; //Directory of the keyframe store, empty to keep keyframes in memory only
+    bool keyframe_store_warm_start = true; //Load keyframes and NetVLAD index from the store on start
+    int keyframe_cache_size = 500; //Decoded keyframes kept in memory with the store, the others are read back from it
+    int keyframe_store_resident_mb = 256; //Resident pages of the store are dropped beyond this
 };
 
+//Create the NetVLAD index of the keyframe database. Labels are the insertion order for all index types.
+faiss::Index * createLoopIndex(const LoopDetectorConfig & config, int dims);
+
 class SuperGlueOnnx;
 
 class LoopDetector {
@@ -66,41 +91,68 @@ class LoopDetector {
     std::map<LandmarkIdType, LandmarkPerId> landmark_db;
     std::recursive_mutex frame_mutex, landmark_mutex;
 protected:
-    faiss::IndexFlatIP local_index;
-    faiss::IndexFlatIP remote_index;
+    faiss::Index * local_index = nullptr;
+    faiss::Index * remote_index = nullptr;
     Swarm::DroneTrajectory ego_motion_traj;
     std::map<int, int64_t> index_to_frame_id;
     std::map<int, int> imgid2dir;
     std::map<int, std::map<int, int>> inter_drone_loop_count;
     std::set<int> all_nodes;
 
-    std::map<int64_t, VisualImageDescArray> keyframe_database;
+    std::map<int64_t, VisualImageDescArray> keyframe_database; //All keyframes, or a cache of keyframe_store
     std::mutex keyframe_database_mutex;
+    KeyframeStore * keyframe_store = nullptr;
+    std::deque<FrameIdType> keyframe_cache_order; //Insertion order of keyframe_database for eviction
 
     std::map<int64_t, std::vector<cv::Mat>> msgid2cvimgs;
     
+    std::mutex cvimgs_mutex, traj_mutex;
+    
     double t0 = -1;
     int loop_count = 0;
     SuperGlueOnnx * superglue = nullptr;
+
+    //Geometric verification pipeline
+    struct LoopCandidate;
+    std::deque<std::shared_ptr<LoopCandidate>> verify_queue;
+    std::map<int64_t, std::shared_ptr<LoopCandidate>> verified_candidates; //Waiting to be emitted in order
+    int64_t verify_seq = 0;
+    int64_t emit_seq = 0;
+    bool verify_stop = false;
+    std::mutex verify_queue_mutex, emit_mutex;
+    std::condition_variable verify_cond;
+    std::vector<std::thread> verify_threads;
     
-    //Use 3D points from frame a.
-    bool computeLoop(const VisualImageDescArray & frame_array_a, const VisualImageDescArray & frame_array_b,
-            int main_dir_a, int main_dir_b, LoopEdge & ret);
+    //Visualization and on_loop_cb of the verification threads, run on the thread calling processImageArray
+    std::vector<std::function<void()>> caller_tasks;
+    std::mutex caller_tasks_mutex;
+
+    bool solveLoop(LoopCandidate & candidate); //Correspondences and PnP, thread safe
+    bool acceptLoop(LoopCandidate & candidate); //Odometry consistency check and loop id, must be called in order
+    void enqueueLoopCandidate(std::shared_ptr<LoopCandidate> candidate);
+    void verifyThread();
+    void finishLoopCandidate(std::shared_ptr<LoopCandidate> candidate, bool verified);
+    void runOnCallerThread(std::function<void()> task);
+    void drawCandidate(const LoopCandidate & candidate, bool success);
 
     bool computeCorrespondFeatures(const VisualImageDesc & new_img_desc, const VisualImageDesc & old_img_desc, 
             std::vector<Vector3d> &lm_pos_a, std::vector<int> &idx_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &idx_b, 
-            std::vector<int> &cam_indices);
+            std::vector<int> &cam_indices, std::vector<float> &scores);
 
     bool computeCorrespondFeaturesOnImageArray(const VisualImageDescArray & frame_array_a,
             const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b,
-            std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> & cam_indices,
+            std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> & cam_indices, std::vector<float> & scores,
             std::vector<std::pair<int, int>> &index2dirindex_a, std::vector<std::pair<int, int>> &index2dirindex_b);
 
     int addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss = true);
+    bool getKeyframe(FrameIdType frame_id, VisualImageDescArray & frame);
+    int keyframeDroneId(FrameIdType frame_id);
+    void cacheKeyframe(const VisualImageDescArray & frame); //Requires keyframe_database_mutex
+    void warmStart();
     int addImageDescToDatabase(VisualImageDesc & new_img_desc);
     bool queryImageArrayFromDatabase(const VisualImageDescArray & new_img_desc, VisualImageDescArray & ret, int & camera_index_new, int & camera_index_old);
     int queryFrameIndexFromDatabase(const VisualImageDesc & new_img_desc, double & similarity);
-    int queryIndexFromDatabase(const VisualImageDesc & new_img_desc, faiss::IndexFlatIP & index, bool remote_db, double thres, int max_index, double & similarity);
+    int queryIndexFromDatabase(const VisualImageDesc & new_img_desc, faiss::Index & index, bool remote_db, double thres, int max_index, double & similarity);
 
     bool checkLoopOdometryConsistency(LoopEdge & loop_conn) const;
     void drawMatched(const VisualImageDescArray & fisheye_desc_a, const VisualImageDescArray & fisheye_desc_b,
@@ -111,7 +163,9 @@ public:
     std::function<void(VisualImageDescArray&)> broadcast_keyframe_cb;
     int self_id = -1;
     LoopDetector(int self_id, const LoopDetectorConfig & config);
+    ~LoopDetector();
     void processImageArray(VisualImageDescArray & img_des);
+    void processCallbacks(); //Run the visualization and loop callbacks queued by the verification threads
     void onLoopConnection(LoopEdge & loop_conn);
     LoopCam * loop_cam = nullptr;
     cv::Mat decode_image(const VisualImageDesc & _img_desc);
@@ -36,10 +36,43 @@ cv::Vec3b extractColor(const cv::Mat &img, cv::Point2f p);
 cv::Point2f rotate_pt_norm2d(cv::Point2f pt, Eigen::Quaterniond q);
 
 
+//Bucketed occupancy grid of feature points. Cells are min_dist wide, so a nearby point can only be in the 3x3 neighbour cells.
+//A coarser budget grid limits the number of points per region to keep the features uniform.
+//The buffers are kept by reset, so reuse the grid across frames to avoid reallocation.
+class FeatureGrid {
+    float min_dist = 0;
+    float inv_cell_size = 0;
+    int grid_cols = 0;
+    int grid_rows = 0;
+    std::vector<std::vector<cv::Point2f>> cells;
+    int budget_cols = 0;
+    int budget_rows = 0;
+    float budget_scale_x = 0;
+    float budget_scale_y = 0;
+    int cell_budget = 0;
+    std::vector<int> budget_count;
+    int cellIndex(const cv::Point2f & pt) const;
+    int budgetIndex(const cv::Point2f & pt) const;
+public:
+    //budget_grid: number of budget cells per side, 0 disables the budget.
+    void reset(cv::Size size, float min_dist, int budget_grid=0, int cell_budget=0);
+    bool hasNearby(const cv::Point2f & pt) const;
+    bool budgetExceeded(const cv::Point2f & pt) const;
+    void add(const cv::Point2f & pt);
+};
+
+//Detect FAST corners in cols x rows tiles and return the strongest features points outside the zeros of _mask.
+//On CPU the tiles are detected in parallel by max_threads threads, 0 for the hardware concurrency.
+std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows, 
+    bool enable_cuda=true, int max_threads=0);
+
+//grid: optional, pass a grid kept by the caller to reuse its buffers.
+//max_threads: threads of the CPU FAST detector, callers already running in parallel should limit it.
 void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::vector<cv::Point2f> & cur_pts, int require_pts, 
-    bool enable_cuda=true, bool use_fast=false, int fast_rows=3, int fast_cols=4);
+    bool enable_cuda=true, bool use_fast=false, int fast_rows=3, int fast_cols=4, FeatureGrid * grid=nullptr, int max_threads=0);
 
 std::vector<cv::cuda::GpuMat> buildImagePyramid(const cv::cuda::GpuMat& prevImg, int maxLevel_=3);
+std::vector<cv::Mat> buildImagePyramid(const cv::Mat& prevImg, int maxLevel_=3);
 
 std::vector<cv::Point2f> opticalflowTrack(const cv::Mat & cur_img, const cv::Mat & prev_img, std::vector<cv::Point2f> & prev_pts, 
         std::vector<LandmarkIdType> & ids, TrackLRType type=WHOLE_IMG_MATCH, bool enable_cuda=true);
@@ -47,6 +80,10 @@ std::vector<cv::Point2f> opticalflowTrack(const cv::Mat & cur_img, const cv::Mat
 std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vector<cv::cuda::GpuMat> & prev_pyr, 
         std::vector<cv::Point2f> & prev_pts, std::vector<LandmarkIdType> & ids, TrackLRType type=WHOLE_IMG_MATCH, bool update_pyr=true);
 
+//CPU version: cur_pyr is built from cur_img if empty, otherwise it is reused (e.g. cached from the temporal track of this camera).
+std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, const std::vector<cv::Mat> & prev_pyr, std::vector<cv::Mat> & cur_pyr,
+        std::vector<cv::Point2f> & prev_pts, std::vector<LandmarkIdType> & ids, TrackLRType type=WHOLE_IMG_MATCH);
+
 std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b, double knn_match_ratio=0.8,
         const std::vector<cv::Point2f> pts_a=std::vector<cv::Point2f>(),
         const std::vector<cv::Point2f> pts_b=std::vector<cv::Point2f>(),
@@ -55,10 +92,14 @@ std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b,
 int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std::vector<Vector3d> lm_3d_norm_b,
         Swarm::Pose extrinsic_b, Swarm::Pose drone_pose_a, Swarm::Pose drone_pose_b, Swarm::Pose & DP_b_to_a,
         std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true);
+//scores: optional quality of each correspondence, higher first for PROSAC sampling.
+//min_inliers: with PROSAC, give up once a model with min_inliers would have been found.
 Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
-        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers);
+        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers,
+        const std::vector<float> & scores=std::vector<float>(), int min_inliers=0);
 int computeRelativePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
         const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, 
         Swarm::Pose drone_pose_a, Swarm::Pose drone_pose_b, Swarm::Pose & DP_b_to_a,
-        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true);
+        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true, 
+        const std::vector<float> & scores=std::vector<float>());
 }
\ No newline at end of file
@@ -25,6 +25,46 @@ D2FeatureTracker::D2FeatureTracker(D2FTConfig config):
     }
     search_radius = _config.search_local_max_dist*image_width;
     reference_frame_id = params->self_id;
+    if (params->camera_configuration == CameraConfig::FOURCORNER_FISHEYE && _config.enable_parallel_tracking) {
+        //The cameras are tracked concurrently, so their detectors share the cores
+        int cam_num = std::max<int>(params->extrinsics.size(), 1);
+        detect_threads = std::max<int>(std::thread::hardware_concurrency() / cam_num, 1);
+    }
+}
+
+D2FeatureTracker::~D2FeatureTracker() {
+    {
+        std::lock_guard<std::mutex> lock(track_tasks_mutex);
+        track_workers_stop = true;
+    }
+    track_tasks_cond.notify_all();
+    for (auto & th : track_workers) {
+        th.join();
+    }
+}
+
+void D2FeatureTracker::trackWorker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(track_tasks_mutex);
+            track_tasks_cond.wait(lock, [&] { return track_workers_stop || !track_tasks.empty(); });
+            if (track_workers_stop) {
+                return;
+            }
+            task = std::move(track_tasks.front());
+            track_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void D2FeatureTracker::pushTrackTask(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(track_tasks_mutex);
+        track_tasks.emplace_back(std::move(task));
+    }
+    track_tasks_cond.notify_one();
 }
 
 void D2FeatureTracker::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
@@ -91,22 +131,32 @@ bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
         frames.send_to_backend = true;
     }
 
+    for (auto & frame : frames.images) {
+        //Create the LK states before tracking, so tracking tasks never insert into prev_lk_info.
+        if (prev_lk_info.find(frame.camera_index) == prev_lk_info.end()) {
+            prev_lk_info[frame.camera_index] = LKImageInfo();
+        }
+    }
+    std::vector<TrackReport> reports;
+    std::vector<PendingLandmarks> pendings;
     if (params->camera_configuration == CameraConfig::STEREO_PINHOLE) {
-        report.compose(track(frames.images[0], frames.motion_prediction));
-        report.compose(track(frames.images[0], frames.images[1]));
+        PendingLandmarks direct;
+        direct.direct = true;
+        reports.emplace_back(track(frames.images[0], direct, frames.motion_prediction));
+        direct.frame = &frames.images[1];
+        reports.emplace_back(track(frames.images[0], frames.images[1], direct));
     } else if (params->camera_configuration == CameraConfig::PINHOLE_DEPTH) {
-        for (auto & frame : frames.images) {
-            report.compose(track(frame));
+        PendingLandmarks direct;
+        direct.direct = true;
+        for (size_t i = 0; i < frames.images.size(); i++) {
+            reports.emplace_back(track(frames.images[i], direct));
         }
     } else if(params->camera_configuration == CameraConfig::FOURCORNER_FISHEYE) {
-        report.compose(track(frames.images[0], frames.motion_prediction));
-        report.compose(track(frames.images[1], frames.motion_prediction));
-        report.compose(track(frames.images[2], frames.motion_prediction));
-        report.compose(track(frames.images[3], frames.motion_prediction));
-        report.compose(track(frames.images[0], frames.images[1], true, LEFT_RIGHT_IMG_MATCH));
-        report.compose(track(frames.images[1], frames.images[2], true, LEFT_RIGHT_IMG_MATCH));
-        report.compose(track(frames.images[2], frames.images[3], true, LEFT_RIGHT_IMG_MATCH));
-        report.compose(track(frames.images[0], frames.images[3], true, RIGHT_LEFT_IMG_MATCH));
+        trackLocalFramesParallel(frames, reports, pendings);
+    }
+    commitLandmarks(frames, pendings);
+    for (auto & _report : reports) {
+        report.compose(_report);
     }
     if (isKeyframe(report) && frames.send_to_backend) {
         iskeyframe = true;
@@ -129,6 +179,125 @@ bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
     return iskeyframe;
 }
 
+void D2FeatureTracker::trackLocalFramesParallel(VisualImageDescArray & frames, std::vector<TrackReport> & reports, 
+        std::vector<PendingLandmarks> & pendings) {
+    //Task graph of the quadcam: temporal tracking of the four cameras are independent,
+    //each stereo pair waits for the temporal tracking of its two cameras only.
+    struct StereoPair {
+        int left;
+        int right;
+        TrackLRType type;
+    };
+    const std::vector<StereoPair> stereo_pairs{{0, 1, LEFT_RIGHT_IMG_MATCH}, {1, 2, LEFT_RIGHT_IMG_MATCH}, 
+        {2, 3, LEFT_RIGHT_IMG_MATCH}, {0, 3, RIGHT_LEFT_IMG_MATCH}};
+    int cam_num = frames.images.size();
+    if (!_config.enable_parallel_tracking) {
+        //Serial tracking applies the changes of each task directly, so each stereo pair sees the ids assigned by the previous ones.
+        PendingLandmarks direct;
+        direct.direct = true;
+        for (int i = 0; i < cam_num; i++) {
+            reports.emplace_back(track(frames.images[i], direct, frames.motion_prediction));
+        }
+        for (auto & pair : stereo_pairs) {
+            direct.frame = &frames.images[pair.right];
+            reports.emplace_back(track(frames.images[pair.left], frames.images[pair.right], direct, true, pair.type));
+        }
+        return;
+    }
+    reports.resize(cam_num + stereo_pairs.size());
+    pendings.resize(cam_num + stereo_pairs.size());
+    for (int k = 0; k < stereo_pairs.size(); k++) {
+        pendings[cam_num + k].frame = &frames.images[stereo_pairs[k].right];
+    }
+    if (track_workers.empty()) {
+        for (int i = 0; i < cam_num; i++) {
+            track_workers.emplace_back(&D2FeatureTracker::trackWorker, this);
+        }
+    }
+    //A stereo pair is queued by the last of its two temporal tasks to finish, so workers never wait on each other.
+    std::vector<int> stereo_deps(stereo_pairs.size(), 2);
+    int remaining = cam_num + stereo_pairs.size();
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+    auto finish = [&]() {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        remaining--;
+        if (remaining == 0) {
+            done_cond.notify_all();
+        }
+    };
+    auto track_stereo = [&](int k) {
+        auto & pair = stereo_pairs[k];
+        reports[cam_num + k] = track(frames.images[pair.left], frames.images[pair.right], pendings[cam_num + k], true, pair.type);
+        finish();
+    };
+    auto track_temporal = [&](int i) {
+        reports[i] = track(frames.images[i], pendings[i], frames.motion_prediction);
+        std::vector<int> ready;
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            for (int k = 0; k < stereo_pairs.size(); k++) {
+                if ((stereo_pairs[k].left == i || stereo_pairs[k].right == i) && --stereo_deps[k] == 0) {
+                    ready.push_back(k);
+                }
+            }
+        }
+        for (auto k : ready) {
+            pushTrackTask([&track_stereo, k]() { track_stereo(k); });
+        }
+        finish();
+    };
+    for (int i = 0; i < cam_num; i++) {
+        pushTrackTask([&track_temporal, i]() { track_temporal(i); });
+    }
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_cond.wait(lock, [&] { return remaining == 0; });
+}
+
+void D2FeatureTracker::commitLandmarks(VisualImageDescArray & frames, std::vector<PendingLandmarks> & pendings) {
+    //Apply in the order of tasks, the same order as serial tracking.
+    std::map<LandmarkIdType, LandmarkIdType> provisional_ids;
+    auto resolve = [&](LandmarkIdType id) {
+        if (id < -1 && provisional_ids.find(id) != provisional_ids.end()) {
+            return provisional_ids.at(id);
+        }
+        return id;
+    };
+    for (auto & pending : pendings) {
+        for (auto & lm : pending.updated) {
+            lm.landmark_id = resolve(lm.landmark_id);
+            lmanager->updateLandmark(lm);
+        }
+        for (auto & lm : pending.created) {
+            provisional_ids[lm.landmark_id] = lmanager->addLandmark(lm);
+        }
+        if (pending.frame == nullptr) {
+            continue;
+        }
+        for (auto & it : pending.matched) {
+            it.second.landmark_id = resolve(it.second.landmark_id);
+            pending.frame->landmarks[it.first] = it.second;
+        }
+        for (auto & lm : pending.appended) {
+            lm.landmark_id = resolve(lm.landmark_id);
+            pending.frame->landmarks.emplace_back(lm);
+        }
+    }
+    if (provisional_ids.empty()) {
+        return;
+    }
+    for (auto & frame : frames.images) {
+        for (auto & lm : frame.landmarks) {
+            lm.landmark_id = resolve(lm.landmark_id);
+        }
+    }
+    for (auto & it : prev_lk_info) {
+        for (auto & id : it.second.lk_ids) {
+            id = resolve(id);
+        }
+    }
+}
+
 bool D2FeatureTracker::getMatchedPrevKeyframe(const VisualImageDescArray & frame_a, VisualImageDescArray& prev, int & dir_a, int & dir_b) {
     const Guard lock(keyframe_lock);
     if (current_keyframes.size() == 0) {
@@ -321,7 +490,7 @@ void D2FeatureTracker::cvtRemoteLandmarkId(VisualImageDesc & frame) const {
 }
 
 
-TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose & motion_prediction) {
+TrackReport D2FeatureTracker::track(VisualImageDesc & frame, PendingLandmarks & pending, const Swarm::Pose & motion_prediction) {
     TrackReport report;
     if (current_keyframes.size() > 0 && current_keyframes.back().frame_id != frame.frame_id) {
         auto & current_keyframe = current_keyframes.back();
@@ -347,14 +516,20 @@ TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose &
                 cur_lm.velocity = cur_lm.pt3d_norm - prev_lm.pt3d_norm;
                 cur_lm.velocity /= (frame.stamp - current_keyframe.stamp);
                 cur_lm.stamp_discover = prev_lm.stamp_discover;
-                lmanager->updateLandmark(cur_lm);
+                if (pending.direct) {
+                    lmanager->updateLandmark(cur_lm);
+                } else {
+                    pending.updated.emplace_back(cur_lm);
+                }
                 report.sum_parallex += (prev_lm.pt3d_norm - cur_lm.pt3d_norm).norm();
                 // printf("[D2FeatureTracker::track] landmark %ld cam_idx %d<->%d frame_cam_idx %d<->%d parallex %.1f%% prev_2d %.1f %.1f cur_2d %.3f %.3f prev_3d %.3f %.3f %.3f cur_3d %.3f %.3f %.3f\n", 
                 //     landmark_id, prev_lm.camera_index, cur_lm.camera_index, previous.camera_index, frame.camera_index,
                 //     (prev_lm.pt3d_norm - cur_lm.pt3d_norm).norm()*100, prev_lm.pt2d.x, prev_lm.pt2d.y, cur_lm.pt2d.x, cur_lm.pt2d.y,
                 //     prev_lm.pt3d_norm.x(), prev_lm.pt3d_norm.y(), prev_lm.pt3d_norm.z(), cur_lm.pt3d_norm.x(), cur_lm.pt3d_norm.y(), cur_lm.pt3d_norm.z());
                 report.parallex_num ++;
-                if (lmanager->at(landmark_id).track.size() >= _config.long_track_frames) {
+                //Count the pending observation of this frame
+                int track_size = lmanager->at(landmark_id).track.size() + (pending.direct ? 0 : 1);
+                if (track_size >= _config.long_track_frames) {
                     report.long_track_num ++;
                 } else {
                     report.unmatched_num ++;
@@ -365,24 +540,38 @@ TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose &
     if (_config.enable_lk_optical_flow) {
         //Enable LK optical flow feature tracker also.
         //This is for the case that the superpoint features is not tracked well.
-        report.compose(trackLK(frame));
+        report.compose(trackLK(frame, pending));
     }
     return report;
 }
 
-TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
+TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame, PendingLandmarks & pending) {
     //Track LK points
     TrackReport report;
-    if (prev_lk_info.find(frame.camera_index) == prev_lk_info.end()) {
-        prev_lk_info[frame.camera_index] = LKImageInfo();
+    auto & lk_info = prev_lk_info.at(frame.camera_index);
+    pending.camera_index = frame.camera_index;
+    if (_config.enable_cuda && lk_info.pyr.empty()) {
         cv::cuda::GpuMat image_cuda(frame.raw_image);
-        prev_lk_info[frame.camera_index].pyr = buildImagePyramid(image_cuda);
+        lk_info.pyr = buildImagePyramid(image_cuda);
     }
-    auto cur_lk_pts = prev_lk_info[frame.camera_index].lk_pts;
-    auto cur_lk_ids = prev_lk_info[frame.camera_index].lk_ids;
-    if (!cur_lk_ids.empty()) {
+    auto cur_lk_pts = lk_info.lk_pts;
+    auto cur_lk_ids = lk_info.lk_ids;
+    if (!_config.enable_cuda) {
+        if (!frame.raw_image.empty()) {
+            //Always build the pyramid of current image, it is reused by stereo tracking and next frame.
+            int prev_lk_num = cur_lk_ids.size();
+            std::vector<cv::Mat> cur_pyr;
+            cur_lk_pts = opticalflowTrackPyr(frame.raw_image, lk_info.cpu_pyr, cur_pyr, 
+                cur_lk_pts, cur_lk_ids, TrackLRType::WHOLE_IMG_MATCH);
+            lk_info.cpu_pyr = cur_pyr;
+            if (params->verbose && prev_lk_num > 0) {
+                printf("[D2FeatureTracker::trackLK] track %d LK points, %d lost, track rate %.1f%%\n", 
+                    prev_lk_num, prev_lk_num - cur_lk_pts.size(), cur_lk_pts.size() * 100.0 / prev_lk_num);
+            }
+        }
+    } else if (!cur_lk_ids.empty()) {
         int prev_lk_num = cur_lk_ids.size();
-        cur_lk_pts = opticalflowTrackPyr(frame.raw_image, prev_lk_info[frame.camera_index].pyr, cur_lk_pts, cur_lk_ids, 
+        cur_lk_pts = opticalflowTrackPyr(frame.raw_image, lk_info.pyr, cur_lk_pts, cur_lk_ids, 
             TrackLRType::WHOLE_IMG_MATCH, true);
         if (params->verbose) {
             printf("[D2FeatureTracker::trackLK] track %d LK points, %d lost, track rate %.1f%%\n", 
@@ -397,7 +586,6 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
             continue;
         }
         auto &lm = ret.second;
-        auto track = lmanager->at(cur_lk_ids[i]).track;
         lm.velocity = extractPointVelocity(lm);
         auto prev_found = getPreviousLandmarkFrame(lm);
         if (prev_found.first) {
@@ -418,7 +606,8 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
     std::vector<cv::Point2f> n_pts;
     if (!frame.raw_image.empty()) {
         TicToc t_det;
-        detectPoints(frame.raw_image, n_pts, cur_all_pts, params->total_feature_num, true, _config.lk_use_fast);
+        detectPoints(frame.raw_image, n_pts, cur_all_pts, params->total_feature_num, _config.enable_cuda, _config.lk_use_fast,
+            3, 4, &lk_info.grid, detect_threads);
         if (params->enable_perf_output) {
             printf("[D2FeatureTracker::trackLK] detect %ld points in %.2fms\n", n_pts.size(), t_det.toc());
         }
@@ -432,16 +621,24 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
             continue;
         }
         auto &lm = ret.second;
-        auto _id = lmanager->addLandmark(lm);
-        lm.landmark_id = _id;
+        LandmarkIdType _id;
+        if (pending.direct) {
+            _id = lmanager->addLandmark(lm);
+            lm.landmark_id = _id;
+        } else {
+            //The provisional id is replaced when the landmark is committed to the landmark manager
+            _id = pending.nextProvisionalId();
+            lm.landmark_id = _id;
+            pending.created.emplace_back(lm);
+        }
         frame.landmarks.emplace_back(lm);
         cur_lk_pts.emplace_back(pt);
         cur_lk_ids.emplace_back(_id);
     }
-    prev_lk_info[frame.camera_index].lk_pts = cur_lk_pts;
-    prev_lk_info[frame.camera_index].lk_ids = cur_lk_ids;
-    prev_lk_info[frame.camera_index].image  = frame.raw_image.clone();
-    prev_lk_info[frame.camera_index].frame_id = frame.frame_id;
+    lk_info.lk_pts = cur_lk_pts;
+    lk_info.lk_ids = cur_lk_ids;
+    lk_info.image  = frame.raw_image.clone();
+    lk_info.frame_id = frame.frame_id;
     return report;
 }
 
@@ -476,7 +673,11 @@ Vector3d D2FeatureTracker::extractPointVelocity(const LandmarkPerFrame & lpf) co
     return Vector3d(0, 0, 0);
 }
 
-TrackReport D2FeatureTracker::track(const VisualImageDesc & left_frame, VisualImageDesc & right_frame, bool enable_lk, TrackLRType type) {
+TrackReport D2FeatureTracker::track(const VisualImageDesc & left_frame, const VisualImageDesc & right_frame, PendingLandmarks & pending,
+        bool enable_lk, TrackLRType type) {
+    //right_frame may be read by other stereo tasks, the changes go to pending and pending.frame must be right_frame.
+    assert(pending.frame == &right_frame);
+    pending.camera_index = right_frame.camera_index;
     auto prev_pts = left_frame.landmarks2D();
     auto cur_pts = right_frame.landmarks2D();
     std::vector<int> ids_b_to_a;
@@ -495,31 +696,50 @@ TrackReport D2FeatureTracker::track(const VisualImageDesc & left_frame, VisualIm
             assert(ids_b_to_a[i] < left_frame.spLandmarkNum() && "too large");
             auto prev_index = ids_b_to_a[i];
             auto landmark_id = left_frame.landmarks[prev_index].landmark_id;
-            auto &cur_lm = right_frame.landmarks[i];
+            auto cur_lm = right_frame.landmarks[i];
             auto &prev_lm = left_frame.landmarks[prev_index];
             cur_lm.landmark_id = landmark_id;
             cur_lm.stamp_discover = prev_lm.stamp_discover;
             cur_lm.velocity = extractPointVelocity(cur_lm);
-            lmanager->updateLandmark(cur_lm);
+            if (pending.direct) {
+                lmanager->updateLandmark(cur_lm);
+                pending.frame->landmarks[i] = cur_lm;
+            } else {
+                pending.updated.emplace_back(cur_lm);
+                pending.matched.emplace_back(i, cur_lm);
+            }
             report.stereo_point_num ++;
         }
     }
     if (_config.enable_lk_optical_flow && enable_lk) {
-        trackLK(left_frame, right_frame, type);
+        trackLK(left_frame, right_frame, pending, type);
     }
     return report;
 }
 
-TrackReport D2FeatureTracker::trackLK(const VisualImageDesc & left_frame, VisualImageDesc & right_frame, TrackLRType type) {
+TrackReport D2FeatureTracker::trackLK(const VisualImageDesc & left_frame, const VisualImageDesc & right_frame, 
+        PendingLandmarks & pending, TrackLRType type) {
     //Track LK points
     //This function MUST run after track(...)
     TrackReport report;
-    auto cur_lk_pts = prev_lk_info[left_frame.camera_index].lk_pts;
-    auto cur_lk_ids = prev_lk_info[left_frame.camera_index].lk_ids;
-    auto cur_lk_pyr = prev_lk_info[left_frame.camera_index].pyr;
-    assert(left_frame.frame_id == prev_lk_info[left_frame.camera_index].frame_id);
+    const auto & left_lk_info = prev_lk_info.at(left_frame.camera_index);
+    auto cur_lk_pts = left_lk_info.lk_pts;
+    auto cur_lk_ids = left_lk_info.lk_ids;
+    assert(left_frame.frame_id == left_lk_info.frame_id);
     if (!cur_lk_ids.empty()) {
-        cur_lk_pts = opticalflowTrackPyr(right_frame.raw_image, cur_lk_pyr, cur_lk_pts, cur_lk_ids, type, false);
+        if (_config.enable_cuda) {
+            auto cur_lk_pyr = left_lk_info.pyr;
+            cur_lk_pts = opticalflowTrackPyr(right_frame.raw_image, cur_lk_pyr, cur_lk_pts, cur_lk_ids, type, false);
+        } else {
+            //Reuse the pyramid of right image if it has been built by its own temporal tracking.
+            std::vector<cv::Mat> right_pyr;
+            auto it = prev_lk_info.find(right_frame.camera_index);
+            if (it != prev_lk_info.end() && it->second.frame_id == right_frame.frame_id) {
+                right_pyr = it->second.cpu_pyr;
+            }
+            cur_lk_pts = opticalflowTrackPyr(right_frame.raw_image, left_lk_info.cpu_pyr, right_pyr,
+                cur_lk_pts, cur_lk_ids, type);
+        }
     }
     // printf("[trackLK] indices %d<->%d track type %d LK points: %lu\n", left_frame.camera_index, right_frame.camera_index, type, cur_lk_pts.size());
     for (int i = 0; i < cur_lk_pts.size(); i++) {
@@ -528,10 +748,18 @@ TrackReport D2FeatureTracker::trackLK(const VisualImageDesc & left_frame, Visual
             continue;
         }
         auto &lm = ret.second;
-        lm.stamp_discover = lmanager->at(cur_lk_ids[i]).stamp_discover;
+        if (cur_lk_ids[i] >= 0) {
+            //Otherwise the landmark is discovered in this frame, stamp_discover is the frame stamp already
+            lm.stamp_discover = lmanager->at(cur_lk_ids[i]).stamp_discover;
+        }
         lm.velocity = extractPointVelocity(lm);
-        lmanager->updateLandmark(lm);
-        right_frame.landmarks.emplace_back(lm);
+        if (pending.direct) {
+            lmanager->updateLandmark(lm);
+            pending.frame->landmarks.emplace_back(lm);
+        } else {
+            pending.updated.emplace_back(lm);
+            pending.appended.emplace_back(lm);
+        }
     }
     report.stereo_point_num = cur_lk_pts.size();
     return report;
@@ -881,10 +1109,7 @@ bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, co
         }
     }
     std::vector<cv::Point2f> matched_pts_a_normed, matched_pts_b_normed, matched_pts_a, matched_pts_b;
-    if (params->show) {
-        landmark_predictions_viz[img_desc_b.camera_id] = std::vector<cv::Point2f>();
-        landmark_predictions_matched_viz[img_desc_b.camera_id] = std::vector<cv::Point2f>();
-    }
+    std::vector<cv::Point2f> predictions_viz, predictions_matched_viz;
     for (auto match : _matches) {
         ids_a.push_back(match.queryIdx);
         ids_b.push_back(match.trainIdx);
@@ -893,12 +1118,18 @@ bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, co
         matched_pts_a.push_back(pts_a[match.queryIdx]);
         matched_pts_b.push_back(pts_b[match.trainIdx]);
         if (params->show && param.enable_prediction) {
-            landmark_predictions_viz[img_desc_b.camera_id].push_back(pts_pred_a_on_b[match.queryIdx]);
-            landmark_predictions_matched_viz[img_desc_b.camera_id].push_back(pts_b[match.trainIdx]);
+            predictions_viz.push_back(pts_pred_a_on_b[match.queryIdx]);
+            predictions_matched_viz.push_back(pts_b[match.trainIdx]);
             // printf("Point %d: (%f, %f) -> (%f, %f)\n", match.queryIdx, 
             //     pts_pred_a_on_b[match.queryIdx].x, pts_pred_a_on_b[match.queryIdx].y, pts_b[match.trainIdx].x, pts_b[match.trainIdx].y);
         }
     }
+    if (params->show) {
+        //Stereo tracking of different pairs may run concurrently
+        std::lock_guard<std::mutex> lock(predictions_viz_lock);
+        landmark_predictions_viz[img_desc_b.camera_id] = predictions_viz;
+        landmark_predictions_matched_viz[img_desc_b.camera_id] = predictions_matched_viz;
+    }
     if (img_desc_a.drone_id != img_desc_b.drone_id &&
             params->ftconfig->check_essential && !param.enable_superglue) {
         //only perform this for remote
@@ -110,8 +110,6 @@ void D2Frontend::processStereoframe(const StereoFrame & stereoframe) {
 
 void D2Frontend::addToLoopQueue(const VisualImageDescArray & viokf) {
     if (params->enable_loop) {
-        lock_guard guard(loop_lock);
-        Utility::TicToc tic;
         loop_queue.push(viokf);
     }
 }
@@ -166,20 +164,35 @@ void D2Frontend::processRemoteImage(VisualImageDescArray & frame_desc, bool succ
 
 
 void D2Frontend::loopDetectionThread() {
+    loop_queue.waitLatency().setName("loop_queue_wait");
+    VisualImageDescArray vframearry;
     while (ros::ok()) {
-        if (loop_queue.size() > 0) {
-            VisualImageDescArray vframearry;
-            {
-                lock_guard guard(loop_lock);
-                vframearry = loop_queue.front();
-                loop_queue.pop();
-            }
-            if (loop_queue.size() > 10) {
-                ROS_WARN("[D2Frontend] Loop queue size is %d", loop_queue.size());
-            }
-            loop_detector->processImageArray(vframearry);
+        //Wakes up on new keyframes, the timeout only checks ros::ok()
+        if (!loop_queue.pop(vframearry, 100)) {
+            loop_detector->processCallbacks();
+            continue;
+        }
+        if (loop_queue.size() > 10) {
+            ROS_WARN("[D2Frontend] Loop queue size is %d", loop_queue.size());
+        }
+        Utility::TicToc tic;
+        loop_detector->processImageArray(vframearry);
+        loop_latency.add(tic.toc());
+        if (params->enable_perf_output && loop_latency.size() % 100 == 0) {
+            printf("[D2Frontend] %s\n[D2Frontend] %s\n", loop_queue.waitLatency().toStr().c_str(), loop_latency.toStr().c_str());
+        }
+    }
+}
+
+void D2Frontend::remoteImageThread() {
+    remote_image_queue.waitLatency().setName("remote_image_queue_wait");
+    VisualImageDescArray frame_desc;
+    while (ros::ok()) {
+        //Wakes up on new remote frames, the timeout only checks ros::ok()
+        if (!remote_image_queue.pop(frame_desc, 100)) {
+            continue;
         }
-        usleep(10000);
+        onRemoteImage(frame_desc);
     }
 }
 
@@ -191,7 +204,7 @@ void D2Frontend::pubNodeFrame(const VisualImageDescArray & viokf) {
 void D2Frontend::onRemoteFrameROS(const swarm_msgs::ImageArrayDescriptor & remote_img_desc) {
     // ROS_INFO("Remote");
     if (received_image) {
-        this->onRemoteImage(remote_img_desc);
+        remote_image_queue.push(remote_img_desc);
     }
 }
 
@@ -223,7 +236,7 @@ void D2Frontend::Init(ros::NodeHandle & nh) {
             if (params->enable_pub_remote_frame) {
                 remote_image_desc_pub.publish(frame_desc.toROS());
             }
-            this->onRemoteImage(frame_desc);
+            remote_image_queue.push(frame_desc);
             this->pubNodeFrame(frame_desc);
         }
     };
@@ -273,6 +286,7 @@ void D2Frontend::Init(ros::NodeHandle & nh) {
 
     // loop_timer = nh.createTimer(ros::Duration(0.01), &D2Frontend::loopTimerCallback, this);
     th_loop_det = std::thread(&D2Frontend::loopDetectionThread, this);
+    th_remote_image = std::thread(&D2Frontend::remoteImageThread, this);
     th = std::thread([&] {
         while(0 == loop_net->lcmHandle()) {
         }
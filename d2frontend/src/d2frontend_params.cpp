@@ -93,6 +93,12 @@ namespace D2FrontEnd {
         ftconfig->check_essential = (int) fsSettings["check_essential"];
         ftconfig->enable_lk_optical_flow = (int) fsSettings["enable_lk_optical_flow"];
         ftconfig->lk_use_fast = (int) fsSettings["lk_use_fast"];
+        if (!fsSettings["enable_cuda"].empty()) {
+            ftconfig->enable_cuda = (int) fsSettings["enable_cuda"];
+        }
+        if (!fsSettings["enable_parallel_tracking"].empty()) {
+            ftconfig->enable_parallel_tracking = (int) fsSettings["enable_parallel_tracking"];
+        }
         ftconfig->remote_min_match_num = fsSettings["remote_min_match_num"];
         ftconfig->double_counting_common_feature = (int) fsSettings["double_counting_common_feature"];
         ftconfig->enable_superglue_local = (int) fsSettings["enable_superglue_local"];
@@ -106,7 +112,9 @@ namespace D2FrontEnd {
         nh.param<double>("new_feature_thres", ftconfig->new_feature_thres, 0.5);
         nh.param<int>("min_keyframe_num", ftconfig->min_keyframe_num, 2);
         nh.param<std::string>("superglue_model_path", ftconfig->superglue_model_path, "");
-        ftconfig->enable_search_local_aera_remote = (int) fsSettings["enable_search_local_aera_remote"];
+        if (!fsSettings["enable_search_local_aera_remote"].empty()) {
+            ftconfig->enable_search_local_aera_remote = (int) fsSettings["enable_search_local_aera_remote"];
+        }
         ftconfig->enable_motion_prediction_local = (int) fsSettings["enable_motion_prediction_local"];
         if (!fsSettings["enable_search_local_aera"].empty()) {
             ftconfig->enable_search_local_aera = (int) fsSettings["enable_search_local_aera"];
@@ -119,6 +127,18 @@ namespace D2FrontEnd {
         } else {
             printf("[D2FrontendParams] feature_min_dist not found, use default\n");
         }
+        if (!fsSettings["enable_guided_match"].empty()) {
+            enable_guided_match = (int) fsSettings["enable_guided_match"];
+        }
+        if (!fsSettings["enable_int8_match"].empty()) {
+            enable_int8_match = (int) fsSettings["enable_int8_match"];
+        }
+        if (!fsSettings["enable_prosac_pnp"].empty()) {
+            enable_prosac_pnp = (int) fsSettings["enable_prosac_pnp"];
+        }
+        if (!fsSettings["feature_budget_grid"].empty()) {
+            feature_budget_grid = fsSettings["feature_budget_grid"];
+        }
         //Loop detector
         loopdetectorconfig->enable_homography_test = (int) fsSettings["enable_homography_test"];
         loopdetectorconfig->accept_loop_max_yaw = (double) fsSettings["accept_loop_max_yaw"];
@@ -139,8 +159,29 @@ namespace D2FrontEnd {
         nh.param<double>("loop_cov_pos", loopdetectorconfig->loop_cov_pos, 0.013);
         nh.param<double>("loop_cov_ang", loopdetectorconfig->loop_cov_ang, 2.5e-04);
         nh.param<int>("min_direction_loop", loopdetectorconfig->MIN_DIRECTION_LOOP, 3);
+        nh.param<int>("loop_verify_threads", loopdetectorconfig->verify_threads, 2);
+        nh.param<int>("loop_verify_queue_size", loopdetectorconfig->verify_queue_size, 8);
+        nh.param<double>("loop_verify_max_age", loopdetectorconfig->verify_max_age, 2.0);
+        nh.param<std::string>("keyframe_store_path", loopdetectorconfig->keyframe_store_path, "");
+        nh.param<bool>("keyframe_store_warm_start", loopdetectorconfig->keyframe_store_warm_start, true);
+        nh.param<int>("keyframe_cache_size", loopdetectorconfig->keyframe_cache_size, 500);
+        nh.param<int>("keyframe_store_resident_mb", loopdetectorconfig->keyframe_store_resident_mb, 256);
         pgo_mode = static_cast<PGO_MODE>((int) fsSettings["pgo_mode"]);
         nh.param<std::string>("superglue_model_path", loopdetectorconfig->superglue_model_path, "");
+        if (!fsSettings["loop_index_type"].empty()) {
+            std::string index_type = (std::string) fsSettings["loop_index_type"];
+            if (index_type == "hnsw") {
+                loopdetectorconfig->index_type = LOOP_INDEX_HNSW;
+            } else if (index_type != "flat") {
+                printf("[D2FrontendParams] unknown loop_index_type %s, use flat\n", index_type.c_str());
+            }
+            if (!fsSettings["hnsw_m"].empty()) {
+                loopdetectorconfig->hnsw_m = fsSettings["hnsw_m"];
+            }
+            if (!fsSettings["hnsw_ef_search"].empty()) {
+                loopdetectorconfig->hnsw_ef_search = fsSettings["hnsw_ef_search"];
+            }
+        }
 
         //Network config
         nh.param<std::string>("lcm_uri", _lcm_uri, "udpm://224.0.0.251:7667?ttl=1");
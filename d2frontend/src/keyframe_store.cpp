@@ -0,0 +1,307 @@
+#include <d2frontend/keyframe_store.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+
+#define KEYFRAME_STORE_MAGIC 0x4432534b
+#define KEYFRAME_STORE_VERSION 1
+//Mappings grow by chunks, so appends rarely remap
+#define MAP_CHUNK (64ul*1024*1024)
+
+namespace D2FrontEnd {
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string & _path, bool truncate) {
+    close();
+    fd = ::open(_path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        printf("[KeyframeStore] Failed to open %s: %s\n", _path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    file_size = st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (base != nullptr) {
+        munmap(base, mapped);
+        base = nullptr;
+        mapped = 0;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool MappedFile::remap() {
+    if (base != nullptr) {
+        munmap(base, mapped);
+        base = nullptr;
+    }
+    mapped = (file_size / MAP_CHUNK + 1) * MAP_CHUNK;
+    //Pages beyond the end of file are never read
+    void * ptr = mmap(nullptr, mapped, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        printf("[KeyframeStore] mmap failed: %s\n", strerror(errno));
+        mapped = 0;
+        return false;
+    }
+    base = (char*) ptr;
+    return true;
+}
+
+bool MappedFile::append(const void * buf, size_t len) {
+    if (!write(file_size, buf, len)) {
+        return false;
+    }
+    file_size += len;
+    return true;
+}
+
+bool MappedFile::write(size_t offset, const void * buf, size_t len) {
+    const char * ptr = (const char*) buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, ptr, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("[KeyframeStore] write failed: %s\n", strerror(errno));
+            return false;
+        }
+        ptr += n;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool MappedFile::truncate(size_t len) {
+    if (ftruncate(fd, len) != 0) {
+        return false;
+    }
+    file_size = len;
+    return true;
+}
+
+const char * MappedFile::data() {
+    if (file_size == 0) {
+        return nullptr;
+    }
+    if (base == nullptr || file_size > mapped) {
+        remap();
+    }
+    return base;
+}
+
+void MappedFile::evict() {
+    if (base != nullptr) {
+        madvise(base, mapped, MADV_DONTNEED);
+    }
+}
+
+KeyframeStore::KeyframeStore(const std::string & _path, int _netvlad_dims, size_t _max_resident_bytes):
+    path(_path), netvlad_dims(_netvlad_dims), max_resident_bytes(_max_resident_bytes) {
+}
+
+bool KeyframeStore::open(bool warm_start) {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    mkdir(path.c_str(), 0755);
+    struct Meta {
+        uint32_t magic;
+        uint32_t version;
+        int32_t netvlad_dims;
+        int32_t session;
+    } meta = {KEYFRAME_STORE_MAGIC, KEYFRAME_STORE_VERSION, netvlad_dims, 0};
+    MappedFile meta_file;
+    if (!meta_file.open(path + "/meta", false)) {
+        return false;
+    }
+    if (warm_start && meta_file.size() == sizeof(Meta)) {
+        Meta old;
+        memcpy(&old, meta_file.data(), sizeof(Meta));
+        if (old.magic != meta.magic || old.version != meta.version || old.netvlad_dims != meta.netvlad_dims) {
+            printf("[KeyframeStore] %s is incompatible (dims %d), start from empty store\n", path.c_str(), old.netvlad_dims);
+            warm_start = false;
+        } else {
+            meta.session = old.session + 1;
+        }
+    } else {
+        warm_start = false;
+    }
+    session = meta.session;
+    meta_file.truncate(0);
+    meta_file.append(&meta, sizeof(Meta));
+    if (!log.open(path + "/frames.log", !warm_start) || !frame_idx.open(path + "/frames.idx", !warm_start) ||
+            !desc.open(path + "/netvlad.f32", !warm_start) || !desc_idx.open(path + "/netvlad.idx", !warm_start)) {
+        return false;
+    }
+    //Drop torn appends: records are written after their data.
+    size_t frame_num = frame_idx.size() / sizeof(FrameRecord);
+    while (frame_num > 0 && frameRecord(frame_num - 1).offset + frameRecord(frame_num - 1).size > log.size()) {
+        frame_num --;
+    }
+    frame_idx.truncate(frame_num * sizeof(FrameRecord));
+    log.truncate(frame_num > 0 ? frameRecord(frame_num - 1).offset + frameRecord(frame_num - 1).size : 0);
+    size_t desc_num = std::min(desc_idx.size() / sizeof(DescRecord), desc.size() / (netvlad_dims * sizeof(float)));
+    desc_idx.truncate(desc_num * sizeof(DescRecord));
+    desc.truncate(desc_num * netvlad_dims * sizeof(float));
+    frame_records.clear();
+    for (size_t i = 0; i < frame_num; i++) {
+        frame_records[storeFrameId(frameRecord(i).frame_id, frameRecord(i).session)] = i;
+    }
+    printf("[KeyframeStore] Open %s session %d with %ld keyframes %ld descriptors log %.1fMB\n", path.c_str(),
+        session, frame_num, desc_num, log.size()/1024.0/1024.0);
+    return true;
+}
+
+const KeyframeStore::FrameRecord & KeyframeStore::frameRecord(size_t i) {
+    return ((const FrameRecord*) frame_idx.data())[i];
+}
+
+void KeyframeStore::append(const VisualImageDescArray & frame) {
+    //Raw images are not stored, compressed images are kept if any
+    auto lcm = frame.toLCM(true, false, true);
+    std::vector<char> buf(lcm.getEncodedSize());
+    lcm.encode(buf.data(), 0, buf.size());
+    FrameRecord record;
+    record.frame_id = frame.frame_id;
+    record.drone_id = frame.drone_id;
+    record.session = session;
+    record.stamp = frame.stamp;
+    Eigen::Map<Eigen::Vector3d>(record.pose) = frame.pose_drone.pos();
+    auto q = frame.pose_drone.att();
+    record.pose[3] = q.w();
+    record.pose[4] = q.x();
+    record.pose[5] = q.y();
+    record.pose[6] = q.z();
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    record.offset = log.size();
+    record.size = buf.size();
+    if (log.append(buf.data(), buf.size()) && frame_idx.append(&record, sizeof(FrameRecord))) {
+        frame_records[frame.frame_id] = frame_idx.size() / sizeof(FrameRecord) - 1;
+    }
+}
+
+void KeyframeStore::appendDescriptor(FrameIdType frame_id, int dir, int drone_id, const float * netvlad) {
+    DescRecord record = {frame_id, dir, drone_id, session};
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    if (desc.append(netvlad, netvlad_dims * sizeof(float))) {
+        desc_idx.append(&record, sizeof(DescRecord));
+    }
+}
+
+void KeyframeStore::updatePose(FrameIdType frame_id, const Swarm::Pose & pose) {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    auto it = frame_records.find(frame_id);
+    if (it == frame_records.end()) {
+        return;
+    }
+    double buf[7];
+    Eigen::Map<Eigen::Vector3d>(buf) = pose.pos();
+    auto q = pose.att();
+    buf[3] = q.w();
+    buf[4] = q.x();
+    buf[5] = q.y();
+    buf[6] = q.z();
+    frame_idx.write(it->second * sizeof(FrameRecord) + offsetof(FrameRecord, pose), buf, sizeof(buf));
+}
+
+bool KeyframeStore::load(FrameIdType frame_id, VisualImageDescArray & frame) {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    auto it = frame_records.find(frame_id);
+    if (it == frame_records.end()) {
+        return false;
+    }
+    auto & record = frameRecord(it->second);
+    ImageArrayDescriptor_t lcm;
+    if (lcm.decode(log.data() + record.offset, 0, record.size) < 0) {
+        printf("[KeyframeStore] Failed to decode keyframe %ld\n", frame_id);
+        return false;
+    }
+    frame = VisualImageDescArray(lcm);
+    if (record.session != session) {
+        frame.frame_id = it->first;
+        for (auto & img : frame.images) {
+            img.frame_id = it->first;
+            for (auto & lm : img.landmarks) {
+                lm.frame_id = it->first;
+                lm.landmark_id = -1;
+            }
+        }
+    }
+    frame.pose_drone = Swarm::Pose(Eigen::Quaterniond(record.pose[3], record.pose[4], record.pose[5], record.pose[6]),
+        Eigen::Vector3d(record.pose[0], record.pose[1], record.pose[2]));
+    //Decoded frames are cached by the caller, the mapped pages are only needed once
+    resident_bytes += record.size;
+    if (resident_bytes > max_resident_bytes) {
+        log.evict();
+        resident_bytes = 0;
+    }
+    return true;
+}
+
+bool KeyframeStore::hasFrame(FrameIdType frame_id) {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    return frame_records.find(frame_id) != frame_records.end();
+}
+
+FrameIdType KeyframeStore::storeFrameId(FrameIdType frame_id, int _session) const {
+    if (_session == session) {
+        return frame_id;
+    }
+    return frame_id + ((FrameIdType)(_session + 1) << SESSION_ID_SHIFT);
+}
+
+bool KeyframeStore::isPreviousSession(FrameIdType frame_id) const {
+    return D2Common::isPreviousSessionFrame(frame_id);
+}
+
+int KeyframeStore::droneId(FrameIdType frame_id) {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    auto it = frame_records.find(frame_id);
+    if (it == frame_records.end()) {
+        return -1;
+    }
+    return frameRecord(it->second).drone_id;
+}
+
+size_t KeyframeStore::frameNum() {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    return frame_records.size();
+}
+
+size_t KeyframeStore::descriptorNum() {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    return desc_idx.size() / sizeof(DescRecord);
+}
+
+const float * KeyframeStore::descriptors() {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    return (const float*) desc.data();
+}
+
+const KeyframeStore::DescRecord * KeyframeStore::descriptorRecords() {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    return (const DescRecord*) desc_idx.data();
+}
+
+void KeyframeStore::evict() {
+    std::lock_guard<std::recursive_mutex> lock(store_mutex);
+    log.evict();
+    frame_idx.evict();
+    desc.evict();
+    desc_idx.evict();
+    resident_bytes = 0;
+}
+}
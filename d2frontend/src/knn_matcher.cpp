@@ -0,0 +1,213 @@
+#include <d2frontend/knn_matcher.h>
+#include <limits>
+#include <numeric>
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+//Rows of b in a tile are 64*256 bytes with superpoint descriptors, fits L1 cache.
+#define TILE_B 64
+#define TILE_A 16
+
+namespace D2FrontEnd {
+void QuantizedDescriptors::quantize(const cv::Mat & desc) {
+    assert(desc.type() == CV_32F && "descriptors must be float");
+    rows = desc.rows;
+    dims = desc.cols;
+    stride = (dims + 31) / 32 * 32;
+    data.assign(rows * stride, 0);
+    scales.resize(rows);
+    sqr_norms.resize(rows);
+    for (int i = 0; i < rows; i++) {
+        const float * src = desc.ptr<float>(i);
+        float max = 0, sqr_norm = 0;
+        for (int j = 0; j < dims; j++) {
+            max = std::max(max, std::abs(src[j]));
+            sqr_norm += src[j] * src[j];
+        }
+        sqr_norms[i] = sqr_norm;
+        if (max == 0) {
+            scales[i] = 0;
+            continue;
+        }
+        //Use 127 so that -128 never appears, which is required by the sign trick of the AVX2 kernel.
+        scales[i] = max / 127.0f;
+        float inv_scale = 127.0f / max;
+        int8_t * dst = data.data() + i * stride;
+        for (int j = 0; j < dims; j++) {
+            dst[j] = (int8_t) std::lround(src[j] * inv_scale);
+        }
+    }
+}
+
+int32_t dotInt8(const int8_t * a, const int8_t * b, int n) {
+#ifdef __AVX2__
+    //n is the padded stride, a multiple of 32.
+    __m256i acc = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int i = 0; i < n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        //maddubs takes unsigned x signed: move the sign of a to b.
+        __m256i abs_a = _mm256_sign_epi8(va, va);
+        __m256i sign_b = _mm256_sign_epi8(vb, va);
+        __m256i prod16 = _mm256_maddubs_epi16(abs_a, sign_b);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(prod16, ones));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += (int16_t) a[i] * (int16_t) b[i];
+    }
+    return sum;
+#endif
+}
+
+std::vector<cv::DMatch> matchKNNInt8(const QuantizedDescriptors & desc_a, const QuantizedDescriptors & desc_b, double knn_match_ratio) {
+    std::vector<cv::DMatch> good_matches;
+    if (desc_a.rows == 0 || desc_b.rows < 2 || desc_a.stride != desc_b.stride) {
+        return good_matches;
+    }
+    const float inf = std::numeric_limits<float>::max();
+    //Squared distances of the best two candidates of each query
+    std::vector<float> best_dist(desc_a.rows, inf), second_dist(desc_a.rows, inf);
+    std::vector<int> best_idx(desc_a.rows, -1);
+    for (int b0 = 0; b0 < desc_b.rows; b0 += TILE_B) {
+        int b1 = std::min(b0 + TILE_B, desc_b.rows);
+        for (int a0 = 0; a0 < desc_a.rows; a0 += TILE_A) {
+            int a1 = std::min(a0 + TILE_A, desc_a.rows);
+            for (int i = a0; i < a1; i++) {
+                const int8_t * qa = desc_a.row(i);
+                float & d1 = best_dist[i];
+                float & d2 = second_dist[i];
+                for (int j = b0; j < b1; j++) {
+                    float dot = dotInt8(qa, desc_b.row(j), desc_a.stride) * desc_a.scales[i] * desc_b.scales[j];
+                    float dist = desc_a.sqr_norms[i] + desc_b.sqr_norms[j] - 2 * dot;
+                    if (dist < d1) {
+                        d2 = d1;
+                        d1 = dist;
+                        best_idx[i] = j;
+                    } else if (dist < d2) {
+                        d2 = dist;
+                    }
+                }
+            }
+        }
+    }
+    //Ratio test on distances, i.e. d1 < ratio^2 * d2 on squared distances.
+    float ratio_sqr = knn_match_ratio * knn_match_ratio;
+    for (int i = 0; i < desc_a.rows; i++) {
+        float d1 = std::max(best_dist[i], 0.0f);
+        float d2 = std::max(second_dist[i], 0.0f);
+        if (best_idx[i] >= 0 && d1 < ratio_sqr * d2) {
+            good_matches.emplace_back(i, best_idx[i], std::sqrt(d1));
+        }
+    }
+    return good_matches;
+}
+
+PointHash2D::PointHash2D(const std::vector<cv::Point2f> & pts, float radius) {
+    inv_cell_size = 1.0f / radius;
+    cells.reserve(pts.size());
+    for (int i = 0; i < pts.size(); i++) {
+        int64_t cx, cy;
+        if (cellOf(pts[i], cx, cy)) {
+            cells[key(cx, cy)].push_back(i);
+        }
+    }
+}
+
+bool PointHash2D::cellOf(const cv::Point2f & pt, int64_t & cx, int64_t & cy) const {
+    //Predicted points may be invalid, e.g. behind the camera
+    float x = pt.x * inv_cell_size, y = pt.y * inv_cell_size;
+    if (!std::isfinite(x) || !std::isfinite(y) || std::abs(x) > 1e9 || std::abs(y) > 1e9) {
+        return false;
+    }
+    cx = (int64_t) std::floor(x);
+    cy = (int64_t) std::floor(y);
+    return true;
+}
+
+void PointHash2D::query(const cv::Point2f & pt, float radius, const std::vector<cv::Point2f> & pts, std::vector<int> & ret) const {
+    int64_t cx, cy;
+    if (!cellOf(pt, cx, cy)) {
+        return;
+    }
+    float radius_sqr = radius * radius;
+    //Radius larger than the cell size reaches further cells
+    int64_t r = std::max<int64_t>((int64_t) std::ceil(radius * inv_cell_size), 1);
+    for (int64_t i = cx - r; i <= cx + r; i++) {
+        for (int64_t j = cy - r; j <= cy + r; j++) {
+            auto it = cells.find(key(i, j));
+            if (it == cells.end()) {
+                continue;
+            }
+            for (auto idx : it->second) {
+                auto d = pts[idx] - pt;
+                if (d.dot(d) <= radius_sqr) {
+                    ret.push_back(idx);
+                }
+            }
+        }
+    }
+}
+
+std::vector<cv::DMatch> matchKNNGuided(const QuantizedDescriptors & desc_a, const QuantizedDescriptors & desc_b, double knn_match_ratio,
+        const std::vector<cv::Point2f> & pts_a, const std::vector<cv::Point2f> & pts_b, double radius) {
+    std::vector<cv::DMatch> good_matches;
+    if (desc_a.rows == 0 || desc_b.rows == 0 || desc_a.stride != desc_b.stride || radius <= 0) {
+        return good_matches;
+    }
+    PointHash2D hash(pts_b, radius);
+    float ratio_sqr = knn_match_ratio * knn_match_ratio;
+    std::vector<int> candidates, ring;
+    for (int i = 0; i < desc_a.rows; i++) {
+        candidates.clear();
+        hash.query(pts_a[i], radius, pts_b, candidates);
+        if (candidates.empty()) {
+            continue;
+        }
+        const int8_t * qa = desc_a.row(i);
+        auto sqr_dist = [&](int j) {
+            float dot = dotInt8(qa, desc_b.row(j), desc_a.stride) * desc_a.scales[i] * desc_b.scales[j];
+            return std::max(desc_a.sqr_norms[i] + desc_b.sqr_norms[j] - 2 * dot, 0.0f);
+        };
+        float d1 = std::numeric_limits<float>::max(), d2 = d1;
+        int best = -1;
+        for (auto j : candidates) {
+            float dist = sqr_dist(j);
+            if (dist < d1) {
+                d2 = d1;
+                d1 = dist;
+                best = j;
+            } else if (dist < d2) {
+                d2 = dist;
+            }
+        }
+        if (candidates.size() == 1) {
+            //The second best of a lone candidate comes from a ring of twice the radius,
+            //or from all of b as the global 2-NN when the ring is empty too.
+            ring.clear();
+            hash.query(pts_a[i], 2 * radius, pts_b, ring);
+            if (ring.size() < 2) {
+                ring.resize(desc_b.rows);
+                std::iota(ring.begin(), ring.end(), 0);
+            }
+            for (auto j : ring) {
+                if (j != best) {
+                    d2 = std::min(d2, sqr_dist(j));
+                }
+            }
+        }
+        if (d1 < ratio_sqr * d2) {
+            good_matches.emplace_back(i, best, std::sqrt(d1));
+        }
+    }
+    return good_matches;
+}
+}
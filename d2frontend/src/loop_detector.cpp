@@ -21,9 +21,25 @@ using namespace D2Common;
 
 namespace D2FrontEnd {
 
+//A loop candidate found by the NetVLAD query, waiting for geometric verification.
+struct LoopDetector::LoopCandidate {
+    int64_t seq = 0;
+    double enqueue_time = 0;
+    VisualImageDescArray frame_array_a; //From self drone, provides the 3d points
+    VisualImageDescArray frame_array_b;
+    int main_dir_a = 0;
+    int main_dir_b = 0;
+    bool solved = false;
+    LoopEdge ret;
+    Swarm::Pose DP_old_to_new;
+    std::vector<int> inliers;
+    std::vector<std::pair<int, int>> index2dirindex_a, index2dirindex_b;
+};
+
 void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
     //Lock frame_mutex with Guard
     std::lock_guard<std::recursive_mutex> guard(frame_mutex);
+    processCallbacks();
     TicToc tt;
     static double t_sum = 0;
     static int t_count = 0;
@@ -42,7 +58,10 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
         return;
     }
 
-    ego_motion_traj.push(ros::Time(image_array.stamp), image_array.pose_drone);
+    {
+        const std::lock_guard<std::mutex> lock(traj_mutex);
+        ego_motion_traj.push(ros::Time(image_array.stamp), image_array.pose_drone);
+    }
 
     int drone_id = image_array.drone_id;
     int images_num = image_array.images.size();
@@ -97,6 +116,7 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
                     break;
                 }
             }
+            const std::lock_guard<std::mutex> lock(cvimgs_mutex);
             msgid2cvimgs[image_array.frame_id] = imgs;
         }
 
@@ -110,21 +130,20 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
                 printf("[LoopDetector] frame %ld is matched to local frame %ld but not in db\n", image_array.frame_id, image_array.matched_frame);
             } else {
                 // printf("[LoopDetector] frame %ld is matched to local frame %ld in db\n", image_array.frame_id, image_array.matched_frame);
-                success = true;
-                const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-                _old_fisheye_img = keyframe_database.at(image_array.matched_frame);
+                success = getKeyframe(image_array.matched_frame, _old_fisheye_img);
                 camera_index = 0; //TODO: this is a hack
                 camera_index_old = 0;
                 if (is_lazy_frame) {
                     //In this case, it's a keyframe that has been broadcasted and should be recorded in database
                     printf("[LoopDetector] frame %ld is matched to local frame %ld in db and we find it in cache\n", 
                             image_array.frame_id, image_array.matched_frame);
-                    if (keyframe_database.find(image_array.frame_id) == keyframe_database.end()) {
+                    VisualImageDescArray cached_frame;
+                    if (!getKeyframe(image_array.frame_id, cached_frame)) {
                         ROS_WARN("[LoopDetector] Lazy frame %ld is matched to local frame %ld in db, but is not in cache", image_array.frame_id, image_array.matched_frame);
                         success = false;
                     } else {
                         printf("[LoopDetector] frame %ld is found in database\n", image_array.frame_id);
-                        image_array = keyframe_database.at(image_array.frame_id);
+                        image_array = cached_frame;
                     }
                 }
             }
@@ -146,16 +165,30 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
                 }
             } else {
                 printf("Compute loop connection %ld and %ld\n", image_array.frame_id, _old_fisheye_img.frame_id);
-                swarm_msgs::LoopEdge ret;
-                if (_old_fisheye_img.drone_id == self_id) {
-                    success = computeLoop(_old_fisheye_img, image_array, camera_index_old, camera_index, ret);
+                auto candidate = std::make_shared<LoopCandidate>();
+                //Keyframes of previous sessions have no landmarks in this session, they can only provide the 2d points.
+                bool old_from_previous_session = keyframe_store != nullptr && keyframe_store->isPreviousSession(_old_fisheye_img.frame_id);
+                if (_old_fisheye_img.drone_id == self_id && !old_from_previous_session) {
+                    candidate->frame_array_a = std::move(_old_fisheye_img);
+                    candidate->frame_array_b = image_array;
+                    candidate->main_dir_a = camera_index_old;
+                    candidate->main_dir_b = camera_index;
                 } else if (image_array.drone_id == self_id) {
-                    success = computeLoop(image_array, _old_fisheye_img, camera_index, camera_index_old, ret);
+                    candidate->frame_array_a = image_array;
+                    candidate->frame_array_b = std::move(_old_fisheye_img);
+                    candidate->main_dir_a = camera_index;
+                    candidate->main_dir_b = camera_index_old;
                 } else {
                     ROS_WARN("[LoopDetector%d] Will not compute loop, drone id is %d", self_id, image_array.drone_id);
+                    candidate = nullptr;
                 }
-                if (success) {
-                    onLoopConnection(ret);
+                if (candidate && _config.verify_threads > 0) {
+                    enqueueLoopCandidate(candidate);
+                } else if (candidate) {
+                    solveLoop(*candidate);
+                    if (acceptLoop(*candidate)) {
+                        onLoopConnection(candidate->ret);
+                    }
                 }
             }
         } else {
@@ -198,27 +231,34 @@ int LoopDetector::addImageArrayToDatabase(VisualImageDescArray & new_fisheye_des
                 index_to_frame_id[index] = new_fisheye_desc.frame_id;
                 imgid2dir[index] = i;
                 // ROS_INFO("[LoopDetector] Add keyframe from %d(dir %d) to local keyframe database index: %d", img_desc.drone_id, i, index);
+                if (keyframe_store != nullptr && img_desc.image_desc.size() == params->netvlad_dims) {
+                    keyframe_store->appendDescriptor(new_fisheye_desc.frame_id, i, img_desc.drone_id, img_desc.image_desc.data());
+                }
             }
             if (params->camera_configuration == CameraConfig::PINHOLE_DEPTH) {
                 break;
             }
-            const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
         }
     }
-    keyframe_database[new_fisheye_desc.frame_id] = new_fisheye_desc;
+    if (keyframe_store != nullptr) {
+        keyframe_store->append(new_fisheye_desc);
+    }
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    cacheKeyframe(new_fisheye_desc);
     printf("[LoopDetector] Add KF %ld with %d images from %d to local keyframe database. Total frames: %ld\n", 
-            new_fisheye_desc.frame_id, new_fisheye_desc.images.size(), new_fisheye_desc.drone_id, keyframe_database.size());
+            new_fisheye_desc.frame_id, new_fisheye_desc.images.size(), new_fisheye_desc.drone_id, 
+            keyframe_store != nullptr ? keyframe_store->frameNum() : keyframe_database.size());
     // new_fisheye_desc.printSize();
     return new_fisheye_desc.frame_id;
 }
 
 int LoopDetector::addImageDescToDatabase(VisualImageDesc & img_desc_a) {
     if (img_desc_a.drone_id == self_id) {
-        local_index.add(1, img_desc_a.image_desc.data());
-        return local_index.ntotal - 1;
+        local_index->add(1, img_desc_a.image_desc.data());
+        return local_index->ntotal - 1;
     } else {
-        remote_index.add(1, img_desc_a.image_desc.data());
-        return remote_index.ntotal - 1 + REMOTE_MAGIN_NUMBER;
+        remote_index->add(1, img_desc_a.image_desc.data());
+        return remote_index->ntotal - 1 + REMOTE_MAGIN_NUMBER;
     }
     return -1;
 }
@@ -230,8 +270,8 @@ int LoopDetector::queryFrameIndexFromDatabase(const VisualImageDesc & img_desc,
     if (img_desc.drone_id == self_id) {
         //Then this is self drone
         double similarity_local, similarity_remote;
-        int ret_remote = queryIndexFromDatabase(img_desc, remote_index, true, thres, _config.match_index_dist, similarity_remote);
-        int ret_local = queryIndexFromDatabase(img_desc, local_index, false, thres, _config.match_index_dist, similarity_local);
+        int ret_remote = queryIndexFromDatabase(img_desc, *remote_index, true, thres, _config.match_index_dist, similarity_remote);
+        int ret_local = queryIndexFromDatabase(img_desc, *local_index, false, thres, _config.match_index_dist, similarity_local);
         if (ret_remote >=0 && ret_local >= 0) {
             if (similarity_local > similarity_remote) {
                 similarity = similarity_local;
@@ -248,12 +288,12 @@ int LoopDetector::queryFrameIndexFromDatabase(const VisualImageDesc & img_desc,
             return ret_local;
         }
     } else {
-        ret = queryIndexFromDatabase(img_desc, local_index, false, thres, _config.match_index_dist_remote, similarity);
+        ret = queryIndexFromDatabase(img_desc, *local_index, false, thres, _config.match_index_dist_remote, similarity);
     }
     return ret;
 }
 
-int LoopDetector::queryIndexFromDatabase(const VisualImageDesc & img_desc, faiss::IndexFlatIP & index, bool remote_db, 
+int LoopDetector::queryIndexFromDatabase(const VisualImageDesc & img_desc, faiss::Index & index, bool remote_db, 
         double thres, int max_index, double & similarity) {
     float similiarity[1024] = {0};
     faiss::idx_t labels[1024];
@@ -282,8 +322,7 @@ int LoopDetector::queryIndexFromDatabase(const VisualImageDesc & img_desc, faiss
         }
         // int return_frame_id = index_to_frame_id.at(labels[i] + index_offset);
         return_frame_id = labels[i] + index_offset;
-        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-        return_drone_id = keyframe_database.at(index_to_frame_id.at(return_frame_id)).drone_id;
+        return_drone_id = keyframeDroneId(index_to_frame_id.at(return_frame_id));
         // ROS_INFO("Return Label %d/%d/%d from %d, distance %f/%f", labels[i] + index_offset, index.ntotal, index.ntotal - max_index , return_drone_id, similiarity[i], thres);
         if (labels[i] <= index.ntotal - max_index && similiarity[i] > thres) {
             //Is same id, max index make sense
@@ -325,13 +364,13 @@ bool LoopDetector::queryImageArrayFromDatabase(const VisualImageDescArray & img_
         }
 
         if (best_image_index != -1) {
-            const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-            int frame_id = index_to_frame_id[best_image_index];
+            FrameIdType frame_id = index_to_frame_id[best_image_index];
             camera_index_old = imgid2dir[best_image_index];
-            printf("[LoopDetector] Query image for %ld: ret frame_id %d index %d drone %d with camera %d similarity %f\n", 
-                img_desc_a.frame_id, frame_id, best_image_index, keyframe_database.at(frame_id).drone_id, camera_index_old, best_similarity);
-            ret = keyframe_database.at(frame_id);
-            return true;
+            if (getKeyframe(frame_id, ret)) {
+                printf("[LoopDetector] Query image for %ld: ret frame_id %ld index %d drone %d with camera %d similarity %f\n", 
+                    img_desc_a.frame_id, frame_id, best_image_index, ret.drone_id, camera_index_old, best_similarity);
+                return true;
+            }
         }
     }
 
@@ -342,7 +381,7 @@ bool LoopDetector::queryImageArrayFromDatabase(const VisualImageDescArray & img_
 
 
 int LoopDetector::databaseSize() const {
-    return local_index.ntotal + remote_index.ntotal;
+    return local_index->ntotal + remote_index->ntotal;
 }
 
 
@@ -351,9 +390,16 @@ bool LoopDetector::checkLoopOdometryConsistency(LoopEdge & loop_conn) const {
         //Is inter_loop, odometry consistency check is disabled.
         return true;
     }
+    if (isPreviousSessionFrame(loop_conn.keyframe_id_a) || isPreviousSessionFrame(loop_conn.keyframe_id_b)) {
+        //Cross-session loop, the ego motion of this session does not reach the keyframe of the previous session.
+        return true;
+    }
 
     Swarm::LoopEdge edge(loop_conn);
-    auto odom = ego_motion_traj.get_relative_pose_by_appro_ts(edge.ts_a, edge.ts_b);
+    auto odom = [&]() {
+        const std::lock_guard<std::mutex> lock(traj_mutex);
+        return ego_motion_traj.get_relative_pose_by_appro_ts(edge.ts_a, edge.ts_b);
+    }();
     Eigen::Matrix6d cov_vec = odom.second + edge.getCovariance();
     auto dp = Swarm::Pose::DeltaPose(edge.relative_pose, odom.first);
     auto md = Swarm::computeSquaredMahalanobisDistance(dp.log_map(), cov_vec);
@@ -372,7 +418,7 @@ bool LoopDetector::checkLoopOdometryConsistency(LoopEdge & loop_conn) const {
 //index2dirindex store the dir and the index of the point
 bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescArray & frame_array_a,
     const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b,
-    std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &cam_indices, std::vector<std::pair<int, int>> &index2dirindex_a,
+    std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &cam_indices, std::vector<float> &scores, std::vector<std::pair<int, int>> &index2dirindex_a,
     std::vector<std::pair<int, int>> &index2dirindex_b) {
     std::vector<int> dirs_a;
     std::vector<int> dirs_b;
@@ -410,10 +456,11 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
         std::vector<int> _idx_a;
         std::vector<int> _idx_b;
         std::vector<int> _camera_indices;
+        std::vector<float> _scores;
 
         if (dir_a < frame_array_a.images.size() && dir_b < frame_array_b.images.size() && dir_a >= 0 && dir_b >= 0) {
             bool succ = computeCorrespondFeatures(frame_array_a.images[dir_a],frame_array_b.images[dir_b],
-                _lm_pos_a, _idx_a, _lm_norm_3d_b, _idx_b, _camera_indices);
+                _lm_pos_a, _idx_a, _lm_norm_3d_b, _idx_b, _camera_indices, _scores);
             // ROS_INFO("[LoopDetector] computeCorrespondFeatures on camera_index %d:%d gives %d common features", dir_b, dir_a, _lm_pos_a.size());
             if (!succ) {
                 continue;
@@ -434,6 +481,7 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
         lm_pos_a.insert(lm_pos_a.end(), _lm_pos_a.begin(), _lm_pos_a.end());
         lm_norm_3d_b.insert(lm_norm_3d_b.end(), _lm_norm_3d_b.begin(), _lm_norm_3d_b.end());
         cam_indices.insert(cam_indices.end(), _camera_indices.begin(), _camera_indices.end());
+        scores.insert(scores.end(), _scores.begin(), _scores.end());
     }
 
     if(lm_norm_3d_b.size() > _config.loop_inlier_feature_num && matched_dir_count >= _config.MIN_DIRECTION_LOOP) {
@@ -448,7 +496,7 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
 
 bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a, const VisualImageDesc & img_desc_b, 
             std::vector<Vector3d> &lm_pos_a, std::vector<int> &idx_a, std::vector<Vector3d> &lm_norm_3d_b, 
-            std::vector<int> &idx_b, std::vector<int> &cam_indices) {
+            std::vector<int> &idx_b, std::vector<int> &cam_indices, std::vector<float> &scores) {
     std::vector<cv::DMatch> _matches;
     auto & _a_lms = img_desc_a.landmarks;
     auto & _b_lms = img_desc_b.landmarks;
@@ -499,6 +547,12 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
             lm_pos_a.push_back(landmark_db.at(landmark_id).position);
             lm_norm_3d_b.push_back(pt3d_norm_b);
             cam_indices.push_back(img_desc_b.camera_index);
+            //Matches with closer descriptors of stronger keypoints are sampled first by PROSAC
+            float score = 1.0f / (1.0f + match.distance);
+            if (index_a < img_desc_a.landmark_scores.size() && index_b < img_desc_b.landmark_scores.size()) {
+                score *= img_desc_a.landmark_scores[index_a] * img_desc_b.landmark_scores[index_b];
+            }
+            scores.push_back(score);
     }
 
     if (lm_b_2d.size() < 4) {
@@ -511,14 +565,18 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
         reduceVector(idx_b, mask);
         reduceVector(lm_pos_a, mask);
         reduceVector(lm_norm_3d_b, mask);
+        reduceVector(cam_indices, mask);
+        reduceVector(scores, mask);
     }
     return true;
 }
 
-//Require 3d points of frame a and 2d point of frame b
-bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const VisualImageDescArray & frame_array_b,
-    int main_dir_a, int main_dir_b, LoopEdge & ret) {
-
+bool LoopDetector::solveLoop(LoopCandidate & candidate) {
+    //May run on verification threads: only touch the candidate, the config and landmark_db (locked)
+    const auto & frame_array_a = candidate.frame_array_a;
+    const auto & frame_array_b = candidate.frame_array_b;
+    int main_dir_a = candidate.main_dir_a, main_dir_b = candidate.main_dir_b;
+    auto & ret = candidate.ret;
     if (frame_array_a.spLandmarkNum() < _config.loop_inlier_feature_num) {
         return false;
     }
@@ -526,8 +584,6 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
 
     assert(frame_array_a.drone_id == self_id && "frame_array_a must from self drone to provide more 2d points!");
 
-    bool success = false;
-
     double t_b = frame_array_b.stamp - t0;
     double t_a = frame_array_a.stamp - t0;
     printf("[LoopDetector::computeLoop@%d] Compute loop drone b %d(d%d,dir %d)->a %d(d%d,dir %d) t %.1f->%.1f(%.1f)s landmarks %d:%d.\n", 
@@ -536,14 +592,11 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
 
     std::vector<Vector3d> lm_pos_a;
     std::vector<Vector3d> lm_norm_3d_b;
-    std::vector<int> dirs_a;
-    Swarm::Pose DP_old_to_new;
-    std::vector<int> inliers;
     std::vector<int> camera_indices;
-    std::vector<std::pair<int, int>> index2dirindex_a, index2dirindex_b;
+    std::vector<float> scores;
     
-    success = computeCorrespondFeaturesOnImageArray(frame_array_a, frame_array_b, 
-        main_dir_a, main_dir_b, lm_pos_a, lm_norm_3d_b, camera_indices, index2dirindex_a, index2dirindex_b);
+    bool success = computeCorrespondFeaturesOnImageArray(frame_array_a, frame_array_b, 
+        main_dir_a, main_dir_b, lm_pos_a, lm_norm_3d_b, camera_indices, scores, candidate.index2dirindex_a, candidate.index2dirindex_b);
     
     if(success) {
         std::vector<Swarm::Pose> extrinsics;
@@ -551,14 +604,15 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
             extrinsics.push_back(img.extrinsic);
         }
         success = computeRelativePosePnPnonCentral(lm_pos_a, lm_norm_3d_b,
-                extrinsics, camera_indices, frame_array_a.pose_drone, frame_array_b.pose_drone, DP_old_to_new, inliers, _config.is_4dof);
+                extrinsics, camera_indices, frame_array_a.pose_drone, frame_array_b.pose_drone, candidate.DP_old_to_new, 
+                candidate.inliers, _config.is_4dof, true, scores);
         if (!success) {
             printf("[LoopDetector::computeLoop@%d] Compute relative pose failed!\n", self_id);
             return false;
         }
 
         //setup return loop
-        ret.relative_pose = DP_old_to_new.toROS();
+        ret.relative_pose = candidate.DP_old_to_new.toROS();
         ret.drone_id_a = frame_array_b.drone_id;
         ret.ts_a = ros::Time(frame_array_b.stamp);
 
@@ -579,32 +633,137 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
         ret.ang_cov.y = _config.loop_cov_ang;
         ret.ang_cov.z = _config.loop_cov_ang;
 
-        ret.pnp_inlier_num = inliers.size();
-        ret.id = self_id*MAX_LOOP_ID + loop_count;
-
-        if (checkLoopOdometryConsistency(ret)) {
-            loop_count ++;
-            printf("[LoopDetector] Loop %ld Detected %d->%d dt %3.3fs DPose %s inliers %d. Will publish\n",
-                ret.id, ret.drone_id_a, ret.drone_id_b, (ret.ts_b - ret.ts_a).toSec(),
-                DP_old_to_new.toStr().c_str(), ret.pnp_inlier_num);
+        ret.pnp_inlier_num = candidate.inliers.size();
+        candidate.solved = true;
+    } else if (params->show) {
+        drawCandidate(candidate, false);
+    }
+    return success;
+}
 
-            int new_d_id = frame_array_a.drone_id;
-            int old_d_id = frame_array_b.drone_id;
-            inter_drone_loop_count[new_d_id][old_d_id] = inter_drone_loop_count[new_d_id][old_d_id] +1;
-            inter_drone_loop_count[old_d_id][new_d_id] = inter_drone_loop_count[old_d_id][new_d_id] +1;
-        } else {
-            success = false;
-            printf("[LoopDetector] Loop not consistency with odometry, give up.\n");
-        }
+bool LoopDetector::acceptLoop(LoopCandidate & candidate) {
+    //Called in the order of candidates, the loop ids follow this order.
+    if (!candidate.solved) {
+        return false;
+    }
+    auto & ret = candidate.ret;
+    bool success = true;
+    ret.id = self_id*MAX_LOOP_ID + loop_count;
+    if (checkLoopOdometryConsistency(ret)) {
+        loop_count ++;
+        printf("[LoopDetector] Loop %ld Detected %d->%d dt %3.3fs DPose %s inliers %d. Will publish\n",
+            ret.id, ret.drone_id_a, ret.drone_id_b, (ret.ts_b - ret.ts_a).toSec(),
+            candidate.DP_old_to_new.toStr().c_str(), ret.pnp_inlier_num);
+
+        int new_d_id = candidate.frame_array_a.drone_id;
+        int old_d_id = candidate.frame_array_b.drone_id;
+        inter_drone_loop_count[new_d_id][old_d_id] = inter_drone_loop_count[new_d_id][old_d_id] +1;
+        inter_drone_loop_count[old_d_id][new_d_id] = inter_drone_loop_count[old_d_id][new_d_id] +1;
+    } else {
+        success = false;
+        printf("[LoopDetector] Loop not consistency with odometry, give up.\n");
     }
 
     if (params->show) {
-        drawMatched(frame_array_a, frame_array_b, main_dir_a, main_dir_b, success, inliers, DP_old_to_new, index2dirindex_a, index2dirindex_b);
+        drawCandidate(candidate, success);
     }
 
     return success;
 }
 
+void LoopDetector::enqueueLoopCandidate(std::shared_ptr<LoopCandidate> candidate) {
+    std::shared_ptr<LoopCandidate> dropped;
+    {
+        std::lock_guard<std::mutex> lock(verify_queue_mutex);
+        candidate->seq = verify_seq ++;
+        candidate->enqueue_time = ros::WallTime::now().toSec();
+        if (verify_queue.size() >= _config.verify_queue_size) {
+            dropped = verify_queue.front();
+            verify_queue.pop_front();
+        }
+        verify_queue.push_back(candidate);
+    }
+    verify_cond.notify_one();
+    if (dropped) {
+        ROS_WARN("[LoopDetector@%d] Verification queue full, drop candidate %ld<->%ld", self_id, 
+            dropped->frame_array_a.frame_id, dropped->frame_array_b.frame_id);
+        finishLoopCandidate(dropped, false);
+    }
+}
+
+void LoopDetector::verifyThread() {
+    while (true) {
+        std::shared_ptr<LoopCandidate> candidate;
+        {
+            std::unique_lock<std::mutex> lock(verify_queue_mutex);
+            verify_cond.wait(lock, [&] { return verify_stop || !verify_queue.empty(); });
+            if (verify_stop) {
+                return;
+            }
+            candidate = verify_queue.front();
+            verify_queue.pop_front();
+        }
+        double age = ros::WallTime::now().toSec() - candidate->enqueue_time;
+        if (age > _config.verify_max_age) {
+            ROS_WARN("[LoopDetector@%d] Drop stale candidate %ld<->%ld waited %.1fs", self_id, 
+                candidate->frame_array_a.frame_id, candidate->frame_array_b.frame_id, age);
+            finishLoopCandidate(candidate, false);
+            continue;
+        }
+        solveLoop(*candidate);
+        finishLoopCandidate(candidate, true);
+    }
+}
+
+void LoopDetector::finishLoopCandidate(std::shared_ptr<LoopCandidate> candidate, bool verified) {
+    //Emit the results in the order of candidates, so on_loop_cb sees the same order as synchronous verification.
+    std::lock_guard<std::mutex> lock(emit_mutex);
+    if (!verified) {
+        candidate->solved = false;
+    }
+    verified_candidates[candidate->seq] = candidate;
+    while (!verified_candidates.empty() && verified_candidates.begin()->first == emit_seq) {
+        auto it = verified_candidates.begin();
+        if (acceptLoop(*it->second)) {
+            LoopEdge ret = it->second->ret;
+            runOnCallerThread([this, ret] () mutable {
+                onLoopConnection(ret);
+            });
+        }
+        verified_candidates.erase(it);
+        emit_seq ++;
+    }
+}
+
+void LoopDetector::runOnCallerThread(std::function<void()> task) {
+    if (_config.verify_threads <= 0) {
+        task();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(caller_tasks_mutex);
+    caller_tasks.emplace_back(std::move(task));
+}
+
+void LoopDetector::processCallbacks() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(caller_tasks_mutex);
+        tasks.swap(caller_tasks);
+    }
+    for (auto & task : tasks) {
+        task();
+    }
+}
+
+void LoopDetector::drawCandidate(const LoopCandidate & candidate, bool success) {
+    //HighGUI is not thread safe, the verification threads only queue the drawing
+    auto _candidate = std::make_shared<LoopCandidate>(candidate);
+    runOnCallerThread([this, _candidate, success] {
+        drawMatched(_candidate->frame_array_a, _candidate->frame_array_b, _candidate->main_dir_a, _candidate->main_dir_b, success, 
+            _candidate->inliers, _candidate->DP_old_to_new, _candidate->index2dirindex_a, _candidate->index2dirindex_b);
+    });
+}
+
 void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a, 
             const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b, 
             bool success, std::vector<int> inliers, Swarm::Pose DP_b_to_a,
@@ -613,8 +772,12 @@ void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a,
     cv::Mat show;
     char title[100] = {0};
     std::vector<cv::Mat> _matched_imgs;
-    auto & imgs_a = msgid2cvimgs[frame_array_a.frame_id];
-    auto & imgs_b = msgid2cvimgs[frame_array_b.frame_id];
+    std::vector<cv::Mat> imgs_a, imgs_b;
+    {
+        const std::lock_guard<std::mutex> lock(cvimgs_mutex);
+        imgs_a = msgid2cvimgs[frame_array_a.frame_id];
+        imgs_b = msgid2cvimgs[frame_array_b.frame_id];
+    }
     _matched_imgs.resize(imgs_b.size());
     for (size_t i = 0; i < imgs_b.size(); i ++) {
         int dir_a = ((-main_dir_b + main_dir_a + _config.MAX_DIRS) % _config.MAX_DIRS + i)% _config.MAX_DIRS;
@@ -716,23 +879,141 @@ void LoopDetector::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
         if (keyframe_database.find(frame_id) != keyframe_database.end()) {
             keyframe_database.at(frame_id).pose_drone = frame->odom.pose();
         }
+        if (keyframe_store != nullptr) {
+            keyframe_store->updatePose(frame_id, frame->odom.pose());
+        }
+    }
+}
+
+faiss::Index * createLoopIndex(const LoopDetectorConfig & config, int dims) {
+    if (config.index_type == LOOP_INDEX_HNSW) {
+        auto index = new faiss::IndexHNSWFlat(dims, config.hnsw_m, faiss::METRIC_INNER_PRODUCT);
+        index->hnsw.efConstruction = config.hnsw_ef_construction;
+        //queryIndexFromDatabase asks for up to SEARCH_NEAREST_NUM + match_index_dist neighbours, efSearch must cover them.
+        index->hnsw.efSearch = std::max({config.hnsw_ef_search, SEARCH_NEAREST_NUM + config.match_index_dist,
+            SEARCH_NEAREST_NUM + config.match_index_dist_remote});
+        return index;
     }
+    return new faiss::IndexFlatIP(dims);
 }
 
 bool LoopDetector::hasFrame(FrameIdType frame_id) {
     const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-    return keyframe_database.find(frame_id) != keyframe_database.end();
+    if (keyframe_database.find(frame_id) != keyframe_database.end()) {
+        return true;
+    }
+    return keyframe_store != nullptr && keyframe_store->hasFrame(frame_id);
+}
+
+bool LoopDetector::getKeyframe(FrameIdType frame_id, VisualImageDescArray & frame) {
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    auto it = keyframe_database.find(frame_id);
+    if (it != keyframe_database.end()) {
+        frame = it->second;
+        return true;
+    }
+    if (keyframe_store != nullptr && keyframe_store->load(frame_id, frame)) {
+        cacheKeyframe(frame);
+        return true;
+    }
+    return false;
+}
+
+int LoopDetector::keyframeDroneId(FrameIdType frame_id) {
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    auto it = keyframe_database.find(frame_id);
+    if (it != keyframe_database.end()) {
+        return it->second.drone_id;
+    }
+    if (keyframe_store != nullptr) {
+        return keyframe_store->droneId(frame_id);
+    }
+    return -1;
+}
+
+void LoopDetector::cacheKeyframe(const VisualImageDescArray & frame) {
+    if (keyframe_store == nullptr || _config.keyframe_cache_size <= 0) {
+        keyframe_database[frame.frame_id] = frame;
+        return;
+    }
+    if (keyframe_database.find(frame.frame_id) == keyframe_database.end()) {
+        keyframe_cache_order.push_back(frame.frame_id);
+    }
+    keyframe_database[frame.frame_id] = frame;
+    //Evicted keyframes are read back from the store when needed
+    while (keyframe_database.size() > _config.keyframe_cache_size) {
+        keyframe_database.erase(keyframe_cache_order.front());
+        keyframe_cache_order.pop_front();
+    }
+}
+
+void LoopDetector::warmStart() {
+    TicToc tic;
+    size_t num = keyframe_store->descriptorNum();
+    const float * descs = keyframe_store->descriptors();
+    auto records = keyframe_store->descriptorRecords();
+    int dims = params->netvlad_dims;
+    //Rows are added to the faiss indices in runs straight from the mapped column, without copying.
+    size_t start = 0;
+    while (start < num) {
+        bool remote = records[start].drone_id != self_id;
+        size_t end = start;
+        while (end < num && (records[end].drone_id != self_id) == remote) {
+            FrameIdType frame_id = keyframe_store->storeFrameId(records[end].frame_id, records[end].session);
+            int index = remote ? remote_index->ntotal + (end - start) + REMOTE_MAGIN_NUMBER : local_index->ntotal + (end - start);
+            index_to_frame_id[index] = frame_id;
+            imgid2dir[index] = records[end].dir;
+            end ++;
+        }
+        auto index = remote ? remote_index : local_index;
+        index->add(end - start, descs + start * dims);
+        start = end;
+    }
+    //The descriptors are now held by the indices
+    keyframe_store->evict();
+    printf("[LoopDetector@%d] Warm start %ld keyframes %ld descriptors (local %ld remote %ld) in %.1fms\n", self_id, 
+        keyframe_store->frameNum(), num, local_index->ntotal, remote_index->ntotal, tic.toc());
 }
 
 LoopDetector::LoopDetector(int _self_id, const LoopDetectorConfig & config):
         self_id(_self_id),
         _config(config),
-        local_index(params->netvlad_dims), 
-        remote_index(params->netvlad_dims), 
     ego_motion_traj(_self_id, true, _config.pos_covariance_per_meter, _config.yaw_covariance_per_meter) {
+    local_index = createLoopIndex(_config, params->netvlad_dims);
+    remote_index = createLoopIndex(_config, params->netvlad_dims);
     if (_config.enable_superglue) {
         superglue = new SuperGlueOnnx(_config.superglue_model_path);
     }
+    if (!_config.keyframe_store_path.empty()) {
+        keyframe_store = new KeyframeStore(_config.keyframe_store_path, params->netvlad_dims, 
+            (size_t)_config.keyframe_store_resident_mb*1024*1024);
+        if (!keyframe_store->open(_config.keyframe_store_warm_start)) {
+            ROS_WARN("[LoopDetector@%d] Failed to open keyframe store %s, keep keyframes in memory", self_id, _config.keyframe_store_path.c_str());
+            delete keyframe_store;
+            keyframe_store = nullptr;
+        } else {
+            warmStart();
+        }
+    }
+    for (int i = 0; i < _config.verify_threads; i++) {
+        verify_threads.emplace_back(&LoopDetector::verifyThread, this);
+    }
+}
+
+LoopDetector::~LoopDetector() {
+    {
+        std::lock_guard<std::mutex> lock(verify_queue_mutex);
+        verify_stop = true;
+    }
+    verify_cond.notify_all();
+    for (auto & th : verify_threads) {
+        th.join();
+    }
+    if (keyframe_store != nullptr) {
+        delete keyframe_store;
+    }
+    delete local_index;
+    delete remote_index;
 }
 
 }
\ No newline at end of file
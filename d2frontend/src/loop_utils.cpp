@@ -1,7 +1,12 @@
 #include <d2frontend/utils.h>
+#include <d2frontend/knn_matcher.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/eigen.hpp>
 #include <fstream>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <random>
 #include <d2common/d2basetypes.h>
 #include <d2common/utils.hpp>
 #include <d2frontend/d2frontend_params.h>
@@ -25,8 +30,6 @@ using D2Common::Utility::TicToc;
 
 namespace D2FrontEnd {
 
-std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows);
-
 cv::Mat getImageFromMsg(const sensor_msgs::CompressedImageConstPtr &img_msg, int flag) {
     return cv::imdecode(img_msg->data, flag);
 }
@@ -221,11 +224,27 @@ std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b,
         const std::vector<cv::Point2f> pts_a,
         const std::vector<cv::Point2f> pts_b,
         double search_local_dist) {
+    std::vector<cv::DMatch> good_matches;
+    if (params->enable_guided_match && params->enable_int8_match && search_local_dist > 0) {
+        //Only keypoints within search_local_dist are compared, so no filtering afterwards.
+        //The guided matcher works on the int8 descriptors, without enable_int8_match the float path below is used.
+        return matchKNNGuided(QuantizedDescriptors(desc_a), QuantizedDescriptors(desc_b), knn_match_ratio,
+            pts_a, pts_b, search_local_dist);
+    }
+    if (params->enable_int8_match) {
+        auto matches = matchKNNInt8(QuantizedDescriptors(desc_a), QuantizedDescriptors(desc_b), knn_match_ratio);
+        for (auto & match : matches) {
+            if (search_local_dist > 0 && cv::norm(pts_a[match.queryIdx] - pts_b[match.trainIdx]) > search_local_dist) {
+                continue;
+            }
+            good_matches.push_back(match);
+        }
+        return good_matches;
+    }
     //Match descriptors with OpenCV knnMatch
     std::vector<std::vector<cv::DMatch>> matches;
     cv::BFMatcher bfmatcher(cv::NORM_L2);
     bfmatcher.knnMatch(desc_a, desc_b, matches, 2);
-    std::vector<cv::DMatch> good_matches;
     for (auto & match : matches) {
         if (match.size() < 2) {
             continue;
@@ -355,6 +374,74 @@ std::vector<cv::Point2f> opticalflowTrack(const cv::Mat & cur_img, const cv::Mat
     return cur_pts;
 } 
 
+//Initial guess of the tracked points on cur_img. For left-right tracking on the undistorted quadcam images,
+//points which can not appear in the other half of the image are removed from prev_pts and ids.
+std::vector<cv::Point2f> initialTrackPoints(int cols, std::vector<cv::Point2f> & prev_pts, 
+        std::vector<LandmarkIdType> & ids, TrackLRType type, float move_cols) {
+    if (type == WHOLE_IMG_MATCH) {
+        return prev_pts;
+    }
+    std::vector<cv::Point2f> cur_pts;
+    std::vector<uchar> status(prev_pts.size(), 0);
+    for (unsigned int i = 0; i < prev_pts.size(); i++) {
+        auto pt = prev_pts[i];
+        if (type == LEFT_RIGHT_IMG_MATCH && pt.x < cols - move_cols) {
+            pt.x += move_cols;
+            status[i] = 1;
+            cur_pts.push_back(pt);
+        } else if (type == RIGHT_LEFT_IMG_MATCH && pt.x >= move_cols) {
+            pt.x -= move_cols;
+            status[i] = 1;
+            cur_pts.push_back(pt);
+        }
+    }
+    reduceVector(prev_pts, status);
+    reduceVector(ids, status);
+    return cur_pts;
+}
+
+//Initial guess of the backward track, i.e. the tracked points shifted back for left-right tracking.
+std::vector<cv::Point2f> initialReversePoints(const std::vector<cv::Point2f> & cur_pts, const std::vector<uchar> & status, 
+        TrackLRType type, float move_cols) {
+    std::vector<cv::Point2f> reverse_pts = cur_pts;
+    for (unsigned int i = 0; i < reverse_pts.size(); i++) {
+        auto & pt = reverse_pts[i];
+        if (type == LEFT_RIGHT_IMG_MATCH && status[i] == 1) {
+            pt.x -= move_cols;
+        }
+        if (type == RIGHT_LEFT_IMG_MATCH && status[i] == 1) {
+            pt.x += move_cols;
+        }
+    }
+    return reverse_pts;
+}
+
+//Forward-backward consistency (0.5 pixel) and border check.
+//The loop is written branch free on the raw floats so the compiler can vectorize it (AVX2/NEON).
+void checkForwardBackward(std::vector<uchar> & status, const std::vector<uchar> & reverse_status, 
+        const std::vector<cv::Point2f> & prev_pts, const std::vector<cv::Point2f> & reverse_pts,
+        const std::vector<cv::Point2f> & cur_pts, cv::Size shape) {
+    const int BORDER_SIZE = 1;
+    //Same as inBorder with cvRound
+    const float min_x = BORDER_SIZE - 0.5f, max_x = shape.width - BORDER_SIZE - 0.5f;
+    const float min_y = BORDER_SIZE - 0.5f, max_y = shape.height - BORDER_SIZE - 0.5f;
+    const float * prev = reinterpret_cast<const float *>(prev_pts.data());
+    const float * reverse = reinterpret_cast<const float *>(reverse_pts.data());
+    const float * cur = reinterpret_cast<const float *>(cur_pts.data());
+    const uchar * rs = reverse_status.data();
+    uchar * st = status.data();
+    const size_t num = status.size();
+    for (size_t i = 0; i < num; i++) {
+        float dx = prev[2*i] - reverse[2*i];
+        float dy = prev[2*i + 1] - reverse[2*i + 1];
+        float x = cur[2*i];
+        float y = cur[2*i + 1];
+        bool good = (st[i] != 0) & (rs[i] != 0) & (dx*dx + dy*dy <= 0.25f) & 
+            (x >= min_x) & (x < max_x) & (y >= min_y) & (y < max_y);
+        st[i] = good;
+    }
+}
+
 std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vector<cv::cuda::GpuMat> & prev_pyr, 
         std::vector<cv::Point2f> & prev_pts, std::vector<LandmarkIdType> & ids, TrackLRType type, bool update_pyr) {
     if (prev_pts.size() == 0) {
@@ -362,45 +449,11 @@ std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vecto
     }
     TicToc tic;
     std::vector<uchar> status;
-    std::vector<cv::Point2f> cur_pts;
     float move_cols = cur_img.cols*90.0/params->undistort_fov; //slightly lower than 0.5 cols when fov=200
-
-    if (prev_pts.size() == 0) {
-        return std::vector<cv::Point2f>();
-    }
-
-    if (type == WHOLE_IMG_MATCH) {
-        cur_pts = prev_pts;
-    } else  {
-        status.resize(prev_pts.size());
-        std::fill(status.begin(), status.end(), 0);
-        if (type == LEFT_RIGHT_IMG_MATCH) {
-            for (unsigned int i = 0; i < prev_pts.size(); i++) {
-                auto pt = prev_pts[i];
-                if (pt.x < cur_img.cols - move_cols) {
-                    pt.x += move_cols;
-                    status[i] = 1;
-                    cur_pts.push_back(pt);
-                }
-            }
-        } else {
-            for (unsigned int i = 0; i < prev_pts.size(); i++) {
-                auto pt = prev_pts[i];
-                if (pt.x >= move_cols) {
-                    pt.x -= move_cols;
-                    status[i] = 1;
-                    cur_pts.push_back(pt);
-                }
-            }
-        }
-        reduceVector(prev_pts, status);
-        reduceVector(ids, status);
-    }
-    status.resize(0);
+    auto cur_pts = initialTrackPoints(cur_img.cols, prev_pts, ids, type, move_cols);
     if (cur_pts.size() == 0) {
         return std::vector<cv::Point2f>();
     }
-    std::vector<float> err;
     std::vector<uchar> reverse_status;
     std::vector<cv::Point2f> reverse_pts;
 
@@ -414,36 +467,13 @@ std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vecto
     d_pyrLK_sparse->calc(prev_pyr, cur_pyr, gpu_prev_pts, gpu_cur_pts, gpu_status);
     gpu_status.download(status);
     gpu_cur_pts.download(cur_pts);
-    reverse_pts = cur_pts;
-    for (unsigned int i = 0; i < prev_pts.size(); i++) {
-        auto & pt = reverse_pts[i];
-        if (type == LEFT_RIGHT_IMG_MATCH && status[i] == 1) {
-            pt.x -= move_cols;
-        }
-        if (type == RIGHT_LEFT_IMG_MATCH && status[i] == 1) {
-            pt.x += move_cols;
-        }
-    }
+    reverse_pts = initialReversePoints(cur_pts, status, type, move_cols);
     cv::cuda::GpuMat reverse_gpu_pts(reverse_pts);
     d_pyrLK_sparse->calc(cur_pyr, prev_pyr, gpu_cur_pts, reverse_gpu_pts, reverse_gpu_status);
     reverse_gpu_pts.download(reverse_pts);
     reverse_gpu_status.download(reverse_status);
 
-    for(size_t i = 0; i < status.size(); i++)
-    {
-        if(status[i] && reverse_status[i] && cv::norm(prev_pts[i] - reverse_pts[i]) <= 0.5)
-        {
-            status[i] = 1;
-        }
-        else
-            status[i] = 0;
-    }
-
-    for (int i = 0; i < int(cur_pts.size()); i++){
-        if (status[i] && !inBorder(cur_pts[i], cur_img.size())) {
-            status[i] = 0;
-        }
-    }   
+    checkForwardBackward(status, reverse_status, prev_pts, reverse_pts, cur_pts, cur_img.size());
     reduceVector(prev_pts, status);
     reduceVector(cur_pts, status);
     reduceVector(ids, status);
@@ -453,9 +483,102 @@ std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vecto
     return cur_pts;
 } 
 
+std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, const std::vector<cv::Mat> & prev_pyr, std::vector<cv::Mat> & cur_pyr,
+        std::vector<cv::Point2f> & prev_pts, std::vector<LandmarkIdType> & ids, TrackLRType type) {
+    if (cur_pyr.empty()) {
+        cur_pyr = buildImagePyramid(cur_img);
+    }
+    if (prev_pts.size() == 0 || prev_pyr.empty()) {
+        return std::vector<cv::Point2f>();
+    }
+    std::vector<uchar> status, reverse_status;
+    std::vector<float> err;
+    float move_cols = cur_img.cols*90.0/params->undistort_fov; //slightly lower than 0.5 cols when fov=200
+    auto cur_pts = initialTrackPoints(cur_img.cols, prev_pts, ids, type, move_cols);
+    if (cur_pts.size() == 0) {
+        return std::vector<cv::Point2f>();
+    }
+    //Both pyramids carry their gradients, so no image is filtered here.
+    auto criteria = cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 30, 0.01);
+    cv::calcOpticalFlowPyrLK(prev_pyr, cur_pyr, prev_pts, cur_pts, status, err, WIN_SIZE, PYR_LEVEL, 
+            criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+    auto reverse_pts = initialReversePoints(cur_pts, status, type, move_cols);
+    cv::calcOpticalFlowPyrLK(cur_pyr, prev_pyr, cur_pts, reverse_pts, reverse_status, err, WIN_SIZE, PYR_LEVEL, 
+            criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+
+    checkForwardBackward(status, reverse_status, prev_pts, reverse_pts, cur_pts, cur_img.size());
+    reduceVector(prev_pts, status);
+    reduceVector(cur_pts, status);
+    reduceVector(ids, status);
+    return cur_pts;
+}
+
+
+void FeatureGrid::reset(cv::Size size, float _min_dist, int budget_grid, int _cell_budget) {
+    min_dist = _min_dist;
+    inv_cell_size = 1.0f / std::max(min_dist, 1.0f);
+    grid_cols = std::max(1, (int) std::ceil(size.width * inv_cell_size));
+    grid_rows = std::max(1, (int) std::ceil(size.height * inv_cell_size));
+    if (cells.size() < grid_cols * grid_rows) {
+        cells.resize(grid_cols * grid_rows);
+    }
+    for (auto & cell : cells) {
+        cell.clear();
+    }
+    budget_cols = budget_rows = std::max(0, budget_grid);
+    cell_budget = _cell_budget;
+    if (budget_cols > 0) {
+        budget_scale_x = (float) budget_cols / size.width;
+        budget_scale_y = (float) budget_rows / size.height;
+        budget_count.assign(budget_cols * budget_rows, 0);
+    }
+}
+
+int FeatureGrid::cellIndex(const cv::Point2f & pt) const {
+    int c = std::min(std::max((int)(pt.x * inv_cell_size), 0), grid_cols - 1);
+    int r = std::min(std::max((int)(pt.y * inv_cell_size), 0), grid_rows - 1);
+    return r * grid_cols + c;
+}
+
+int FeatureGrid::budgetIndex(const cv::Point2f & pt) const {
+    int c = std::min(std::max((int)(pt.x * budget_scale_x), 0), budget_cols - 1);
+    int r = std::min(std::max((int)(pt.y * budget_scale_y), 0), budget_rows - 1);
+    return r * budget_cols + c;
+}
+
+bool FeatureGrid::hasNearby(const cv::Point2f & pt) const {
+    int c = std::min(std::max((int)(pt.x * inv_cell_size), 0), grid_cols - 1);
+    int r = std::min(std::max((int)(pt.y * inv_cell_size), 0), grid_rows - 1);
+    float min_dist_sqr = min_dist * min_dist;
+    for (int i = std::max(r - 1, 0); i <= std::min(r + 1, grid_rows - 1); i++) {
+        for (int j = std::max(c - 1, 0); j <= std::min(c + 1, grid_cols - 1); j++) {
+            for (auto & pt_j : cells[i * grid_cols + j]) {
+                auto d = pt - pt_j;
+                if (d.dot(d) < min_dist_sqr) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool FeatureGrid::budgetExceeded(const cv::Point2f & pt) const {
+    if (budget_cols == 0 || cell_budget <= 0) {
+        return false;
+    }
+    return budget_count[budgetIndex(pt)] >= cell_budget;
+}
+
+void FeatureGrid::add(const cv::Point2f & pt) {
+    cells[cellIndex(pt)].emplace_back(pt);
+    if (budget_cols > 0) {
+        budget_count[budgetIndex(pt)] ++;
+    }
+}
 
 void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::vector<cv::Point2f> & cur_pts, 
-        int require_pts, bool enable_cuda, bool use_fast, int fast_rows, int fast_cols) {
+        int require_pts, bool enable_cuda, bool use_fast, int fast_rows, int fast_cols, FeatureGrid * grid, int max_threads) {
     int lack_up_top_pts = require_pts - static_cast<int>(cur_pts.size());
     cv::Mat mask;
     if (params->enable_perf_output) {
@@ -470,7 +593,14 @@ void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::ve
         }
         cv::Mat d_prevPts;
         if (use_fast) {
-            n_pts_tmp = detectFastByRegion(img, mask, num_to_detect, fast_rows, fast_cols);
+            if (cur_pts.size() > 0) {
+                //Occupancy of the tracked points, so the top corners of each tile are not spent next to them.
+                mask = cv::Mat(img.size(), CV_8UC1, cv::Scalar(255));
+                for (auto & pt : cur_pts) {
+                    cv::circle(mask, pt, params->feature_min_dist, 0, -1);
+                }
+            }
+            n_pts_tmp = detectFastByRegion(img, mask, num_to_detect, fast_rows, fast_cols, enable_cuda, max_threads);
         } else {
             //Use goodFeaturesToTrack
             if (enable_cuda) {
@@ -491,18 +621,21 @@ void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::ve
             }
         }
         n_pts.clear();
-        std::vector<cv::Point2f> all_pts = cur_pts;
+        FeatureGrid local_grid;
+        if (grid == nullptr) {
+            grid = &local_grid;
+        }
+        //Allow each cell twice of the uniform share, as texture is rarely uniform.
+        int budget_cells = params->feature_budget_grid * params->feature_budget_grid;
+        int cell_budget = budget_cells > 0 ? (2 * require_pts + budget_cells - 1) / budget_cells : 0;
+        grid->reset(img.size(), params->feature_min_dist, params->feature_budget_grid, cell_budget);
+        for (auto & pt : cur_pts) {
+            grid->add(pt);
+        }
         for (auto & pt : n_pts_tmp) {
-            bool has_nearby = false;
-            for (auto &pt_j: all_pts) {
-                if (cv::norm(pt-pt_j) < params->feature_min_dist) {
-                    has_nearby = true;
-                    break;
-                }
-            }
-            if (!has_nearby) {
+            if (!grid->hasNearby(pt) && !grid->budgetExceeded(pt)) {
                 n_pts.push_back(pt);
-                all_pts.push_back(pt);
+                grid->add(pt);
             }
             if (n_pts.size() >= lack_up_top_pts) {
                 break;
@@ -513,18 +646,86 @@ void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::ve
     }
 }  
 
-std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows) {
+std::vector<cv::Point2f> detectFastByRegionCPU(const cv::Mat & img, const cv::Mat & mask, int features, int cols, int rows, int max_threads) {
+    int small_width = img.cols / cols;
+    int small_height = img.rows / rows;
+    int num_tiles = cols * rows;
+    int num_features = ceil((double)features*1.5/ ((double) num_tiles));
+    auto compare = [](const cv::KeyPoint & a, const cv::KeyPoint & b) {
+        return a.response > b.response;
+    };
+    //Each tile keeps only its top num_features keypoints, so no global sort of all keypoints is needed.
+    std::vector<std::vector<cv::KeyPoint>> tile_kpts(num_tiles);
+    std::atomic<int> next_tile(0);
+    auto worker = [&]() {
+        for (int k = next_tile++; k < num_tiles; k = next_tile++) {
+            int i = k / rows, j = k % rows;
+            cv::Rect roi(small_width*i, small_height*j, small_width, small_height);
+            auto & kpts = tile_kpts[k];
+            cv::FAST(img(roi), kpts, 10, true, cv::FastFeatureDetector::TYPE_9_16);
+            if (!mask.empty()) {
+                cv::Mat mask_roi = mask(roi);
+                kpts.erase(std::remove_if(kpts.begin(), kpts.end(), [&](const cv::KeyPoint & kp) {
+                    return mask_roi.at<uchar>(cvRound(kp.pt.y), cvRound(kp.pt.x)) == 0;
+                }), kpts.end());
+            }
+            if (kpts.size() > num_features) {
+                std::nth_element(kpts.begin(), kpts.begin() + num_features, kpts.end(), compare);
+                kpts.resize(num_features);
+            }
+            for (auto & kp : kpts) {
+                kp.pt.x += small_width*i;
+                kp.pt.y += small_height*j;
+            }
+        }
+    };
+    int num_workers = max_threads > 0 ? max_threads : std::thread::hardware_concurrency();
+    num_workers = std::min<int>(num_tiles, std::max<int>(num_workers, 1));
+    std::vector<std::future<void>> tasks;
+    for (int i = 1; i < num_workers; i++) {
+        tasks.emplace_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (auto & task : tasks) {
+        task.get();
+    }
+    std::vector<cv::KeyPoint> total_kpts;
+    for (auto & kpts : tile_kpts) {
+        total_kpts.insert(total_kpts.end(), kpts.begin(), kpts.end());
+    }
+    //At most 1.5x features candidates remain, sort them so the strongest are accepted first.
+    std::sort(total_kpts.begin(), total_kpts.end(), compare);
+    std::vector<cv::Point2f> ret;
+    for (int i = 0; i < total_kpts.size() && ret.size() < features; i ++) {
+        ret.push_back(total_kpts[i].pt);
+    }
+    return ret;
+}
+
+std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows, 
+        bool enable_cuda, int max_threads) {
+    if (!enable_cuda) {
+        return detectFastByRegionCPU(_img.getMat(), _mask.getMat(), features, cols, rows, max_threads);
+    }
     int small_width = _img.cols() / cols;
     int small_height = _img.rows() / rows;
     int num_features = ceil((double)features*1.5/ ((double) cols * rows));
     auto fast = cv::cuda::FastFeatureDetector::create(10, true, cv::FastFeatureDetector::TYPE_9_16, features);
     cv::cuda::GpuMat gpu_img(_img);
+    cv::cuda::GpuMat gpu_mask;
+    if (!_mask.empty()) {
+        gpu_mask.upload(_mask);
+    }
     std::vector<cv::KeyPoint> total_kpts;
     for (int i = 0; i < cols; i ++) {
         for (int j = 0; j < rows; j ++) {
             std::vector<cv::KeyPoint> kpts;
             cv::Rect roi(small_width*i, small_height*j, small_width, small_height);
-            fast->detect(gpu_img(roi), kpts);
+            if (gpu_mask.empty()) {
+                fast->detect(gpu_img(roi), kpts);
+            } else {
+                fast->detect(gpu_img(roi), kpts, gpu_mask(roi));
+            }
             // printf("Detect %d features in region %d %d\n", kpts.size(), i, j);
             for (auto kp : kpts) {
                 kp.pt.x = kp.pt.x + small_width*i;
@@ -612,8 +813,196 @@ int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std
     return success;
 }
 
+//Vectorised inlier check of the non-central absolute pose problem, the same error as AbsolutePoseSacProblem:
+//1 - cos of the angle between the bearing and the reprojected point, both in the camera frame.
+//Bearings are rotated to the body frame once, so a hypothesis costs one 3xN product and column-wise reductions.
+struct PnPVerifier {
+    Eigen::Matrix3Xd points;
+    Eigen::Matrix3Xd bearings_body;
+    Eigen::Matrix3Xd cam_offsets;
+    PnPVerifier(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
+            const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, const std::vector<int> & order) {
+        int N = order.size();
+        points.resize(3, N);
+        bearings_body.resize(3, N);
+        cam_offsets.resize(3, N);
+        for (int i = 0; i < N; i++) {
+            int idx = order[i];
+            auto & ext = cam_extrinsics[camera_indices[idx]];
+            points.col(i) = lm_positions_a[idx];
+            bearings_body.col(i) = ext.R() * lm_3d_norm_b[idx];
+            cam_offsets.col(i) = ext.pos();
+        }
+    }
+    //Inliers of columns [start, start + n) under the body pose (R, t) in the frame of points, columns are appended to inlier_cols.
+    int countInliers(const Matrix3d & R, const Vector3d & t, int start, int n, double threshold, std::vector<int> * inlier_cols = nullptr) const {
+        Eigen::Matrix3Xd d = R.transpose() * (points.middleCols(start, n).colwise() - t) - cam_offsets.middleCols(start, n);
+        Eigen::ArrayXd dots = d.cwiseProduct(bearings_body.middleCols(start, n)).colwise().sum().transpose().array();
+        Eigen::ArrayXd norms = d.colwise().norm().transpose().array();
+        auto inlier = dots > (1.0 - threshold) * norms;
+        if (inlier_cols != nullptr) {
+            for (int i = 0; i < n; i++) {
+                if (inlier(i)) {
+                    inlier_cols->push_back(start + i);
+                }
+            }
+        }
+        return inlier.count();
+    }
+};
+
+//PROSAC (Chum and Matas, CVPR 2005) with SPRT verification (Matas and Chum, ICCV 2005) on GP3P hypotheses.
+//Samples are drawn from the best scored correspondences first and the sampling set grows with the iterations.
+//Each hypothesis is verified on blocks of randomly ordered points and dropped as soon as the likelihood ratio
+//says it is a bad model, so most of the hypotheses cost a few blocks only.
+//The search stops when the best model is found with the confidence, or when a model with min_inliers
+//would have been sampled with the confidence but none is found. The later makes failed loops cheap.
+static bool prosacPnPnonCentral(opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem & problem, 
+        const PnPVerifier & verifier, const std::vector<int> & shuffled, const std::vector<int> & sorted, 
+        double threshold, int min_inliers, int max_iterations, opengv::transformation_t & best_model) {
+    const int m = problem.getSampleSize();
+    const int N = sorted.size();
+    const int block = 32;
+    const double confidence = 0.99;
+    const double t_model = 200; //Time of a hypothesis in the units of verifying a point
+    const double models_per_sample = 2;
+    if (N < m) {
+        return false;
+    }
+    std::mt19937 rng(0);
+    std::vector<int> rank(N);
+    for (int i = 0; i < N; i++) {
+        rank[sorted[i]] = i;
+    }
+    int best_inliers = 0;
+    double eps = std::max((double) min_inliers / N, 0.1); //Inlier ratio of the good model
+    double delta = 0.05; //Probability a point is consistent with a bad model
+    double delta_sum = 0;
+    int rejected = 0;
+    auto sprtThreshold = [&]() {
+        double C = (1 - delta) * log((1 - delta) / (1 - eps)) + delta * log(delta / eps);
+        double A = t_model * C / models_per_sample + 1;
+        for (int i = 0; i < 10; i++) {
+            A = t_model * C / models_per_sample + 1 + log(A);
+        }
+        return A;
+    };
+    auto iterationsFor = [&](double w) {
+        double p_good = pow(std::min(w, 1.0), m);
+        if (p_good >= 1) {
+            return 0.0;
+        }
+        if (p_good <= 0) {
+            return (double) max_iterations;
+        }
+        return log(1 - confidence) / log(1 - p_good);
+    };
+    double log_A = log(sprtThreshold());
+    double max_k = max_iterations;
+    //Iterations needed to draw a model with min_inliers if there is one
+    double fail_k = min_inliers > 0 ? iterationsFor((double) min_inliers / N) : max_iterations;
+
+    //PROSAC growth function, T_N is the iterations of RANSAC
+    int n = m;
+    double T_n = max_iterations;
+    for (int i = 0; i < m; i++) {
+        T_n *= (double)(n - i) / (N - i);
+    }
+    int T_n_prime = 1;
+    std::vector<int> sample(m);
+    std::vector<int> pool;
+    for (int t = 1; t <= max_iterations && t <= max_k; t++) {
+        if (best_inliers < min_inliers && t > fail_k) {
+            break;
+        }
+        if (t == T_n_prime && n < N) {
+            n++;
+            double T_n_next = T_n * n / (n - m);
+            T_n_prime += (int) ceil(T_n_next - T_n);
+            T_n = T_n_next;
+        }
+        //Sample m-1 from the top n-1 and the n-th, or m from the top n when the growth is behind
+        pool.assign(sorted.begin(), sorted.begin() + n);
+        int k = m;
+        if (T_n_prime >= t) {
+            sample[m - 1] = pool[n - 1];
+            pool.pop_back();
+            k = m - 1;
+        }
+        for (int i = 0; i < k; i++) {
+            int j = std::uniform_int_distribution<int>(i, pool.size() - 1)(rng);
+            std::swap(pool[i], pool[j]);
+            sample[i] = pool[i];
+        }
+        opengv::transformation_t model;
+        if (!problem.computeModelCoefficients(sample, model)) {
+            continue;
+        }
+        Matrix3d R = model.block<3, 3>(0, 0);
+        Vector3d t_model_pos = model.block<3, 1>(0, 3);
+        //SPRT on blocks of the shuffled points
+        double log_lambda = 0;
+        double log_in = log(delta / eps), log_out = log((1 - delta) / (1 - eps));
+        int inliers = 0, tested = 0;
+        bool rejected_by_sprt = false, hopeless = false;
+        for (int start = 0; start < N; start += block) {
+            int len = std::min(block, N - start);
+            int _inliers = verifier.countInliers(R, t_model_pos, start, len, threshold);
+            inliers += _inliers;
+            tested += len;
+            log_lambda += _inliers * log_in + (len - _inliers) * log_out;
+            if (log_lambda > log_A) {
+                rejected_by_sprt = true;
+                break;
+            }
+            if (inliers + N - tested <= best_inliers) {
+                hopeless = true;
+                break;
+            }
+        }
+        if (rejected_by_sprt) {
+            //Bad models estimate delta
+            rejected ++;
+            delta_sum += (double) inliers / tested;
+            double _delta = std::min(std::max(delta_sum / rejected, 0.01), 0.5 * eps);
+            if (fabs(_delta - delta) > 0.05 * delta) {
+                delta = _delta;
+                log_A = log(sprtThreshold());
+            }
+            continue;
+        }
+        if (hopeless) {
+            continue;
+        }
+        if (inliers > best_inliers) {
+            best_inliers = inliers;
+            best_model = model;
+            eps = std::max(eps, (double) inliers / N);
+            log_A = log(sprtThreshold());
+            //PROSAC maximality: iterations to draw an all-inlier sample from the top n' correspondences, minimized over n'
+            //with enough support. The confidence of the SPRT rejecting a good model is ignored, it is tiny at these thresholds.
+            std::vector<int> inlier_cols, inliers_prefix(N + 1, 0);
+            verifier.countInliers(R, t_model_pos, 0, N, threshold, &inlier_cols);
+            for (auto col : inlier_cols) {
+                inliers_prefix[rank[shuffled[col]] + 1] ++;
+            }
+            for (int i = 0; i < N; i++) {
+                inliers_prefix[i + 1] += inliers_prefix[i];
+            }
+            int min_support = std::max(min_inliers, 2 * m);
+            for (int _n = min_support; _n <= N; _n++) {
+                if (inliers_prefix[_n] >= min_support) {
+                    max_k = std::min(max_k, iterationsFor((double) inliers_prefix[_n] / _n));
+                }
+            }
+        }
+    }
+    return best_inliers >= m;
+}
+
 Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
-        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers) {
+        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers,
+        const std::vector<float> & scores, int min_inliers) {
     opengv::bearingVectors_t bearings;
     std::vector<int> camCorrespondences;
     opengv::points_t points;
@@ -632,18 +1021,46 @@ Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_
     //Solve with GP3P + RANSAC
     opengv::absolute_pose::NoncentralAbsoluteAdapter adapter(
         bearings, camCorrespondences, points, camOffsets, camRotations);
-    opengv::sac::Ransac<
-        opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> ransac;
     std::shared_ptr<opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> absposeproblem_ptr(new opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem(
         adapter, opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem::GP3P));
-    ransac.sac_model_ = absposeproblem_ptr;
     // ransac.threshold_ = 1.0 - cos(atan(sqrt(10.0)*0.5/460.0));
-    ransac.threshold_ = 0.5/params->focal_length;
-    ransac.max_iterations_ = 50;
-    ransac.computeModel();
-    //Obtain relative pose results
-    inliers = ransac.inliers_;
-    auto best_transformation = ransac.model_coefficients_;
+    double threshold = 0.5/params->focal_length;
+    opengv::transformation_t best_transformation;
+    if (params->enable_prosac_pnp) {
+        int N = lm_positions_a.size();
+        std::vector<int> sorted(N);
+        for (int i = 0; i < N; i++) {
+            sorted[i] = i;
+        }
+        auto shuffled = sorted;
+        if (scores.size() == N) {
+            std::stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) { return scores[a] > scores[b]; });
+        }
+        std::mt19937 rng(0);
+        std::shuffle(shuffled.begin(), shuffled.end(), rng);
+        PnPVerifier verifier(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, shuffled);
+        inliers.clear();
+        //Same budget as the RANSAC below, PROSAC and SPRT make each of them cheaper and usually stop much earlier.
+        if (!prosacPnPnonCentral(*absposeproblem_ptr, verifier, shuffled, sorted, threshold, min_inliers, 50, best_transformation)) {
+            return Swarm::Pose();
+        }
+        std::vector<int> inlier_cols;
+        verifier.countInliers(best_transformation.block<3, 3>(0, 0), best_transformation.block<3, 1>(0, 3), 0, N, threshold, &inlier_cols);
+        for (auto col : inlier_cols) {
+            inliers.push_back(shuffled[col]);
+        }
+        std::sort(inliers.begin(), inliers.end());
+    } else {
+        opengv::sac::Ransac<
+            opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> ransac;
+        ransac.sac_model_ = absposeproblem_ptr;
+        ransac.threshold_ = threshold;
+        ransac.max_iterations_ = 50;
+        ransac.computeModel();
+        //Obtain relative pose results
+        inliers = ransac.inliers_;
+        best_transformation = ransac.model_coefficients_;
+    }
     Matrix3d R = best_transformation.block<3, 3>(0, 0);
     Vector3d t = best_transformation.block<3, 1>(0, 3);
     Swarm::Pose p_drone_old_in_new_init(R, t);
@@ -676,9 +1093,10 @@ Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_
 int computeRelativePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
         const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, 
         Swarm::Pose drone_pose_a, Swarm::Pose ego_motion_b, 
-        Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, bool is_4dof, bool verify_gravity) {
+        Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, bool is_4dof, bool verify_gravity, const std::vector<float> & scores) {
     D2Common::Utility::TicToc tic;
-    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers);
+    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers,
+        scores, params->loopdetectorconfig->loop_inlier_feature_num);
     DP_b_to_a =  Swarm::Pose::DeltaPose(pnp_predict_pose_b, drone_pose_a, is_4dof);
 
     bool success = true;
@@ -712,4 +1130,11 @@ std::vector<cv::cuda::GpuMat> buildImagePyramid(const cv::cuda::GpuMat& prevImg,
 
     return prevPyr;
 }
+
+std::vector<cv::Mat> buildImagePyramid(const cv::Mat& prevImg, int maxLevel_) {
+    std::vector<cv::Mat> prevPyr;
+    //The pyramid is built with derivatives, so the gradients are computed once per image and shared by all tracks against it.
+    cv::buildOpticalFlowPyramid(prevImg, prevPyr, WIN_SIZE, maxLevel_, true);
+    return prevPyr;
+}
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "d2frontend/d2frontend_params.h"
+#include "d2frontend/utils.h"
+#include <d2common/utils.hpp>
+#include <boost/program_options.hpp>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+D2FrontendParams * D2FrontEnd::params = new D2FrontendParams;
+
+//Compare CPU FAST by region with goodFeaturesToTrack on the same image.
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("image,i", po::value<std::string>()->default_value(""), "path of test image, random texture if empty")
+        ("width,w", po::value<int>()->default_value(640), "width of random image")
+        ("height,h", po::value<int>()->default_value(480), "height of random image")
+        ("features,f", po::value<int>()->default_value(150), "num of features to detect")
+        ("min-dist,d", po::value<double>()->default_value(20), "min distance between features")
+        ("num-test,t", po::value<int>()->default_value(100), "num of tests");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    auto image_path = vm["image"].as<std::string>();
+    int features = vm["features"].as<int>();
+    int num_test = vm["num-test"].as<int>();
+    params->feature_min_dist = vm["min-dist"].as<double>();
+    params->total_feature_num = features;
+    cv::setNumThreads(1);
+
+    cv::Mat img;
+    if (image_path.empty()) {
+        img = cv::Mat(vm["height"].as<int>(), vm["width"].as<int>(), CV_8UC1);
+        cv::randu(img, 0, 255);
+        cv::GaussianBlur(img, img, cv::Size(5, 5), 1.5);
+    } else {
+        img = cv::imread(image_path, cv::IMREAD_GRAYSCALE);
+    }
+    printf("image %dx%d features %d min_dist %.1f num_test %d\n", img.cols, img.rows, features, params->feature_min_dist, num_test);
+
+    std::vector<cv::Point2f> pts;
+    double t_gftt = 0, t_fast = 0, t_gftt_detect = 0, t_fast_detect = 0;
+    int n_gftt = 0, n_fast = 0;
+    for (int i = 0; i < num_test; i++) {
+        TicToc tic;
+        cv::goodFeaturesToTrack(img, pts, features, 0.01, params->feature_min_dist);
+        t_gftt += tic.toc();
+        n_gftt += pts.size();
+        tic.tic();
+        pts = detectFastByRegion(img, cv::noArray(), features, 3, 4, false);
+        t_fast += tic.toc();
+        n_fast += pts.size();
+    }
+    //Full detectPoints including de-duplication, starting from no tracked points.
+    FeatureGrid grid;
+    for (int i = 0; i < num_test; i++) {
+        std::vector<cv::Point2f> cur_pts, n_pts;
+        TicToc tic;
+        detectPoints(img, n_pts, cur_pts, features, false, false, 3, 4, &grid);
+        t_gftt_detect += tic.toc();
+        tic.tic();
+        detectPoints(img, n_pts, cur_pts, features, false, true, 3, 4, &grid);
+        t_fast_detect += tic.toc();
+    }
+    printf("goodFeaturesToTrack: %.2fms avg %.1f pts\n", t_gftt/num_test, (double)n_gftt/num_test);
+    printf("detectFastByRegion CPU: %.2fms avg %.1f pts\n", t_fast/num_test, (double)n_fast/num_test);
+    printf("detectPoints GFTT: %.2fms detectPoints FAST: %.2fms\n", t_gftt_detect/num_test, t_fast_detect/num_test);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "d2frontend/d2frontend_params.h"
+#include "d2frontend/loop_detector.h"
+#include "d2frontend/keyframe_store.h"
+#include <d2common/utils.hpp>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <unistd.h>
+#include <random>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+D2FrontendParams * D2FrontEnd::params = new D2FrontendParams;
+
+double residentMB() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE) / 1024.0 / 1024.0;
+}
+
+//Write a keyframe store of synthetic keyframes, then measure the warm start of LoopDetector
+//(open the store and build the NetVLAD index from it) and reading keyframes back under the resident limit.
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("path,p", po::value<std::string>()->default_value("/tmp/d2frontend_keyframe_store"), "directory of the store")
+        ("num,n", po::value<int>()->default_value(50000), "num of keyframes to write, 0 to use the existing store")
+        ("images", po::value<int>()->default_value(1), "images with NetVLAD per keyframe")
+        ("landmarks,l", po::value<int>()->default_value(20), "landmarks per image")
+        ("netvlad-dims", po::value<int>()->default_value(4096), "dims of NetVLAD")
+        ("loads", po::value<int>()->default_value(10000), "num of random keyframe loads")
+        ("resident-mb", po::value<int>()->default_value(256), "resident limit of the store");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    auto path = vm["path"].as<std::string>();
+    int num = vm["num"].as<int>(), images = vm["images"].as<int>(), landmarks = vm["landmarks"].as<int>();
+    params->netvlad_dims = vm["netvlad-dims"].as<int>();
+    int self_id = 0;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> dist;
+    if (num > 0) {
+        KeyframeStore store(path, params->netvlad_dims, (size_t)vm["resident-mb"].as<int>()*1024*1024);
+        store.open(false);
+        TicToc tic;
+        for (int i = 0; i < num; i++) {
+            VisualImageDescArray frame;
+            frame.frame_id = i;
+            frame.drone_id = self_id;
+            frame.stamp = i * 0.1;
+            for (int j = 0; j < images; j++) {
+                VisualImageDesc img;
+                img.frame_id = i;
+                img.drone_id = self_id;
+                img.camera_index = j;
+                img.image_desc.resize(params->netvlad_dims);
+                for (auto & v : img.image_desc) {
+                    v = dist(rng);
+                }
+                for (int k = 0; k < landmarks; k++) {
+                    D2Common::LandmarkPerFrame lm;
+                    lm.landmark_id = i * landmarks + k;
+                    lm.pt2d = cv::Point2f(dist(rng), dist(rng));
+                    lm.pt3d_norm = Eigen::Vector3d(lm.pt2d.x, lm.pt2d.y, 1);
+                    img.landmarks.emplace_back(lm);
+                }
+                img.landmark_descriptor.resize(landmarks * params->superpoint_dims);
+                for (auto & v : img.landmark_descriptor) {
+                    v = dist(rng);
+                }
+                store.appendDescriptor(frame.frame_id, j, self_id, img.image_desc.data());
+                frame.images.emplace_back(img);
+            }
+            store.append(frame);
+        }
+        printf("write %d keyframes in %.1fms\n", num, tic.toc());
+    }
+
+    //Warm start as LoopDetector does on start
+    LoopDetectorConfig config;
+    config.verify_threads = 0;
+    config.keyframe_store_path = path;
+    config.keyframe_store_resident_mb = vm["resident-mb"].as<int>();
+    double rss0 = residentMB();
+    TicToc tic;
+    auto loop_detector = new LoopDetector(self_id, config);
+    printf("warm start: %.1fms database %d resident %.1fMB\n", tic.toc(), loop_detector->databaseSize(), residentMB() - rss0);
+    delete loop_detector;
+
+    //Random keyframe reads, the resident memory should stay bounded
+    KeyframeStore store(path, params->netvlad_dims, (size_t)vm["resident-mb"].as<int>()*1024*1024);
+    //Each open starts a new session, keyframes written above are of session 0
+    store.open(true);
+    int loads = vm["loads"].as<int>(), stored = store.frameNum();
+    double t_load = 0, max_rss = 0;
+    rss0 = residentMB();
+    for (int i = 0; i < loads && stored > 0; i++) {
+        int frame_id = std::uniform_int_distribution<int>(0, stored - 1)(rng);
+        VisualImageDescArray frame;
+        TicToc tic;
+        store.load(store.storeFrameId(frame_id, 0), frame);
+        t_load += tic.toc();
+        max_rss = std::max(max_rss, residentMB() - rss0);
+    }
+    printf("load: avg %.3fms max resident %.1fMB\n", t_load/loads, max_rss);
+    return 0;
+}
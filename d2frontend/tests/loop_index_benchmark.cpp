@@ -0,0 +1,111 @@
+#include "d2frontend/d2frontend_params.h"
+#include "d2frontend/loop_detector.h"
+#include "d2frontend/utils.h"
+#include <d2common/utils.hpp>
+#include <boost/program_options.hpp>
+#include <random>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+D2FrontendParams * D2FrontEnd::params = new D2FrontendParams;
+
+//Compare recall and latency of the loop detection indices against the flat index.
+//The database is a csv of NetVLAD descriptors (one per row) recorded from a mission, or random unit vectors if not given.
+//Descriptors are inserted one by one and each one queries the database before its insertion, as LoopDetector does.
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("database,d", po::value<std::string>()->default_value(""), "csv of NetVLAD descriptors")
+        ("num,n", po::value<int>()->default_value(20000), "num of random descriptors if no database")
+        ("dims", po::value<int>()->default_value(4096), "dims of random descriptors")
+        ("top-k,k", po::value<int>()->default_value(15), "num of neighbours to query, SEARCH_NEAREST_NUM + match_index_dist")
+        ("hnsw-m,m", po::value<int>()->default_value(32), "HNSW neighbors per node")
+        ("ef-search,e", po::value<int>()->default_value(64), "HNSW efSearch");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    Eigen::MatrixXf descs;
+    auto database = vm["database"].as<std::string>();
+    if (database.empty()) {
+        std::mt19937 rng(0);
+        std::normal_distribution<float> dist;
+        int dims = vm["dims"].as<int>();
+        descs.resize(vm["num"].as<int>(), dims);
+        for (int i = 0; i < descs.rows(); i++) {
+            for (int j = 0; j < dims; j++) {
+                descs(i, j) = dist(rng);
+            }
+            //Consecutive keyframes are similar
+            if (i > 0) {
+                descs.row(i) += 3 * descs.row(i - 1).normalized() * sqrt(dims);
+            }
+            descs.row(i).normalize();
+        }
+    } else {
+        descs = load_csv_mat_eigen(database);
+    }
+    //Row major for faiss
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> data = descs;
+    int num = data.rows(), dims = data.cols(), k = vm["top-k"].as<int>();
+    printf("database %d descriptors dims %d top-k %d\n", num, dims, k);
+
+    LoopDetectorConfig config;
+    config.match_index_dist = 0;
+    config.match_index_dist_remote = 0;
+    config.hnsw_m = vm["hnsw-m"].as<int>();
+    config.hnsw_ef_search = vm["ef-search"].as<int>();
+    config.index_type = LOOP_INDEX_FLAT;
+    faiss::Index * flat = createLoopIndex(config, dims);
+    config.index_type = LOOP_INDEX_HNSW;
+    faiss::Index * hnsw = createLoopIndex(config, dims);
+
+    std::vector<float> sim_flat(k), sim_hnsw(k);
+    std::vector<faiss::idx_t> labels_flat(k), labels_hnsw(k);
+    double t_add_flat = 0, t_add_hnsw = 0, t_query_flat = 0, t_query_hnsw = 0;
+    int recall1 = 0, queries = 0;
+    double recallk = 0;
+    for (int i = 0; i < num; i++) {
+        const float * x = data.row(i).data();
+        if (i >= k) {
+            TicToc tic;
+            flat->search(1, x, k, sim_flat.data(), labels_flat.data());
+            t_query_flat += tic.toc();
+            tic.tic();
+            hnsw->search(1, x, k, sim_hnsw.data(), labels_hnsw.data());
+            t_query_hnsw += tic.toc();
+            recall1 += labels_flat[0] == labels_hnsw[0];
+            int hit = 0;
+            for (int a = 0; a < k; a++) {
+                hit += std::find(labels_hnsw.begin(), labels_hnsw.end(), labels_flat[a]) != labels_hnsw.end();
+            }
+            recallk += (double) hit / k;
+            queries ++;
+        }
+        TicToc tic;
+        flat->add(1, x);
+        t_add_flat += tic.toc();
+        tic.tic();
+        hnsw->add(1, x);
+        t_add_hnsw += tic.toc();
+        if ((i + 1) % 5000 == 0 && queries > 0) {
+            printf("%d: flat query %.3fms hnsw query %.3fms recall@1 %.3f recall@%d %.3f\n", i + 1,
+                t_query_flat/queries, t_query_hnsw/queries, (double) recall1/queries, k, recallk/queries);
+        }
+    }
+    if (queries == 0) {
+        printf("database too small\n");
+        return 0;
+    }
+    printf("flat: add %.3fms query %.3fms\n", t_add_flat/num, t_query_flat/queries);
+    printf("hnsw: add %.3fms query %.3fms recall@1 %.3f recall@%d %.3f\n", t_add_hnsw/num, t_query_hnsw/queries,
+        (double) recall1/queries, k, recallk/queries);
+    delete flat;
+    delete hnsw;
+    return 0;
+}
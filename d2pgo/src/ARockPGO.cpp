@@ -7,6 +7,7 @@ void ARockPGO::inputDPGOData(const DPGOData & data) {
     // printf("[ARockPGO@%d]input DPGOData from %d\n", self_id, data.drone_id);
     const std::lock_guard<std::recursive_mutex> lock(pgo_data_mutex);
     pgo_data.emplace_back(data);
+    notifyDualData();
 }
 
 void ARockPGO::processPGOData(const DPGOData & data) {
@@ -37,21 +38,22 @@ void ARockPGO::processPGOData(const DPGOData & data) {
                         create = true;
                     }
                     //Then we update the dual state.
+                    auto & duals = dual_states.at(drone_id);
                     if (param_info.type == ParamsType::POSE) {
                         Swarm::Pose pose(dual);
-                        pose.to_vector(dual_states_remote[drone_id][ptr].data());
+                        pose.to_vector(duals.remote(ptr).data());
                         if (create)
-                            pose.to_vector(dual_states_local[drone_id][ptr].data());
+                            pose.to_vector(duals.local(ptr).data());
                     } else if (param_info.type == ParamsType::POSE_4D) {
-                        dual_states_remote[drone_id][ptr] = dual;
+                        duals.remote(ptr) = dual;
                         if (create)
-                            dual_states_local[drone_id][ptr] = dual;
+                            duals.local(ptr) = dual;
                     } else if (param_info.type == ParamsType::POSE_PERTURB_6D) { 
                         // printf("[ARockPGO@%d] updating dual state for %d@%d.:", self_id, param_info.id, drone_id);
                         // std::cout << dual.transpose() << std::endl;
-                        dual_states_remote[drone_id][ptr] = dual;
+                        duals.remote(ptr) = dual;
                         if (create)
-                            dual_states_local[drone_id][ptr] = dual;
+                            duals.local(ptr) = dual;
                     }
                 }
             }
@@ -73,7 +75,7 @@ void ARockPGO::broadcastData() {
     // printf("ARockPGO::broadcastData\n");
     const std::lock_guard<std::recursive_mutex> lock(pgo_data_mutex);
     //broadcast the data.
-    for (auto it : dual_states_local) {
+    for (auto & it : dual_states) {
         DPGOData data;
         data.type = DPGO_DELTA_POSE_DUAL;
         data.stamp = ros::Time::now().toSec();
@@ -81,9 +83,10 @@ void ARockPGO::broadcastData() {
         data.target_id = it.first;
         data.reference_frame_id = SolverWrapper::state->getReferenceFrameId();
         // printf("ARockPGO::broadcastData of drone %d\n", data.target_id);
-        for (auto it2: it.second) {
-            auto ptr = it2.first;
-            auto & dual_state = it2.second;
+        auto & duals = it.second;
+        for (int i = 0; i < duals.size(); i ++) {
+            auto ptr = duals.param(i);
+            auto dual_state = duals.local(i);
             ParamInfo param = all_estimating_params.at(ptr);
             Swarm::Pose pose;
             if (param.type == ParamsType::POSE) {
@@ -27,8 +27,12 @@ void D2PGO::addFrame(D2BaseFrame frame) {
         ego_motion_trajs[frame.drone_id] = traj;
     }
     ego_motion_trajs[frame.drone_id].push(frame.stamp, frame.initial_ego_pose, frame.frame_id);
+    rejection.addFrame(frame.drone_id, frame.frame_id, frame.initial_ego_pose);
     updated = true;
-    is_rot_init_convergence = false;
+    if (!config.enable_incremental_solve) {
+        //In incremental mode the rotation is initialized when the whole graph is rebuilt.
+        is_rot_init_convergence = false;
+    }
 }
 
 void D2PGO::addLoop(const Swarm::LoopEdge & loop_info, bool add_state_by_loop) {
@@ -39,6 +43,7 @@ void D2PGO::addLoop(const Swarm::LoopEdge & loop_info, bool add_state_by_loop) {
     }
     all_loops.emplace_back(loop_info);
     all_loops.back().id = all_loops.size() - 1;
+    addPreviousSessionFrame(loop_info);
     // printf("[D2PGO::addLoop@%d] Add edge %ld<->%ld drone %d<->%d hasKF %d %d\n ", self_id, loop_info.keyframe_id_a,
     //     loop_info.keyframe_id_b, loop_info.id_a, loop_info.id_b, state.hasFrame(loop_info.keyframe_id_a), state.hasFrame(loop_info.keyframe_id_b));
     if (add_state_by_loop) {
@@ -68,7 +73,45 @@ void D2PGO::addLoop(const Swarm::LoopEdge & loop_info, bool add_state_by_loop) {
         }
     }
     updated = true;
-    is_rot_init_convergence = false;
+    if (!config.enable_incremental_solve) {
+        is_rot_init_convergence = false;
+    }
+}
+
+void D2PGO::addPreviousSessionPose(FrameIdType frame_id, const Swarm::Pose & pose) {
+    const Guard lock(state_lock);
+    if (prev_session_poses.find(frame_id) == prev_session_poses.end()) {
+        prev_session_poses[frame_id] = pose;
+    }
+}
+
+void D2PGO::addPreviousSessionFrame(const Swarm::LoopEdge & loop_info) {
+    //A keyframe of a previous session becomes a node connected by its cross-session loops and, through its stored
+    //pose, to the other keyframes of its session. It is not part of the ego motion of this session.
+    bool prev_a = isPreviousSessionFrame(loop_info.keyframe_id_a);
+    bool prev_b = isPreviousSessionFrame(loop_info.keyframe_id_b);
+    if (prev_a == prev_b) {
+        return;
+    }
+    FrameIdType prev_id = prev_a ? loop_info.keyframe_id_a : loop_info.keyframe_id_b;
+    FrameIdType cur_id = prev_a ? loop_info.keyframe_id_b : loop_info.keyframe_id_a;
+    if (state.hasFrame(prev_id) || !state.hasFrame(cur_id)) {
+        return;
+    }
+    if (prev_session_poses.find(prev_id) == prev_session_poses.end()) {
+        printf("[D2PGO@%d]no stored pose of previous session frame %ld, ignore its loops\n", self_id, prev_id);
+        return;
+    }
+    D2BaseFrame frame_desc;
+    frame_desc.drone_id = prev_a ? loop_info.id_a : loop_info.id_b;
+    frame_desc.frame_id = prev_id;
+    frame_desc.reference_frame_id = state.getFramebyId(cur_id)->reference_frame_id;
+    auto cur_pose = state.getFramebyId(cur_id)->odom.pose();
+    frame_desc.odom.pose() = prev_a ? cur_pose * loop_info.relative_pose.inverse() : cur_pose * loop_info.relative_pose;
+    state.addFrame(frame_desc, false);
+    prev_session_frames[prev_id >> SESSION_ID_SHIFT].push_back(prev_id);
+    rejection.addPreviousSessionFrame(prev_id, prev_session_poses.at(prev_id));
+    printf("[D2PGO@%d]add previous session frame %ld by loop with %ld\n", self_id, prev_id, cur_id);
 }
 
 void D2PGO::inputDPGOData(const DPGOData & data) {
@@ -134,6 +177,7 @@ bool D2PGO::solve_multi(bool force_solve) {
         static_cast<ARockPGO*>(solver)->resetResiduals();
         // solver = new ARockPGO(&state, this, config.arock_config);
     }
+    clearFactorRecords();
     // used_frames.clear();
     used_loops.clear();
     //Use available loops for outlier rejection.
@@ -223,9 +267,25 @@ bool D2PGO::solve_single() {
         // printf("[D2PGO] Not enough frames to solve %d.\n", state.size(self_id));
         return false;
     }
-    used_loops.clear();
-
-    solver = new CeresSolver(&state, config.ceres_options);
+    //Incremental: keep the problem of last solve and only add the new factors
+    bool incremental = config.enable_incremental_solve && solver != nullptr && isRotInitConvergence() &&
+        incremental_solve_count < config.incremental_full_solve_interval;
+    if (!incremental) {
+        used_loops.clear();
+        clearFactorRecords();
+        relin_frames.clear();
+        if (config.enable_incremental_solve && incremental_solve_count >= config.incremental_full_solve_interval) {
+            is_rot_init_convergence = false;
+        }
+        incremental_solve_count = 0;
+        if (solver == nullptr) {
+            ceres::Problem::Options problem_options;
+            problem_options.enable_fast_removal = config.enable_incremental_solve;
+            solver = new CeresSolver(&state, config.ceres_options, problem_options);
+        } else {
+            solver->reset();
+        }
+    }
     // used_frames.clear();
     //Use available loops for outlier rejection.
     std::vector<Swarm::LoopEdge> available_loops;
@@ -234,11 +294,17 @@ bool D2PGO::solve_single() {
             available_loops.emplace_back(loop_info);
         }
     }
+    std::vector<Swarm::LoopEdge> good_loops;
     if (config.enable_pcm) {
-        auto good_loops = rejection.OutlierRejectionLoopEdges(ros::Time::now(), available_loops);
-        setupLoopFactors(solver, good_loops);
+        good_loops = rejection.OutlierRejectionLoopEdges(ros::Time::now(), available_loops);
     } else {
-        setupLoopFactors(solver, available_loops);
+        good_loops = available_loops;
+    }
+    std::set<FrameIdType> affected_frames;
+    if (incremental) {
+        updateLoopFactors(good_loops, affected_frames);
+    } else {
+        setupLoopFactors(solver, good_loops);
     }
     if (config.enable_ego_motion) {
         setupEgoMotionFactors(solver);
@@ -250,6 +316,7 @@ bool D2PGO::solve_single() {
             saveG2O();
         }
         //Simply return here, we do solve ceres in.
+        solver->reset();
         delete solver;
         solver = nullptr;
         return solve_single();
@@ -261,11 +328,44 @@ bool D2PGO::solve_single() {
         updated = false;
         return true;
     }
-    if (config.enable_gravity_prior) {
+    if (config.enable_gravity_prior && !incremental) {
+        //In incremental solve the new frames get their gravity prior at the next full solve
         setupGravityPriorFactors(solver);
     }
     setStateProperties(solver->getProblem());
+    std::set<FrameIdType> active_frames;
+    if (incremental) {
+        active_frames = incrementalActiveFrames(affected_frames);
+        setActiveFrames(solver->getProblem(), active_frames);
+    } else if (config.enable_incremental_solve) {
+        active_frames = used_frames;
+    }
+    //States before solve for relinearization
+    int state_size = frameStateSize();
+    std::map<FrameIdType, std::vector<state_type>> states_before;
+    for (auto frame_id : active_frames) {
+        auto pointer = frameState(frame_id);
+        states_before[frame_id] = std::vector<state_type>(pointer, pointer + state_size);
+    }
     auto report = solver->solve();
+    if (config.enable_incremental_solve) {
+        relin_frames.clear();
+        for (auto & it : states_before) {
+            auto pointer = frameState(it.first);
+            for (int i = 0; i < state_size; i ++) {
+                if (fabs(pointer[i] - it.second[i]) > config.incremental_relin_thres) {
+                    relin_frames.insert(it.first);
+                    break;
+                }
+            }
+        }
+        for (auto drone_id : state.availableDrones()) {
+            solved_frame_num[drone_id] = state.size(drone_id);
+        }
+        if (incremental) {
+            incremental_solve_count ++;
+        }
+    }
     if (config.perturb_mode) {
         postPerturbSolve();
     } else {
@@ -277,14 +377,114 @@ bool D2PGO::solve_single() {
     if (config.write_g2o) {
         saveG2O();
     }
-    printf("[D2PGO::solve@%d] solve_count %d mode single,%d total frames %ld loops %d opti_time %.1fms iters %d initial cost %.2e final cost %.2e\n", 
-            self_id, solve_count, config.mode, used_frames.size(), used_loops_count, report.total_time*1000, 
+    printf("[D2PGO::solve@%d] solve_count %d mode single,%d%s total frames %ld active %ld loops %d opti_time %.1fms iters %d initial cost %.2e final cost %.2e\n", 
+            self_id, solve_count, config.mode, incremental ? ",incremental" : "", used_frames.size(), 
+            incremental ? active_frames.size() : used_frames.size(), used_loops_count, report.total_time*1000, 
             report.total_iterations, report.initial_cost, report.final_cost);
     solve_count ++;
     updated = false;
     return true;
 }
 
+void D2PGO::clearFactorRecords() {
+    loop_residuals.clear();
+    ego_motion_factor_num.clear();
+    prev_session_factor_num.clear();
+    solved_frame_num.clear();
+}
+
+//Add the new good loops to the problem and remove the loops rejected since the last solve.
+void D2PGO::updateLoopFactors(const std::vector<Swarm::LoopEdge> & good_loops, std::set<FrameIdType> & affected_frames) {
+    std::set<int> good_ids;
+    std::vector<Swarm::LoopEdge> new_loops;
+    for (auto & loop : good_loops) {
+        good_ids.insert(loop.id);
+        if (loop_residuals.find(loop.id) == loop_residuals.end()) {
+            new_loops.emplace_back(loop);
+            affected_frames.insert(loop.keyframe_id_a);
+            affected_frames.insert(loop.keyframe_id_b);
+        }
+    }
+    std::vector<ResidualInfo*> removing;
+    std::set<int> removed_ids;
+    for (auto it = loop_residuals.begin(); it != loop_residuals.end();) {
+        if (good_ids.find(it->first) == good_ids.end()) {
+            auto & loop = all_loops[it->first];
+            affected_frames.insert(loop.keyframe_id_a);
+            affected_frames.insert(loop.keyframe_id_b);
+            removing.emplace_back(it->second);
+            removed_ids.insert(it->first);
+            it = loop_residuals.erase(it);
+        } else {
+            it ++;
+        }
+    }
+    if (removing.size() > 0) {
+        solver->removeResiduals(removing);
+        used_loops.erase(std::remove_if(used_loops.begin(), used_loops.end(), [&](const Swarm::LoopEdge & edge) {
+            return removed_ids.find(edge.id) != removed_ids.end() && 
+                edge.keyframe_id_a == all_loops[edge.id].keyframe_id_a && edge.keyframe_id_b == all_loops[edge.id].keyframe_id_b;
+        }), used_loops.end());
+    }
+    setupLoopFactors(solver, new_loops);
+    used_loops_count = loop_residuals.size();
+}
+
+//With frames eliminated in time order, a new factor changes the estimate of its frames and of every later frame
+//of the same drone, the rest of the graph keeps its linearization (as the affected part of the Bayes tree in iSAM).
+std::set<FrameIdType> D2PGO::incrementalActiveFrames(const std::set<FrameIdType> & affected_frames) {
+    std::set<FrameIdType> active_frames = relin_frames;
+    for (auto drone_id : state.availableDrones()) {
+        auto & frames = state.getFrames(drone_id);
+        //New frames and the last solved one, which gets the new ego-motion factor
+        int start = 0;
+        if (solved_frame_num.find(drone_id) != solved_frame_num.end()) {
+            start = std::max(solved_frame_num.at(drone_id) - 1, 0);
+        }
+        for (int i = 0; i < start; i ++) {
+            if (affected_frames.find(frames[i]->frame_id) != affected_frames.end()) {
+                start = i;
+                break;
+            }
+        }
+        for (int i = start; i < frames.size(); i ++) {
+            if (used_frames.find(frames[i]->frame_id) != used_frames.end()) {
+                active_frames.insert(frames[i]->frame_id);
+            }
+        }
+    }
+    return active_frames;
+}
+
+void D2PGO::setActiveFrames(ceres::Problem & problem, const std::set<FrameIdType> & active_frames) {
+    auto head_id = state.headId(self_id);
+    for (auto frame_id : used_frames) {
+        auto pointer = frameState(frame_id);
+        if (!problem.HasParameterBlock(pointer) || frame_id == head_id) {
+            continue;
+        }
+        if (active_frames.find(frame_id) != active_frames.end()) {
+            problem.SetParameterBlockVariable(pointer);
+        } else {
+            problem.SetParameterBlockConstant(pointer);
+        }
+    }
+}
+
+state_type * D2PGO::frameState(FrameIdType frame_id) {
+    if (config.perturb_mode && config.pgo_pose_dof == PGO_POSE_6D) {
+        return state.getPerturbState(frame_id);
+    }
+    return state.getPoseState(frame_id);
+}
+
+int D2PGO::frameStateSize() const {
+    if (config.pgo_pose_dof == PGO_POSE_4D) {
+        return POSE4D_SIZE;
+    }
+    return config.perturb_mode ? POSE_EFF_SIZE : POSE_SIZE;
+}
+
 bool D2PGO::isRotInitConvergence() const {
     return is_rot_init_convergence || !config.enable_rotation_initialization;
 }
@@ -308,7 +508,9 @@ void D2PGO::rotInitial(const std::vector<Swarm::LoopEdge> & good_loops) {
         rot_init->setFixedFrameId(state.headId(self_id));
     }
     SolverReport report = rot_init->solve();
-    if (config.mode == PGO_MODE_NON_DIST || (report.state_changes < config.rot_init_state_eps && solve_count > 10)) {
+    if (!report.succ) {
+        printf("[D2PGO@%d]rotInitial: rot init linear solve failed\n", self_id);
+    } else if (config.mode == PGO_MODE_NON_DIST || (report.state_changes < config.rot_init_state_eps && solve_count > 10)) {
         is_rot_init_convergence = true;
         printf("[D2PGO@%d]rotInitial: rot init convergence: %.1f%%\n", self_id, report.state_changes*100);
     } else {
@@ -344,7 +546,7 @@ void D2PGO::saveG2O(bool only_self) {
 }
 
 void D2PGO::evalLoop(const Swarm::LoopEdge & loop) {
-    auto factor = new RelPoseFactor4D(loop.relative_pose, loop.getSqrtInfoMat4D());
+    auto factor = new RelPoseFactor4DAD(loop.relative_pose, loop.getSqrtInfoMat4D());
     auto kf_a = state.getFramebyId(loop.keyframe_id_a);
     auto kf_b = state.getFramebyId(loop.keyframe_id_b);
     auto pose_ptr_a = state.getPoseState(loop.keyframe_id_a);
@@ -366,26 +568,12 @@ void D2PGO::setupLoopFactors(SolverWrapper * solver, const std::vector<Swarm::Lo
     auto loss_function = nullptr;
     for (auto loop : good_loops) {
         if (state.hasFrame(loop.keyframe_id_a) && state.hasFrame(loop.keyframe_id_b)) {
-            ceres::CostFunction * loop_factor = nullptr;
-            if (config.pgo_pose_dof == PGO_POSE_4D) {
-                loop_factor = RelPoseFactor4D::Create(loop);
-                // this->evalLoop(loop);
-            } else {
-                if (config.pgo_use_autodiff) {
-                    if (config.perturb_mode && isRotInitConvergence()) {
-                        auto qa = state.getAttitudeInit(loop.keyframe_id_a);
-                        auto qb = state.getAttitudeInit(loop.keyframe_id_b);
-                        loop_factor = RelPoseFactorPerturbAD::Create(loop, qa, qb);
-                    } else {
-                        loop_factor = RelPoseFactorAD::Create(loop);
-                    }
-                } else {
-                    loop_factor = RelPoseFactor::Create(loop);
-                }
-            }
+            auto loop_factor = createRelPoseFactor(loop);
+            // this->evalLoop(loop);
             auto res_info = RelPoseResInfo::create(loop_factor, 
                 loss_function, loop.keyframe_id_a, loop.keyframe_id_b, config.pgo_pose_dof == PGO_POSE_4D, config.perturb_mode);
             solver->addResidual(res_info);
+            loop_residuals[loop.id] = res_info;
             used_frames.insert(loop.keyframe_id_a);
             used_frames.insert(loop.keyframe_id_b);
             auto drone_id_a = state.getFramebyId(loop.keyframe_id_a)->drone_id;
@@ -410,47 +598,17 @@ void D2PGO::setupLoopFactors(SolverWrapper * solver, const std::vector<Swarm::Lo
 }
 
 void D2PGO::setupEgoMotionFactors(SolverWrapper * solver, int drone_id) {
-    auto frames = state.getFrames(drone_id);
+    auto & frames = state.getFrames(drone_id);
     auto traj = state.getEgomotionTraj(drone_id);
-    for (int i = 0; i < frames.size() - 1; i ++ ) {
+    //Factors before ego_motion_factor_num are already in the problem in incremental solve
+    for (int i = ego_motion_factor_num[drone_id]; i < (int) frames.size() - 1; i ++ ) {
         auto frame_a = frames[i];
         auto frame_b = frames[i + 1];
-        Swarm::Pose rel_pose;
-        if (config.pgo_pose_dof == PGO_POSE_4D) {
-            rel_pose = Swarm::Pose::DeltaPose(frame_a->initial_ego_pose, frame_b->initial_ego_pose, true);
-        } else {
-            rel_pose = Swarm::Pose::DeltaPose(frame_a->initial_ego_pose, frame_b->initial_ego_pose);
-        }
-        double len = rel_pose.pos().norm();
-        if (len < config.min_cov_len) {
-            len = config.min_cov_len;
-        }
-        Eigen::Matrix6d cov = Eigen::Matrix6d::Zero();
-        cov.block<3, 3>(0, 0) = Matrix3d::Identity()*config.pos_covariance_per_meter*len 
-            + 0.5*Matrix3d::Identity()*config.yaw_covariance_per_meter*len*len;
-        cov.block<3, 3>(3, 3) = Matrix3d::Identity()*config.yaw_covariance_per_meter*len;
-        Matrix6d sqrt_info = cov.inverse().cwiseAbs().cwiseSqrt();
-        Swarm::LoopEdge loop(frame_a->frame_id, frame_b->frame_id, rel_pose, sqrt_info);
-        if (config.pgo_pose_dof == PGO_POSE_4D) {
-            auto factor = RelPoseFactor4D::Create(loop);
-            auto res_info = RelPoseResInfo::create(factor, nullptr, frame_a->frame_id, frame_b->frame_id, true);
-            solver->addResidual(res_info);
-        } else if (config.pgo_pose_dof == PGO_POSE_6D) {
-            ceres::CostFunction * factor;
-            if (config.pgo_use_autodiff) {
-                if (config.perturb_mode && isRotInitConvergence()) {
-                    auto qa = state.getAttitudeInit(frame_a->frame_id);
-                    auto qb = state.getAttitudeInit(frame_b->frame_id);
-                    factor = RelPoseFactorPerturbAD::Create(loop, qa, qb);
-                } else {
-                    factor = RelPoseFactorAD::Create(loop);
-                }
-            } else {
-                factor = RelPoseFactor::Create(loop);
-            }
-            auto res_info = RelPoseResInfo::create(factor, nullptr, frame_a->frame_id, frame_b->frame_id, false, config.perturb_mode);
-            solver->addResidual(res_info);
-        }
+        auto loop = odometryEdge(frame_a->frame_id, frame_b->frame_id, frame_a->initial_ego_pose, frame_b->initial_ego_pose);
+        auto factor = createRelPoseFactor(loop);
+        auto res_info = RelPoseResInfo::create(factor, nullptr, frame_a->frame_id, frame_b->frame_id, 
+            config.pgo_pose_dof == PGO_POSE_4D, config.perturb_mode);
+        solver->addResidual(res_info);
         used_frames.insert(frame_a->frame_id);
         used_frames.insert(frame_b->frame_id);
         used_loops.emplace_back(loop);
@@ -459,6 +617,65 @@ void D2PGO::setupEgoMotionFactors(SolverWrapper * solver, int drone_id) {
             used_latest_ts[frame_b->drone_id] = frame_b->stamp;
         }
     }
+    ego_motion_factor_num[drone_id] = std::max((int) frames.size() - 1, 0);
+}
+
+Swarm::LoopEdge D2PGO::odometryEdge(FrameIdType id_a, FrameIdType id_b, const Swarm::Pose & pose_a, const Swarm::Pose & pose_b) const {
+    Swarm::Pose rel_pose;
+    if (config.pgo_pose_dof == PGO_POSE_4D) {
+        rel_pose = Swarm::Pose::DeltaPose(pose_a, pose_b, true);
+    } else {
+        rel_pose = Swarm::Pose::DeltaPose(pose_a, pose_b);
+    }
+    double len = rel_pose.pos().norm();
+    if (len < config.min_cov_len) {
+        len = config.min_cov_len;
+    }
+    Eigen::Matrix6d cov = Eigen::Matrix6d::Zero();
+    cov.block<3, 3>(0, 0) = Matrix3d::Identity()*config.pos_covariance_per_meter*len 
+        + 0.5*Matrix3d::Identity()*config.yaw_covariance_per_meter*len*len;
+    cov.block<3, 3>(3, 3) = Matrix3d::Identity()*config.yaw_covariance_per_meter*len;
+    Matrix6d sqrt_info = cov.inverse().cwiseAbs().cwiseSqrt();
+    return Swarm::LoopEdge(id_a, id_b, rel_pose, sqrt_info);
+}
+
+void D2PGO::setupPreviousSessionFactors(SolverWrapper * solver) {
+    //Keyframes of a previous session are chained in the order they join the graph, by their stored poses
+    for (auto & it : prev_session_frames) {
+        auto & frames = it.second;
+        for (int i = std::max(prev_session_factor_num[it.first], 1); i < (int) frames.size(); i ++) {
+            auto loop = odometryEdge(frames[i - 1], frames[i], prev_session_poses.at(frames[i - 1]), prev_session_poses.at(frames[i]));
+            auto factor = createRelPoseFactor(loop);
+            auto res_info = RelPoseResInfo::create(factor, nullptr, frames[i - 1], frames[i], 
+                config.pgo_pose_dof == PGO_POSE_4D, config.perturb_mode);
+            solver->addResidual(res_info);
+            used_frames.insert(frames[i - 1]);
+            used_frames.insert(frames[i]);
+            used_loops.emplace_back(loop);
+        }
+        prev_session_factor_num[it.first] = frames.size();
+    }
+}
+
+ceres::CostFunction * D2PGO::createRelPoseFactor(const Swarm::LoopEdge & loop) {
+    if (config.pgo_pose_dof == PGO_POSE_4D) {
+        if (config.pgo_use_autodiff) {
+            return RelPoseFactor4DAD::Create(loop);
+        }
+        return RelPoseFactor4D::Create(loop);
+    }
+    if (config.perturb_mode && isRotInitConvergence()) {
+        auto qa = state.getAttitudeInit(loop.keyframe_id_a);
+        auto qb = state.getAttitudeInit(loop.keyframe_id_b);
+        if (config.pgo_use_autodiff) {
+            return RelPoseFactorPerturbAD::Create(loop, qa, qb);
+        }
+        return RelPoseFactorPerturb::Create(loop, qa, qb);
+    }
+    if (config.pgo_use_autodiff) {
+        return RelPoseFactorAD::Create(loop);
+    }
+    return RelPoseFactor::Create(loop);
 }
 
 void D2PGO::setupGravityPriorFactors(SolverWrapper * solver) {
@@ -496,6 +713,7 @@ void D2PGO::setupEgoMotionFactors(SolverWrapper * solver) {
     } else if (config.mode >= PGO_MODE_DISTRIBUTED_AROCK) {
         setupEgoMotionFactors(solver, self_id);
     }
+    setupPreviousSessionFactors(solver);
 }
 
 void D2PGO::setStateProperties(ceres::Problem & problem) {
@@ -38,11 +38,33 @@ protected:
     bool rot_init_finished = false;
     int save_count = 0;
 
+    //Incremental solve_single
+    std::map<int, ResidualInfo*> loop_residuals; //Loop id -> residual in the problem
+    std::map<int, int> ego_motion_factor_num; //Number of ego-motion factors of each drone in the problem
+    std::map<int, int> prev_session_factor_num; //Number of chained keyframes of each previous session in the problem
+    std::map<int, int> solved_frame_num; //Number of frames of each drone in the last solve
+    std::set<FrameIdType> relin_frames; //Frames moved more than incremental_relin_thres in the last solve
+    int incremental_solve_count = 0; //Incremental solves since the last full solve
+
+    //Keyframes of previous sessions
+    std::map<FrameIdType, Swarm::Pose> prev_session_poses; //Stored pose, in the frame of its session
+    std::map<int, std::vector<FrameIdType>> prev_session_frames; //Session -> keyframes in the order they join the graph
+
     void saveG2O(bool only_self=false);
+    void addPreviousSessionFrame(const Swarm::LoopEdge & loop_info);
+    void setupPreviousSessionFactors(SolverWrapper * solver);
+    Swarm::LoopEdge odometryEdge(FrameIdType id_a, FrameIdType id_b, const Swarm::Pose & pose_a, const Swarm::Pose & pose_b) const;
     void setupLoopFactors(SolverWrapper * solver, const std::vector<Swarm::LoopEdge> & good_loops);
     void setupEgoMotionFactors(SolverWrapper * solver);
     void setupEgoMotionFactors(SolverWrapper * solver, int drone_id);
     void setupGravityPriorFactors(SolverWrapper * solver);
+    ceres::CostFunction * createRelPoseFactor(const Swarm::LoopEdge & loop);
+    void clearFactorRecords();
+    void updateLoopFactors(const std::vector<Swarm::LoopEdge> & good_loops, std::set<FrameIdType> & affected_frames);
+    std::set<FrameIdType> incrementalActiveFrames(const std::set<FrameIdType> & affected_frames);
+    void setActiveFrames(ceres::Problem & problem, const std::set<FrameIdType> & active_frames);
+    state_type * frameState(FrameIdType frame_id);
+    int frameStateSize() const;
     bool isMain() const;
     bool isRotInitConvergence() const;
     void waitForRotInitFinish();
@@ -54,12 +76,13 @@ public:
     D2PGO(D2PGOConfig _config):
         config(_config), self_id(_config.self_id), main_id(_config.main_id),
         state(_config.self_id, _config.pgo_pose_dof == PGO_POSE_4D),
-        rejection(_config.self_id, _config.pcm_rej, ego_motion_trajs),
+        rejection(_config.self_id, _config.pcm_rej),
         available_robots{_config.self_id} {
     }
     void evalLoop(const Swarm::LoopEdge & loop);
     void addFrame(D2BaseFrame frame_desc);
     void addLoop(const Swarm::LoopEdge & loop_info, bool add_state_by_loop=false);
+    void addPreviousSessionPose(FrameIdType frame_id, const Swarm::Pose & pose);
     void setStateProperties(ceres::Problem & problem);
     bool solve_multi(bool force_solve=false);
     bool solve_single();
@@ -14,6 +14,7 @@ struct RotInitConfig {
     bool enable_float32 = true;
     bool enable_pose6d_solver = false;
     int pose6d_iterations = 1;
+    bool enable_cholmod = true; //Supernodal CHOLMOD LLT when built with USE_CHOLMOD, otherwise SimplicialLLT
     int self_id;
 };
 
@@ -26,6 +27,9 @@ struct SwarmLocalOutlierRejectionParams {
     bool redundant = true;
     bool is_4dof = true;
     bool incremental_pcm = true;
+    int num_threads = 0; //Threads for the pairwise consistency checks, 0 for the hardware concurrency
+    double pos_covariance_per_meter = 4e-3; //Odometry covariance model of the consistency checks
+    double yaw_covariance_per_meter = 4e-5;
 };
 
 struct D2PGOConfig {
@@ -49,12 +53,17 @@ struct D2PGOConfig {
     bool enable_rotation_initialization = true;
     bool enable_gravity_prior = false;
     bool debug_rot_init_only = false;
-    bool pgo_use_autodiff = true;
+    bool pgo_use_autodiff = false; //Otherwise the pose graph factors with analytic Jacobians are used
     bool perturb_mode = true;
     double rot_init_state_eps = 1e-2;
     SwarmLocalOutlierRejectionParams pcm_rej;
     RotInitConfig rot_init_config;
     double rot_init_timeout = 3;
     bool debug_save_g2o_only = false;
+    //Incremental solve_single: the problem is kept between solves, only new factors are added and only the frames
+    //affected by them or moved more than incremental_relin_thres in the last solve are optimized.
+    bool enable_incremental_solve = false;
+    int incremental_full_solve_interval = 50; //Rebuild and solve the whole graph after these incremental solves
+    double incremental_relin_thres = 1e-3;
 };
 }
\ No newline at end of file
@@ -39,6 +39,13 @@ protected:
     
     void processLoop(const swarm_msgs::LoopEdge & loop_info) {
         // ROS_INFO("[D2PGONode@%d] processLoop from %ld to %ld", config.self_id, loop_info.keyframe_id_a, loop_info.keyframe_id_b);
+        //Keyframes of previous sessions come with their stored poses
+        if (isPreviousSessionFrame(loop_info.keyframe_id_a)) {
+            pgo->addPreviousSessionPose(loop_info.keyframe_id_a, Swarm::Pose(loop_info.self_pose_a));
+        }
+        if (isPreviousSessionFrame(loop_info.keyframe_id_b)) {
+            pgo->addPreviousSessionPose(loop_info.keyframe_id_b, Swarm::Pose(loop_info.self_pose_b));
+        }
         pgo->addLoop(Swarm::LoopEdge(loop_info));
     }
     
@@ -183,16 +190,42 @@ protected:
         config.arock_config.rho_frame_theta = fsSettings["pgo_rho_frame_theta"];
         config.arock_config.eta_k = fsSettings["pgo_eta_k"];
         config.arock_config.max_steps = 1;
+        if (!fsSettings["pgo_arock_adaptive_steps"].empty()) {
+            config.arock_config.adaptive_steps = (int) fsSettings["pgo_arock_adaptive_steps"];
+        }
+        if (!fsSettings["pgo_arock_step_changes_thres"].empty()) {
+            config.arock_config.step_changes_thres = fsSettings["pgo_arock_step_changes_thres"];
+        }
 
         //Outlier rejection
         config.is_realtime = true;
         config.enable_pcm = (int)fsSettings["enable_pcm"];
         config.pcm_rej.pcm_thres = fsSettings["pcm_thres"];
+        if (!fsSettings["pcm_num_threads"].empty()) {
+            config.pcm_rej.num_threads = (int) fsSettings["pcm_num_threads"];
+        }
+        config.pcm_rej.pos_covariance_per_meter = config.pos_covariance_per_meter;
+        config.pcm_rej.yaw_covariance_per_meter = config.yaw_covariance_per_meter;
         config.enable_rotation_initialization = false;
         config.enable_gravity_prior = (int)fsSettings["enable_gravity_prior"];
         config.rot_init_config.gravity_sqrt_info = fsSettings["gravity_sqrt_info"];
         solver_timer_freq = (double) fsSettings["solver_timer_freq"];
         config.perturb_mode = true;
+        if (!fsSettings["pgo_rot_init_cholmod"].empty()) {
+            config.rot_init_config.enable_cholmod = (int) fsSettings["pgo_rot_init_cholmod"];
+        }
+        if (!fsSettings["pgo_use_autodiff"].empty()) {
+            config.pgo_use_autodiff = (int) fsSettings["pgo_use_autodiff"];
+        }
+        if (!fsSettings["pgo_incremental_solve"].empty()) {
+            config.enable_incremental_solve = (int) fsSettings["pgo_incremental_solve"];
+        }
+        if (!fsSettings["pgo_incremental_full_solve_interval"].empty()) {
+            config.incremental_full_solve_interval = (int) fsSettings["pgo_incremental_full_solve_interval"];
+        }
+        if (!fsSettings["pgo_incremental_relin_thres"].empty()) {
+            config.incremental_relin_thres = fsSettings["pgo_incremental_relin_thres"];
+        }
         //Debugging 
         config.debug_save_g2o_only = (int) fsSettings["debug_save_g2o_only"];
         if (config.mode == PGO_MODE::PGO_MODE_NON_DIST) {
@@ -22,7 +22,8 @@ public:
         drone_frames[self_id] = std::vector<D2BaseFrame*>();
     }
 
-    void addFrame(const D2BaseFrame & _frame) {
+    //Frames without ego motion, e.g. keyframes of previous sessions, are only connected by loops.
+    void addFrame(const D2BaseFrame & _frame, bool has_ego_motion = true) {
         const Guard lock(state_lock);
         // printf("[D2PGO@%d] PGOState: add frame %ld for drone %d: %s\n", self_id, 
         //         _frame.frame_id, _frame.drone_id, _frame.odom.pose().toStr().c_str());
@@ -47,6 +48,9 @@ public:
 
             initial_attitude[frame->frame_id] = _frame.odom.att();
         }
+        if (!has_ego_motion) {
+            return;
+        }
         if (drone_frames.find(_frame.drone_id) == drone_frames.end()) {
             drone_frames[_frame.drone_id] = std::vector<D2BaseFrame*>();
             ego_drone_trajs[_frame.drone_id] = Swarm::DroneTrajectory();
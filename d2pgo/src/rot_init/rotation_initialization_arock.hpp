@@ -23,21 +23,22 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
         }
         report.total_time = tic.toc() / 1000;
         report.total_iterations = 1;
-        report.succ = true;
+        report.succ = RotationInitialization<T>::last_solve_succ;
         report.message = "";
         // printf("[RotationInitARock::solveLocalStep%d] local solve time: %.3f ms state changes %f\n", self_id, report.total_time * 1000, report.state_changes);
         return report;
     }
 
     void setDualStateFactors() {
-        for (auto &param_pair : dual_states_remote) {
-            for (auto it : param_pair.second) {
-                auto state_pointer = it.first;
+        for (auto &param_pair : dual_states) {
+            auto &duals = param_pair.second;
+            for (int i = 0; i < duals.size(); i ++) {
+                auto state_pointer = duals.param(i);
                 auto param_info = all_estimating_params.at(state_pointer);
                 if (RotationInitialization<T>::isFixedFrame(param_info.id)) {
                     continue;
                 }
-                auto &dual_state = it.second;
+                VectorXd dual_state = duals.remote(i);
                 if (solve_6d) {
                     Matrix6d inf = Matrix6d::Identity();
                     inf.block<3, 3>(0, 0) *= config.rho_frame_T;
@@ -113,7 +114,7 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
     void broadcastData() {
         const std::lock_guard<std::recursive_mutex> lock(pgo_data_mutex);
         // broadcast the data.
-        for (auto it : dual_states_local) {
+        for (auto &it : dual_states) {
             DPGOData data;
             data.stamp = ros::Time::now().toSec();
             data.drone_id = self_id;
@@ -124,16 +125,16 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
             } else {
                 data.type = DPGO_ROT_MAT_DUAL;
             }
-            for (auto it2 : it.second) {
-                auto ptr = it2.first;
-                auto &dual_state = it2.second;
+            auto &duals = it.second;
+            for (int i = 0; i < duals.size(); i ++) {
+                auto ptr = duals.param(i);
                 // printf("[broadcastData%d] local dual drone %d: frame_id %d delta:", self_id, 
                 //         data.target_id, all_estimating_params.at(ptr).id);
-                // std::cout << dual_state.transpose() << std::endl;
+                // std::cout << duals.local(i).transpose() << std::endl;
                 ParamInfo param = all_estimating_params.at(ptr);
                 data.frame_poses[param.id] =
                     state->getFramebyId(param.id)->odom.pose();
-                data.frame_duals[param.id] = dual_state;
+                data.frame_duals[param.id] = duals.local(i);
             }
             if (broadcastDataCallback) broadcastDataCallback(data);
         }
@@ -170,9 +171,10 @@ class RotationInitARock : public RotationInitialization<T>, public ARockBase {
                         // printf("[processPGOData%d] remote dual drone %d: frame_id %d dual:", self_id, 
                         //         drone_id, param_info.id);
                         // std::cout << dual.transpose() << std::endl;
-                        dual_states_remote[drone_id][ptr] = dual;
+                        auto &duals = dual_states.at(drone_id);
+                        duals.remote(ptr) = dual;
                         if (create) 
-                            dual_states_local[drone_id][ptr] = dual;
+                            duals.local(ptr) = dual;
                     }
                 } else {
                     ROS_WARN("[ARockPGO@%d]process DPGOData from %d, frame_id %ld not found\n", self_id, data.drone_id, frame_id);
@@ -211,6 +213,7 @@ public:
     void addLoops(const std::vector<Swarm::LoopEdge> &good_loops) override {
         RotationInitialization<T>::addLoops(good_loops);
         updated = true;
+        need_scan = true;
     }
 
     void inputDPGOData(const DPGOData &data) {
@@ -218,6 +221,7 @@ public:
         // data.drone_id);
         std::lock_guard<std::recursive_mutex> lock(pgo_data_mutex);
         pgo_data.push_back(data);
+        notifyDualData();
         for (auto it : data.frame_duals) {
             auto frame_id = it.first;
             if (RotationInitialization<T>::state->hasFrame(frame_id)) {
@@ -3,27 +3,18 @@
 #include "../pgostate.hpp"
 #include <swarm_msgs/relative_measurments.hpp>
 #include "../d2pgo_config.h"
+#include "sparse_normal_equation.hpp"
 
 namespace D2PGO {
 using D2Common::Utility::skewSymVec3;
 using D2Common::Utility::recoverRotationSVD;
 using D2Common::Utility::TicToc;
 
-template <typename Derived, typename T>
-inline void fillInTripet(int i0, int j0, const MatrixBase<Derived> & M, std::vector<Eigen::Triplet<T>> & triplets) {
-    for (int i = 0; i < M.rows(); i ++) { //Row, col of relative rotation R
-        for (int j = 0; j < M.cols(); j ++) {
-            triplets.emplace_back(Eigen::Triplet<T>(i0 + i, j0 + j, M(i, j)));
-        }
-    }
-}
-
 template<typename T>
 class RotationInitialization {
 protected:
     typedef Eigen::Matrix<T, 3, 3> Mat3;
     typedef Eigen::Matrix<T, 3, 1> Vec3;
-    typedef Eigen::Triplet<T> Tpl;
     typedef Eigen::Matrix<T, Eigen::Dynamic, 1> VecX;
 
     PGOState * state = nullptr;
@@ -37,6 +28,9 @@ protected:
     int self_id;
     int eff_frame_num = 0;
     bool is_multi = false;
+    bool last_solve_succ = true; //False if the last linear solve failed and the state was not updated
+    SparseNormalEquation<T> rot_neq; //Separate normal equations keep the symbolic analysis of both problems
+    SparseNormalEquation<T> pose_neq;
 
     virtual void addFrameId(FrameIdType _frame_id) {
         all_frames.insert(_frame_id);
@@ -86,7 +80,7 @@ protected:
         }
     }
 
-    int setupRotInitProblembyLoop(int row_id, const Swarm::LoopEdge & loop, std::vector<Tpl> & triplet_list, VecX & b) {
+    int setupRotInitProblembyLoop(int row_id, const Swarm::LoopEdge & loop, SparseNormalEquation<T> & neq, VecX & b) {
         //Set up the problem
         auto frame_id_a = loop.keyframe_id_a;
         auto frame_id_b = loop.keyframe_id_b;
@@ -104,13 +98,13 @@ protected:
         Mat3 R = loop.relative_pose.R().template cast<T>();
         Mat3 Rt = R.transpose();
         for (int k = 0; k < 3; k ++) { //Row of Rotation of keyframe a
-            fillInTripet(row_id + k*POS_SIZE, ROTMAT_SIZE*idx_a + POS_SIZE*k, sqrt_info*Rt, triplet_list);
-            fillInTripet(row_id + k*POS_SIZE, ROTMAT_SIZE*idx_b + POS_SIZE*k, -sqrt_info, triplet_list);
+            neq.add(row_id + k*POS_SIZE, ROTMAT_SIZE*idx_a + POS_SIZE*k, sqrt_info*Rt);
+            neq.add(row_id + k*POS_SIZE, ROTMAT_SIZE*idx_b + POS_SIZE*k, -sqrt_info);
         }
         return row_id + 9;
     }
 
-    int setupRotInitProblembyPrior(int row_id, const Swarm::PosePrior & prior, std::vector<Tpl> & triplet_list, VecX & b) {
+    int setupRotInitProblembyPrior(int row_id, const Swarm::PosePrior & prior, SparseNormalEquation<T> & neq, VecX & b) {
         auto frame_id = prior.frame_id;
         auto idx = getFrameIdx(frame_id);
         if (idx == -1) {
@@ -122,13 +116,13 @@ protected:
         sqrt_R = Mat3::Identity() * sqrt_R.norm();
         // std::cout << "sqrtinfo:\n" << sqrt_R << std::endl;
         for (int k = 0; k < 3; k ++) { //Row of Rotation of keyframe a
-            fillInTripet(row_id + k*POS_SIZE, ROTMAT_SIZE*idx + POS_SIZE*k, sqrt_R, triplet_list);
+            neq.add(row_id + k*POS_SIZE, ROTMAT_SIZE*idx + POS_SIZE*k, sqrt_R);
             b.segment(row_id + k*POS_SIZE, POS_SIZE) = sqrt_R*Rt.col(k);     
         }
         return row_id + 9;
     }
 
-    int setupRotInitProblembyGravityPrior(int row_id, FrameIdType frame_id, std::vector<Tpl> & triplet_list, VecX & b) {
+    int setupRotInitProblembyGravityPrior(int row_id, FrameIdType frame_id, SparseNormalEquation<T> & neq, VecX & b) {
         //I3*r^3 = gravity_body
         auto idx = getFrameIdx(frame_id);
         if (idx == -1) {
@@ -138,81 +132,59 @@ protected:
         Vec3 gravity_body = (att_odom.inverse()*config.gravity_direction).template cast<T>();
         const int k = 2;
         Mat3 sqrt_info = Mat3::Identity()*config.gravity_sqrt_info;
-        fillInTripet(row_id, ROTMAT_SIZE*idx + POS_SIZE*k, sqrt_info, triplet_list);
+        neq.add(row_id, ROTMAT_SIZE*idx + POS_SIZE*k, sqrt_info);
         b.segment(row_id, 3) = sqrt_info*gravity_body;           
         return row_id + 3;
     }
 
-    VecX solveLinear(int row_id, int cols, const std::vector<Tpl> & triplet_list, VecX & b) {
-        SparseMatrix<T> A(row_id, cols);
-        A.setFromTriplets(triplet_list.begin(), triplet_list.end());
-        auto At = A.transpose();
-        SparseMatrix<T> H = At*A;
-        if (b.rows() > row_id) {
-            b.conservativeResize(row_id);
-        }
-        b = At*b;
-        Eigen::SimplicialLLT<Eigen::SparseMatrix<T>> solver;
-        solver.compute(H);
-        if (solver.info() != Eigen::Success) {
-            std::cout << solver.info() << std::endl;
-            std::ofstream ofsh("/tmp/H" + std::to_string(self_id) + ".txt");
-            for(int i = 0; i < H.outerSize(); i++)
-                for(typename Eigen::SparseMatrix<T>::InnerIterator it(H,i); it; ++it)
-                    ofsh << it.row() << " " << it.col() << " " << it.value() << std::endl;
-
-            std::ofstream ofs("/tmp/A" + std::to_string(self_id) + ".txt");
-            for (auto triplet : triplet_list) {
-                ofs << triplet.row() << " " << triplet.col() << " " << triplet.value() << std::endl;
-            }
-            ofs.close();
-            std::ofstream ofs1("/tmp/b" + std::to_string(self_id) + ".txt");
-            ofs1 << b << std::endl;
-            ofs1.close();
-        }
-        assert(solver.info() == Eigen::Success && "LLT failed");
-        auto X = solver.solve(b);
-        return X;
-    }
-
     double solveLinearRot() {
         TicToc tic;
+        last_solve_succ = false;
         VecX b(loops.size()*ROTMAT_SIZE + pose_priors.size()*ROTMAT_SIZE);
         if (config.enable_gravity_prior) {
             b.resize(loops.size()*ROTMAT_SIZE + pose_priors.size()*ROTMAT_SIZE + eff_frame_num*POS_SIZE);
         }
         b.setZero();
         int row_id = 0;
-        std::vector<Tpl> triplet_list;
+        rot_neq.reset(ROTMAT_SIZE*eff_frame_num);
         for (auto loop : loops) {
-            row_id = setupRotInitProblembyLoop(row_id, loop, triplet_list, b);
+            row_id = setupRotInitProblembyLoop(row_id, loop, rot_neq, b);
+            rot_neq.finishResidual(b);
         }
 
         for (auto prior: pose_priors) {
-            row_id = setupRotInitProblembyPrior(row_id, prior, triplet_list, b);
+            row_id = setupRotInitProblembyPrior(row_id, prior, rot_neq, b);
+            rot_neq.finishResidual(b);
         }
         
         if (config.enable_gravity_prior) {
             //For each frame, add the gravity prior
             for (auto it : frame_id_to_idx) {
                 auto frame_id = it.first;
-                row_id = setupRotInitProblembyGravityPrior(row_id, frame_id, triplet_list, b);
+                row_id = setupRotInitProblembyGravityPrior(row_id, frame_id, rot_neq, b);
+                rot_neq.finishResidual(b);
             }
         }
         double dt_setup = tic.toc();
         TicToc tic_solve;
-        auto X = solveLinear(row_id, 9*eff_frame_num, triplet_list, b);
+        VecX X;
+        bool succ = rot_neq.solve(X, std::to_string(self_id));
+        if (!succ) {
+            printf("[RotInit%d] solveLinearRot LLT failed, rotations are not updated\n", self_id);
+            return 1.0; //Must not be read as converged
+        }
+        last_solve_succ = true;
         double dt_solve = tic_solve.toc();
         TicToc tic2;
         auto state_changes = recoverRotationLLT(X);
-        printf("[RotInit%d] RotInit %.2fms setup %.2fms LLT %.2fms Recover %.2fms state_changes %.1f%% Poses %ld EffPoses %d Loops %ld Priors %ld F32: %d g_prior: %d\n", 
+        printf("[RotInit%d] RotInit %.2fms setup %.2fms LLT %.2fms Recover %.2fms state_changes %.1f%% Poses %ld EffPoses %d Loops %ld Priors %ld NNZ %d pattern_reused %d F32: %d g_prior: %d\n", 
             self_id, tic.toc(), dt_setup, dt_solve, tic2.toc(), state_changes*100,
-            frame_id_to_idx.size(), eff_frame_num, loops.size(), pose_priors.size(),
+            frame_id_to_idx.size(), eff_frame_num, loops.size(), pose_priors.size(), rot_neq.nonZeros(), rot_neq.patternReused(),
             typeid(T) == typeid(float), config.enable_gravity_prior);
         return state_changes;
     }
 
-    int setupPose6dProblembyLoop(int row_id, const Swarm::LoopEdge & loop, std::vector<Tpl> & triplet_list, VecX & b, bool finetune_rot = true) {
+    int setupPose6dProblembyLoop(int row_id, const Swarm::LoopEdge & loop, SparseNormalEquation<T> & neq, VecX & b, bool finetune_rot = true) {
         //Set up the problem
         int pose_size = POSE_EFF_SIZE;
         if (!finetune_rot) {
@@ -236,14 +208,14 @@ protected:
         //Translation error.
         //For now a pose has 6 param. XYZ and theta_x, theta_y, theta_z
         //Row of Rotation of keyframe a
-        fillInTripet(row_id, pose_size*idx_b, T_sqrt_info, triplet_list); //  take +T_sqrt_info*T_b
-        fillInTripet(row_id, pose_size*idx_a, -T_sqrt_info, triplet_list); // take -T_sqrt_info*T_a
+        neq.add(row_id, pose_size*idx_b, T_sqrt_info); //  take +T_sqrt_info*T_b
+        neq.add(row_id, pose_size*idx_a, -T_sqrt_info); // take -T_sqrt_info*T_a
         b.segment(row_id, 3) = T_sqrt_info*Ra*t;  // T_sqrt_info*R*T_a->b    
         if (!finetune_rot) {
             return row_id + 3;
         }
         Mat3 Cm = Ra*(skewSymVec3(t).transpose()); //R * S(v_a) t_{a->b} => Cm * v
-        fillInTripet(row_id, pose_size*idx_a + POS_SIZE, -T_sqrt_info*Cm, triplet_list); //  take Cm*T_sqrt_info*v_a
+        neq.add(row_id, pose_size*idx_a + POS_SIZE, -T_sqrt_info*Cm); //  take Cm*T_sqrt_info*v_a
         row_id = row_id + 3;
         //Finish translation error.
         //Rotation error.
@@ -258,7 +230,7 @@ protected:
                 Rb(2, 2),   0,          -Rb(2, 0),
                 -Rb(2, 1),  Rb(2, 0),   0;
 
-        fillInTripet(row_id, pose_size*idx_b + POS_SIZE, Cm_rb*R_sqrt_info, triplet_list); //  take Cm_rb*v_b
+        neq.add(row_id, pose_size*idx_b + POS_SIZE, Cm_rb*R_sqrt_info); //  take Cm_rb*v_b
         Matrix<T, 9, 3> Cm_ra;
         Cm_ra <<    Ra(0, 2)*Rab(1, 0) - Ra(0, 1)*Rab(2, 0), -Ra(0, 2)*Rab(0, 0) + Ra(0, 0)*Rab(2, 0), Ra(0, 1)*Rab(0, 0) - Ra(0, 0) * Rab(1, 0),
                     Ra(0, 2)*Rab(1, 1) - Ra(0, 1)*Rab(2, 1), -Ra(0, 2)*Rab(0, 1) + Ra(0, 0)*Rab(2, 1), Ra(0, 1)*Rab(0, 1) - Ra(0, 0) * Rab(1, 1),
@@ -269,7 +241,7 @@ protected:
                     Ra(2, 2)*Rab(1, 0) - Ra(2, 1)*Rab(2, 0), -Ra(2, 2)*Rab(0, 0) + Ra(2, 0)*Rab(2, 0), Ra(2, 1)*Rab(0, 0) - Ra(2, 0) * Rab(1, 0),
                     Ra(2, 2)*Rab(1, 1) - Ra(2, 1)*Rab(2, 1), -Ra(2, 2)*Rab(0, 1) + Ra(2, 0)*Rab(2, 1), Ra(2, 1)*Rab(0, 1) - Ra(2, 0) * Rab(1, 1),
                     Ra(2, 2)*Rab(1, 2) - Ra(2, 1)*Rab(2, 2), -Ra(2, 2)*Rab(0, 2) + Ra(2, 0)*Rab(2, 2), Ra(2, 1)*Rab(0, 2) - Ra(2, 0) * Rab(1, 2);
-        fillInTripet(row_id, pose_size*idx_a + POS_SIZE, -Cm_ra*R_sqrt_info, triplet_list); //  take -Cm_ra*v_a
+        neq.add(row_id, pose_size*idx_a + POS_SIZE, -Cm_ra*R_sqrt_info); //  take -Cm_ra*v_a
         Matrix<T, 3, 3, RowMajor> right = R_sqrt_info*(-Rb+Ra*Rab); // R_sqrt_info*(R_b - R_a*Rab)
         Map<Matrix<T, 9, 1>> right_vec(right.data()); // Flat matrix
         b.segment(row_id, 9) = right_vec;
@@ -277,7 +249,7 @@ protected:
         return row_id;
     }
 
-    int setupPose6DProblembyPrior(int row_id, const Swarm::PosePrior & prior, std::vector<Tpl> & triplet_list, VecX & b, bool finetune_rot=true) {
+    int setupPose6DProblembyPrior(int row_id, const Swarm::PosePrior & prior, SparseNormalEquation<T> & neq, VecX & b, bool finetune_rot=true) {
         auto frame_id = prior.frame_id;
         auto idx = getFrameIdx(frame_id);
         int pose_size = POSE_EFF_SIZE;
@@ -291,7 +263,7 @@ protected:
         // printf("[setupPose6DProblembyPrior%d]Prior for %d T_prior: %.4f %.4f %.4f\n", self_id, frame_id, Tp(0), Tp(1), Tp(2));
         //Translation error.
         Mat3 sqrt_T = prior.getSqrtInfoMat().block<3, 3>(0, 0).template cast<T>();
-        fillInTripet(row_id, pose_size*idx, sqrt_T, triplet_list); // take T_sqrt_info*T_a
+        neq.add(row_id, pose_size*idx, sqrt_T); // take T_sqrt_info*T_a
         b.segment(row_id, 3) = sqrt_T*Tp;  // T_sqrt_info*T_p
         row_id = row_id + 3;
         if (!finetune_rot) {
@@ -319,7 +291,7 @@ protected:
                     0,         -Ra(2, 2),  Ra(2, 1),
                     Ra(2, 2),   0,          -Ra(2, 0),
                     -Ra(2, 1),  Ra(2, 0),   0;
-            fillInTripet(row_id, pose_size*idx + POS_SIZE, Cm_ra*sqrt_R, triplet_list); //  take Cm_ra*sqrt_R*R_a
+            neq.add(row_id, pose_size*idx + POS_SIZE, Cm_ra*sqrt_R); //  take Cm_ra*sqrt_R*R_a
             Matrix<T, 3, 3, RowMajor> Rp_with_info = sqrt_R*Rp;
             Map<Matrix<T, 9, 1>> right_vec(Rp_with_info.data()); // Flat matrix
             b.segment(row_id, 9) = right_vec; // Rp
@@ -329,30 +301,39 @@ protected:
 
     double solveLinearPose6d(bool finetune_rot = false) {
         TicToc tic;
+        last_solve_succ = false;
         int pose_size = POSE_EFF_SIZE;
         if (!finetune_rot) {
             pose_size = POS_SIZE;
         }
         VecX b(loops.size()*pose_size + pose_priors.size()*pose_size);
-        std::vector<Eigen::Triplet<T>> triplet_list;
         b.setZero();
         int row_id = 0;
+        pose_neq.reset(pose_size*eff_frame_num);
         for (auto loop : loops) {
-            row_id = setupPose6dProblembyLoop(row_id, loop, triplet_list, b, finetune_rot);
+            row_id = setupPose6dProblembyLoop(row_id, loop, pose_neq, b, finetune_rot);
+            pose_neq.finishResidual(b);
         }
         for (auto prior: pose_priors) {
-            row_id = setupPose6DProblembyPrior(row_id, prior, triplet_list, b, finetune_rot);
+            row_id = setupPose6DProblembyPrior(row_id, prior, pose_neq, b, finetune_rot);
+            pose_neq.finishResidual(b);
         }
         double dt_setup = tic.toc();
         tic.tic();
         TicToc tic_solve;
-        auto X = solveLinear(row_id, pose_size*eff_frame_num, triplet_list, b);
+        VecX X;
+        bool succ = pose_neq.solve(X, std::to_string(self_id));
+        if (!succ) {
+            printf("[RotInit%d] solveLinearPose6d LLT failed, poses are not updated\n", self_id);
+            return 1.0;
+        }
+        last_solve_succ = true;
         double dt_solve = tic_solve.toc();
         //Recover poses from X
         double changes = recoverPose6dfromLinear(X, finetune_rot);
-        printf("[RotInit%d] solveLinearPose6d %.2fms setup %.2fms LLT %.2fms changes %.2f%% Poses %ld EffPoses %d Loops %ld Priors %ld F32: %d\n", self_id,
+        printf("[RotInit%d] solveLinearPose6d %.2fms setup %.2fms LLT %.2fms changes %.2f%% Poses %ld EffPoses %d Loops %ld Priors %ld NNZ %d pattern_reused %d F32: %d\n", self_id,
             tic.toc(), dt_setup, dt_solve, changes*100, frame_id_to_idx.size(), eff_frame_num, loops.size(), pose_priors.size(),
-            typeid(T) == typeid(float));
+            pose_neq.nonZeros(), pose_neq.patternReused(), typeid(T) == typeid(float));
         return changes;
     }
 
@@ -419,7 +400,8 @@ protected:
 
 public:
     RotationInitialization(PGOState * _state, RotInitConfig _config):
-        state(_state), config(_config), self_id(_config.self_id) {
+        state(_state), config(_config), self_id(_config.self_id),
+        rot_neq(_config.enable_cholmod), pose_neq(_config.enable_cholmod) {
     }
 
     virtual void addLoop(const Swarm::LoopEdge & loop) {
@@ -449,6 +431,7 @@ public:
         updateFrameIdx();
         setPriorFactorsbyFixedParam();
         report.state_changes = solveLinearRot();
+        report.succ = last_solve_succ;
         report.total_time = tic.toc();
         report.total_iterations = 1;
         return report;   
@@ -0,0 +1,192 @@
+#pragma once
+#include <Eigen/Sparse>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <iostream>
+#include <cassert>
+#ifdef USE_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
+
+namespace D2PGO {
+//Normal equation H = A^T*A, g = A^T*b of a sparse linear least squares problem, assembled directly from the
+//row blocks of A. Columns are grouped in blocks of 3, H is kept as its lower triangular 3x3 blocks.
+//The compressed pattern of H and the symbolic analysis of the Cholesky factorization are reused while the
+//blocks of H are unchanged, i.e. while the loops are unchanged. With USE_CHOLMOD and enable_cholmod,
+//the supernodal CHOLMOD factorization is used (in double), which runs on multithreaded BLAS.
+template <typename T>
+class SparseNormalEquation {
+public:
+    typedef Eigen::Matrix<T, Eigen::Dynamic, 1> VecX;
+    typedef Eigen::Matrix<T, 3, 3> Mat3;
+    static constexpr int BLOCK_SIZE = 3;
+protected:
+    struct JacobianBlock {
+        int row;
+        int col_block;
+        Eigen::Matrix<T, Eigen::Dynamic, BLOCK_SIZE> M;
+    };
+    int cols = 0;
+    std::vector<JacobianBlock> pending; //Blocks of A of the current residual
+    std::map<std::pair<int, int>, Mat3> blocks; //(col block, row block) -> block of H, row block >= col block
+    VecX g;
+
+    std::vector<std::pair<int, int>> pattern; //Blocks of H in the last factorization
+    Eigen::SparseMatrix<T> H;
+    Eigen::SimplicialLLT<Eigen::SparseMatrix<T>> llt;
+#ifdef USE_CHOLMOD
+    Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double>> cholmod_llt;
+#endif
+    bool enable_cholmod = true;
+    bool pattern_reused = false;
+
+    //Visit the entries of the lower triangle of H in compressed column order
+    template <typename Func>
+    void forEachEntry(Func f) const {
+        for (auto it = blocks.begin(); it != blocks.end();) {
+            int col_block = it->first.first;
+            auto it_end = it;
+            while (it_end != blocks.end() && it_end->first.first == col_block) {
+                it_end ++;
+            }
+            for (int c = 0; c < BLOCK_SIZE; c ++) {
+                for (auto it_blk = it; it_blk != it_end; it_blk ++) {
+                    int row_block = it_blk->first.second;
+                    for (int r = row_block == col_block ? c : 0; r < BLOCK_SIZE; r ++) {
+                        f(row_block*BLOCK_SIZE + r, col_block*BLOCK_SIZE + c, it_blk->second(r, c));
+                    }
+                }
+            }
+            it = it_end;
+        }
+    }
+
+    void updateMatrix() {
+        pattern_reused = H.rows() == cols && pattern.size() == blocks.size() &&
+            std::equal(pattern.begin(), pattern.end(), blocks.begin(),
+                [](const std::pair<int, int> & a, const std::pair<const std::pair<int, int>, Mat3> & b) {
+                    return a == b.first;
+                });
+        if (pattern_reused) {
+            T * values = H.valuePtr();
+            int k = 0;
+            forEachEntry([&](int r, int c, T v) {
+                values[k++] = v;
+            });
+            return;
+        }
+        pattern.clear();
+        for (auto & it : blocks) {
+            pattern.emplace_back(it.first);
+        }
+        Eigen::VectorXi col_nnz = Eigen::VectorXi::Zero(cols);
+        forEachEntry([&](int r, int c, T v) {
+            col_nnz(c) ++;
+        });
+        H.resize(cols, cols);
+        H.reserve(col_nnz);
+        forEachEntry([&](int r, int c, T v) {
+            H.insert(r, c) = v;
+        });
+        H.makeCompressed();
+    }
+
+    void dumpProblem(const std::string & tag) const {
+        std::ofstream ofsh("/tmp/H" + tag + ".txt");
+        for(int i = 0; i < H.outerSize(); i++)
+            for(typename Eigen::SparseMatrix<T>::InnerIterator it(H,i); it; ++it)
+                ofsh << it.row() << " " << it.col() << " " << it.value() << std::endl;
+        ofsh.close();
+        std::ofstream ofs1("/tmp/g" + tag + ".txt");
+        ofs1 << g << std::endl;
+        ofs1.close();
+    }
+public:
+    SparseNormalEquation(bool _enable_cholmod = true): enable_cholmod(_enable_cholmod) {}
+
+    void setEnableCholmod(bool _enable_cholmod) {
+        enable_cholmod = _enable_cholmod;
+    }
+
+    //Start a new problem with cols unknowns
+    void reset(int _cols) {
+        cols = _cols;
+        pending.clear();
+        blocks.clear();
+        g = VecX::Zero(cols);
+    }
+
+    //M is the block of A at (row, col), col is a multiple of 3 and M has 3 columns.
+    template <typename Derived>
+    void add(int row, int col, const Eigen::MatrixBase<Derived> & M) {
+        static_assert(Derived::ColsAtCompileTime == BLOCK_SIZE, "Jacobian blocks of SparseNormalEquation have 3 columns");
+        assert(col % BLOCK_SIZE == 0 && "Jacobian block not aligned with column blocks");
+        pending.push_back({row, col / BLOCK_SIZE, M.template cast<T>()});
+    }
+
+    //Accumulate the blocks added since the last call, which must be the complete rows of one residual, into H and g.
+    void finishResidual(const VecX & b) {
+        for (auto & p : pending) {
+            g.template segment<BLOCK_SIZE>(p.col_block*BLOCK_SIZE) += p.M.transpose()*b.segment(p.row, p.M.rows());
+            for (auto & q : pending) {
+                if (p.col_block < q.col_block) {
+                    continue;
+                }
+                int row0 = std::max(p.row, q.row);
+                int row1 = std::min(p.row + p.M.rows(), q.row + q.M.rows());
+                if (row0 >= row1) {
+                    continue;
+                }
+                auto it = blocks.find(std::make_pair(q.col_block, p.col_block));
+                if (it == blocks.end()) {
+                    it = blocks.emplace(std::make_pair(q.col_block, p.col_block), Mat3::Zero()).first;
+                }
+                it->second += p.M.middleRows(row0 - p.row, row1 - row0).transpose()*q.M.middleRows(row0 - q.row, row1 - row0);
+            }
+        }
+        pending.clear();
+    }
+
+    //Solve H*x = g. Returns false if the factorization fails.
+    bool solve(VecX & x, const std::string & tag = "") {
+        updateMatrix();
+#ifdef USE_CHOLMOD
+        if (enable_cholmod) {
+            Eigen::SparseMatrix<double> Hd = H.template cast<double>();
+            if (!pattern_reused) {
+                cholmod_llt.analyzePattern(Hd);
+            }
+            cholmod_llt.factorize(Hd);
+            if (cholmod_llt.info() != Eigen::Success) {
+                std::cout << "[SparseNormalEquation] CHOLMOD factorization failed " << cholmod_llt.info() << std::endl;
+                dumpProblem(tag);
+                return false;
+            }
+            x = cholmod_llt.solve(g.template cast<double>()).template cast<T>();
+            return true;
+        }
+#endif
+        if (!pattern_reused) {
+            llt.analyzePattern(H);
+        }
+        llt.factorize(H);
+        if (llt.info() != Eigen::Success) {
+            std::cout << "[SparseNormalEquation] LLT factorization failed " << llt.info() << std::endl;
+            dumpProblem(tag);
+            return false;
+        }
+        x = llt.solve(g);
+        return true;
+    }
+
+    bool patternReused() const {
+        return pattern_reused;
+    }
+
+    int nonZeros() const {
+        return H.nonZeros();
+    }
+};
+}
@@ -1,6 +1,7 @@
 #include "swarm_outlier_rejection.hpp"
 #include <fstream>
 #include <stdio.h>
+#include <algorithm>
 #include "fast_max-clique_finder/src/graphIO.h"
 #include "fast_max-clique_finder/src/findClique.h"
 #include <d2common/utils.hpp>
@@ -15,8 +16,8 @@ using D2Common::FrameIdType;
 namespace D2PGO {
 std::fstream pcm_errors;
 FILE * f_logs;
-SwarmLocalOutlierRejection::SwarmLocalOutlierRejection(int _self_id, const SwarmLocalOutlierRejectionParams &_param, std::map<int, Swarm::DroneTrajectory> &_ego_motion_trajs):
-        self_id(_self_id), param(_param), ego_motion_trajs(_ego_motion_trajs) {
+SwarmLocalOutlierRejection::SwarmLocalOutlierRejection(int _self_id, const SwarmLocalOutlierRejectionParams &_param):
+        self_id(_self_id), param(_param) {
     if (param.debug_write_pcm_errors) {
         f_logs = fopen("/root/output/pcm_logs.txt", "w");
         pcm_errors.open("/root/output/pcm_errors.txt", std::ios::out);
@@ -25,6 +26,56 @@ SwarmLocalOutlierRejection::SwarmLocalOutlierRejection(int _self_id, const Swarm
     }
 }
 
+void SwarmLocalOutlierRejection::addFrame(int drone_id, FrameIdType frame_id, const Swarm::Pose & ego_pose) {
+    auto & cache = odom_caches[drone_id];
+    if (cache.index.find(frame_id) != cache.index.end()) {
+        return;
+    }
+    double length = 0;
+    if (!cache.poses.empty()) {
+        length = cache.lengths.back() + (ego_pose.pos() - cache.poses.back().pos()).norm();
+    }
+    cache.index[frame_id] = cache.poses.size();
+    cache.poses.emplace_back(ego_pose);
+    cache.lengths.emplace_back(length);
+}
+
+void SwarmLocalOutlierRejection::addPreviousSessionFrame(FrameIdType frame_id, const Swarm::Pose & stored_pose) {
+    auto & cache = odom_caches[groupOf(-1, frame_id)];
+    if (cache.index.find(frame_id) != cache.index.end()) {
+        return;
+    }
+    cache.index[frame_id] = cache.poses.size();
+    cache.poses.emplace_back(stored_pose);
+    cache.lengths.emplace_back(0);
+}
+
+int SwarmLocalOutlierRejection::groupOf(int drone_id, FrameIdType frame_id) {
+    if (isPreviousSessionFrame(frame_id)) {
+        return -1 - (int) (frame_id >> SESSION_ID_SHIFT);
+    }
+    return drone_id;
+}
+
+std::pair<Swarm::Pose, Matrix6d> SwarmLocalOutlierRejection::relativeOdometry(int group, FrameIdType frame_a, 
+        FrameIdType frame_b, double & length) const {
+    //ODOM is frame_a->frame_b, the covariance grows with the trajectory length between them.
+    auto & cache = odom_caches.at(group);
+    int idx_a = cache.index.at(frame_a);
+    int idx_b = cache.index.at(frame_b);
+    if (group < 0) {
+        //Keyframes of a previous session are added in any order, use the straight distance
+        length = (cache.poses[idx_b].pos() - cache.poses[idx_a].pos()).norm();
+    } else {
+        length = std::abs(cache.lengths[idx_b] - cache.lengths[idx_a]);
+    }
+    Matrix6d cov = Matrix6d::Zero();
+    cov.block<3, 3>(0, 0) = Matrix3d::Identity()*param.pos_covariance_per_meter*length 
+        + 0.5*Matrix3d::Identity()*param.yaw_covariance_per_meter*length*length;
+    cov.block<3, 3>(3, 3) = Matrix3d::Identity()*param.yaw_covariance_per_meter*length;
+    return std::make_pair(Swarm::Pose::DeltaPose(cache.poses[idx_a], cache.poses[idx_b], param.is_4dof), cov);
+}
+
 std::vector<int64_t> SwarmLocalOutlierRejection::good_loops() {
     lcm_mutex.lock();
     std::vector<int64_t> ret;
@@ -49,16 +100,19 @@ std::vector<Swarm::LoopEdge> SwarmLocalOutlierRejection::OutlierRejectionLoopEdg
     std::vector<Swarm::LoopEdge> good_loops;
     int new_loop_count = 0;
     for (auto & edge: available_loops) {
+        //Cross-session loops are checked among the loops to the same previous session
+        int group_a = groupOf(edge.id_a, edge.keyframe_id_a);
+        int group_b = groupOf(edge.id_b, edge.keyframe_id_b);
         if (all_loops_set.find(edge.id) == all_loops_set.end()) {
-            new_loops[edge.id_a][edge.id_b].emplace_back(edge);
-            if (edge.id_a!=edge.id_b){
-                new_loops[edge.id_b][edge.id_a].emplace_back(edge);
+            new_loops[group_a][group_b].emplace_back(edge);
+            if (group_a != group_b){
+                new_loops[group_b][group_a].emplace_back(edge);
             }
             if (all_loop_map.find(edge.id) == all_loop_map.end()) {
                 all_loop_map[edge.id] = edge;
             }
-            all_loops_set_by_pair[edge.id_a][edge.id_b].insert(edge.id);
-            all_loops_set_by_pair[edge.id_b][edge.id_a].insert(edge.id);
+            all_loops_set_by_pair[group_a][group_b].insert(edge.id);
+            all_loops_set_by_pair[group_b][group_a].insert(edge.id);
             new_loop_count += 1;
         }
         all_loops_set.insert(edge.id);
@@ -88,13 +142,13 @@ std::vector<Swarm::LoopEdge> SwarmLocalOutlierRejection::OutlierRejectionLoopEdg
 
     lcm_mutex.lock();
     for (auto & loop : available_loops) {
-        auto id_a = loop.id_a;
-        auto id_b = loop.id_b;
+        auto id_a = groupOf(loop.id_a, loop.keyframe_id_a);
+        auto id_b = groupOf(loop.id_b, loop.keyframe_id_b);
         if (good_loops_set.find(id_a) == good_loops_set.end() || good_loops_set[id_a].find(id_b) == good_loops_set[id_a].end()) {
             //The inlier set of the pair in good loop not established, so we make use all of them
             good_loops.emplace_back(loop);
         } else {
-            auto _good_loops_set = good_loops_set[loop.id_a][loop.id_b];
+            auto _good_loops_set = good_loops_set[id_a][id_b];
             if (_good_loops_set.find(loop.id) != _good_loops_set.end()) {
                 good_loops.emplace_back(loop);
             }
@@ -111,115 +165,137 @@ std::vector<Swarm::LoopEdge> SwarmLocalOutlierRejection::OutlierRejectionLoopEdg
     return good_loops;
 }
 
-void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<Swarm::LoopEdge > & new_loops, int id_a, int id_b) {
-    std::map<FrameIdType, int> bad_pair_count;
-
-    auto & pcm_graph = loop_pcm_graph[id_a][id_b];
-    auto & _all_loops = all_loops[id_a][id_b];
-
-    TicToc tic1;
-
-    for (size_t i = 0; i < new_loops.size(); i++) {
-        auto & edge1 = new_loops[i];
-        //Now only process inter-edges
-        while (pcm_graph.size() < _all_loops.size() + 1) {
-            pcm_graph.emplace_back(std::vector<int>(0));
-        }
+double SwarmLocalOutlierRejection::pairConsistency(const PCMPairGraph & graph, int i, int j) const {
+    //Squared mahalanobis distance of the cycle of loop i, loop j and the ego-motion between their keyframes.
+    //Negative if the loops do not link the same pair of trajectories.
+    auto & edge1 = graph.loops[i];
+    auto & edge2 = graph.loops[j];
+    int group_a1 = groupOf(edge1.id_a, edge1.keyframe_id_a), group_b1 = groupOf(edge1.id_b, edge1.keyframe_id_b);
+    int group_a2 = groupOf(edge2.id_a, edge2.keyframe_id_a), group_b2 = groupOf(edge2.id_b, edge2.keyframe_id_b);
+    int same_robot_pair = 0;
+    if (group_a1 == group_a2 && group_b1 == group_b2) {
+        same_robot_pair = 1;
+    } else if (group_a1 == group_b2 && group_b1 == group_a2) {
+        same_robot_pair = 2;
+    }
+    if (same_robot_pair <= 0) {
+        return -1;
+    }
+    auto & _cov_mat_1 = graph.covariances[i];
+    auto & _cov_mat_2 = graph.covariances[j];
+    Matrix6d _covariance = _cov_mat_1 + _cov_mat_2;
+    std::pair<Swarm::Pose, Matrix6d> odom_a, odom_b;
+    Swarm::Pose p_edge2;
+    double traj_a = 0, traj_b = 0;
+    if (same_robot_pair == 1) {
+        p_edge2 = edge2.relative_pose;
+        odom_a = relativeOdometry(group_a1, edge1.keyframe_id_a, edge2.keyframe_id_a, traj_a);
+        odom_b = relativeOdometry(group_b1, edge1.keyframe_id_b, edge2.keyframe_id_b, traj_b);
+    } else {
+        p_edge2 = graph.inv_poses[j];
+        odom_a = relativeOdometry(group_a1, edge1.keyframe_id_a, edge2.keyframe_id_b, traj_a);
+        odom_b = relativeOdometry(group_b1, edge1.keyframe_id_b, edge2.keyframe_id_a, traj_b);
+    }
+    _covariance += odom_a.second + odom_b.second;
 
-        auto p_edge1 = edge1.relative_pose;
-        Matrix6d _cov_mat_1 = edge1.getCovariance();
-
-        for (size_t j = 0; j < _all_loops.size(); j++) {
-            auto & edge2 = _all_loops[j];
-            auto _cov_mat_2 = edge2.getCovariance();;
-            Matrix6d _covariance = _cov_mat_1 + _cov_mat_2;
-
-            int same_robot_pair = edge2.same_robot_pair(edge1);
-            if (same_robot_pair > 0) {
-                //Now we can compute the consistency error.
-                std::pair<Swarm::Pose, Matrix6d> odom_a, odom_b;
-                Swarm::Pose p_edge2;
-                double traj_a = 0, traj_b = 0;
-
-                if (same_robot_pair == 1) {
-                    p_edge2 = edge2.relative_pose;
-                    //ODOM is tsa->tsb
-                    odom_a = ego_motion_trajs.at(edge1.id_a).get_relative_pose_by_frame_id(edge1.keyframe_id_a, edge2.keyframe_id_a, param.is_4dof);
-                    odom_b = ego_motion_trajs.at(edge1.id_b).get_relative_pose_by_frame_id(edge1.keyframe_id_b, edge2.keyframe_id_b, param.is_4dof);
-                    if (param.debug_write_debug) {
-                        traj_a = ego_motion_trajs.at(edge1.id_a).trajectory_length_by_ts(edge1.ts_a, edge2.ts_a);
-                        traj_b = ego_motion_trajs.at(edge1.id_b).trajectory_length_by_ts(edge1.ts_b, edge2.ts_b);
-                    }
-
-                    _covariance += odom_a.second + odom_b.second;
-
-                }  else if (same_robot_pair == 2) {
-                    p_edge2 = edge2.relative_pose.inverse();
-                    odom_a = ego_motion_trajs.at(edge1.id_a).get_relative_pose_by_frame_id(edge1.keyframe_id_a, edge2.keyframe_id_b, param.is_4dof);
-                    odom_b = ego_motion_trajs.at(edge1.id_b).get_relative_pose_by_frame_id(edge1.keyframe_id_b, edge2.keyframe_id_a, param.is_4dof);
-                    
-                    if (param.debug_write_debug) {
-                        traj_a = ego_motion_trajs.at(edge1.id_a).trajectory_length_by_ts(edge1.ts_a, edge2.ts_b);
-                        traj_b = ego_motion_trajs.at(edge1.id_b).trajectory_length_by_ts(edge1.ts_b, edge2.ts_a);
-                    }
-
-                    _covariance += odom_a.second + odom_b.second;
-                }
+    Swarm::Pose err_pose = odom_a.first*p_edge2*odom_b.first.inverse()*graph.inv_poses[i];
+    auto logmap = err_pose.log_map();
+    double smd = Swarm::computeSquaredMahalanobisDistance(logmap, _covariance);
 
-                Swarm::Pose err_pose = odom_a.first*p_edge2*odom_b.first.inverse()*p_edge1.inverse();
-                auto logmap = err_pose.log_map();
-                double smd = Swarm::computeSquaredMahalanobisDistance(logmap, _covariance);
+    if (param.debug_write_debug) {
+        fprintf(f_logs, "\n");
+        fprintf(f_logs, "EdgePair %ld->%ld\n", edge1.id, edge2.id);
+        fprintf(f_logs, "Edge1 %ld->%ld DOF %d Pose %s cov_1 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
+            edge1.keyframe_id_a, edge1.keyframe_id_b, edge1.res_count, edge1.relative_pose.toStr().c_str(),
+            _cov_mat_1(0, 0), _cov_mat_1(1, 1), _cov_mat_1(2, 2), _cov_mat_1(3, 3), _cov_mat_1(4, 4), _cov_mat_1(5, 5));
+        fprintf(f_logs, "Edge2 %ld->%ld DOF %d Pose %s cov_2 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
+            edge2.keyframe_id_a, edge2.keyframe_id_b, edge2.res_count, edge2.relative_pose.toStr().c_str(),
+            _cov_mat_2(0, 0), _cov_mat_2(1, 1), _cov_mat_2(2, 2), _cov_mat_2(3, 3), _cov_mat_2(4, 4), _cov_mat_2(5, 5));
+            
+        auto cov = odom_a.second;
+        fprintf(f_logs, "odom_a %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_a.first.toStr().c_str(), 
+            traj_a, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
+        cov = odom_b.second;
+        fprintf(f_logs, "odom_b %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_b.first.toStr().c_str(), 
+            traj_b, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
+        fprintf(f_logs, "err_pose %s logmap [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", err_pose.toStr().c_str(), 
+            logmap(0), logmap(1), logmap(2), logmap(3), logmap(4), logmap(5));
+        fprintf(f_logs, "squaredMahalanobisDistance %f Same Direction %d _cov(T, Q)  [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", smd, same_robot_pair == 1,
+            _covariance(0, 0), _covariance(1, 1), _covariance(2, 2), _covariance(3, 3), _covariance(4, 4), _covariance(5, 5));
+    }
+    
+    if (param.debug_write_pcm_errors) {
+        pcm_errors << edge1.id << " " << edge2.id << " "  << smd << " " << std::endl;
+    }
+    return smd;
+}
 
-                if (smd < param.pcm_thres) {
-                    //Add edge i to j
-                    pcm_graph[_all_loops.size()].push_back(j);
-                    pcm_graph[j].push_back(_all_loops.size());
-                }
+void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<Swarm::LoopEdge > & new_loops, int id_a, int id_b) {
+    auto & graph = pcm_graphs[id_a][id_b];
+    TicToc tic1;
 
-                if (param.debug_write_debug) {
-                    fprintf(f_logs, "\n");
-                    fprintf(f_logs, "EdgePair %ld->%ld\n", edge1.id, edge2.id);
-                    fprintf(f_logs, "Edge1 %ld->%ld DOF %d Pose %s cov_1 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
-                        edge1.keyframe_id_a, edge1.keyframe_id_b, edge1.res_count, edge1.relative_pose.toStr().c_str(),
-                        _cov_mat_1(0, 0), _cov_mat_1(1, 1), _cov_mat_1(2, 2), _cov_mat_1(3, 3), _cov_mat_1(4, 4), _cov_mat_1(5, 5));
-                    fprintf(f_logs, "Edge2 %ld->%ld DOF %d Pose %s cov_2 [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", 
-                        edge2.keyframe_id_a, edge2.keyframe_id_b, edge2.res_count, edge2.relative_pose.toStr().c_str(),
-                        _cov_mat_2(0, 0), _cov_mat_2(1, 1), _cov_mat_2(2, 2), _cov_mat_2(3, 3), _cov_mat_2(4, 4), _cov_mat_2(5, 5));
-                        
-                    auto cov = odom_a.second;
-                    fprintf(f_logs, "odom_a %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_a.first.toStr().c_str(), 
-                        traj_a, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
-                    cov = odom_b.second;
-                    fprintf(f_logs, "odom_b %s traj len %.2f cov (T, Q) [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", odom_b.first.toStr().c_str(), 
-                        traj_b, cov(0, 0), cov(1, 1), cov(2, 2), cov(3, 3), cov(4, 4), cov(5, 5));
-                    fprintf(f_logs, "err_pose %s logmap [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", err_pose.toStr().c_str(), 
-                        logmap(0), logmap(1), logmap(2), logmap(3), logmap(4), logmap(5));
-                    fprintf(f_logs, "squaredMahalanobisDistance %f Same Direction %d _cov(T, Q)  [%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e,%+3.1e]\n", smd, same_robot_pair == 1,
-                        _covariance(0, 0), _covariance(1, 1), _covariance(2, 2), _covariance(3, 3), _covariance(4, 4), _covariance(5, 5));
-                }
-                
-                if (param.debug_write_pcm_errors) {
-                    pcm_errors << edge1.id << " " << edge2.id << " "  << smd << " " << std::endl;
-                }
+    int old_num = graph.loops.size();
+    for (auto & edge : new_loops) {
+        graph.loops.emplace_back(edge);
+        graph.covariances.emplace_back(edge.getCovariance());
+        graph.inv_poses.emplace_back(edge.relative_pose.inverse());
+        graph.adjacency.emplace_back();
+    }
 
+    //New loop k is checked against all loops before it: pairs [pair_offsets[k], pair_offsets[k + 1]) are 
+    //(old_num + k, 0), (old_num + k, 1), ... The pairs are split to contiguous ranges checked by threads.
+    std::vector<size_t> pair_offsets(new_loops.size() + 1, 0);
+    for (size_t k = 0; k < new_loops.size(); k ++) {
+        pair_offsets[k + 1] = pair_offsets[k] + old_num + k;
+    }
+    size_t pair_num = pair_offsets.back();
+    std::vector<char> consistent(pair_num, 0);
+    int num_threads = param.num_threads > 0 ? param.num_threads : std::thread::hardware_concurrency();
+    if (param.debug_write_debug || param.debug_write_pcm_errors) {
+        //Keep the logs in order
+        num_threads = 1;
+    }
+    num_threads = std::max(1, std::min(num_threads, (int) (pair_num / 256) + 1));
+    auto check_range = [&](size_t begin, size_t end) {
+        if (begin >= end) {
+            return;
+        }
+        size_t k = std::upper_bound(pair_offsets.begin(), pair_offsets.end(), begin) - pair_offsets.begin() - 1;
+        for (size_t t = begin; t < end; t ++) {
+            while (t >= pair_offsets[k + 1]) {
+                k ++;
+            }
+            double smd = pairConsistency(graph, old_num + k, t - pair_offsets[k]);
+            consistent[t] = smd >= 0 && smd < param.pcm_thres;
+        }
+    };
+    size_t chunk = (pair_num + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i ++) {
+        threads.emplace_back(check_range, std::min(i*chunk, pair_num), std::min((i + 1)*chunk, pair_num));
+    }
+    check_range(0, std::min(chunk, pair_num));
+    for (auto & th : threads) {
+        th.join();
+    }
+    //Consistent pairs are appended in increasing order so the adjacency lists stay sorted
+    for (size_t k = 0; k < new_loops.size(); k ++) {
+        int i = old_num + k;
+        for (int j = 0; j < i; j ++) {
+            if (consistent[pair_offsets[k] + j]) {
+                graph.adjacency[i].push_back(j);
+                graph.adjacency[j].push_back(i);
             }
         }
-        _all_loops.push_back(edge1);
     }
 
     double compute_pcm_erros = tic1.toc();
+    auto & _all_loops = graph.loops;
     std::vector<int> max_clique_data;
-    FMC::CGraphIO pcm_graph_fmc;
-    pcm_graph_fmc.m_vi_Vertices.push_back(0);
-    for(size_t i=0;i < pcm_graph.size(); i++) {
-        pcm_graph_fmc.m_vi_Edges.insert(pcm_graph_fmc.m_vi_Edges.end(),pcm_graph[i].begin(),pcm_graph[i].end());
-        pcm_graph_fmc.m_vi_Vertices.push_back(pcm_graph_fmc.m_vi_Edges.size());
-    }
-    pcm_graph_fmc.CalculateVertexDegrees();
     if (param.incremental_pcm) {
         TicToc tic;
         int prev_max_clique_size = good_loops_set[id_a][id_b].size();
-        int ret = FMC::maxCliqueHeuIncremental(pcm_graph_fmc, new_loops.size(), prev_max_clique_size, max_clique_data);
+        int ret = FMC::maxCliqueHeuIncremental(graph.adjacency, new_loops.size(), prev_max_clique_size, max_clique_data);
         if (ret > 0 && max_clique_data.size() > 0) {
             good_loops_set[id_a][id_b].clear();
             good_loops_set[id_b][id_a].clear();
@@ -228,13 +304,20 @@ void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<
                 good_loops_set[id_b][id_a].insert(_all_loops[i].id);
             }
         }
-        printf("[D2PGO](OutlierRejection) %d<->%d compute_pcm_errors %.1fms maxCliqueHeuInc takes %.1fms ret %d(%d) loops %ld good %ld\n", 
-            id_a, id_b, compute_pcm_erros, tic.toc(), ret, max_clique_data.size(), _all_loops.size(), good_loops_set[id_a][id_b].size());
+        printf("[D2PGO](OutlierRejection) %d<->%d compute_pcm_errors %.1fms(%ld pairs %d threads) maxCliqueHeuInc takes %.1fms ret %d(%d) loops %ld good %ld\n", 
+            id_a, id_b, compute_pcm_erros, pair_num, num_threads, tic.toc(), ret, max_clique_data.size(), _all_loops.size(), good_loops_set[id_a][id_b].size());
     } else {
         TicToc tic;
+        FMC::CGraphIO pcm_graph_fmc;
+        pcm_graph_fmc.m_vi_Vertices.push_back(0);
+        for(size_t i=0;i < graph.adjacency.size(); i++) {
+            pcm_graph_fmc.m_vi_Edges.insert(pcm_graph_fmc.m_vi_Edges.end(), graph.adjacency[i].begin(), graph.adjacency[i].end());
+            pcm_graph_fmc.m_vi_Vertices.push_back(pcm_graph_fmc.m_vi_Edges.size());
+        }
+        pcm_graph_fmc.CalculateVertexDegrees();
         FMC::maxCliqueHeu(pcm_graph_fmc, max_clique_data);
-        printf("[D2PGO](OutlierRejection) %d<->%d compute_pcm_errors %.1fms maxCliqueHeu takes %.1fms loops %ld good %ld\n", 
-            id_a, id_b, compute_pcm_erros, tic.toc(), _all_loops.size(), max_clique_data.size());
+        printf("[D2PGO](OutlierRejection) %d<->%d compute_pcm_errors %.1fms(%ld pairs %d threads) maxCliqueHeu takes %.1fms loops %ld good %ld\n", 
+            id_a, id_b, compute_pcm_erros, pair_num, num_threads, tic.toc(), _all_loops.size(), max_clique_data.size());
         //In non-incremental mode, we need to clear the good_loops_set
         good_loops_set[id_a][id_b].clear();
         good_loops_set[id_b][id_a].clear();
@@ -244,4 +327,4 @@ void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<
         }
     }
 }
-}
\ No newline at end of file
+}
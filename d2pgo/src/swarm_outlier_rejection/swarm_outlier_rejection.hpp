@@ -4,20 +4,44 @@
 #include <mutex>
 #include <swarm_msgs/drone_trajectory.hpp>
 #include <swarm_msgs/relative_measurments.hpp>
+#include <d2common/d2basetypes.h>
+#include <unordered_map>
 #include "../d2pgo_config.h"
 
 namespace D2PGO {
 
 typedef std::vector<std::vector<int>> DisjointGraph;
+
+//Loops of a robot pair and their pairwise consistency graph, updated in place when new loops arrive.
+struct PCMPairGraph {
+    std::vector<Swarm::LoopEdge> loops;
+    std::vector<Eigen::Matrix6d> covariances; //Covariance of each loop
+    std::vector<Swarm::Pose> inv_poses; //Inverse relative pose of each loop
+    DisjointGraph adjacency; //Consistent loops of each loop, sorted
+};
+
+//Ego-motion of a drone at each keyframe in the order they are added, so the odometry between two keyframes
+//is composed in O(1) instead of being queried from the DroneTrajectory for every pair.
+//Keyframes of a previous session have their own cache with the stored poses, the lengths are not used there.
+struct PCMOdomCache {
+    std::vector<Swarm::Pose> poses; //Ego pose of each keyframe
+    std::vector<double> lengths; //Trajectory length from the first keyframe
+    std::unordered_map<D2Common::FrameIdType, int> index;
+};
+
 class SwarmLocalOutlierRejection {
     SwarmLocalOutlierRejectionParams param;
-    std::map<int, Swarm::DroneTrajectory>  & ego_motion_trajs;
-    //Drone  ida           idb            index_det       linked dets
-    std::map<int, std::map<int, DisjointGraph>> loop_pcm_graph;
-    std::map<int, std::map<int, std::vector<Swarm::LoopEdge>>> all_loops;
+    std::map<int, PCMOdomCache> odom_caches; //Group (see groupOf) -> cache
+    //Drone  ida           idb
+    std::map<int, std::map<int, PCMPairGraph>> pcm_graphs;
     std::set<int64_t> all_loops_set;
 
     void OutlierRejectionLoopEdgesPCM(const std::vector<Swarm::LoopEdge > & inter_loops, int id_a, int id_b);
+    double pairConsistency(const PCMPairGraph & graph, int i, int j) const;
+    std::pair<Swarm::Pose, Matrix6d> relativeOdometry(int group, D2Common::FrameIdType frame_a, 
+        D2Common::FrameIdType frame_b, double & length) const;
+    //Loops are grouped by the trajectories they link: the drone id in this session, -1 - session for a previous session.
+    static int groupOf(int drone_id, D2Common::FrameIdType frame_id);
     std::vector<int64_t> good_loops();
 public:
     std::map<int, std::map<int, std::set<int64_t>>> all_loops_set_by_pair;
@@ -27,7 +51,9 @@ public:
 
     std::mutex lcm_mutex;
     
-    SwarmLocalOutlierRejection(int self_id, const SwarmLocalOutlierRejectionParams &_param, std::map<int, Swarm::DroneTrajectory> &_ego_motion_trajs);
+    SwarmLocalOutlierRejection(int self_id, const SwarmLocalOutlierRejectionParams &_param);
+    void addFrame(int drone_id, D2Common::FrameIdType frame_id, const Swarm::Pose & ego_pose);
+    void addPreviousSessionFrame(D2Common::FrameIdType frame_id, const Swarm::Pose & stored_pose);
     std::vector<Swarm::LoopEdge> OutlierRejectionLoopEdges(ros::Time stamp, const std::vector<Swarm::LoopEdge> & available_loops);
 };
 }
\ No newline at end of file
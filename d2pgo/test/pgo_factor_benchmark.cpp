@@ -0,0 +1,104 @@
+#include "posegraph_g2o.hpp"
+#include <d2common/solver/RelPoseFactor.hpp>
+#include <d2common/solver/angle_manifold.h>
+
+using namespace D2PGO;
+
+//Cost and time per iteration of the AutoDiff and the analytic Jacobian pose graph factors.
+//The same problem is built with each factor from a g2o pose graph and solved from the poses in the file.
+//4-DoF graphs use RelPoseFactor4D, 6-DoF graphs RelPoseFactorPerturb and RelRotFactor9D.
+//Usage: pgo_factor_benchmark path.g2o [is_4dof=0] [max_iterations=20]
+
+enum BenchmarkFactor {
+    FACTOR_4D,
+    FACTOR_PERTURB,
+    FACTOR_ROT_9D
+};
+
+void benchmark(const std::string & name, const std::map<FrameIdType, D2BaseFrame> & frames,
+        const std::vector<Swarm::LoopEdge> & edges, BenchmarkFactor type, bool autodiff, int max_iterations) {
+    std::map<FrameIdType, std::vector<double>> states;
+    std::map<FrameIdType, Quaterniond> att_init;
+    for (auto & it : frames) {
+        auto pose = it.second.odom.pose();
+        if (type == FACTOR_4D) {
+            states[it.first] = {pose.pos().x(), pose.pos().y(), pose.pos().z(), pose.yaw()};
+        } else if (type == FACTOR_PERTURB) {
+            states[it.first] = {pose.pos().x(), pose.pos().y(), pose.pos().z(), 0, 0, 0};
+            att_init[it.first] = pose.att();
+        } else {
+            Matrix<double, 3, 3, RowMajor> R = pose.R();
+            states[it.first] = std::vector<double>(R.data(), R.data() + 9);
+        }
+    }
+    ceres::Problem problem;
+    int residual_num = 0;
+    for (auto & edge : edges) {
+        if (states.find(edge.keyframe_id_a) == states.end() || states.find(edge.keyframe_id_b) == states.end()) {
+            continue;
+        }
+        ceres::CostFunction * factor = nullptr;
+        if (type == FACTOR_4D) {
+            factor = autodiff ? RelPoseFactor4DAD::Create(edge) : RelPoseFactor4D::Create(edge);
+        } else if (type == FACTOR_PERTURB) {
+            auto & qa = att_init[edge.keyframe_id_a];
+            auto & qb = att_init[edge.keyframe_id_b];
+            factor = autodiff ? RelPoseFactorPerturbAD::Create(edge, qa, qb) : RelPoseFactorPerturb::Create(edge, qa, qb);
+        } else {
+            factor = autodiff ? RelRotFactor9DAD::Create(edge) : RelRotFactor9D::Create(edge);
+        }
+        problem.AddResidualBlock(factor, nullptr, states[edge.keyframe_id_a].data(), states[edge.keyframe_id_b].data());
+        residual_num ++;
+    }
+    if (type == FACTOR_4D) {
+        for (auto & it : states) {
+            if (problem.HasParameterBlock(it.second.data())) {
+                problem.SetManifold(it.second.data(), PosAngleManifold::Create());
+            }
+        }
+    }
+    if (problem.HasParameterBlock(states.begin()->second.data())) {
+        problem.SetParameterBlockConstant(states.begin()->second.data());
+    }
+
+    ceres::Solver::Options options;
+    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+    options.num_threads = 1;
+    options.max_num_iterations = max_iterations;
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    int iterations = summary.num_successful_steps + summary.num_unsuccessful_steps;
+    printf("[pgo_factor_benchmark] %s: %d residuals iterations %d cost %.4e->%.4e total %.1fms residual %.1fms jacobian %.1fms per iteration %.2fms\n",
+        name.c_str(), residual_num, iterations, summary.initial_cost, summary.final_cost, summary.total_time_in_seconds*1000,
+        summary.residual_evaluation_time_in_seconds*1000, summary.jacobian_evaluation_time_in_seconds*1000,
+        summary.total_time_in_seconds*1000/std::max(iterations, 1));
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        printf("Usage: %s path.g2o [is_4dof=0] [max_iterations=20]\n", argv[0]);
+        return -1;
+    }
+    std::string path = argv[1];
+    bool is_4dof = argc > 2 ? atoi(argv[2]) : false;
+    int max_iterations = argc > 3 ? atoi(argv[3]) : 20;
+
+    std::map<FrameIdType, D2BaseFrame> frames;
+    std::vector<Swarm::LoopEdge> edges;
+    read_g2o_agent(path, frames, edges, is_4dof);
+    printf("[pgo_factor_benchmark] %ld frames %ld edges\n", frames.size(), edges.size());
+    if (frames.empty()) {
+        return -1;
+    }
+    if (is_4dof) {
+        benchmark("RelPoseFactor4DAD", frames, edges, FACTOR_4D, true, max_iterations);
+        benchmark("RelPoseFactor4D", frames, edges, FACTOR_4D, false, max_iterations);
+    } else {
+        benchmark("RelPoseFactorPerturbAD", frames, edges, FACTOR_PERTURB, true, max_iterations);
+        benchmark("RelPoseFactorPerturb", frames, edges, FACTOR_PERTURB, false, max_iterations);
+        benchmark("RelRotFactor9DAD", frames, edges, FACTOR_ROT_9D, true, max_iterations);
+        benchmark("RelRotFactor9D", frames, edges, FACTOR_ROT_9D, false, max_iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "posegraph_g2o.hpp"
+#include "../src/d2pgo.h"
+#include <ros/ros.h>
+
+using namespace D2PGO;
+
+//Latency of D2PGO::solve_single against the graph size, feeding a g2o pose graph frame by frame
+//to the full and the incremental solver. Prints a csv and the difference between the two results.
+//Usage: pgo_incremental_benchmark path.g2o [is_4dof=0] [frames_per_solve=10] [full_solve_interval=50]
+
+D2PGOConfig benchmarkConfig(bool is_4dof, bool incremental, int full_solve_interval) {
+    D2PGOConfig config;
+    config.self_id = 0;
+    config.main_id = 0;
+    config.mode = PGO_MODE_NON_DIST;
+    config.pgo_pose_dof = is_4dof ? PGO_POSE_4D : PGO_POSE_6D;
+    config.perturb_mode = !is_4dof;
+    config.loop_distance_threshold = 10000;
+    config.enable_ego_motion = false; //Odometry edges are in the g2o file
+    config.enable_rotation_initialization = false;
+    config.debug_rot_init_only = false;
+    config.ceres_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    config.ceres_options.num_threads = 1;
+    config.ceres_options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+    config.ceres_options.max_num_iterations = 50;
+    config.ceres_options.max_solver_time_in_seconds = 10;
+    config.enable_incremental_solve = incremental;
+    config.incremental_full_solve_interval = full_solve_interval;
+    return config;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        printf("Usage: %s path.g2o [is_4dof=0] [frames_per_solve=10] [full_solve_interval=50]\n", argv[0]);
+        return -1;
+    }
+    ros::Time::init();
+    std::string path = argv[1];
+    bool is_4dof = argc > 2 ? atoi(argv[2]) : false;
+    int step = argc > 3 ? atoi(argv[3]) : 10;
+    int full_solve_interval = argc > 4 ? atoi(argv[4]) : 50;
+
+    std::map<FrameIdType, D2BaseFrame> frames;
+    std::vector<Swarm::LoopEdge> edges;
+    read_g2o_agent(path, frames, edges, is_4dof);
+    printf("[pgo_incremental_benchmark] %ld frames %ld edges\n", frames.size(), edges.size());
+    //Edges are added with their latest frame
+    std::map<FrameIdType, std::vector<Swarm::LoopEdge>> edges_by_frame;
+    for (auto & edge : edges) {
+        edges_by_frame[std::max(edge.keyframe_id_a, edge.keyframe_id_b)].emplace_back(edge);
+    }
+
+    std::vector<D2PGO::D2PGO*> pgos{
+        new D2PGO::D2PGO(benchmarkConfig(is_4dof, false, full_solve_interval)),
+        new D2PGO::D2PGO(benchmarkConfig(is_4dof, true, full_solve_interval))};
+    std::vector<double> sum_ms(pgos.size(), 0);
+    std::vector<double> max_ms(pgos.size(), 0);
+    printf("frames,edges,full_ms,incremental_ms\n");
+    int count = 0, edge_count = 0, solve_num = 0;
+    for (auto & it : frames) {
+        for (auto pgo : pgos) {
+            pgo->addFrame(it.second);
+        }
+        for (auto & edge : edges_by_frame[it.first]) {
+            if (frames.find(edge.keyframe_id_a) == frames.end() || frames.find(edge.keyframe_id_b) == frames.end()) {
+                continue;
+            }
+            for (auto pgo : pgos) {
+                pgo->addLoop(edge);
+            }
+            edge_count ++;
+        }
+        count ++;
+        if (count % step != 0 && count != frames.size()) {
+            continue;
+        }
+        std::vector<double> ms(pgos.size());
+        for (size_t k = 0; k < pgos.size(); k ++) {
+            Utility::TicToc tic;
+            pgos[k]->solve_single();
+            ms[k] = tic.toc();
+            sum_ms[k] += ms[k];
+            max_ms[k] = std::max(max_ms[k], ms[k]);
+        }
+        solve_num ++;
+        printf("%d,%d,%.2f,%.2f\n", count, edge_count, ms[0], ms[1]);
+    }
+
+    //Difference of the incremental result from the full solve
+    auto frames_full = pgos[0]->getAllLocalFrames();
+    auto frames_inc = pgos[1]->getAllLocalFrames();
+    double pos_err = 0, ang_err = 0;
+    for (size_t i = 0; i < frames_full.size(); i ++) {
+        auto delta = Swarm::Pose::DeltaPose(frames_full[i]->odom.pose(), frames_inc[i]->odom.pose());
+        pos_err += delta.pos().squaredNorm();
+        ang_err += delta.att().angularDistance(Quaterniond::Identity()) * delta.att().angularDistance(Quaterniond::Identity());
+    }
+    printf("[pgo_incremental_benchmark] solves %d full avg %.1fms max %.1fms incremental avg %.1fms max %.1fms\n",
+        solve_num, sum_ms[0] / solve_num, max_ms[0], sum_ms[1] / solve_num, max_ms[1]);
+    printf("[pgo_incremental_benchmark] incremental vs full RMSE pos %.4fm ang %.4fdeg\n",
+        sqrt(pos_err / frames_full.size()), sqrt(ang_err / frames_full.size()) * 57.3);
+    return 0;
+}
@@ -54,5 +54,11 @@ int maxCliqueHeuIncremental(CGraphIO& gio,
                             size_t num_new_lc,
                             size_t prev_maxclique_size,
                             vector<int>& max_clique_data);
+//Same heuristic on sorted adjacency lists updated in place, without building the CSR graph.
+//max_clique_data is the clique found if it is larger than prev_maxclique_size.
+int maxCliqueHeuIncremental(const vector<vector<int>>& adjacency,
+                            size_t num_new_lc,
+                            size_t prev_maxclique_size,
+                            vector<int>& max_clique_data);
 }
 #endif 
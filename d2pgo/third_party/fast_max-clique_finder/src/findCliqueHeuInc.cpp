@@ -97,4 +97,55 @@ int maxCliqueHeuIncremental(CGraphIO& gio,
 
   return maxClq;
 }
-}
\ No newline at end of file
+
+int maxCliqueHeuIncremental(const vector<vector<int>>& adjacency,
+                            size_t num_new_lc,
+                            size_t prev_maxclique_size,
+                            vector<int>& max_clique_data) {
+  int maxClq = prev_maxclique_size;
+  size_t maxDegree = 0;
+  for (auto& neighbors : adjacency) {
+    maxDegree = std::max(maxDegree, neighbors.size());
+  }
+  vector<int> v_i_S(maxDegree + 1, 0);
+  vector<int> v_i_S1(maxDegree + 1, 0);
+  vector<int> clique;
+  clique.reserve(maxDegree + 1);
+  for (size_t iCandidateVertex = adjacency.size() - num_new_lc;
+       iCandidateVertex < adjacency.size(); iCandidateVertex++) {
+    auto& candidate_neighbors = adjacency[iCandidateVertex];
+    // Pruning 1
+    if (maxClq > (int)candidate_neighbors.size()) {
+      continue;
+    }
+    int iPos = 0;
+    v_i_S[iPos++] = iCandidateVertex;
+    for (int u : candidate_neighbors) {
+      // Pruning 3
+      if (maxClq <= (int)adjacency[u].size()) v_i_S[iPos++] = u;
+    }
+    // Greedily take the last vertex of the candidate set and keep its neighbors
+    clique.clear();
+    while (iPos > 0) {
+      int imdv = v_i_S[iPos - 1];
+      auto& neighbors = adjacency[imdv];
+      clique.push_back(imdv);
+      int iPos1 = 0;
+      for (int j = 0; j < iPos; j++) {
+        // Pruning 5
+        if (std::binary_search(neighbors.begin(), neighbors.end(), v_i_S[j]) &&
+            maxClq <= (int)adjacency[v_i_S[j]].size()) {
+          v_i_S1[iPos1++] = v_i_S[j];
+        }
+      }
+      for (int j = 0; j < iPos1; j++) v_i_S[j] = v_i_S1[j];
+      iPos = iPos1;
+    }
+    if (maxClq < (int)clique.size()) {
+      max_clique_data = clique;
+      maxClq = clique.size();
+    }
+  }
+  return maxClq;
+}
+}
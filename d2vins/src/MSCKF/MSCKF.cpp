@@ -1,62 +1,130 @@
 #include "MSCKF.hpp"
 #include <d2common/utils.hpp>
+#include <set>
+#include <algorithm>
+#include <unistd.h>
 
 namespace D2VINS {
-MSCKF::MSCKF() {
+MSCKF::MSCKF(): MSCKF(D2VINSConfig()) {
+}
+
+MSCKF::MSCKF(const D2VINSConfig & config): _config(config) {
+    //Continuous time noise densities of [n_g, n_wg, n_a, n_wa]
     Q_imu.setZero();
-    Q_imu.block<3, 3>(0, 0) = _config.gyr_n*Matrix3d::Identity();
-    Q_imu.block<3, 3>(3, 3) = _config.gyr_w*Matrix3d::Identity();
-    Q_imu.block<3, 3>(6, 6) = _config.acc_n*Matrix3d::Identity();
-    Q_imu.block<3, 3>(9, 9) = _config.acc_w*Matrix3d::Identity();
+    Q_imu.block<3, 3>(0, 0) = _config.gyr_n*_config.gyr_n*Matrix3d::Identity();
+    Q_imu.block<3, 3>(3, 3) = _config.gyr_w*_config.gyr_w*Matrix3d::Identity();
+    Q_imu.block<3, 3>(6, 6) = _config.acc_n*_config.acc_n*Matrix3d::Identity();
+    Q_imu.block<3, 3>(9, 9) = _config.acc_w*_config.acc_w*Matrix3d::Identity();
+    nominal_state.camera_extrisincs = _config.camera_extrinsics;
 }
 
-void MSCKF::initFirstPose() {
-    auto q0 = Utility::g2R(imubuf.mean_acc());
+void MSCKF::initFirstPose(double t) {
+    //Static start as D2Estimator::tryinitFirstPose: gravity from mean acc and gyro bias from mean gyro.
+    auto mean_acc = imubuf.mean_acc();
+    auto q0 = Utility::g2R(mean_acc);
     nominal_state.q_imu = q0;
+    nominal_state.bias_gyro = imubuf.mean_gyro();
+    nominal_state.bias_acc = mean_acc - q0.inverse()*IMUData::Gravity;
+    auto imus = imubuf.pop(t);
+    imu_last = imus.size() > 0 ? imus.buf.back() : imubuf[0];
+    t_last = t;
+    //Roll, pitch and gyro bias are as uncertain as the means of the IMU noise, yaw and position are the gauge.
+    double var_gyr = _config.gyr_n * _config.gyr_n * _config.IMU_FREQ / (imus.size() + 1);
+    double var_att = _config.acc_n * _config.acc_n * _config.IMU_FREQ / (imus.size() + 1) / IMUData::Gravity.squaredNorm();
+    error_state = MSCKFErrorStateVector();
+    Eigen::Matrix<double, IMU_STATE_DIM, 1> P0;
+    P0 << var_att, var_att, 1e-8, var_gyr, var_gyr, var_gyr, 1e-4, 1e-4, 1e-4, 1e-2, 1e-2, 1e-2, 1e-8, 1e-8, 1e-8;
+    error_state.P = P0.asDiagonal();
+    initFirstPoseFlag = true;
+    printf("\033[0;32m[D2VINS::MSCKF] Init pose with IMU: %s\n", getOdometry().toStr().c_str());
+    printf("[D2VINS::MSCKF] Gyro bias: %.3f %.3f %.3f\033[0m\n", nominal_state.bias_gyro.x(),
+        nominal_state.bias_gyro.y(), nominal_state.bias_gyro.z());
 }
 
-void MSCKF::predict(const double t, const IMUData & imudata) {
-    //Follows  Mourikis, Anastasios I., and Stergios I. Roumeliotis. 
-    // "A multi-state constraint Kalman filter for vision-aided inertial navigation." 
-    // Proceedings 2007 IEEE International Conference on Robotics and Automation. IEEE, 2007.
-    // Sect III-B
-    if (t_last < 0 ) {
-        t_last = t;
-    }
-
+void MSCKF::inputImu(const IMUData & imudata) {
+    //Filter is propagated to the image time when image comes, the images are later than the IMU.
     imubuf.add(imudata);
+}
+
+bool MSCKF::inputImage(const VisualImageDescArray & frame) {
+    double t_imu_frame = frame.stamp + _config.td_initial;
+    while (!imubuf.available(t_imu_frame)) {
+        //Wait for IMU
+        usleep(2000);
+        printf("[D2VINS::MSCKF] wait for imu...\n");
+    }
+    const Guard lock(state_lock);
     if (!initFirstPoseFlag) {
-        //First pose is inited in keyframe. So first pose must is a keyframe.
-        return;
+        if (imubuf.size() < _config.init_imu_num) {
+            printf("[D2VINS::MSCKF] not enough imu data %ld/%d for init\n", imubuf.size(), _config.init_imu_num);
+            return false;
+        }
+        initFirstPose(t_imu_frame);
+    } else {
+        auto imus = imubuf.pop(t_imu_frame);
+        for (auto & imu : imus.buf) {
+            predict(imu.t, imu);
+        }
+        if (imubuf.size() > 0) {
+            //The rest from last IMU to image
+            predict(t_imu_frame, imubuf[0]);
+        }
     }
+    addKeyframe(frame.frame_id, t_imu_frame);
 
-    double dt = t - t_last;
-
-    static IMUData imudatalast;
-
-    //trapezoidal integration
-    Vector3d gyro = (imudata.gyro + imudatalast.gyro)/2;
-    Vector3d acc = (imudata.acc + imudatalast.acc)/2;
-    imudatalast = imudata;
-    
-    Vector3d angvel_hat = imudata.gyro - error_state.bias_gyro; //Planet angular velocity is ignored
-    Matrix3d Rq_hat = nominal_state.get_imu_R();
-    Vector3d acc_hat = imudata.acc - error_state.bias_acc;
-
-    //Nominal State
-    Quaterniond omg_l(0, angvel_hat.x(), angvel_hat.y(), angvel_hat.z());
+    std::set<LandmarkIdType> observed;
+    for (auto & image : frame.images) {
+        for (auto lm : image.landmarks) {
+            if (lm.landmark_id < 0 || lm.pt3d_norm.z() < 1e-2 ||
+                    lm.camera_index >= nominal_state.camera_extrisincs.size()) {
+                continue;
+            }
+            lm.frame_id = frame.frame_id;
+            observed.insert(lm.landmark_id);
+            auto it = feature_tracks.find(lm.landmark_id);
+            if (it == feature_tracks.end()) {
+                feature_tracks.emplace(lm.landmark_id, LandmarkPerId(lm));
+            } else {
+                it->second.add(lm);
+            }
+        }
+    }
 
-    //Naive intergation
-    auto qdot = nominal_state.q_imu * omg_l;
-    auto vdot = Rq_hat*acc_hat + IMUData::Gravity;
-    auto pdot = nominal_state.v_imu;
+    //Features lost in this frame will never be observed again
+    std::vector<LandmarkIdType> lost;
+    for (auto & it : feature_tracks) {
+        if (observed.find(it.first) == observed.end()) {
+            lost.emplace_back(it.first);
+        }
+    }
+    updateFeatures(lost);
+    pruneClones();
+    return true;
+}
 
-    //Internal the quaternion is save as [qw, qx, qy, qz] in Eigen
-    nominal_state.q_imu.coeffs().block<3, 1>(0, 0) += qdot.coeffs().block<3, 1>(0, 0)*dt;
-    nominal_state.q_imu.normalize();
-    nominal_state.v_imu += vdot*dt;
-    nominal_state.p_imu += pdot*dt;
+void MSCKF::predict(const double t, const IMUData & imudata) {
+    //Follows  Mourikis, Anastasios I., and Stergios I. Roumeliotis.
+    // "A multi-state constraint Kalman filter for vision-aided inertial navigation."
+    // Proceedings 2007 IEEE International Conference on Robotics and Automation. IEEE, 2007.
+    // Sect III-B
+    // The attitude error is in body frame: R = R_hat * Exp(ang)
+    double dt = t - t_last;
+    if (dt <= 0) {
+        imu_last = imudata;
+        return;
+    }
 
+    //Nominal state, midpoint integration as IMUData::propagation
+    Vector3d angvel_hat = 0.5 * (imu_last.gyro + imudata.gyro) - nominal_state.bias_gyro; //Planet angular velocity is ignored
+    Vector3d acc_hat = 0.5 * (imu_last.acc + imudata.acc) - nominal_state.bias_acc;
+    Matrix3d Rq_hat = nominal_state.get_imu_R();
+    Quaterniond q_new = nominal_state.q_imu * Utility::quatfromRotationVector(Vector3d(angvel_hat * dt));
+    q_new.normalize();
+    Vector3d acc_w = 0.5 * (Rq_hat * (imu_last.acc - nominal_state.bias_acc) +
+        q_new * (imudata.acc - nominal_state.bias_acc)) - IMUData::Gravity;
+    nominal_state.p_imu += nominal_state.v_imu * dt + 0.5 * acc_w * dt * dt;
+    nominal_state.v_imu += acc_w * dt;
+    nominal_state.q_imu = q_new;
 
     //Error state
     // Model:
@@ -67,17 +135,15 @@ void MSCKF::predict(const double t, const IMUData & imudata) {
     F_mat.setZero();
 
     //Rows 1-3, dynamics on quat
-    F_mat.block<3, 3>(0, 0) = skewSymmetric(angvel_hat);
+    F_mat.block<3, 3>(0, 0) = - Utility::skewSymmetric(angvel_hat);
     F_mat.block<3, 3>(0, 3) = - Matrix3d::Identity();
 
     //Rows 4-6, dynamics on bias is empty
     //Rows 7-9, dynamics on velocity
-    F_mat.block<3, 3>(6, 0) = - Rq_hat * skewSymmetric(acc_hat);
-    F_mat.block<3, 3>(6, 6) = - 2 * skewSymmetric(acc_hat);
+    F_mat.block<3, 3>(6, 0) = - Rq_hat * Utility::skewSymmetric(acc_hat);
     F_mat.block<3, 3>(6, 9) = - Rq_hat;
-    F_mat.block<3, 3>(6, 12) = - skewSymmetric(acc_hat);
     //Rows 10-12, dynamics on bias is empty
-    
+
     //Rows 13-15, dynamics on position
     F_mat.block<3, 3>(12, 6) = Matrix3d::Identity();
 
@@ -88,43 +154,295 @@ void MSCKF::predict(const double t, const IMUData & imudata) {
     G_mat.block<3, 3>(6, 6) = - Rq_hat;
     G_mat.block<3, 3>(9, 9) = Matrix3d::Identity();
 
-    //Now we need to intergate this, naive approach is trapezoidal rule
-    //x_err_new = F_mat*x_err_last*dt + x_err_last
-    //Or \dot Phi = F_mat Phi, Phi(0) = I
-    // Phi = I + F_mat Phi * dt
-    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Phi;
-    Phi.setIdentity();
-    Phi = Phi + F_mat*dt;
-    auto G = G_mat*dt;
-    
+    // \dot Phi = F_mat Phi, Phi(0) = I, to second order
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Fdt = F_mat*dt;
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> Phi =
+        Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM>::Identity() + Fdt + 0.5*Fdt*Fdt;
+
     // Suggest by (268)-(269) in Sola J. Quaternion kinematics for the error-state Kalman filter
     // We don't predict the error state space
     // Instead, we only predict the P of error state, and predict the nominal state
-    auto P_new = Phi*error_state.getImuP()*Phi.transpose() + G*Q_imu*G.transpose();
-    auto P_imu_other_new = Phi*error_state.getImuOtherP();
-
-    //Set states to error_state
+    Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> P_new = Phi*error_state.getImuP()*Phi.transpose() +
+        G_mat*Q_imu*G_mat.transpose()*dt;
+    P_new = 0.5*(P_new + P_new.transpose());
     error_state.setImuP(P_new);
-    error_state.setImuOtherP(P_imu_other_new);
+    if (error_state.P.cols() > IMU_STATE_DIM) {
+        Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> P_imu_other_new = Phi*error_state.getImuOtherP();
+        error_state.setImuOtherP(P_imu_other_new);
+    }
+    t_last = t;
+    imu_last = imudata;
 }
 
-void MSCKF::addKeyframe(const double t) {
+void MSCKF::addKeyframe(FrameIdType frame_id, const double t) {
     //For convience, we require t here is exact same to last imu t
-     if (!initFirstPoseFlag) {
-        if (imubuf.size() >= _config.init_imu_num) {
-            initFirstPose();
-        }
-        return;
-    }
     if (t_last >= 0) {
         assert(fabs(t - t_last) < 1.0/_config.IMU_FREQ && "MSCKF new image must be added EXACTLY after the corresponding imu is applied!");
     }
     error_state.stateAugmentation(t);
-    nominal_state.addKeyframe(t);
+    nominal_state.addKeyframe(frame_id, t);
+}
+
+int MSCKF::cloneIndex(FrameIdType frame_id) const {
+    for (int i = 0; i < nominal_state.sld_win_ids.size(); i++) {
+        if (nominal_state.sld_win_ids[i] == frame_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool MSCKF::triangulate(const LandmarkPerId & feature, Vector3d & p_f) const {
+    //Linear triangulation by the bearings, then refine on the normalized plane with Gauss-Newton
+    std::vector<Matrix3d> R_wcs;
+    std::vector<Vector3d> p_wcs, pts_norm;
+    Matrix3d A = Matrix3d::Zero();
+    Vector3d b = Vector3d::Zero();
+    for (auto & obs : feature.track) {
+        int index = cloneIndex(obs.frame_id);
+        if (index < 0) {
+            continue;
+        }
+        auto & pose = nominal_state.sld_win_poses[index];
+        auto & ext = nominal_state.camera_extrisincs[obs.camera_index];
+        Matrix3d R_wi = pose.att().toRotationMatrix();
+        Matrix3d R_wc = R_wi * ext.att().toRotationMatrix();
+        Vector3d p_wc = pose.pos() + R_wi * ext.pos();
+        Vector3d d = (R_wc * obs.pt3d_norm).normalized();
+        Matrix3d A_i = Matrix3d::Identity() - d * d.transpose();
+        A += A_i;
+        b += A_i * p_wc;
+        R_wcs.emplace_back(R_wc);
+        p_wcs.emplace_back(p_wc);
+        pts_norm.emplace_back(obs.pt3d_norm / obs.pt3d_norm.z());
+    }
+    if (R_wcs.size() < 2) {
+        return false;
+    }
+    SelfAdjointEigenSolver<Matrix3d> eig(A);
+    if (eig.eigenvalues()(0) < 1e-4 * eig.eigenvalues()(2)) {
+        //Not enough parallax
+        return false;
+    }
+    p_f = A.ldlt().solve(b);
+    for (int iter = 0; iter < 5; iter ++) {
+        Matrix3d JtJ = Matrix3d::Zero();
+        Vector3d Jtr = Vector3d::Zero();
+        for (int i = 0; i < R_wcs.size(); i++) {
+            Vector3d p_c = R_wcs[i].transpose() * (p_f - p_wcs[i]);
+            if (p_c.z() < 1e-2) {
+                return false;
+            }
+            Matrix<double, 2, 3> J_proj;
+            J_proj << 1, 0, -p_c.x()/p_c.z(), 0, 1, -p_c.y()/p_c.z();
+            J_proj /= p_c.z();
+            Matrix<double, 2, 3> J = J_proj * R_wcs[i].transpose();
+            Vector2d r = pts_norm[i].head<2>() - p_c.head<2>() / p_c.z();
+            JtJ += J.transpose() * J;
+            Jtr += J.transpose() * r;
+        }
+        Vector3d dp = JtJ.ldlt().solve(Jtr);
+        p_f += dp;
+        if (dp.norm() < 1e-6 * p_f.norm()) {
+            break;
+        }
+    }
+    for (int i = 0; i < R_wcs.size(); i++) {
+        if ((R_wcs[i].transpose() * (p_f - p_wcs[i])).z() < 1e-2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MSCKF::featureJacobian(const LandmarkPerId & feature, MatrixXd & H_o, VectorXd & r_o) const {
+    std::set<FrameIdType> clones;
+    for (auto & obs : feature.track) {
+        if (cloneIndex(obs.frame_id) >= 0) {
+            clones.insert(obs.frame_id);
+        }
+    }
+    if (clones.size() < _config.msckf_min_track) {
+        return false;
+    }
+    Vector3d p_f;
+    if (!triangulate(feature, p_f)) {
+        return false;
+    }
+    int rows = 0;
+    MatrixXd H_x = MatrixXd::Zero(feature.track.size() * 2, error_state.stateDimFull());
+    MatrixXd H_f(feature.track.size() * 2, 3);
+    VectorXd r(feature.track.size() * 2);
+    for (auto & obs : feature.track) {
+        int index = cloneIndex(obs.frame_id);
+        if (index < 0) {
+            continue;
+        }
+        auto & pose = nominal_state.sld_win_poses[index];
+        auto & ext = nominal_state.camera_extrisincs[obs.camera_index];
+        Matrix3d R_wi = pose.att().toRotationMatrix();
+        Matrix3d R_ic = ext.att().toRotationMatrix();
+        Vector3d p_b = R_wi.transpose() * (p_f - pose.pos());
+        Vector3d p_c = R_ic.transpose() * (p_b - ext.pos());
+        Matrix<double, 2, 3> J_proj;
+        J_proj << 1, 0, -p_c.x()/p_c.z(), 0, 1, -p_c.y()/p_c.z();
+        J_proj /= p_c.z();
+        Matrix<double, 2, 3> J_b = J_proj * R_ic.transpose();
+        int col = error_state.cloneIndex(index);
+        //p_b = R_wi^T(p_f - p_wi), with R_wi = R_wi_hat * Exp(ang): d p_b/d ang = [p_b]x
+        H_x.block<2, 3>(rows, col) = J_b * Utility::skewSymmetric(p_b);
+        H_x.block<2, 3>(rows, col + 3) = - J_b * R_wi.transpose();
+        H_f.block<2, 3>(rows, 0) = J_b * R_wi.transpose();
+        r.segment<2>(rows) = (obs.pt3d_norm / obs.pt3d_norm.z()).head<2>() - p_c.head<2>() / p_c.z();
+        rows += 2;
+    }
+    if (rows <= 3) {
+        return false;
+    }
+    //Project to the left nullspace of H_f [Mourikis et al. 2007] (23)-(24), the feature is removed from the system
+    HouseholderQR<MatrixXd> qr(H_f.topRows(rows));
+    MatrixXd Qt = qr.householderQ().transpose();
+    H_o = (Qt * H_x.topRows(rows)).bottomRows(rows - 3);
+    r_o = (Qt * r.head(rows)).tail(rows - 3);
+    return true;
+}
+
+bool MSCKF::gatingTest(const MatrixXd & H, const VectorXd & r) const {
+    double sigma = _config.msckf_pixel_noise / _config.focal_length;
+    MatrixXd S = H * error_state.P * H.transpose();
+    S.diagonal().array() += sigma * sigma;
+    double gamma = r.dot(S.ldlt().solve(r));
+    //95% quantile of chi-square by Wilson-Hilferty approximation
+    double dof = r.size();
+    double chi2 = dof * pow(1 - 2/(9*dof) + 1.6449*sqrt(2/(9*dof)), 3);
+    return gamma < chi2;
+}
+
+bool MSCKF::update(const LandmarkPerId & feature_by_id) {
+    MatrixXd H_o;
+    VectorXd r_o;
+    if (!featureJacobian(feature_by_id, H_o, r_o) || !gatingTest(H_o, r_o)) {
+        return false;
+    }
+    measurementUpdate(H_o, r_o);
+    return true;
+}
+
+void MSCKF::updateFeatures(const std::vector<LandmarkIdType> & feature_ids) {
+    std::vector<MatrixXd> Hs;
+    std::vector<VectorXd> rs;
+    int rows = 0;
+    for (auto id : feature_ids) {
+        MatrixXd H_o;
+        VectorXd r_o;
+        if (featureJacobian(feature_tracks.at(id), H_o, r_o) && gatingTest(H_o, r_o)) {
+            rows += r_o.size();
+            Hs.emplace_back(H_o);
+            rs.emplace_back(r_o);
+        }
+        feature_tracks.erase(id);
+    }
+    if (rows == 0) {
+        return;
+    }
+    MatrixXd H(rows, error_state.stateDimFull());
+    VectorXd r(rows);
+    rows = 0;
+    for (int i = 0; i < Hs.size(); i++) {
+        H.middleRows(rows, Hs[i].rows()) = Hs[i];
+        r.segment(rows, rs[i].size()) = rs[i];
+        rows += rs[i].size();
+    }
+    measurementUpdate(H, r);
+}
+
+void MSCKF::measurementUpdate(const MatrixXd & H, const VectorXd & r) {
+    double sigma = _config.msckf_pixel_noise / _config.focal_length;
+    int dim = H.cols();
+    MatrixXd T_H;
+    VectorXd r_n;
+    if (H.rows() > dim) {
+        //QR compression [Mourikis et al. 2007] (26)-(28), Q^T [H r] is upper triangular and only the first
+        //dim rows carry information. Noise is isotropic so it is unchanged.
+        MatrixXd Hr(H.rows(), dim + 1);
+        Hr << H, r;
+        HouseholderQR<MatrixXd> qr(Hr);
+        MatrixXd R = qr.matrixQR().topRows(dim).triangularView<Upper>();
+        T_H = R.leftCols(dim);
+        r_n = R.col(dim);
+    } else {
+        T_H = H;
+        r_n = r;
+    }
+    MatrixXd & P = error_state.P;
+    MatrixXd PHt = P * T_H.transpose();
+    MatrixXd S = T_H * PHt;
+    S.diagonal().array() += sigma * sigma;
+    MatrixXd K = S.ldlt().solve(PHt.transpose()).transpose();
+    VectorXd dx = K * r_n;
+    //Joseph form
+    MatrixXd I_KH = MatrixXd::Identity(dim, dim) - K * T_H;
+    P = I_KH * P * I_KH.transpose() + sigma * sigma * K * K.transpose();
+    P = 0.5 * (P + P.transpose());
+    nominal_state.applyCorrection(dx);
+    error_state.reset(nominal_state);
 }
 
-void MSCKF::update(const LandmarkPerId & feature_by_id) {  
-   
+void MSCKF::pruneClones() {
+    while (nominal_state.sld_win_poses.size() > _config.max_sld_win_size) {
+        int n = nominal_state.sld_win_poses.size();
+        bool close_clone = false;
+        if (n >= 3) {
+            auto & pose_a = nominal_state.sld_win_poses[n - 3];
+            auto & pose_b = nominal_state.sld_win_poses[n - 2];
+            double dist = (pose_b.pos() - pose_a.pos()).norm();
+            double angle = AngleAxisd(pose_a.att().inverse() * pose_b.att()).angle();
+            close_clone = dist < _config.msckf_clone_min_dist && angle < _config.msckf_clone_min_angle;
+        }
+        if (close_clone) {
+            //The second newest clone is close to its previous one and adds little parallax, drop it with its observations
+            FrameIdType frame_id = nominal_state.sld_win_ids[n - 2];
+            for (auto & it : feature_tracks) {
+                auto & track = it.second.track;
+                track.erase(std::remove_if(track.begin(), track.end(), [frame_id](const LandmarkPerFrame & obs) {
+                    return obs.frame_id == frame_id;
+                }), track.end());
+            }
+            nominal_state.removeKeyframe(n - 2);
+            error_state.removeClone(n - 2);
+            continue;
+        }
+        //Features seen by the oldest clone are used before it is removed, their tracks start again on the next observation
+        FrameIdType oldest = nominal_state.sld_win_ids[0];
+        std::vector<LandmarkIdType> features;
+        for (auto & it : feature_tracks) {
+            for (auto & obs : it.second.track) {
+                if (obs.frame_id == oldest) {
+                    features.emplace_back(it.first);
+                    break;
+                }
+            }
+        }
+        updateFeatures(features);
+        nominal_state.removeKeyframe(0);
+        error_state.removeClone(0);
+    }
+}
+
+bool MSCKF::isInitialized() const {
+    return initFirstPoseFlag;
 }
 
-}
\ No newline at end of file
+Swarm::Odometry MSCKF::getOdometry() const {
+    const Guard lock(state_lock);
+    Swarm::Odometry odom(t_last, Swarm::Pose(nominal_state.q_imu, nominal_state.p_imu));
+    odom.vel() = nominal_state.v_imu;
+    return odom;
+}
+
+std::pair<Vector3d, Vector3d> MSCKF::getBiases() const {
+    const Guard lock(state_lock);
+    return std::make_pair(nominal_state.bias_acc, nominal_state.bias_gyro);
+}
+
+}
@@ -1,6 +1,9 @@
+#pragma once
 #include <d2common/d2vinsframe.h>
+#include <d2common/d2frontend_types.h>
 #include "../d2vins_params.hpp"
 #include "MSCKF_state.hpp"
+#include <atomic>
 using namespace D2Common;
 namespace D2VINS {
 class MSCKF {
@@ -8,17 +11,33 @@ class MSCKF {
     MSCKFErrorStateVector error_state;
     D2VINSConfig _config;
     double t_last = -1;
-    bool initFirstPoseFlag = false;
+    mutable std::recursive_mutex state_lock;
+    std::atomic<bool> initFirstPoseFlag{false}; //Read by isInitialized() from the IMU thread
 
     IMUBuffer imubuf;
+    IMUData imu_last;
 
     Eigen::Matrix<double, IMU_NOISE_DIM, IMU_NOISE_DIM> Q_imu;
+    std::map<LandmarkIdType, LandmarkPerId> feature_tracks; //Observations of the features in the clones
 
+    bool featureJacobian(const LandmarkPerId & feature, MatrixXd & H_o, VectorXd & r_o) const;
+    bool triangulate(const LandmarkPerId & feature, Vector3d & p_f) const;
+    void measurementUpdate(const MatrixXd & H, const VectorXd & r);
+    bool gatingTest(const MatrixXd & H, const VectorXd & r) const;
+    int cloneIndex(FrameIdType frame_id) const;
+    void updateFeatures(const std::vector<LandmarkIdType> & feature_ids);
+    void pruneClones();
 public:
     MSCKF();
-    void initFirstPose();
+    MSCKF(const D2VINSConfig & config);
+    void initFirstPose(double t);
+    void inputImu(const IMUData & imudata);
+    bool inputImage(const VisualImageDescArray & frame);
     void predict(const double t, const IMUData & imudata);
-    void addKeyframe(const double t); //For convience, we require t here is exact same to last imu t
-    void update(const LandmarkPerId & feature_by_id);
+    void addKeyframe(FrameIdType frame_id, const double t); //For convience, we require t here is exact same to last imu t
+    bool update(const LandmarkPerId & feature_by_id);
+    bool isInitialized() const;
+    Swarm::Odometry getOdometry() const;
+    std::pair<Vector3d, Vector3d> getBiases() const; //Ba, Bg
 };
-}
\ No newline at end of file
+}
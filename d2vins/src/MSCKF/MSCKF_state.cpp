@@ -1,4 +1,7 @@
 #include "MSCKF_state.hpp"
+#include <d2common/utils.hpp>
+
+using namespace D2Common;
 
 MSCKFStateVector::MSCKFStateVector():
     q_imu(1.0, 0.0, 0.0, 0.0),
@@ -9,35 +12,66 @@ MSCKFStateVector::MSCKFStateVector():
 {
 }
 
-Matrix3d MSCKFStateVector::get_imu_R() const { 
+Matrix3d MSCKFStateVector::get_imu_R() const {
     return q_imu.toRotationMatrix();
 }
 
-MSCKFErrorStateVector::MSCKFErrorStateVector(const MSCKFStateVector & state0) {
+void MSCKFStateVector::addKeyframe(FrameIdType frame_id, double t) {
+    sld_win_poses.push_back(Swarm::Pose(q_imu, p_imu));
+    sld_win_ids.push_back(frame_id);
+    sld_win_stamps.push_back(t);
+}
+
+void MSCKFStateVector::removeKeyframe(int index) {
+    sld_win_poses.erase(sld_win_poses.begin() + index);
+    sld_win_ids.erase(sld_win_ids.begin() + index);
+    sld_win_stamps.erase(sld_win_stamps.begin() + index);
+}
+
+void MSCKFStateVector::applyCorrection(const VectorXd & dx) {
+    q_imu = q_imu * Utility::quatfromRotationVector(Vector3d(dx.segment<3>(0)));
+    q_imu.normalize();
+    bias_gyro += dx.segment<3>(3);
+    v_imu += dx.segment<3>(6);
+    bias_acc += dx.segment<3>(9);
+    p_imu += dx.segment<3>(12);
+    int index = dx.size() - sld_win_poses.size() * CLONE_STATE_DIM;
+    for (auto & pose : sld_win_poses) {
+        Quaterniond q = pose.att() * Utility::quatfromRotationVector(Vector3d(dx.segment<3>(index)));
+        q.normalize();
+        pose = Swarm::Pose(q, pose.pos() + dx.segment<3>(index + 3));
+        index += CLONE_STATE_DIM;
+    }
+}
+
+MSCKFErrorStateVector::MSCKFErrorStateVector() {
     ang.setZero();
     pos.setZero();
     v_imu.setZero();
     bias_gyro.setZero();
     bias_acc.setZero();
-    camera_extrisincs.resize(state0.camera_extrisincs.size());
-    for (auto & extrinsic : camera_extrisincs) {
-        extrinsic.first.setZero();
-        extrinsic.second.setZero();
-    }
+    P = MatrixXd::Zero(IMU_STATE_DIM, IMU_STATE_DIM);
+}
 
+MSCKFErrorStateVector::MSCKFErrorStateVector(const MSCKFStateVector & state0):
+    MSCKFErrorStateVector() {
+    //Extrinsics are fixed, so only the clones are in the error state
     sld_win_poses.resize(state0.sld_win_poses.size());
-    
-    for (auto & pose : camera_extrisincs) {
+    for (auto & pose : sld_win_poses) {
         pose.first.setZero();
         pose.second.setZero();
     }
+    P = MatrixXd::Zero(stateDimFull(), stateDimFull());
 }
 
 void MSCKFErrorStateVector::reset(MSCKFStateVector & nominal) {
-    assert(camera_extrisincs.size() == nominal.camera_extrisincs.size());
     assert(sld_win_poses.size() == nominal.sld_win_poses.size());
-
-    //TODO:
+    //The error is injected to nominal state by MSCKFStateVector::applyCorrection
+    setImuVector(Eigen::Matrix<double, IMU_STATE_DIM, 1>::Zero());
+    for (auto & pose : sld_win_poses) {
+        pose.first.setZero();
+        pose.second.setZero();
+    }
 }
 
 void MSCKFErrorStateVector::setImuVector(Eigen::Matrix<double, IMU_STATE_DIM, 1> v) {
@@ -52,10 +86,6 @@ void MSCKFErrorStateVector::setImuP(Eigen::Matrix<double, IMU_STATE_DIM, IMU_STA
     P.block<IMU_STATE_DIM, IMU_STATE_DIM>(0, 0) = _P;
 }
 
-void MSCKFStateVector::addKeyframe(double t) {
-    sld_win_poses.push_back(Swarm::Pose(q_imu, p_imu));
-}
-
 Eigen::Matrix<double, IMU_STATE_DIM, 1> MSCKFErrorStateVector::getImuVector() const {
     Eigen::Matrix<double, IMU_STATE_DIM, 1> v;
     v.block<3, 1>(0, 0) = ang;
@@ -83,18 +113,33 @@ void MSCKFErrorStateVector::stateAugmentation(double t) {
     // This function  modified from (14) - (16) in [Mourikis et al. 2007].
     // The original state records image poses in  [Mourikis et al. 2007].
     // [Li M. et al. 2013] suggest to directly use IMU poses.
-    // Our implementations also record IMU poses because we will make this appliable to arbitrary number of cameras. 
+    // Our implementations also record IMU poses because we will make this appliable to arbitrary number of cameras.
 
     int prev_dim = stateDimFull();
     sld_win_poses.push_back(std::make_pair(ang, pos));
-    auto G = MatrixXd(prev_dim + 6, prev_dim);
-    G.setZero();
-
-    auto J = MatrixXd(6, prev_dim);
+    MatrixXd J = MatrixXd::Zero(CLONE_STATE_DIM, prev_dim);
     J.block(0, 0, 3, 3) = Matrix3d::Identity();
     J.block(3, 12, 3, 3)  = Matrix3d::Identity();
 
-    G.block(0, 0, prev_dim, prev_dim).setIdentity();
-    G.block(prev_dim, 0, 6, prev_dim) = J;
-    P = G * P * G.transpose();
+    //P = G * P * G^T with G = [I; J], written by blocks to avoid the full product
+    MatrixXd P_new(prev_dim + CLONE_STATE_DIM, prev_dim + CLONE_STATE_DIM);
+    P_new.topLeftCorner(prev_dim, prev_dim) = P;
+    MatrixXd JP = J * P;
+    P_new.bottomLeftCorner(CLONE_STATE_DIM, prev_dim) = JP;
+    P_new.topRightCorner(prev_dim, CLONE_STATE_DIM) = JP.transpose();
+    P_new.bottomRightCorner(CLONE_STATE_DIM, CLONE_STATE_DIM) = JP * J.transpose();
+    P = P_new;
+}
+
+void MSCKFErrorStateVector::removeClone(int index) {
+    int dim = stateDimFull();
+    int start = cloneIndex(index);
+    int tail = dim - start - CLONE_STATE_DIM;
+    MatrixXd P_new(dim - CLONE_STATE_DIM, dim - CLONE_STATE_DIM);
+    P_new.topLeftCorner(start, start) = P.topLeftCorner(start, start);
+    P_new.topRightCorner(start, tail) = P.topRightCorner(start, tail);
+    P_new.bottomLeftCorner(tail, start) = P.bottomLeftCorner(tail, start);
+    P_new.bottomRightCorner(tail, tail) = P.bottomRightCorner(tail, tail);
+    P = P_new;
+    sld_win_poses.erase(sld_win_poses.begin() + index);
 }
@@ -1,25 +1,33 @@
+#pragma once
 #include "swarm_msgs/Pose.h"
+#include <d2common/d2basetypes.h>
 
 #define IMU_STATE_DIM 15
 #define IMU_NOISE_DIM 12
+#define CLONE_STATE_DIM 6
+
+using D2Common::FrameIdType;
 
 class MSCKFStateVector {
 public:
     // Follow param should be
-    //q, bias_gyro, v, bias_acc, p, [q_cam, p_cam], [q_t-1,p_t-1] ... [q_t-n, p_t-n]
+    //q, bias_gyro, v, bias_acc, p, [q_cam, p_cam], [q_t-n,p_t-n] ... [q_t-1, p_t-1]
     Quaterniond q_imu; //quaternion in global frame
     Vector3d bias_gyro; //bias in body frame
     Vector3d v_imu; //Velocity of Imu in global frame
     Vector3d bias_acc; //bias of acceleration
     Vector3d p_imu; //position
-    std::vector<Swarm::Pose> camera_extrisincs; //[q, p]^T
-    std::vector<Swarm::Pose> sld_win_poses;  //[q_{t-1},p_{t-1}], [q_{t-2},p_{t-2}] .., [q_{t-n},p_{t-n}]
+    std::vector<Swarm::Pose> camera_extrisincs; //[q, p]^T, fixed (not in the error state)
+    std::vector<Swarm::Pose> sld_win_poses;  //IMU poses of the clones, oldest first
+    std::vector<FrameIdType> sld_win_ids; //Frame id of the clones
+    std::vector<double> sld_win_stamps;
 
+    void addKeyframe(FrameIdType frame_id, double t);
+    void removeKeyframe(int index);
+    //Apply the error state [ang, bias_gyro, v_imu, bias_acc, pos, [ang, pos] of the clones], angle errors are in body frame
+    void applyCorrection(const VectorXd & dx);
 
-    void addKeyframe(double t);
-    
     MSCKFStateVector();
-    Eigen::VectorXd getFullVector();
     Matrix3d get_imu_R() const;
 };
 
@@ -34,16 +42,16 @@ public:
     //IMU poses to here...
 
     std::vector<std::pair<Vector3d, Vector3d>>  sld_win_poses; //In q, P order
-    
+
     MatrixXd P;
 
-    MSCKFErrorStateVector() {}
+    MSCKFErrorStateVector();
 
     MSCKFErrorStateVector(const MSCKFStateVector & state0);
-    
+
     void stateAugmentation(double t);
-    
-    VectorXd getFullVector() const;
+    void removeClone(int index);
+
     Eigen::Matrix<double, IMU_STATE_DIM, 1> getImuVector() const;
     Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> getImuP() const;
     Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> getImuOtherP() const;
@@ -51,11 +59,14 @@ public:
     void setImuVector(Eigen::Matrix<double, IMU_STATE_DIM, 1> v);
     void setImuP(Eigen::Matrix<double, IMU_STATE_DIM, IMU_STATE_DIM> _P);
     void setImuOtherP(Eigen::Matrix<double, IMU_STATE_DIM, Eigen::Dynamic> _P);
-    
+
     void reset(MSCKFStateVector & state); //Reset with MSCKF state
 
-    unsigned int stateDimFull() {
-        return IMU_STATE_DIM + camera_extrisincs.size() * 6 + sld_win_poses.size() * 6;
+    unsigned int stateDimFull() const {
+        return IMU_STATE_DIM + camera_extrisincs.size() * 6 + sld_win_poses.size() * CLONE_STATE_DIM;
     }
 
-};
\ No newline at end of file
+    unsigned int cloneIndex(int index) const {
+        return IMU_STATE_DIM + camera_extrisincs.size() * 6 + index * CLONE_STATE_DIM;
+    }
+};
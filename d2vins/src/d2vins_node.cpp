@@ -9,6 +9,7 @@
 #include <queue>
 #include <chrono>
 #include <d2frontend/d2featuretracker.h>
+#include <d2common/event_queue.hpp>
 #include <swarm_msgs/swarm_fused.h>
 
 using namespace std::chrono;
@@ -31,13 +32,13 @@ class D2VINSNode :  public D2FrontEnd::D2Frontend
     ros::Subscriber imu_sub, pgo_fused_sub;
     ros::Publisher visual_array_pub;
     int frame_count = 0;
-    std::queue<D2Common::VisualImageDescArray> viokf_queue;
-    std::mutex queue_lock;
+    EventQueue<D2Common::VisualImageDescArray> viokf_queue;
+    EventQueue<bool> solve_queue{EventQueue<bool>::COALESCE}; //Solve requests pending together are solved once
+    LatencyHistogram estimator_latency{"estimator_process"}; //From dequeue to the frame processed
     ros::Timer estimator_timer, solver_timer;
     std::thread thread_comm, thread_solver, thread_viokf;
     bool has_received_imu = false;
     double last_imu_ts = 0;
-    bool need_solve = false;
     std::set<int> ready_drones;
     std::map<int, Swarm::Pose> pgo_poses;
     std::map<int, std::pair<int, Swarm::Pose>> vins_poses;
@@ -47,9 +48,10 @@ protected:
     }
 
     virtual void backendFrameCallback(const D2Common::VisualImageDescArray & viokf) override {
-        if (params->estimation_mode < D2VINSConfig::SERVER_MODE) {
-            Guard guard(queue_lock);
-            viokf_queue.emplace(viokf);
+        if (params->estimation_mode < D2VINSConfig::SERVER_MODE || params->estimation_mode == D2VINSConfig::MSCKF_MODE) {
+            if (!viokf_queue.push(viokf)) {
+                ROS_WARN("[D2VINS] Dropped pending frames, %ld dropped in total", viokf_queue.dropped());
+            }
         }
         frame_count ++;
     };
@@ -58,12 +60,12 @@ protected:
         {
             ready_drones.insert(frame_desc.drone_id);
             vins_poses[frame_desc.drone_id] = std::make_pair(frame_desc.reference_frame_id, frame_desc.pose_drone);
-            if (params->estimation_mode != D2VINSConfig::SINGLE_DRONE_MODE && succ_track &&
-                    !frame_desc.is_lazy_frame && frame_desc.matched_frame < 0) {
+            bool single_drone = params->estimation_mode == D2VINSConfig::SINGLE_DRONE_MODE ||
+                params->estimation_mode == D2VINSConfig::MSCKF_MODE;
+            if (!single_drone && succ_track && !frame_desc.is_lazy_frame && frame_desc.matched_frame < 0) {
                 estimator->inputRemoteImage(frame_desc);
             } else {
-                if (params->estimation_mode != D2VINSConfig::SINGLE_DRONE_MODE && 
-                        frame_desc.sld_win_status.size() > 0) {
+                if (!single_drone && frame_desc.sld_win_status.size() > 0) {
                     estimator->updateSldwin(frame_desc.drone_id, frame_desc.sld_win_status);
                 }
                 if (frame_desc.matched_frame < 0) {
@@ -92,70 +94,72 @@ protected:
     }
 
     void processVIOKFThread() {
+        D2Common::VisualImageDescArray viokf;
         while(ros::ok()) {
-            if (!viokf_queue.empty()) {
-                Utility::TicToc estimator_timer;
-                if (viokf_queue.size() > params->warn_pending_frames) {
-                    ROS_WARN("[D2VINS] Low efficient on D2VINS::estimator pending frames: %d", viokf_queue.size());
-                }
-                D2Common::VisualImageDescArray viokf;
-                {
-                    Guard guard(queue_lock);
-                    viokf = viokf_queue.front();
-                    viokf_queue.pop();
+            //Wakes up on new frames, the timeout only checks ros::ok()
+            if (!viokf_queue.pop(viokf, 100)) {
+                continue;
+            }
+            Utility::TicToc estimator_timer;
+            if (viokf_queue.size() > params->warn_pending_frames) {
+                ROS_WARN("[D2VINS] Low efficient on D2VINS::estimator pending frames: %d", viokf_queue.size());
+            }
+            bool ret;
+            {
+                Utility::TicToc input;
+                ret = estimator->inputImage(viokf);
+                double input_time = input.toc();
+                Utility::TicToc loop;
+                if (viokf.is_keyframe) {
+                    addToLoopQueue(viokf);
                 }
-                bool ret;
-                {
-                    Utility::TicToc input;
-                    ret = estimator->inputImage(viokf);
-                    double input_time = input.toc();
-                    Utility::TicToc loop;
-                    if (viokf.is_keyframe) {
-                        addToLoopQueue(viokf);
-                    }
-                    updateOutModuleSldWinAndLandmarkDB();
-                    need_solve = true;
-                    if (params->verbose || params->enable_perf_output)
-                        printf("[D2VINS] input_time %.1fms, loop detector related takes %.1f ms\n", input_time, loop.toc());
+                updateOutModuleSldWinAndLandmarkDB();
+                if (params->estimation_mode == D2VINSConfig::DISTRIBUTED_CAMERA_CONSENUS) {
+                    solve_queue.push(true);
                 }
+                if (params->verbose || params->enable_perf_output)
+                    printf("[D2VINS] input_time %.1fms, loop detector related takes %.1f ms\n", input_time, loop.toc());
+            }
 
-                if (params->pub_visual_frame) {
-                    visual_array_pub.publish(viokf.toROS());
+            if (params->pub_visual_frame) {
+                visual_array_pub.publish(viokf.toROS());
+            }
+            estimator_latency.add(estimator_timer.toc());
+            if (params->verbose || params->enable_perf_output)
+                printf("[D2VINS] estimator_timer_callback takes %.1f ms\n", estimator_timer.toc());
+            if (params->enable_perf_output && estimator_latency.size() % 100 == 0) {
+                printf("[D2VINS] %s\n[D2VINS] %s\n", viokf_queue.waitLatency().toStr().c_str(),
+                    estimator_latency.toStr().c_str());
+            }
+            bool discover_mode = false;
+            for (auto & id : ready_drones) {
+                if (pgo_poses.find(id) == pgo_poses.end() && !estimator->getState().hasDrone(id)) {
+                    discover_mode = true;
+                    break;
                 }
-                if (params->verbose || params->enable_perf_output)
-                    printf("[D2VINS] estimator_timer_callback takes %.1f ms\n", estimator_timer.toc());
-                bool discover_mode = false;
-                for (auto & id : ready_drones) {
-                    if (pgo_poses.find(id) == pgo_poses.end() && !estimator->getState().hasDrone(id)) {
-                        discover_mode = true;
-                        break;
-                    }
+            }
+            if (ret && D2FrontEnd::params->enable_network) { //Only send keyframes
+                if (params->lazy_broadcast_keyframe && !viokf.is_keyframe && !discover_mode) {
+                    continue;
                 }
-                if (ret && D2FrontEnd::params->enable_network) { //Only send keyframes
-                    if (params->lazy_broadcast_keyframe && !viokf.is_keyframe && !discover_mode) {
-                        continue;
-                    }
-                    std::set<int> nearbydrones = estimator->getNearbyDronesbyPGOData(vins_poses); 
-                    bool force_landmarks = false || discover_mode;
-                    if (nearbydrones.size() > 0) {
-                        force_landmarks = true;
-                        if (params->verbose) {
-                            printf("[D2VINS] Nearby drones: ");
-                            for (auto & id : nearbydrones) {
-                                printf("%d ", id);
-                            }
-                            printf("\n");
+                std::set<int> nearbydrones = estimator->getNearbyDronesbyPGOData(vins_poses); 
+                bool force_landmarks = false || discover_mode;
+                if (nearbydrones.size() > 0) {
+                    force_landmarks = true;
+                    if (params->verbose) {
+                        printf("[D2VINS] Nearby drones: ");
+                        for (auto & id : nearbydrones) {
+                            printf("%d ", id);
                         }
-                    }
-                    printf("[D2VINS] force landmarks %d to broadcast\n", force_landmarks);
-                    Utility::TicToc broadcast_timer;
-                    loop_net->broadcastVisualImageDescArray(viokf, force_landmarks);
-                    if (params->verbose || params->enable_perf_output) {
-                        printf("[D2VINS] broadcastVisualImageDescArray takes %.1f ms\n", broadcast_timer.toc());
+                        printf("\n");
                     }
                 }
-            } else {
-                usleep(1000);
+                printf("[D2VINS] force landmarks %d to broadcast\n", force_landmarks);
+                Utility::TicToc broadcast_timer;
+                loop_net->broadcastVisualImageDescArray(viokf, force_landmarks);
+                if (params->verbose || params->enable_perf_output) {
+                    printf("[D2VINS] broadcastVisualImageDescArray takes %.1f ms\n", broadcast_timer.toc());
+                }
             }
         }
     }
@@ -172,7 +176,7 @@ protected:
     }
 
     void pgoSwarmFusedCallback(const swarm_msgs::swarm_fused & fused) {
-        if (params->estimation_mode == D2VINSConfig::SINGLE_DRONE_MODE) {
+        if (params->estimation_mode == D2VINSConfig::SINGLE_DRONE_MODE || params->estimation_mode == D2VINSConfig::MSCKF_MODE) {
             return;
         }
         for (size_t i = 0; i < fused.ids.size(); i++) {
@@ -190,18 +194,13 @@ protected:
     }
 
     void solverThread() {
+        bool request;
         while (ros::ok()) {
-            if (need_solve) {
-                estimator->solveinDistributedMode();
-                updateOutModuleSldWinAndLandmarkDB();
-                if (!params->consensus_sync_to_start) {
-                    need_solve = false;
-                } else {
-                    usleep(0.5/params->estimator_timer_freq*1e6);
-                }
-            } else {
-                usleep(1000);
+            if (!solve_queue.pop(request, 100)) {
+                continue;
             }
+            estimator->solveinDistributedMode();
+            updateOutModuleSldWinAndLandmarkDB();
         }
     }
 
@@ -214,6 +213,10 @@ protected:
         estimator->init(nh, d2vins_net);
         visual_array_pub = nh.advertise<swarm_msgs::ImageArrayDescriptor>("image_array_desc", 1);
         imu_sub = nh.subscribe(params->imu_topic, 1000, &D2VINSNode::imuCallback, this, ros::TransportHints().tcpNoDelay()); //We need a big queue for IMU.
+        viokf_queue.waitLatency().setName("frame_queue_wait");
+        if (params->max_pending_frames > 0) {
+            viokf_queue.setPolicy(EventQueue<D2Common::VisualImageDescArray>::DROP_OLDEST, params->max_pending_frames);
+        }
         pgo_fused_sub = nh.subscribe("/d2pgo/swarm_fused", 1, &D2VINSNode::pgoSwarmFusedCallback, this, ros::TransportHints().tcpNoDelay());
         thread_viokf = std::thread([&] {
             processVIOKFThread();
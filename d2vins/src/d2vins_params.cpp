@@ -57,6 +57,14 @@ void D2VINSConfig::init(const std::string & config_file) {
     noise.block<3, 3>(12, 12) =  (params->acc_w * params->acc_w) * Eigen::Matrix3d::Identity();
     noise.block<3, 3>(15, 15) =  (params->gyr_w * params->gyr_w) * Eigen::Matrix3d::Identity();
     IntegrationBase::noise = noise;
+    if (!fsSettings["imu_repropagate_ba_thres"].empty()) {
+        imu_repropagate_ba_thres = fsSettings["imu_repropagate_ba_thres"];
+    }
+    if (!fsSettings["imu_repropagate_bg_thres"].empty()) {
+        imu_repropagate_bg_thres = fsSettings["imu_repropagate_bg_thres"];
+    }
+    IntegrationBase::repropagate_ba_thres = imu_repropagate_ba_thres;
+    IntegrationBase::repropagate_bg_thres = imu_repropagate_bg_thres;
     
     depth_sqrt_inf = fsSettings["depth_sqrt_inf"];
     IMUData::Gravity = Vector3d(0., 0., fsSettings["g_norm"]);
@@ -88,6 +96,9 @@ void D2VINSConfig::init(const std::string & config_file) {
     //Multi-drone
     estimation_mode = (ESTIMATION_MODE) (int) fsSettings["estimation_mode"];
     lazy_broadcast_keyframe = (int) fsSettings["lazy_broadcast_keyframe"];
+    if (!fsSettings["max_pending_frames"].empty()) {
+        max_pending_frames = (int) fsSettings["max_pending_frames"];
+    }
 
     //Initialiazation
     init_method = (InitialMethod) (int)fsSettings["init_method"];
@@ -105,12 +116,32 @@ void D2VINSConfig::init(const std::string & config_file) {
 
     //Marginalization
     margin_sparse_solver = (int)fsSettings["margin_sparse_solver"];
+    if (!fsSettings["margin_landmark_schur"].empty()) {
+        margin_landmark_schur = (int)fsSettings["margin_landmark_schur"];
+    }
+    if (!fsSettings["margin_num_threads"].empty()) {
+        margin_num_threads = (int)fsSettings["margin_num_threads"];
+    }
     enable_marginalization = (int)fsSettings["enable_marginalization"];
     remove_base_when_margin_remote = (int)fsSettings["remove_base_when_margin_remote"];
     margin_enable_fej = (int)fsSettings["margin_enable_fej"];
     
     camera_extrinsics = D2FrontEnd::params->extrinsics;
 
+    //MSCKF
+    if (!fsSettings["msckf_min_track"].empty()) {
+        msckf_min_track = (int)fsSettings["msckf_min_track"];
+    }
+    if (!fsSettings["msckf_pixel_noise"].empty()) {
+        msckf_pixel_noise = fsSettings["msckf_pixel_noise"];
+    }
+    if (!fsSettings["msckf_clone_min_dist"].empty()) {
+        msckf_clone_min_dist = fsSettings["msckf_clone_min_dist"];
+    }
+    if (!fsSettings["msckf_clone_min_angle"].empty()) {
+        msckf_clone_min_angle = fsSettings["msckf_clone_min_angle"];
+    }
+
     //Solver
     solver_time = fsSettings["max_solver_time"];
     // options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;// ceres::DENSE_SCHUR;
@@ -122,6 +153,9 @@ void D2VINSConfig::init(const std::string & config_file) {
     ceres_options.trust_region_strategy_type = ceres::DOGLEG;
     ceres_options.max_solver_time_in_seconds = solver_time;
     ceres_options.max_num_iterations = fsSettings["max_num_iterations"];
+    if (!fsSettings["enable_incremental_problem"].empty()) {
+        enable_incremental_problem = (int)fsSettings["enable_incremental_problem"];
+    }
 
     //Consenus Solver
     consensus_config = new ConsensusSolverConfig;
@@ -22,6 +22,8 @@ struct D2VINSConfig {
     double gyr_n = 0.05;
     double acc_w = 0.002;
     double gyr_w = 0.0004;
+    double imu_repropagate_ba_thres = 0.1; //Bias changes beyond these re-integrate the IMU samples,
+    double imu_repropagate_bg_thres = 0.01; //smaller ones are corrected to first order
     double focal_length = 460.0;
     double initial_pos_sqrt_info = 1000.0;
     double initial_yaw_sqrt_info = 10000.0;
@@ -65,11 +67,13 @@ struct D2VINSConfig {
     double process_input_timer = 100.0;
     double estimator_timer_freq = 10.0;
     int warn_pending_frames = 10;
+    int max_pending_frames = 0; //Drop the oldest frames waiting for the estimator beyond this, 0 keeps all
     enum ESTIMATION_MODE {
         SINGLE_DRONE_MODE, //Not accept remote frame
         SOLVE_ALL_MODE, //Each drone solve all the information
         DISTRIBUTED_CAMERA_CONSENUS, //Distributed camera consensus
-        SERVER_MODE //In this mode receive all remote and solve them
+        SERVER_MODE, //In this mode receive all remote and solve them
+        MSCKF_MODE //Single drone with the MSCKF filter instead of the sliding window optimization
     } estimation_mode = SOLVE_ALL_MODE;
     double estimate_extrinsic_vel_thres = 0.2;
     int max_solve_cnt = 10000;
@@ -84,6 +88,7 @@ struct D2VINSConfig {
 
     //Solver
     ceres::Solver::Options ceres_options;
+    bool enable_incremental_problem = true; //Keep the residual blocks across solves (non-distributed modes)
     D2Common::ConsensusSolverConfig * consensus_config = nullptr;
     bool consensus_sync_to_start = true;
     int consensus_trigger_time_err_us = 50;
@@ -95,10 +100,18 @@ struct D2VINSConfig {
 
     //Margin config
     bool margin_sparse_solver = true;
+    bool margin_landmark_schur = true; //Eliminate the removed landmarks in closed form before the frames
+    int margin_num_threads = 0; //Threads evaluating the jacobians, 0 for the hardware concurrency
     bool enable_marginalization = true;
     int remove_base_when_margin_remote = 2;
     bool margin_enable_fej = true;
 
+    //MSCKF (MSCKF_MODE), the clones are limited by max_sld_win_size
+    int msckf_min_track = 3; //Min clones observing a feature to use it
+    double msckf_pixel_noise = 1.5; //Std of feature measurements in pixel
+    double msckf_clone_min_dist = 0.2; //The newer clone closer than these to its previous one is pruned first
+    double msckf_clone_min_angle = 0.2;
+
     //Safety
     int min_measurements_per_keyframe = 10;
     double max_imu_time_err = 0.0025;
@@ -9,11 +9,13 @@
 #include "../factors/projectionOneFrameTwoCamFactor.h"
 #include "../factors/projectionTwoFrameTwoCamFactor.h"
 #include <d2common/solver/pose_local_parameterization.h>
+#include <d2common/solver/FactorPool.hpp>
 #include <d2frontend/utils.h>
 #include "marginalization/marginalization.hpp"
 #include "solver/VINSConsenusSolver.hpp"
 #include "../network/d2vins_net.hpp"
 #include "solver/ConsensusSync.hpp"
+#include "../MSCKF/MSCKF.hpp"
 
 namespace D2VINS {
 
@@ -38,35 +40,58 @@ void D2Estimator::init(ros::NodeHandle & nh, D2VINSNet * net) {
         onSyncSignal(drone_id, signal, token);
     };
 
-    imu_bufs[self_id] = IMUBuffer();
+    self_imu_buf = &imu_bufs[self_id];
     if (params->estimation_mode == D2VINSConfig::DISTRIBUTED_CAMERA_CONSENUS) {
         solver = new D2VINSConsensusSolver(this, &state, sync_data_receiver, *params->consensus_config, solve_token);
     } else {
-        solver = new CeresSolver(&state, params->ceres_options);
+        ceres::Problem::Options problem_options;
+        incremental_problem = params->enable_incremental_problem;
+        if (incremental_problem) {
+            //Residuals are removed one by one, the loss and parameterization are shared by all solves
+            problem_options.enable_fast_removal = true;
+            problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+            problem_options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+            landmark_loss = new ceres::HuberLoss(1.0);
+            pose_local_parameterization = new PoseLocalParameterization;
+        }
+        solver = new CeresSolver(&state, params->ceres_options, problem_options);
+    }
+    if (params->estimation_mode == D2VINSConfig::MSCKF_MODE) {
+        msckf = new MSCKF(*params);
     }
 }
 
 void D2Estimator::inputImu(IMUData data) {
     IMUData last = data;
-    if (imu_bufs[self_id].size() > 0 ) {
-        last = imu_bufs[self_id].buf.back();
+    if (self_imu_buf->size() > 0 ) {
+        last = self_imu_buf->back();
+    }
+    self_imu_buf->add(data);
+    if (msckf != nullptr) {
+        msckf->inputImu(data);
+        if (!msckf->isInitialized()) {
+            return;
+        }
+        auto bias = msckf->getBiases();
+        std::lock_guard<std::recursive_mutex> lock(imu_prop_lock);
+        data.propagation(last_prop_odom[params->self_id], bias.first, bias.second, last);
+        visual.pubIMUProp(last_prop_odom[params->self_id]);
+        return;
     }
-    imu_bufs[self_id].add(data);
     if (!initFirstPoseFlag || solve_count == 0) {
         return;
     }
     //Propagation current with last Bias.
-    auto last_frame = state.lastFrame(self_id);
     std::lock_guard<std::recursive_mutex> lock(imu_prop_lock);
-    data.propagation(last_prop_odom[params->self_id], last_frame.Ba, last_frame.Bg, last);
+    data.propagation(last_prop_odom[params->self_id], last_prop_Ba, last_prop_Bg, last);
     visual.pubIMUProp(last_prop_odom[params->self_id]);
 }
 
 bool D2Estimator::tryinitFirstPose(VisualImageDescArray & frame) {
-    auto ret = imu_bufs[self_id].periodIMU(-1, frame.stamp + state.getTd(frame.drone_id));
+    auto ret = self_imu_buf->periodIMU(-1, frame.stamp + state.getTd(frame.drone_id));
     auto _imubuf = ret.first;
     if (_imubuf.size() < params->init_imu_num) {
-        printf("[D2Estimator::tryinitFirstPose] not enough imu data %d/%d for init\n", _imubuf.size(), imu_bufs[self_id].size());
+        printf("[D2Estimator::tryinitFirstPose] not enough imu data %d/%d for init\n", _imubuf.size(), self_imu_buf->size());
         return false;
     }
     auto mean_acc = _imubuf.mean_acc();
@@ -156,7 +181,7 @@ VINSFrame * D2Estimator::addFrame(VisualImageDescArray & _frame) {
     }
     _frame.setTd(state.getTd(_frame.drone_id));
     //Assign IMU and initialization to VisualImageDescArray for broadcasting.
-    _frame.imu_buf = motion_predict.second.first;
+    _frame.imu_buf = motion_predict.second.first.toBuffer();
     _frame.pose_drone = frame.odom.pose();
     _frame.Ba = frame.Ba;
     _frame.Bg = frame.Bg;
@@ -171,11 +196,14 @@ VINSFrame * D2Estimator::addFrame(VisualImageDescArray & _frame) {
 
 void D2Estimator::addRemoteImuBuf(int drone_id, const IMUBuffer & imu_) {
     if (imu_bufs.find(drone_id) == imu_bufs.end()) {
-        imu_bufs[drone_id] = imu_;
+        auto & _imu_buf = imu_bufs[drone_id];
+        for (size_t i = 0; i < imu_.size(); i++) {
+            _imu_buf.add(imu_[i]);
+        }
         printf("[D2Estimator::addRemoteImuBuf] Assign imu buf to drone %d cur_size %d\n", drone_id, imu_bufs[drone_id].size());
     } else {
         auto & _imu_buf = imu_bufs.at(drone_id);
-        auto t_last = _imu_buf.t_last;
+        auto t_last = _imu_buf.back().t;
         bool add_first = true;
         for (size_t i = 0; i < imu_.size(); i++) {
             if (imu_[i].t > t_last) {
@@ -289,14 +317,33 @@ void D2Estimator::inputRemoteImage(VisualImageDescArray & frame) {
 bool D2Estimator::inputImage(VisualImageDescArray & _frame) {
     //Guard 
     const Guard lock(frame_mutex);
+    if (msckf != nullptr) {
+        //Filter mode, frames are not kept in the state
+        if (!msckf->inputImage(_frame)) {
+            return false;
+        }
+        auto odom = msckf->getOdometry();
+        auto bias = msckf->getBiases();
+        _frame.pose_drone = odom.pose();
+        _frame.Ba = bias.first;
+        _frame.Bg = bias.second;
+        auto prop_odom = self_imu_buf->tail(odom.stamp).propagation(odom, bias.first, bias.second);
+        {
+            std::lock_guard<std::recursive_mutex> lock(imu_prop_lock);
+            last_prop_odom[self_id] = prop_odom;
+        }
+        visual.pubOdometry(self_id, odom);
+        frame_count ++;
+        return true;
+    }
     if(!initFirstPoseFlag) {
-        printf("[D2VINS::D2Estimator] tryinitFirstPose imu buf %ld\n", imu_bufs[self_id].size());
+        printf("[D2VINS::D2Estimator] tryinitFirstPose imu buf %ld\n", self_imu_buf->size());
         initFirstPoseFlag = tryinitFirstPose(_frame);
         return initFirstPoseFlag;
     }
 
     double t_imu_frame = _frame.stamp + state.td;
-    while (!imu_bufs[self_id].available(t_imu_frame)) {
+    while (!self_imu_buf->available(t_imu_frame)) {
         //Wait for IMU
         usleep(2000);
         printf("[D2VINS::D2Estimator] wait for imu...\n");
@@ -315,7 +362,13 @@ bool D2Estimator::inputImage(VisualImageDescArray & _frame) {
 
 void D2Estimator::setStateProperties() {
     ceres::Problem & problem = solver->getProblem();
-    auto pose_local_param = new PoseLocalParameterization;
+    ceres::LocalParameterization * pose_local_param = nullptr;
+    if (incremental_problem) {
+        //Blocks are kept across solves, so constant flags are reset here.
+        pose_local_param = pose_local_parameterization;
+    } else {
+        pose_local_param = new PoseLocalParameterization;
+    }
     //set LocalParameterization
     for (auto & drone_id : state.availableDrones()) {
         if (state.size(drone_id) > 0) {
@@ -324,6 +377,9 @@ void D2Estimator::setStateProperties() {
                 auto pointer = state.getPoseState(frame_a.frame_id);
                 if (problem.HasParameterBlock(pointer)) {
                     problem.SetParameterization(pointer, pose_local_param);
+                    if (incremental_problem) {
+                        problem.SetParameterBlockVariable(pointer);
+                    }
                 }
             }
         }
@@ -338,6 +394,8 @@ void D2Estimator::setStateProperties() {
         if (!params->estimate_extrinsic || state.size(drone_id) < params->max_sld_win_size || 
                 state.lastFrame().odom.vel().norm() < params->estimate_extrinsic_vel_thres) {
             problem.SetParameterBlockConstant(state.getExtrinsicState(cam_id));
+        } else if (incremental_problem) {
+            problem.SetParameterBlockVariable(state.getExtrinsicState(cam_id));
         }
         problem.SetParameterization(state.getExtrinsicState(cam_id), pose_local_param);
     }
@@ -355,6 +413,8 @@ void D2Estimator::setStateProperties() {
                 state.lastFrame().odom.vel().norm() < params->estimate_extrinsic_vel_thres) {
         // printf("[D2Estimator::setStateProperties@%d] set td to fixed sld_size %d/%d \n", self_id, state.size(), params->max_sld_win_size);
         problem.SetParameterBlockConstant(state.getTdState(self_id));
+    } else if (incremental_problem && problem.HasParameterBlock(state.getTdState(self_id))) {
+        problem.SetParameterBlockVariable(state.getTdState(self_id));
     }
 
     if (!state.getPrior() || params->always_fixed_first_pose) {
@@ -517,9 +577,14 @@ void D2Estimator::solveinDistributedMode() {
         if (drone_id != self_id && params->estimation_mode == D2VINSConfig::DISTRIBUTED_CAMERA_CONSENUS) {
             continue;
         }
-        auto _imu = imu_bufs[self_id].tail(state.lastFrame(drone_id).stamp + state.td);
+        auto & last_frame = state.lastFrame(drone_id);
+        auto odom = self_imu_buf->tail(last_frame.stamp + state.td).propagation(last_frame);
         std::lock_guard<std::recursive_mutex> lock(imu_prop_lock);
-        last_prop_odom[drone_id] = _imu.propagation(state.lastFrame(drone_id));
+        last_prop_odom[drone_id] = odom;
+        if (drone_id == self_id) {
+            last_prop_Ba = last_frame.Ba;
+            last_prop_Bg = last_frame.Bg;
+        }
     }
 
     visual.postSolve();
@@ -542,10 +607,18 @@ void D2Estimator::solveinDistributedMode() {
 void D2Estimator::solveNonDistrib() {
     resetMarginalizer();
     state.preSolve(imu_bufs);
-    solver->reset();
+    if (incremental_problem) {
+        problem_solve_id ++;
+        purgeProblem();
+    } else {
+        solver->reset();
+    }
     setupImuFactors();
     setupLandmarkFactors();
     setupPriorFactor();
+    if (incremental_problem) {
+        sweepProblem();
+    }
     setStateProperties();
     SolverReport report = solver->solve();
     state.syncFromState(used_landmarks);
@@ -561,6 +634,12 @@ void D2Estimator::solveNonDistrib() {
     if (params->enable_perf_output) {
         printf("[D2VINS] average time %.1fms, average time of iter: %.1fms, average iteration %.3f, average cost %.3f\n", 
             sum_time*1000/solve_count, sum_time*1000/sum_iteration, sum_iteration/solve_count, sum_cost/solve_count);
+        static FactorPoolStats last_pool_stats;
+        auto pool_stats = FactorPool::instance().stats();
+        printf("[D2VINS] factor pool: allocs %ld heap allocs %ld this solve, live %ld reserved %.1fKB\n",
+            pool_stats.allocs - last_pool_stats.allocs, pool_stats.heap_allocs - last_pool_stats.heap_allocs,
+            pool_stats.live, pool_stats.reserved_bytes/1024.0);
+        last_pool_stats = pool_stats;
     }
 
     if (params->estimation_mode < D2VINSConfig::SERVER_MODE) {
@@ -574,9 +653,14 @@ void D2Estimator::solveNonDistrib() {
 
     // Reprogation
     for (auto drone_id : state.availableDrones()) {
-        auto _imu = imu_bufs[self_id].tail(state.lastFrame(drone_id).stamp + state.td);
+        auto & last_frame = state.lastFrame(drone_id);
+        auto odom = self_imu_buf->tail(last_frame.stamp + state.td).propagation(last_frame);
         std::lock_guard<std::recursive_mutex> lock(imu_prop_lock);
-        last_prop_odom[drone_id] = _imu.propagation(state.lastFrame(drone_id));
+        last_prop_odom[drone_id] = odom;
+        if (drone_id == self_id) {
+            last_prop_Ba = last_frame.Ba;
+            last_prop_Bg = last_frame.Bg;
+        }
     }
 
     visual.postSolve();
@@ -591,10 +675,106 @@ void D2Estimator::solveNonDistrib() {
     }
 }
 
-void D2Estimator::addIMUFactor(FrameIdType frame_ida, FrameIdType frame_idb, IntegrationBase* pre_integrations) {
-    IMUFactor* imu_factor = new IMUFactor(pre_integrations);
-    auto info = ImuResInfo::create(imu_factor, frame_ida, frame_idb);
+ResidualInfo * D2Estimator::reuseResidual(const FactorKey & key, const void * tag) {
+    if (!incremental_problem) {
+        return nullptr;
+    }
+    auto it = alive_residuals.find(key);
+    if (it == alive_residuals.end()) {
+        return nullptr;
+    }
+    if (it->second.tag != tag) {
+        replaced_residuals.emplace_back(it->second);
+        alive_residuals.erase(it);
+        return nullptr;
+    }
+    it->second.solve_id = problem_solve_id;
+    return it->second.info;
+}
+
+void D2Estimator::addResidual(const FactorKey & key, ResidualInfo * info, const void * tag) {
     solver->addResidual(info);
+    if (incremental_problem) {
+        AliveResidual res;
+        res.info = info;
+        res.tag = tag;
+        res.params = info->paramsPointerList(&state);
+        res.solve_id = problem_solve_id;
+        alive_residuals[key] = res;
+    }
+}
+
+void D2Estimator::removeAliveResiduals(const std::vector<AliveResidual> & removing) {
+    if (removing.empty()) {
+        return;
+    }
+    std::vector<ResidualInfo*> infos;
+    std::set<state_type*> touched_params;
+    for (auto & res : removing) {
+        infos.emplace_back(res.info);
+        touched_params.insert(res.params.begin(), res.params.end());
+    }
+    solver->removeResiduals(infos);
+    //States of removed frames are already freed, their blocks must leave the problem before the addresses are reused.
+    auto & problem = solver->getProblem();
+    std::vector<ceres::ResidualBlockId> blocks;
+    for (auto pointer : touched_params) {
+        if (!problem.HasParameterBlock(pointer)) {
+            continue;
+        }
+        problem.GetResidualBlocksForParameterBlock(pointer, &blocks);
+        if (blocks.empty()) {
+            problem.RemoveParameterBlock(pointer);
+        }
+    }
+}
+
+void D2Estimator::purgeProblem() {
+    //Remove residuals of removed frames and landmarks and the last prior before adding any residual.
+    std::vector<AliveResidual> removing;
+    for (auto it = alive_residuals.begin(); it != alive_residuals.end();) {
+        auto & key = it->first;
+        FrameIdType frame_ida = std::get<1>(key), frame_idb = std::get<2>(key);
+        LandmarkIdType lm_id = std::get<3>(key);
+        bool valid = std::get<0>(key) != ResidualType::PriorResidual && 
+            (frame_ida < 0 || state.hasFrame(frame_ida)) && (frame_idb < 0 || state.hasFrame(frame_idb)) &&
+            (lm_id < 0 || state.hasLandmark(lm_id));
+        if (valid) {
+            it ++;
+        } else {
+            removing.emplace_back(it->second);
+            it = alive_residuals.erase(it);
+        }
+    }
+    removeAliveResiduals(removing);
+}
+
+void D2Estimator::sweepProblem() {
+    //Remove residuals not used in this solve, e.g. landmarks not selected or rebased.
+    std::vector<AliveResidual> removing;
+    removing.swap(replaced_residuals);
+    for (auto it = alive_residuals.begin(); it != alive_residuals.end();) {
+        if (it->second.solve_id == problem_solve_id) {
+            it ++;
+        } else {
+            removing.emplace_back(it->second);
+            it = alive_residuals.erase(it);
+        }
+    }
+    if (params->verbose) {
+        printf("[D2Estimator::sweepProblem@%d] %ld residuals alive %ld removed\n", self_id, alive_residuals.size(), removing.size());
+    }
+    removeAliveResiduals(removing);
+}
+
+void D2Estimator::addIMUFactor(FrameIdType frame_ida, FrameIdType frame_idb, IntegrationBase* pre_integrations) {
+    FactorKey key(ResidualType::IMUResidual, frame_ida, frame_idb, -1, -1, -1);
+    auto info = reuseResidual(key, pre_integrations);
+    if (info == nullptr) {
+        IMUFactor* imu_factor = new IMUFactor(pre_integrations);
+        info = ImuResInfo::create(imu_factor, frame_ida, frame_idb);
+        addResidual(key, info, pre_integrations);
+    }
     if (params->always_fixed_first_pose) {
         //At this time we fix the first pose and ignore the margin of this imu factor to achieve better numerical stability
         return;
@@ -663,7 +843,7 @@ void D2Estimator::setupLandmarkFactors() {
     auto lms = state.availableLandmarkMeasurements(params->max_solve_cnt, params->max_solve_measurements);
     current_landmark_num = lms.size();
     current_measurement_num = 0;
-    auto loss_function = new ceres::HuberLoss(1.0);    
+    ceres::LossFunction * loss_function = incremental_problem ? landmark_loss : new ceres::HuberLoss(1.0);
     keyframe_measurements.clear();
     if (params->verbose) {
         printf("[D2VINS::setupLandmarkFactors] %d landmarks\n", lms.size());
@@ -708,10 +888,14 @@ void D2Estimator::setupLandmarkFactors() {
         if (firstObs.depth_mea && params->fuse_dep && 
                 firstObs.depth < params->max_depth_to_fuse &&
                 firstObs.depth > params->min_depth_to_fuse) {
-            auto f_dep = OneFrameDepth::Create(firstObs.depth);
-            auto info = DepthResInfo::create(f_dep, loss_function, firstObs.frame_id, lm_id);
+            FactorKey key(ResidualType::DepthResidual, firstObs.frame_id, -1, lm_id, base_camera_id, -1);
+            auto info = reuseResidual(key);
+            if (info == nullptr) {
+                auto f_dep = OneFrameDepth::Create(firstObs.depth);
+                info = DepthResInfo::create(f_dep, loss_function, firstObs.frame_id, lm_id);
+                addResidual(key, info);
+            }
             marginalizer->addResidualInfo(info);
-            solver->addResidual(info);
             used_landmarks.insert(lm_id);
         }
         current_measurement_num++;
@@ -723,41 +907,58 @@ void D2Estimator::setupLandmarkFactors() {
             auto mea1 = lm_per_frame.measurement();
             ResidualInfo * info = nullptr;
             if (lm_per_frame.camera_id == base_camera_id) {
-                ceres::CostFunction * f_td = nullptr;
-                bool enable_depth_mea = false;
-                if (lm_per_frame.depth_mea && params->fuse_dep &&
-                    lm_per_frame.depth < params->max_depth_to_fuse && 
-                    lm_per_frame.depth > params->min_depth_to_fuse) {
-                    enable_depth_mea = true;
-                    f_td = new ProjectionTwoFrameOneCamDepthFactor(mea0, mea1, firstObs.velocity, lm_per_frame.velocity,
-                        firstObs.cur_td, lm_per_frame.cur_td, lm_per_frame.depth);
-                } else {
-                    f_td = new ProjectionTwoFrameOneCamFactor(mea0, mea1, firstObs.velocity, lm_per_frame.velocity,
-                        firstObs.cur_td, lm_per_frame.cur_td);
-                }
                 if (firstObs.frame_id == lm_per_frame.frame_id) {
                     printf("\033[0;31m[ [D2VINS::setupLandmarkFactors] Warning: landmarkid %ld frame %ld<->%ld@%ld is the same camera id %d.\033[0m\n",
                         lm_per_frame.landmark_id, firstObs.frame_id, lm_per_frame.frame_id, lm_id, base_camera_id);
                     continue;
                 }
-                info = LandmarkTwoFrameOneCamResInfo::create(f_td, loss_function,
-                    firstObs.frame_id, lm_per_frame.frame_id, lm_id, firstObs.camera_id, enable_depth_mea);
+                FactorKey key(ResidualType::LandmarkTwoFrameOneCamResidual, firstObs.frame_id, lm_per_frame.frame_id, 
+                    lm_id, base_camera_id, lm_per_frame.camera_id);
+                info = reuseResidual(key);
+                if (info == nullptr) {
+                    ceres::CostFunction * f_td = nullptr;
+                    bool enable_depth_mea = false;
+                    if (lm_per_frame.depth_mea && params->fuse_dep &&
+                        lm_per_frame.depth < params->max_depth_to_fuse && 
+                        lm_per_frame.depth > params->min_depth_to_fuse) {
+                        enable_depth_mea = true;
+                        f_td = new ProjectionTwoFrameOneCamDepthFactor(mea0, mea1, firstObs.velocity, lm_per_frame.velocity,
+                            firstObs.cur_td, lm_per_frame.cur_td, lm_per_frame.depth);
+                    } else {
+                        f_td = new ProjectionTwoFrameOneCamFactor(mea0, mea1, firstObs.velocity, lm_per_frame.velocity,
+                            firstObs.cur_td, lm_per_frame.cur_td);
+                    }
+                    info = LandmarkTwoFrameOneCamResInfo::create(f_td, loss_function,
+                        firstObs.frame_id, lm_per_frame.frame_id, lm_id, firstObs.camera_id, enable_depth_mea);
+                    addResidual(key, info);
+                }
             } else {
                 if (lm_per_frame.frame_id == firstObs.frame_id) {
-                    auto f_td = new ProjectionOneFrameTwoCamFactor(mea0, mea1, firstObs.velocity, 
-                        lm_per_frame.velocity, firstObs.cur_td, lm_per_frame.cur_td);
-                    info = LandmarkOneFrameTwoCamResInfo::create(f_td, nullptr,
-                        firstObs.frame_id, lm_id, firstObs.camera_id, lm_per_frame.camera_id);
+                    FactorKey key(ResidualType::LandmarkOneFrameTwoCamResidual, firstObs.frame_id, -1, 
+                        lm_id, base_camera_id, lm_per_frame.camera_id);
+                    info = reuseResidual(key);
+                    if (info == nullptr) {
+                        auto f_td = new ProjectionOneFrameTwoCamFactor(mea0, mea1, firstObs.velocity, 
+                            lm_per_frame.velocity, firstObs.cur_td, lm_per_frame.cur_td);
+                        info = LandmarkOneFrameTwoCamResInfo::create(f_td, nullptr,
+                            firstObs.frame_id, lm_id, firstObs.camera_id, lm_per_frame.camera_id);
+                        addResidual(key, info);
+                    }
                 } else {
-                    auto f_td = new ProjectionTwoFrameTwoCamFactor(mea0, mea1, firstObs.velocity, 
-                        lm_per_frame.velocity, firstObs.cur_td, lm_per_frame.cur_td);
-                    info = LandmarkTwoFrameTwoCamResInfo::create(f_td, loss_function, firstObs.frame_id, lm_per_frame.frame_id, lm_id, 
-                        firstObs.camera_id, lm_per_frame.camera_id);
+                    FactorKey key(ResidualType::LandmarkTwoFrameTwoCamResidual, firstObs.frame_id, lm_per_frame.frame_id, 
+                        lm_id, base_camera_id, lm_per_frame.camera_id);
+                    info = reuseResidual(key);
+                    if (info == nullptr) {
+                        auto f_td = new ProjectionTwoFrameTwoCamFactor(mea0, mea1, firstObs.velocity, 
+                            lm_per_frame.velocity, firstObs.cur_td, lm_per_frame.cur_td);
+                        info = LandmarkTwoFrameTwoCamResInfo::create(f_td, loss_function, firstObs.frame_id, lm_per_frame.frame_id, lm_id, 
+                            firstObs.camera_id, lm_per_frame.camera_id);
+                        addResidual(key, info);
+                    }
                 }
             }
             if (info != nullptr) {
                 current_measurement_num++;
-                solver->addResidual(info);
                 marginalizer->addResidualInfo(info);
                 used_landmarks.insert(lm_id);
             }
@@ -782,9 +983,10 @@ const std::vector<VINSFrame*> & D2Estimator::getSelfSldWin() const {
 void D2Estimator::setupPriorFactor() {
     auto prior_factor = state.getPrior();
     if (prior_factor != nullptr) {
+        //The prior changes with each marginalization, it is always rebuilt.
         auto pfactor = new PriorFactor(*prior_factor);
         auto info = PriorResInfo::create(pfactor);
-        solver->addResidual(info);
+        addResidual(FactorKey(ResidualType::PriorResidual, -1, -1, -1, -1, -1), info);
         marginalizer->addResidualInfo(info);
     }
 }
@@ -803,6 +1005,9 @@ Swarm::Odometry D2Estimator::getOdometry() const {
 }
 
 Swarm::Odometry D2Estimator::getOdometry(int drone_id) const {
+    if (msckf != nullptr && drone_id == self_id) {
+        return msckf->getOdometry();
+    }
     // Attention! We output IMU stamp!
     auto odom =  state.lastFrame(drone_id).odom;
     odom.stamp = odom.stamp + state.td;
@@ -870,12 +1075,21 @@ std::set<int> D2Estimator::getNearbyDronesbyPGOData(const std::map<int, std::pai
     }
     return nearby_drones;
 }
-std::pair<Swarm::Odometry, std::pair<IMUBuffer, int>> D2Estimator::getMotionPredict(double stamp) const {
+std::pair<Swarm::Odometry, std::pair<IMUBufferView, int>> D2Estimator::getMotionPredict(double stamp) const {
+    if (msckf != nullptr) {
+        if (!msckf->isInitialized()) {
+            return std::make_pair(Swarm::Odometry(), std::make_pair(IMUBufferView(), -1));
+        }
+        auto odom = msckf->getOdometry();
+        auto bias = msckf->getBiases();
+        auto ret = self_imu_buf->periodIMU(odom.stamp, stamp + state.td);
+        return std::make_pair(ret.first.propagation(odom, bias.first, bias.second), ret);
+    }
     if(!initFirstPoseFlag) {
-        return std::make_pair(Swarm::Odometry(), std::make_pair(IMUBuffer(), -1));
+        return std::make_pair(Swarm::Odometry(), std::make_pair(IMUBufferView(), -1));
     }
     const auto & last_frame = state.lastFrame();
-    auto ret = imu_bufs.at(self_id).periodIMU(last_frame.imu_buf_index, stamp + state.td);
+    auto ret = self_imu_buf->periodIMU(last_frame.imu_buf_index, stamp + state.td);
     auto _imu = ret.first;
     auto index = ret.second;
     if (fabs(_imu.size()/(stamp - last_frame.stamp) - params->IMU_FREQ) > 15) {
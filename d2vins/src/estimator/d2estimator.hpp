@@ -8,12 +8,14 @@
 #include <d2common/solver/SolverWrapper.hpp>
 #include "solver/ConsensusSync.hpp"
 #include <mutex>
+#include <tuple>
 
 using namespace Eigen;
 using D2Common::VisualImageDescArray;
 
 namespace D2VINS {
 class Marginalizer;
+class MSCKF;
 class D2VINSNet;
 struct DistributedVinsData;
 
@@ -26,14 +28,25 @@ enum SyncSignal {
 
 class D2Estimator {
 protected:
+    //Identity of a residual in the persistent problem: type, frame a, frame b, landmark, camera a, camera b
+    typedef std::tuple<int, FrameIdType, FrameIdType, LandmarkIdType, int, int> FactorKey;
+    struct AliveResidual {
+        ResidualInfo * info = nullptr;
+        const void * tag = nullptr; //The residual is rebuilt when its tag changes, e.g. the pre-integration of IMU factor
+        std::vector<state_type*> params;
+        int solve_id = 0; //Last solve using it
+    };
+
     //Internal states
     bool initFirstPoseFlag = false;   
     D2EstimatorState state;
-    std::map<int, IMUBuffer> imu_bufs;
+    std::map<int, IMURingBuffer> imu_bufs;
+    IMURingBuffer * self_imu_buf = nullptr; //imu_bufs[self_id], written by the IMU thread only
     std::map<int, Swarm::Odometry> last_prop_odom; //last imu propagation odometry
     std::map<int, Swarm::Pose> last_pgo_poses; //last pgo poses
     Marginalizer * marginalizer = nullptr;
     SolverWrapper * solver = nullptr;
+    MSCKF * msckf = nullptr; //MSCKF_MODE, replaces the sliding window of the state
     D2VINSNet * vinsnet = nullptr;
     int solve_count = 0;
     int current_landmark_num = 0;
@@ -50,6 +63,15 @@ protected:
     bool updated = false;
     std::set<LandmarkIdType> used_landmarks;
     std::recursive_mutex imu_prop_lock;
+    Vector3d last_prop_Ba = Vector3d::Zero(), last_prop_Bg = Vector3d::Zero(); //Biases used by the IMU propagation, guarded by imu_prop_lock
+
+    //Persistent problem (enable_incremental_problem)
+    bool incremental_problem = false;
+    int problem_solve_id = 0;
+    std::map<FactorKey, AliveResidual> alive_residuals;
+    std::vector<AliveResidual> replaced_residuals;
+    ceres::LossFunction * landmark_loss = nullptr;
+    ceres::LocalParameterization * pose_local_parameterization = nullptr;
     
     //Internal functions
     bool tryinitFirstPose(VisualImageDescArray & frame);
@@ -60,6 +82,11 @@ protected:
     void setupLandmarkFactors();
     void addIMUFactor(FrameIdType frame_ida, FrameIdType frame_idb, IntegrationBase* _pre_integration);
     void setupPriorFactor();
+    ResidualInfo * reuseResidual(const FactorKey & key, const void * tag = nullptr);
+    void addResidual(const FactorKey & key, ResidualInfo * info, const void * tag = nullptr);
+    void removeAliveResiduals(const std::vector<AliveResidual> & removing);
+    void purgeProblem();
+    void sweepProblem();
     std::pair<bool, Swarm::Pose> initialFramePnP(const VisualImageDescArray & frame, 
         const Swarm::Pose & initial_pose);
     void addSldWinToFrame(VisualImageDescArray & frame);
@@ -99,6 +126,6 @@ public:
     void setPGOPoses(const std::map<int, Swarm::Pose> & poses);
     std::set<int> getNearbyDronesbyPGOData(const std::map<int, std::pair<int, Swarm::Pose>> & vins_poses);
     void setStateProperties();
-    virtual std::pair<Swarm::Odometry, std::pair<IMUBuffer, int>> getMotionPredict(double stamp) const;
+    virtual std::pair<Swarm::Odometry, std::pair<IMUBufferView, int>> getMotionPredict(double stamp) const;
 };
 }
\ No newline at end of file
@@ -351,7 +351,7 @@ void D2EstimatorState::updateSldwin(int drone_id, const std::vector<FrameIdType>
     latest_remote_sld_wins[drone_id] = sld_win;
 }
 
-void D2EstimatorState::updateSldWinsIMU(const std::map<int, IMUBuffer> & remote_imu_bufs) {
+void D2EstimatorState::updateSldWinsIMU(const std::map<int, IMURingBuffer> & remote_imu_bufs) {
     if (params->estimation_mode == D2VINSConfig::DISTRIBUTED_CAMERA_CONSENUS || 
         params->estimation_mode == D2VINSConfig::SINGLE_DRONE_MODE) {
         auto & _sld_win = sld_wins[self_id];
@@ -553,7 +553,7 @@ void D2EstimatorState::outlierRejection(const std::set<LandmarkIdType> & used_la
     lmanager.outlierRejection(this, used_landmarks);
 }
 
-void D2EstimatorState::preSolve(const std::map<int, IMUBuffer> & remote_imu_bufs) {
+void D2EstimatorState::preSolve(const std::map<int, IMURingBuffer> & remote_imu_bufs) {
     // updateSldWinsIMU(remote_imu_bufs); Useless when IMU bufs are correctly set
     lmanager.initialLandmarks(this);
 }
@@ -608,8 +608,12 @@ void D2EstimatorState::solveGyroscopeBias() {
         VectorXd tmp_b(3);
         tmp_b.setZero();
         Eigen::Quaterniond q_ij(frame_i->R().transpose() * frame_j->R());
+        //The integration may be linearized at another bias than frame_i's, see IntegrationBase::repropagate
+        Eigen::Vector3d delta_p, delta_v;
+        Eigen::Quaterniond delta_q;
+        frame_j->pre_integrations->correctedDelta(frame_i->Ba, frame_i->Bg, delta_p, delta_q, delta_v);
         tmp_A = frame_j->pre_integrations->jacobian.template block<3, 3>(O_R, O_BG);
-        tmp_b = 2 * (frame_j->pre_integrations->delta_q.inverse() * q_ij).vec();
+        tmp_b = 2 * (delta_q.inverse() * q_ij).vec();
         A += tmp_A.transpose() * tmp_A;
         b += tmp_A.transpose() * tmp_b;
     }
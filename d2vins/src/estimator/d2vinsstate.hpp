@@ -32,7 +32,7 @@ protected:
         //If remove base, will remove the relevant landmarks' base frame.
         //This is for marginal the keyframes that not is baseframe of all landmarks (in multi-drone)
     void outlierRejection(const std::set<LandmarkIdType> & used_landmarks);
-    void updateSldWinsIMU(const std::map<int, IMUBuffer> & remote_imu_bufs);
+    void updateSldWinsIMU(const std::map<int, IMURingBuffer> & remote_imu_bufs);
     void createPriorFactor4FirstFrame(VINSFrame * frame);
     void solveGyroscopeBias();
 public:
@@ -89,7 +89,7 @@ public:
 
     //Solving process
     void syncFromState(const std::set<LandmarkIdType> & used_landmarks);
-    void preSolve(const std::map<int, IMUBuffer> & remote_imu_bufs);
+    void preSolve(const std::map<int, IMURingBuffer> & remote_imu_bufs);
     void repropagateIMU();
 
     //Debug
@@ -1,6 +1,8 @@
 #include "landmark_manager.hpp"
 #include "d2vinsstate.hpp"
 #include "../d2vins_params.hpp"
+#include <queue>
+#include <algorithm>
 
 namespace D2VINS {
 
@@ -28,80 +30,93 @@ void D2LandmarkManager::addKeyframe(const VisualImageDescArray & images, double
 }
 
 std::vector<LandmarkPerId> D2LandmarkManager::availableMeasurements(int max_pts, int max_solve_measurements, const std::set<FrameIdType> & current_frames) const {
+    //Balanced selection: repeatedly take the frame with fewest selected landmarks and add its best unselected landmark.
+    //Frames are kept in a min-heap of (count, frame_id) and landmarks of each frame in a max-heap of (score, -landmark_id),
+    //both invalidated lazily, so ties are broken as a linear scan of the maps would (lowest frame_id, lowest landmark_id).
+    typedef std::pair<double, LandmarkIdType> ScoredLandmark;
+    typedef std::pair<int, FrameIdType> FrameCount;
     std::map<FrameIdType, int> current_landmark_num;
-    std::map<FrameIdType, int> result_landmark_num;
-    std::map<FrameIdType, std::set<D2Common::LandmarkIdType>> current_assoicated_landmarks;
-    bool exit = false;
+    std::priority_queue<FrameCount, std::vector<FrameCount>, std::greater<FrameCount>> frame_queue;
+    std::map<FrameIdType, std::vector<ScoredLandmark>> frame_candidates; //Heaps built on first visit of the frame
+    std::set<FrameIdType> exhausted_frames;
     std::set<D2Common::LandmarkIdType> ret_ids_set;
     std::vector<LandmarkPerId> ret_set;
     for (auto frame_id : current_frames) {
         current_landmark_num[frame_id] = 0;
-        result_landmark_num[frame_id] = 0;
+        frame_queue.emplace(0, frame_id);
     }
     int count_measurements = 0;
     if (max_solve_measurements <= 0) {
         max_solve_measurements = 1000000;
     }
-    while (!exit) {
+    while (!frame_queue.empty()) {
         //found the frame with minimum landmarks in current frames
-        if (current_landmark_num.size() == 0) {
-            exit = true;
+        auto top = frame_queue.top();
+        frame_queue.pop();
+        auto frame_id = top.second;
+        if (exhausted_frames.find(frame_id) != exhausted_frames.end() || current_landmark_num.at(frame_id) != top.first) {
+            continue;
         }
-        auto it = min_element(current_landmark_num.begin(), current_landmark_num.end(),
-            [](decltype(current_landmark_num)::value_type& l, decltype(current_landmark_num)::value_type& r) -> 
-                bool { return l.second < r.second; });
-        auto frame_id = it->first;
-        //Add the a landmark in its related landmarks with highest score
-        if (related_landmarks.find(frame_id) == related_landmarks.end()) {
-            //Remove the frame from current_landmark_num
-            current_landmark_num.erase(frame_id);
+        auto it_related = related_landmarks.find(frame_id);
+        if (it_related == related_landmarks.end()) {
+            exhausted_frames.insert(frame_id);
             continue;
         }
-        auto frame_related_landmarks = related_landmarks.at(frame_id);
-        //Find the landmark with highest score
-        LandmarkIdType lm_best;
-        double score_best = -10000;
-        bool found = false;
-        for (auto & itre : frame_related_landmarks) {
-            LandmarkIdType lm_id = itre.first;
-            if (landmark_db.find(lm_id) == landmark_db.end() || ret_ids_set.find(lm_id) != ret_ids_set.end()) {
-                //The landmark is not in the database or has been added
-                continue;
-            }
-            auto & lm = landmark_db.at(lm_id);
-            if (lm.track.size() >= params->landmark_estimate_tracks && 
-                lm.flag >= LandmarkFlag::INITIALIZED) {
-                if (lm.scoreForSolve(params->self_id) > score_best) {
-                    score_best = lm.scoreForSolve(params->self_id);
-                    lm_best = lm_id;
-                    found = true;
+        auto it_candidates = frame_candidates.find(frame_id);
+        if (it_candidates == frame_candidates.end()) {
+            auto & candidates = frame_candidates[frame_id];
+            for (auto & itre : it_related->second) {
+                LandmarkIdType lm_id = itre.first;
+                auto it_lm = landmark_db.find(lm_id);
+                if (it_lm == landmark_db.end()) {
+                    continue;
+                }
+                auto & lm = it_lm->second;
+                if (lm.track.size() >= params->landmark_estimate_tracks && lm.flag >= LandmarkFlag::INITIALIZED) {
+                    candidates.emplace_back(lm.scoreForSolve(params->self_id), -lm_id);
                 }
             }
+            std::make_heap(candidates.begin(), candidates.end());
+            it_candidates = frame_candidates.find(frame_id);
         }
-        if (found) {
-            auto & lm = landmark_db.at(lm_best);
-            ret_set.emplace_back(lm);
-            ret_ids_set.insert(lm_best);
-            count_measurements += lm.track.size();
-            //Add the frame to current_landmark_num
-            for (auto track: lm.track) {
-                auto frame_id = track.frame_id;
-                current_assoicated_landmarks[frame_id].insert(lm_best);
-                //We count the landmark numbers, but not the measurements
-                current_landmark_num[frame_id] = current_assoicated_landmarks[frame_id].size();
-                result_landmark_num[frame_id] = current_landmark_num[frame_id];
-            }
-            if (ret_set.size() >= max_pts || count_measurements >= max_solve_measurements) {
-                exit = true;
+        //Find the unselected landmark with highest score
+        auto & candidates = it_candidates->second;
+        while (!candidates.empty() && ret_ids_set.find(-candidates.front().second) != ret_ids_set.end()) {
+            std::pop_heap(candidates.begin(), candidates.end());
+            candidates.pop_back();
+        }
+        if (candidates.empty()) {
+            exhausted_frames.insert(frame_id);
+            continue;
+        }
+        LandmarkIdType lm_best = -candidates.front().second;
+        std::pop_heap(candidates.begin(), candidates.end());
+        candidates.pop_back();
+        auto & lm = landmark_db.at(lm_best);
+        ret_set.emplace_back(lm);
+        ret_ids_set.insert(lm_best);
+        count_measurements += lm.track.size();
+        //We count the landmark numbers, but not the measurements
+        std::set<FrameIdType> track_frames;
+        for (auto & track: lm.track) {
+            track_frames.insert(track.frame_id);
+        }
+        for (auto track_frame : track_frames) {
+            int num = ++ current_landmark_num[track_frame];
+            if (exhausted_frames.find(track_frame) == exhausted_frames.end()) {
+                frame_queue.emplace(num, track_frame);
             }
-        } else {
-            //Remove the frame from current_landmark_num
-            current_landmark_num.erase(frame_id);
+        }
+        if (track_frames.find(frame_id) == track_frames.end()) {
+            frame_queue.emplace(current_landmark_num.at(frame_id), frame_id);
+        }
+        if (ret_set.size() >= max_pts || count_measurements >= max_solve_measurements) {
+            break;
         }
     }
     if (params->verbose) {
         printf("[D2VINS::D2LandmarkManager] Found %ld(total %ld) landmarks measure %d/%d in %ld frames\n", ret_set.size(), landmark_db.size(), 
-                count_measurements, max_solve_measurements, result_landmark_num.size());
+                count_measurements, max_solve_measurements, current_landmark_num.size());
     }
     return ret_set;
 }
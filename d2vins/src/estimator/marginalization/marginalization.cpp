@@ -4,66 +4,305 @@
 #include "../../factors/prior_factor.h"
 #include "../../factors/imu_factor.h"
 #include "../../factors/projectionTwoFrameOneCamFactor.h"
+#include "../../factors/projectionTwoFrameOneCamBatch.h"
+#include <array>
+#include <future>
+#include <numeric>
+#include <thread>
 
 using namespace D2Common;
 
 namespace D2VINS {
+std::pair<MatrixXd, VectorXd> schurComplementLandmarks(const SparseMat & H, const VectorXd & g, int keep_state_dim, 
+        int landmark_start, int landmark_block_size) {
+    const double eps = 1e-8;
+    int state_dim = H.rows();
+    //Reduced system of the keep and removed frame states
+    MatrixXd S = H.topLeftCorner(landmark_start, landmark_start);
+    VectorXd g_s = g.head(landmark_start);
+    std::vector<int> rows;
+    MatrixXd V, W;
+    for (int col = landmark_start; col < state_dim; col += landmark_block_size) {
+        int blk_size = std::min(landmark_block_size, state_dim - col);
+        //Gather the nonzero rows of H_xl for this landmark, and H_ll.
+        rows.clear();
+        MatrixXd H_ll = MatrixXd::Zero(blk_size, blk_size);
+        for (int j = 0; j < blk_size; j ++) {
+            for (SparseMat::InnerIterator it(H, col + j); it; ++it) {
+                if (it.row() < landmark_start && std::find(rows.begin(), rows.end(), it.row()) == rows.end()) {
+                    rows.emplace_back(it.row());
+                } else if (it.row() >= col && it.row() < col + blk_size) {
+                    H_ll(it.row() - col, j) = it.value();
+                }
+            }
+        }
+        if (rows.empty()) {
+            continue;
+        }
+        V.setZero(rows.size(), blk_size);
+        for (int j = 0; j < blk_size; j ++) {
+            for (SparseMat::InnerIterator it(H, col + j); it; ++it) {
+                if (it.row() < landmark_start) {
+                    V(std::find(rows.begin(), rows.end(), it.row()) - rows.begin(), j) = it.value();
+                }
+            }
+        }
+        MatrixXd H_ll_inv;
+        if (blk_size == 1) {
+            H_ll_inv = MatrixXd::Constant(1, 1, H_ll(0, 0) > eps ? 1.0 / H_ll(0, 0) : 0.0);
+        } else {
+            SelfAdjointEigenSolver<MatrixXd> saes(H_ll);
+            H_ll_inv = saes.eigenvectors() * VectorXd((saes.eigenvalues().array() > eps).select(
+                saes.eigenvalues().array().inverse(), 0)).asDiagonal() * saes.eigenvectors().transpose();
+        }
+        W = V * H_ll_inv;
+        VectorXd w_g = W * g.segment(col, blk_size);
+        for (int a = 0; a < rows.size(); a ++) {
+            g_s(rows[a]) -= w_g(a);
+            for (int b = 0; b < rows.size(); b ++) {
+                S(rows[a], rows[b]) -= W.row(a).dot(V.row(b));
+            }
+        }
+    }
+    if (landmark_start == keep_state_dim) {
+        return std::make_pair(S, g_s);
+    }
+    //The removed frames are a few dense blocks
+    return Utility::schurComplement(S, g_s, keep_state_dim);
+}
+
 void Marginalizer::addResidualInfo(ResidualInfo* info) {
     residual_info_list.push_back(info);
 }
 
+//Jacobian block of a residual on a parameter, values are column major in the thread buffer
+struct JacobianBlock {
+    int row;
+    int col;
+    int rows;
+    int cols;
+    size_t offset;
+};
+
+std::vector<std::vector<int>> Marginalizer::projectionBatches() const {
+    //Indices of the projection residuals (without depth) grouped by frame pair and camera
+    std::map<std::tuple<FrameIdType, FrameIdType, int>, std::vector<int>> batches;
+    for (int i = 0; i < residual_info_list.size(); i ++) {
+        auto info = residual_info_list[i];
+        if (info->residual_type != ResidualType::LandmarkTwoFrameOneCamResidual) {
+            continue;
+        }
+        auto lm_info = static_cast<LandmarkTwoFrameOneCamResInfo*>(info);
+        if (lm_info->enable_depth_mea) {
+            continue;
+        }
+        batches[std::make_tuple(lm_info->frame_ida, lm_info->frame_idb, lm_info->camera_id)].emplace_back(i);
+    }
+    std::vector<std::vector<int>> ret;
+    for (auto & it : batches) {
+        ret.emplace_back(std::move(it.second));
+    }
+    return ret;
+}
+
+void Marginalizer::evaluateProjectionBatch(const std::vector<int> & residual_ids) const {
+    //Same as ResidualInfo::Evaluate on each residual, the frame pair terms are computed once.
+    int n = residual_ids.size();
+    ProjectionTwoFrameOneCamBatch batch;
+    batch.resize(n);
+    std::vector<double> inv_deps(n);
+    std::vector<double*> residuals(n);
+    std::vector<std::array<double*, 5>> jacobians(n);
+    std::vector<double * const *> jacobian_ptrs(n);
+    std::vector<ParamInfo> pair_params;
+    for (int k = 0; k < n; k ++) {
+        auto info = residual_info_list[residual_ids[k]];
+        auto params = info->paramsList(state);
+        if (D2VINS::params->margin_enable_fej) {
+            if (last_prior != nullptr) {
+                last_prior->replacetoPrevLinearizedPoints(params);
+            }
+            inv_deps[k] = params[3].data_copied(0);
+        } else {
+            inv_deps[k] = *params[3].pointer;
+        }
+        if (k == 0) {
+            pair_params = params;
+        }
+        batch.setObservation(k, *static_cast<ProjectionTwoFrameOneCamFactor*>(info->cost_function));
+        info->residuals.resize(2);
+        info->jacobians.resize(params.size());
+        for (int i = 0; i < params.size(); i ++) {
+            info->jacobians[i].resize(2, params[i].size);
+            jacobians[k][i] = info->jacobians[i].data();
+        }
+        residuals[k] = info->residuals.data();
+        jacobian_ptrs[k] = jacobians[k].data();
+    }
+    //pose_i, pose_j, extrinsic, td
+    const double * parameters[4];
+    int pair_param_index[4] = {0, 1, 2, 4};
+    for (int i = 0; i < 4; i ++) {
+        auto & param = pair_params[pair_param_index[i]];
+        parameters[i] = D2VINS::params->margin_enable_fej ? param.data_copied.data() : param.pointer;
+    }
+    batch.evaluate(parameters, inv_deps.data(), residuals.data(), jacobian_ptrs.data());
+    for (auto i : residual_ids) {
+        residual_info_list[i]->applyLossFunction();
+    }
+}
+
 VectorXd Marginalizer::evaluate(SparseMat & J, int eff_residual_size, int eff_param_size) {
     //Then evaluate all residuals
     //Setup Jacobian
     //row: sort by residual_info_list
     //col: sort by params_list
-    int cul_res_size = 0;
-    std::vector<Eigen::Triplet<state_type>> triplet_list;
-    VectorXd residual_vec(eff_residual_size);
-    for (auto info : residual_info_list) {
-        if (params->margin_enable_fej) {
-            //In this case, we need to evaluate the residual with the FEJ state
-            auto params = info->paramsList(state);
-            if (last_prior!=nullptr) {
-                last_prior->replacetoPrevLinearizedPoints(params);
-            }
-            info->Evaluate(params, true);
-        } else {
-            info->Evaluate(state);
+    //Residuals are split to contiguous ranges evaluated by threads into their own block buffers,
+    //then each thread copies its blocks to the compressed columns of J, so the rows of each column stay sorted.
+    int residual_num = residual_info_list.size();
+    std::vector<int> residual_rows(residual_num + 1, 0);
+    for (int i = 0; i < residual_num; i ++) {
+        residual_rows[i + 1] = residual_rows[i] + residual_info_list[i]->residualSize();
+    }
+    VectorXd residual_vec = VectorXd::Zero(eff_residual_size);
+    int num_threads = params->margin_num_threads > 0 ? params->margin_num_threads : std::thread::hardware_concurrency();
+    num_threads = std::max(1, std::min(num_threads, residual_num / 16 + 1));
+    std::vector<std::vector<JacobianBlock>> thread_blocks(num_threads);
+    std::vector<std::vector<state_type>> thread_values(num_threads);
+    std::vector<std::vector<int>> thread_col_nnz(num_threads, std::vector<int>(eff_param_size, 0));
+    //Projection residuals are first evaluated in batches of the same frame pair
+    auto batches = projectionBatches();
+    std::vector<uint8_t> batched(residual_num, 0);
+    for (auto & batch : batches) {
+        for (auto i : batch) {
+            batched[i] = 1;
         }
-        auto params = info->paramsList(state);
-        auto residual_size = info->residualSize();
-        residual_vec.segment(cul_res_size, residual_size) = info->residuals;
-        if (std::isnan(info->residuals.maxCoeff()) || std::isnan(info->residuals.minCoeff())) {
-            printf("\033[0;31m[D2VINS::Marginalizer] Residual type %d residuals is nan:\033[0m\n", 
-                info->residual_type);
-            std::cout << info->residuals.transpose() << std::endl;
-            continue;
+    }
+    auto evaluate_batches = [&](int thread_id) {
+        for (size_t k = thread_id; k < batches.size(); k += num_threads) {
+            evaluateProjectionBatch(batches[k]);
         }
-        for (auto param_blk_i = 0; param_blk_i < params.size(); param_blk_i ++) {
-            auto & J_blk = info->jacobians[param_blk_i];
-            //Place this J to row: cul_res_size, col: param_indices
-            auto i0 = cul_res_size;
-            auto j0 = _params.at(params[param_blk_i].pointer).index;
-            auto param_size = params[param_blk_i].size;
-            auto blk_eff_param_size = params[param_blk_i].eff_size;
-            if (std::isnan(J_blk.maxCoeff()) || std::isnan(J_blk.minCoeff())) {
-                printf("\033[0;31m[D2VINS::Marginalizer] Residual type %d param_blk %d jacobians is nan\033[0m:\n",
-                    info->residual_type, param_blk_i);
-                std::cout << J_blk << std::endl;
+    };
+    std::vector<std::future<void>> tasks;
+    for (int t = 1; t < num_threads; t ++) {
+        tasks.emplace_back(std::async(std::launch::async, evaluate_batches, t));
+    }
+    evaluate_batches(0);
+    for (auto & task : tasks) {
+        task.get();
+    }
+    tasks.clear();
+    auto evaluate_range = [&](int thread_id, int begin, int end) {
+        auto & blocks = thread_blocks[thread_id];
+        auto & values = thread_values[thread_id];
+        auto & col_nnz = thread_col_nnz[thread_id];
+        size_t values_size = 0;
+        for (int i = begin; i < end; i ++) {
+            auto sizes = residual_info_list[i]->cost_function->parameter_block_sizes();
+            values_size += (residual_rows[i + 1] - residual_rows[i]) * std::accumulate(sizes.begin(), sizes.end(), 0);
+        }
+        values.reserve(values_size);
+        for (int i = begin; i < end; i ++) {
+            auto info = residual_info_list[i];
+            auto params = info->paramsList(state);
+            if (batched[i]) {
+                //Already evaluated by evaluateProjectionBatch
+            } else if (D2VINS::params->margin_enable_fej) {
+                //In this case, we need to evaluate the residual with the FEJ state
+                auto params_fej = params;
+                if (last_prior!=nullptr) {
+                    last_prior->replacetoPrevLinearizedPoints(params_fej);
+                }
+                info->Evaluate(params_fej, true);
+            } else {
+                info->Evaluate(params);
+            }
+            auto residual_size = info->residualSize();
+            if (std::isnan(info->residuals.maxCoeff()) || std::isnan(info->residuals.minCoeff())) {
+                printf("\033[0;31m[D2VINS::Marginalizer] Residual type %d residuals is nan\033[0m\n", info->residual_type);
                 continue;
             }
-            
-            for (auto i = 0; i < residual_size; i ++) {
-                for (auto j = 0; j < blk_eff_param_size; j ++) {
-                    //We only copy the eff param part, that is: on tangent space.
-                    triplet_list.push_back(Eigen::Triplet<state_type>(i0 + i, j0 + j, J_blk(i, j)));
+            residual_vec.segment(residual_rows[i], residual_size) = info->residuals;
+            size_t first_block = blocks.size();
+            for (auto param_blk_i = 0; param_blk_i < params.size(); param_blk_i ++) {
+                auto & J_blk = info->jacobians[param_blk_i];
+                if (std::isnan(J_blk.maxCoeff()) || std::isnan(J_blk.minCoeff())) {
+                    printf("\033[0;31m[D2VINS::Marginalizer] Residual type %d param_blk %d jacobians is nan\033[0m\n",
+                        info->residual_type, param_blk_i);
+                    continue;
+                }
+                //Place this J to row: residual_rows[i], col: param index. We only copy the eff param part, that is: on tangent space.
+                JacobianBlock blk = {residual_rows[i], _params.at(params[param_blk_i].pointer).index, residual_size, 
+                    params[param_blk_i].eff_size, values.size()};
+                bool merged = false;
+                for (size_t k = first_block; k < blocks.size(); k ++) {
+                    if (blocks[k].col == blk.col) {
+                        //Same parameter twice in the residual, sum as the triplets would
+                        for (auto j = 0; j < blk.cols; j ++) {
+                            for (auto r = 0; r < residual_size; r ++) {
+                                values[blocks[k].offset + j * residual_size + r] += J_blk(r, j);
+                            }
+                        }
+                        merged = true;
+                    }
+                }
+                if (merged) {
+                    continue;
+                }
+                for (auto j = 0; j < blk.cols; j ++) {
+                    for (auto r = 0; r < residual_size; r ++) {
+                        values.emplace_back(J_blk(r, j));
+                    }
+                    col_nnz[blk.col + j] += residual_size;
+                }
+                blocks.emplace_back(blk);
+            }
+        }
+    };
+    int chunk = (residual_num + num_threads - 1) / num_threads;
+    for (int t = 1; t < num_threads; t ++) {
+        tasks.emplace_back(std::async(std::launch::async, evaluate_range, t, 
+            std::min(t * chunk, residual_num), std::min((t + 1) * chunk, residual_num)));
+    }
+    evaluate_range(0, 0, std::min(chunk, residual_num));
+    for (auto & task : tasks) {
+        task.get();
+    }
+
+    //Column starts of J and of each thread's rows in the column
+    std::vector<std::vector<int>> thread_cursors(num_threads, std::vector<int>(eff_param_size));
+    J.resize(eff_residual_size, eff_param_size);
+    int nnz = 0;
+    for (int col = 0; col < eff_param_size; col ++) {
+        J.outerIndexPtr()[col] = nnz;
+        for (int t = 0; t < num_threads; t ++) {
+            thread_cursors[t][col] = nnz;
+            nnz += thread_col_nnz[t][col];
+        }
+    }
+    J.outerIndexPtr()[eff_param_size] = nnz;
+    J.resizeNonZeros(nnz);
+    auto fill_blocks = [&](int thread_id) {
+        auto & cursors = thread_cursors[thread_id];
+        auto & values = thread_values[thread_id];
+        for (auto & blk : thread_blocks[thread_id]) {
+            for (int j = 0; j < blk.cols; j ++) {
+                int & idx = cursors[blk.col + j];
+                for (int r = 0; r < blk.rows; r ++, idx ++) {
+                    J.innerIndexPtr()[idx] = blk.row + r;
+                    J.valuePtr()[idx] = values[blk.offset + j * blk.rows + r];
                 }
             }
         }
-        cul_res_size += residual_size;
+    };
+    tasks.clear();
+    for (int t = 1; t < num_threads; t ++) {
+        tasks.emplace_back(std::async(std::launch::async, fill_blocks, t));
+    }
+    fill_blocks(0);
+    for (auto & task : tasks) {
+        task.get();
     }
-    J.setFromTriplets(triplet_list.begin(), triplet_list.end());
     return residual_vec;
 }
 
@@ -174,7 +413,16 @@ PriorFactor * Marginalizer::marginalize(std::set<FrameIdType> _remove_frame_ids)
     }
     //Compute the schur complement, by sparse LLT.
     PriorFactor * prior = nullptr;
-    if (params->margin_sparse_solver) {
+    if (params->margin_landmark_schur) {
+        tt.tic();
+        auto Ab = schurComplementLandmarks(H, g, keep_state_dim, landmark_start, landmark_block_size);
+        double t_schur = tt.toc();
+        prior = new PriorFactor(keep_params_list, Ab.first, Ab.second);
+        if (params->enable_perf_output) {
+            printf("[D2VINS::marginalize] landmark schurComplement cost %.1fms newPrior %.1fms landmarks %d\n", t_schur, 
+                tt.toc() - t_schur, (total_eff_state_dim - landmark_start) / landmark_block_size);
+        }
+    } else if (params->margin_sparse_solver) {
         tt.tic();
         auto Ab = Utility::schurComplement(H, g, keep_state_dim);
         if (params->enable_perf_output) {
@@ -200,6 +448,12 @@ PriorFactor * Marginalizer::marginalize(std::set<FrameIdType> _remove_frame_ids)
     if (params->debug_write_margin_matrix) {
         Utility::writeMatrixtoFile(params->output_folder + "/H.txt", MatrixXd(H));
         Utility::writeMatrixtoFile(params->output_folder + "/g.txt", MatrixXd(g));
+        //Numbered windows with their layout for marginalization_benchmark
+        static int margin_count = 0;
+        auto prefix = params->output_folder + "/margin_" + std::to_string(margin_count++);
+        Utility::writeMatrixtoFile(prefix + "_H.txt", MatrixXd(H));
+        Utility::writeMatrixtoFile(prefix + "_g.txt", MatrixXd(g));
+        Utility::writeMatrixtoFile(prefix + "_layout.txt", Vector3i(keep_state_dim, landmark_start, landmark_block_size));
     }
    
     if (prior->hasNan()) {
@@ -226,6 +480,7 @@ void Marginalizer::sortParams() {
     total_eff_state_dim = 0; //here on tangent space
     remove_state_dim = 0;
     keep_block_size = 0;
+    landmark_start = -1;
     for (unsigned i = 0; i < params_list.size(); i++) {
         auto & _param = _params.at(params_list[i].pointer);
         _param.index = total_eff_state_dim;
@@ -235,12 +490,20 @@ void Marginalizer::sortParams() {
         //         params_list[i].pointer, _param.type, _param.id, _param.size, _param.index, total_eff_state_dim, _param.is_remove);
         // }
         if (_param.is_remove) {
+            if (_param.type == LANDMARK && landmark_start < 0) {
+                //LANDMARK is the last type, so removed landmarks are at the end
+                landmark_start = _param.index;
+                landmark_block_size = _param.eff_size;
+            }
             remove_state_dim += _param.eff_size;
         } else {
             keep_block_size ++;
         }
         params_list[i] = _param;
     }
+    if (landmark_start < 0) {
+        landmark_start = total_eff_state_dim;
+    }
 }
 
 
@@ -4,9 +4,17 @@
 #include "../ParamResidualInfo.hpp"
 
 namespace D2VINS {
+//Schur complement of H = [keep, removed frames, removed landmarks] onto the keep states.
+//The landmark blocks (size landmark_block_size each, from landmark_start) are only coupled to frames, extrinsics and td,
+//so they are eliminated block by block in closed form, leaving a dense elimination of the few removed frame states.
+std::pair<MatrixXd, VectorXd> schurComplementLandmarks(const SparseMat & H, const VectorXd & g, int keep_state_dim, 
+    int landmark_start, int landmark_block_size);
+
 class Marginalizer {
 protected:
     D2EstimatorState * state = nullptr;
+    //Borrowed from the solver, which owns them and returns them to FactorPool. They must stay alive until marginalize
+    //returns, so the marginalizer is always reset before the solver removes or resets residuals.
     std::vector<ResidualInfo*> residual_info_list;
 
     //To remove ids
@@ -20,10 +28,14 @@ protected:
     int remove_state_dim = 0;
     int total_eff_state_dim = 0;
     int keep_block_size = 0;
+    int landmark_start = 0; //Removed landmarks are the last blocks from here
+    int landmark_block_size = 1;
     PriorFactor * last_prior = nullptr;
 
     void sortParams();
     VectorXd evaluate(SparseMat & J, int eff_residual_size, int eff_param_size);
+    std::vector<std::vector<int>> projectionBatches() const;
+    void evaluateProjectionBatch(const std::vector<int> & residual_ids) const;
     void covarianceEstimation(const SparseMat & H);
     int filterResiduals();
     void showDeltaXofschurComplement(std::vector<ParamInfo> keep_params_list, const SparseMatrix<double> & A, const Matrix<double, Dynamic, 1> & b);
@@ -4,9 +4,10 @@
 #include <ceres/ceres.h>
 #include <Eigen/Dense>
 #include "../d2vins_params.hpp"
+#include <d2common/solver/FactorPool.hpp>
 
 namespace D2VINS {
-class OneFrameDepth {
+class OneFrameDepth : public D2Common::PoolAllocated {
   public:
     OneFrameDepth(double depth):
         _inv_dep(1/depth) {
@@ -21,7 +22,7 @@ class OneFrameDepth {
     double sqrt_inf = 10.0;
 
     static ceres::CostFunction * Create(double depth) {
-        return (new ceres::AutoDiffCostFunction<OneFrameDepth, 1, 1>(
+        return (new D2Common::PooledAutoDiffCostFunction<OneFrameDepth, 1, 1>(
             new OneFrameDepth(depth)));
     }
 };
@@ -12,23 +12,22 @@
 #include <eigen3/Eigen/Dense>
 #include <d2common/integration_base.h>
 #include <ceres/ceres.h>
+#include <d2common/solver/FactorPool.hpp>
 
 using namespace D2VINS;
 using namespace D2Common;
 
 namespace D2VINS {
-class IMUFactor : public ceres::SizedCostFunction<15, 7, 9, 7, 9>
+class IMUFactor : public ceres::SizedCostFunction<15, 7, 9, 7, 9>, public D2Common::PoolAllocated
 {
     bool check = false;
-    Eigen::Matrix<double, 15, 15> sqrt_info;
   public:
     bool debug = false;
     IMUFactor() = delete;
     IMUFactor(IntegrationBase* _pre_integration):pre_integration(_pre_integration)
     {
-        sqrt_info = Eigen::LLT<Eigen::Matrix<double, 15, 15>>(pre_integration->covariance.inverse()).matrixL().transpose();
-        // std::cout << "intergation sum_dt" << pre_integration->sum_dt << "cov\n" << pre_integration->covariance.block<3, 3>(O_BA, O_BA) << std::endl << 
-        //     "sqrt_info OBA\n" << sqrt_info.block<3, 3>(O_BA, O_BA) << std::endl;
+        //The square root information is kept by the integration and updated when it is re-integrated
+        pre_integration->updateSqrtInfo();
     }
 
     void testEvaluate(std::vector<double*> param, double *residuals, double **jacobians)
@@ -40,6 +39,7 @@ class IMUFactor : public ceres::SizedCostFunction<15, 7, 9, 7, 9>
 
     virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
     {
+        const Eigen::Matrix<double, 15, 15> & sqrt_info = pre_integration->sqrtInfo();
 
         Eigen::Vector3d Pi(parameters[0][0], parameters[0][1], parameters[0][2]);
         Eigen::Quaterniond Qi(parameters[0][6], parameters[0][3], parameters[0][4], parameters[0][5]);
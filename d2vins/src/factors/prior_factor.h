@@ -1,5 +1,6 @@
 #pragma once
 #include <ceres/ceres.h>
+#include <d2common/solver/FactorPool.hpp>
 #include <Eigen/Eigen>
 #include <d2common/d2basetypes.h>
 #include <swarm_msgs/Pose.h>
@@ -16,7 +17,7 @@ namespace D2VINS
 std::pair<MatrixXd, VectorXd> toJacRes(const SparseMat & A, const VectorXd & b);
 std::pair<MatrixXd, VectorXd> toJacRes(const MatrixXd & A, const VectorXd & b);
 
-class PriorFactor : public ceres::CostFunction {
+class PriorFactor : public ceres::CostFunction, public D2Common::PoolAllocated {
     std::vector<ParamInfo> keep_params_list;
     std::map<state_type*, ParamInfo> keep_params_map;
     int keep_param_blk_num = 0;
@@ -0,0 +1,261 @@
+#include "projectionTwoFrameOneCamBatch.h"
+#include "projectionTwoFrameOneCamFactor.h"
+#include "../d2vins_params.hpp"
+#include <algorithm>
+
+using namespace Eigen;
+
+namespace D2VINS {
+namespace {
+//Terms shared by all observations of a frame pair.
+struct PairTerms {
+    Matrix3d A; //Camera i to camera j rotation: ric^T * Rj^T * Ri * ric
+    Vector3d b; //Camera i origin in camera j: ric^T * (Rj^T * (Ri * tic + Pi - Pj) - tic)
+    Matrix3d J_w; //ric^T * Rj^T
+    Matrix3d J_imu_i; //J_w * Ri
+    Matrix3d ric;
+    Vector3d tic;
+    double td;
+    PairTerms(const double * pose_i, const double * pose_j, const double * ex, double _td): td(_td) {
+        Vector3d Pi(pose_i[0], pose_i[1], pose_i[2]);
+        Quaterniond Qi(pose_i[6], pose_i[3], pose_i[4], pose_i[5]);
+        Vector3d Pj(pose_j[0], pose_j[1], pose_j[2]);
+        Quaterniond Qj(pose_j[6], pose_j[3], pose_j[4], pose_j[5]);
+        tic = Vector3d(ex[0], ex[1], ex[2]);
+        ric = Quaterniond(ex[6], ex[3], ex[4], ex[5]).toRotationMatrix();
+        Matrix3d Ri = Qi.toRotationMatrix();
+        Matrix3d Rj = Qj.toRotationMatrix();
+        J_w = ric.transpose() * Rj.transpose();
+        J_imu_i = J_w * Ri;
+        A = J_imu_i * ric;
+        b = ric.transpose() * (Rj.transpose() * (Ri * tic + Pi - Pj) - tic);
+    }
+};
+
+//3-vectors of all the observations, one array per component
+template <int Rows>
+struct Vec3Array {
+    typedef Array<double, Rows, 1> Col;
+    Col x, y, z;
+    Vec3Array() {}
+    template <typename X, typename Y, typename Z>
+    Vec3Array(const X & _x, const Y & _y, const Z & _z): x(_x), y(_y), z(_z) {}
+    Vec3Array operator+(const Vec3Array & o) const {
+        return Vec3Array(x + o.x, y + o.y, z + o.z);
+    }
+    Vec3Array operator-(const Vec3Array & o) const {
+        return Vec3Array(x - o.x, y - o.y, z - o.z);
+    }
+    Vec3Array operator+(const Vector3d & o) const {
+        return Vec3Array(x + o.x(), y + o.y(), z + o.z());
+    }
+    Vec3Array operator-(const Vector3d & o) const {
+        return Vec3Array(x - o.x(), y - o.y(), z - o.z());
+    }
+    Vec3Array operator*(const Col & s) const {
+        return Vec3Array(x * s, y * s, z * s);
+    }
+    Vec3Array operator*(double s) const {
+        return Vec3Array(x * s, y * s, z * s);
+    }
+    Col dot(const Vec3Array & o) const {
+        return x * o.x + y * o.y + z * o.z;
+    }
+    //Row vectors times skew(o) are cross products: a^T * [o]x = (a x o)^T
+    Vec3Array cross(const Vec3Array & o) const {
+        return Vec3Array(y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x);
+    }
+};
+
+template <int Rows>
+Vec3Array<Rows> operator*(const Matrix3d & M, const Vec3Array<Rows> & v) {
+    return Vec3Array<Rows>(M(0, 0) * v.x + M(0, 1) * v.y + M(0, 2) * v.z,
+        M(1, 0) * v.x + M(1, 1) * v.y + M(1, 2) * v.z,
+        M(2, 0) * v.x + M(2, 1) * v.y + M(2, 2) * v.z);
+}
+
+template <int Rows>
+void evaluateKernel(const PairTerms & c, const Array<double, Rows, ProjectionTwoFrameOneCamBatch::IN_DIM> & in,
+        const Array<double, Rows, 1> & inv_dep, Array<double, Rows, ProjectionTwoFrameOneCamBatch::OUT_DIM> & out,
+        bool with_jacobians) {
+    typedef ProjectionTwoFrameOneCamBatch B;
+    typedef Vec3Array<Rows> V3;
+    typedef typename V3::Col Col;
+    const Matrix2d & sqrt_info = ProjectionTwoFrameOneCamFactor::sqrt_info;
+    Col dt_i = c.td - in.col(B::TD_I), dt_j = c.td - in.col(B::TD_J);
+    V3 vel_i(in.col(B::VI_X), in.col(B::VI_Y), in.col(B::VI_Z));
+    V3 vel_j(in.col(B::VJ_X), in.col(B::VJ_Y), in.col(B::VJ_Z));
+    V3 pts_i_td = V3(in.col(B::PI_X), in.col(B::PI_Y), in.col(B::PI_Z)) - vel_i * dt_i;
+    V3 pts_j_td = V3(in.col(B::PJ_X), in.col(B::PJ_Y), in.col(B::PJ_Z)) - vel_j * dt_j;
+    Col dep_i = inv_dep.inverse();
+    V3 pts_camera_i = pts_i_td * dep_i;
+    V3 A_pts_camera_i = c.A * pts_camera_i;
+    V3 pts_camera_j = A_pts_camera_i + c.b;
+    //Residual before sqrt_info and the rows of its Jacobian to pts_camera_j (reduce),
+    //t: Jacobian of the residual to td through the measurement in frame j
+    Col r0, r1, t0, t1;
+    V3 red0, red1;
+#ifdef UNIT_SPHERE_ERROR
+    V3 T0(in.col(B::TB_00), in.col(B::TB_01), in.col(B::TB_02));
+    V3 T1(in.col(B::TB_10), in.col(B::TB_11), in.col(B::TB_12));
+    Col norm_inv = pts_camera_j.dot(pts_camera_j).rsqrt();
+    Col norm_j_inv = pts_j_td.dot(pts_j_td).rsqrt();
+    V3 u = pts_camera_j * norm_inv;
+    V3 v = pts_j_td * norm_j_inv;
+    V3 diff = u - v;
+    r0 = T0.dot(diff);
+    r1 = T1.dot(diff);
+    if (with_jacobians) {
+        //d(p / |p|) / dp = (I - u u^T) / |p|
+        red0 = (T0 - u * T0.dot(u)) * norm_inv;
+        red1 = (T1 - u * T1.dot(u)) * norm_inv;
+        Col v_vel_j = v.dot(vel_j);
+        t0 = (T0.dot(vel_j) - T0.dot(v) * v_vel_j) * norm_j_inv;
+        t1 = (T1.dot(vel_j) - T1.dot(v) * v_vel_j) * norm_j_inv;
+    }
+#else
+    Col z_inv = pts_camera_j.z.inverse();
+    r0 = pts_camera_j.x * z_inv - pts_j_td.x;
+    r1 = pts_camera_j.y * z_inv - pts_j_td.y;
+    if (with_jacobians) {
+        Col zero = Col::Zero(z_inv.rows());
+        red0 = V3(z_inv, zero, -pts_camera_j.x * z_inv * z_inv);
+        red1 = V3(zero, z_inv, -pts_camera_j.y * z_inv * z_inv);
+        t0 = vel_j.x;
+        t1 = vel_j.y;
+    }
+#endif
+    out.col(B::RES) = sqrt_info(0, 0) * r0 + sqrt_info(0, 1) * r1;
+    out.col(B::RES + 1) = sqrt_info(1, 0) * r0 + sqrt_info(1, 1) * r1;
+    if (!with_jacobians) {
+        return;
+    }
+    V3 pts_imu_i = c.ric * pts_camera_i + c.tic;
+    V3 pts_imu_j = c.ric * pts_camera_j + c.tic;
+    V3 A_vel_i = c.A * vel_i;
+    Matrix3d J_w_t = c.J_w.transpose(), J_imu_i_t = c.J_imu_i.transpose(), A_t = c.A.transpose();
+    for (int a = 0; a < 2; a ++) {
+        //Row a of sqrt_info * reduce
+        V3 g = red0 * sqrt_info(a, 0) + red1 * sqrt_info(a, 1);
+        V3 g_w = J_w_t * g;
+        V3 g_imu_i = J_imu_i_t * g;
+        V3 g_ric = c.ric * g;
+        V3 rot_i = (g_imu_i * -1.0).cross(pts_imu_i);
+        V3 rot_j = g_ric.cross(pts_imu_j);
+        V3 pos_ex = g_imu_i - g_ric;
+        V3 rot_ex = g.cross(pts_camera_j) - (A_t * g).cross(pts_camera_i);
+        const V3 * blocks[5] = {&g_w, &rot_i, &rot_j, &pos_ex, &rot_ex};
+        int offsets[5] = {B::J_POSE_I + a * 6, B::J_POSE_I + a * 6 + 3, B::J_POSE_J + a * 6 + 3,
+            B::J_EX + a * 6, B::J_EX + a * 6 + 3};
+        for (int k = 0; k < 5; k ++) {
+            out.col(offsets[k]) = blocks[k]->x;
+            out.col(offsets[k] + 1) = blocks[k]->y;
+            out.col(offsets[k] + 2) = blocks[k]->z;
+        }
+        out.col(B::J_POSE_J + a * 6) = -g_w.x;
+        out.col(B::J_POSE_J + a * 6 + 1) = -g_w.y;
+        out.col(B::J_POSE_J + a * 6 + 2) = -g_w.z;
+        out.col(B::J_DEP + a) = -g.dot(A_pts_camera_i) * dep_i;
+        out.col(B::J_TD + a) = -g.dot(A_vel_i) * dep_i + sqrt_info(a, 0) * t0 + sqrt_info(a, 1) * t1;
+    }
+}
+
+template <typename Row>
+void scatter(const Row & out, double * residuals, double * const * jacobians) {
+    typedef ProjectionTwoFrameOneCamBatch B;
+    residuals[0] = out(B::RES);
+    residuals[1] = out(B::RES + 1);
+    if (jacobians == nullptr) {
+        return;
+    }
+    int pose_offsets[3] = {B::J_POSE_I, B::J_POSE_J, B::J_EX};
+    for (int i = 0; i < 3; i ++) {
+        if (jacobians[i]) {
+            //2x7 row major
+            for (int a = 0; a < 2; a ++) {
+                for (int j = 0; j < 6; j ++) {
+                    jacobians[i][a * 7 + j] = out(pose_offsets[i] + a * 6 + j);
+                }
+                jacobians[i][a * 7 + 6] = 0;
+            }
+        }
+    }
+    if (jacobians[3]) {
+        jacobians[3][0] = out(B::J_DEP);
+        jacobians[3][1] = out(B::J_DEP + 1);
+    }
+    if (jacobians[4]) {
+        jacobians[4][0] = out(B::J_TD);
+        jacobians[4][1] = out(B::J_TD + 1);
+    }
+}
+
+template <typename Row>
+void fillObservation(Row row, const ProjectionTwoFrameOneCamFactor & f) {
+    typedef ProjectionTwoFrameOneCamBatch B;
+    row(B::PI_X) = f.pts_i.x(); row(B::PI_Y) = f.pts_i.y(); row(B::PI_Z) = f.pts_i.z();
+    row(B::PJ_X) = f.pts_j.x(); row(B::PJ_Y) = f.pts_j.y(); row(B::PJ_Z) = f.pts_j.z();
+    row(B::VI_X) = f.velocity_i.x(); row(B::VI_Y) = f.velocity_i.y(); row(B::VI_Z) = f.velocity_i.z();
+    row(B::VJ_X) = f.velocity_j.x(); row(B::VJ_Y) = f.velocity_j.y(); row(B::VJ_Z) = f.velocity_j.z();
+    row(B::TD_I) = f.td_i;
+    row(B::TD_J) = f.td_j;
+    for (int j = 0; j < 3; j ++) {
+        row(B::TB_00 + j) = f.tangent_base(0, j);
+        row(B::TB_10 + j) = f.tangent_base(1, j);
+    }
+}
+}
+
+void ProjectionTwoFrameOneCamBatch::resize(int n) {
+    num = n;
+    //Padded to whole blocks, the padding rows are valid observations so they evaluate to finite values
+    int rows = (n + BLOCK_ROWS - 1) / BLOCK_ROWS * BLOCK_ROWS;
+    obs.resize(rows, IN_DIM);
+    obs.setZero();
+    obs.col(PI_Z).setOnes();
+    obs.col(PJ_Z).setOnes();
+    obs.col(TB_00).setOnes();
+    obs.col(TB_11).setOnes();
+}
+
+void ProjectionTwoFrameOneCamBatch::setObservation(int k, const ProjectionTwoFrameOneCamFactor & factor) {
+    fillObservation(obs.row(k), factor);
+}
+
+void ProjectionTwoFrameOneCamBatch::evaluate(double const * const * parameters, const double * inv_deps,
+        double * const * residuals, double * const * const * jacobians) const {
+    PairTerms terms(parameters[0], parameters[1], parameters[2], parameters[3][0]);
+    bool with_jacobians = false;
+    for (int k = 0; k < num && !with_jacobians; k ++) {
+        with_jacobians = jacobians != nullptr && jacobians[k] != nullptr;
+    }
+    //Fixed-size blocks of observations stay on the stack and map to SIMD packets
+    Array<double, BLOCK_ROWS, IN_DIM> in;
+    Array<double, BLOCK_ROWS, OUT_DIM> out;
+    Array<double, BLOCK_ROWS, 1> inv_dep;
+    for (int start = 0; start < num; start += BLOCK_ROWS) {
+        int rows = std::min(num - start, (int) BLOCK_ROWS);
+        in = obs.middleRows<BLOCK_ROWS>(start);
+        inv_dep.setOnes();
+        for (int k = 0; k < rows; k ++) {
+            inv_dep(k) = inv_deps[start + k];
+        }
+        evaluateKernel<BLOCK_ROWS>(terms, in, inv_dep, out, with_jacobians);
+        for (int k = 0; k < rows; k ++) {
+            scatter(out.row(k), residuals[start + k], jacobians == nullptr ? nullptr : jacobians[start + k]);
+        }
+    }
+}
+
+void ProjectionTwoFrameOneCamBatch::evaluate(const ProjectionTwoFrameOneCamFactor & factor, double const * const * parameters,
+        double * residuals, double ** jacobians) {
+    PairTerms terms(parameters[0], parameters[1], parameters[2], parameters[4][0]);
+    Array<double, 1, IN_DIM> in;
+    Array<double, 1, OUT_DIM> out;
+    Array<double, 1, 1> inv_dep;
+    fillObservation(in.row(0), factor);
+    inv_dep(0) = parameters[3][0];
+    evaluateKernel<1>(terms, in, inv_dep, out, jacobians != nullptr);
+    scatter(out.row(0), residuals, jacobians);
+}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+namespace D2VINS {
+class ProjectionTwoFrameOneCamFactor;
+
+//Evaluates ProjectionTwoFrameOneCamFactor for many observations sharing the same frame pair and camera.
+//The terms of the frame pair are computed once, the observations are stored in structure-of-arrays layout
+//and evaluated column-wise with Eigen arrays, so the per-observation math is vectorized across observations.
+//The factor evaluates itself with the same kernel on a single fixed-size row.
+class ProjectionTwoFrameOneCamBatch {
+public:
+    enum {
+        PI_X, PI_Y, PI_Z, PJ_X, PJ_Y, PJ_Z,
+        VI_X, VI_Y, VI_Z, VJ_X, VJ_Y, VJ_Z,
+        TD_I, TD_J,
+        TB_00, TB_01, TB_02, TB_10, TB_11, TB_12, //tangent_base of the measurement in frame j
+        IN_DIM
+    };
+    enum {
+        RES = 0, //2
+        J_POSE_I = 2, //2x6 row major, the 7th column of pose Jacobians is zero
+        J_POSE_J = 14,
+        J_EX = 26,
+        J_DEP = 38, //2
+        J_TD = 40, //2
+        OUT_DIM = 42
+    };
+    enum {
+        BLOCK_ROWS = 8 //Observations evaluated together
+    };
+
+    void resize(int n);
+    int size() const {
+        return num;
+    }
+    void setObservation(int k, const ProjectionTwoFrameOneCamFactor & factor);
+    //parameters: pose_i, pose_j, extrinsic, td. inv_deps: inverse depth of each observation.
+    //Residuals and jacobians of observation k are written to residuals[k] and jacobians[k] in the layout of
+    //ProjectionTwoFrameOneCamFactor::Evaluate, jacobians[k] and its blocks may be nullptr.
+    void evaluate(double const * const * parameters, const double * inv_deps,
+        double * const * residuals, double * const * const * jacobians) const;
+    static void evaluate(const ProjectionTwoFrameOneCamFactor & factor, double const * const * parameters,
+        double * residuals, double ** jacobians);
+protected:
+    int num = 0;
+    Eigen::Array<double, Eigen::Dynamic, IN_DIM> obs;
+};
+}
@@ -14,9 +14,10 @@
 #include <ros/assert.h>
 #include <ceres/ceres.h>
 #include <Eigen/Dense>
+#include <d2common/solver/FactorPool.hpp>
 
 namespace D2VINS {
-class ProjectionTwoFrameOneCamDepthFactor : public ceres::SizedCostFunction<3, 7, 7, 7, 1, 1>
+class ProjectionTwoFrameOneCamDepthFactor : public ceres::SizedCostFunction<3, 7, 7, 7, 1, 1>, public D2Common::PoolAllocated
 {
   public:
     ProjectionTwoFrameOneCamDepthFactor(const Eigen::Vector3d &_pts_i, const Eigen::Vector3d &_pts_j,
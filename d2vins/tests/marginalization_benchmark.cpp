@@ -0,0 +1,157 @@
+#include "../src/estimator/marginalization/marginalization.hpp"
+#include <d2common/utils.hpp>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <sstream>
+#include <random>
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+MatrixXd loadMatrix(const std::string & path) {
+    std::ifstream f(path);
+    std::string line;
+    std::vector<std::vector<double>> rows;
+    while (std::getline(f, line)) {
+        std::stringstream ss(line);
+        std::string cell;
+        std::vector<double> row;
+        while (std::getline(ss, cell, ',')) {
+            row.emplace_back(std::stod(cell));
+        }
+        if (!row.empty()) {
+            rows.emplace_back(row);
+        }
+    }
+    MatrixXd mat(rows.size(), rows.empty() ? 0 : rows[0].size());
+    for (int i = 0; i < rows.size(); i++) {
+        for (int j = 0; j < rows[i].size(); j++) {
+            mat(i, j) = rows[i][j];
+        }
+    }
+    return mat;
+}
+
+//A sliding window of frames (pose and speed bias) chained by IMU factors with inverse depth landmarks seen by
+//nearby frames. The first frame is marginalized with the landmarks based on it. State order is the Marginalizer's:
+//[kept frames, extrinsic, removed frame, removed landmarks].
+void syntheticWindow(int frames, int landmarks, std::mt19937 & rng, SparseMat & H, VectorXd & g, Vector3i & layout) {
+    const int frame_dim = POSE_EFF_SIZE + FRAME_SPDBIAS_SIZE;
+    int keep_dim = (frames - 1) * frame_dim + POSE_EFF_SIZE;
+    int landmark_start = keep_dim + frame_dim;
+    int state_dim = landmark_start + landmarks;
+    auto frame_index = [&](int i) {
+        return i == 0 ? keep_dim : (i - 1) * frame_dim;
+    };
+    std::normal_distribution<double> dist;
+    std::vector<Eigen::Triplet<double>> triplets;
+    int row = 0;
+    for (int i = 0; i < frames - 1; i++) {
+        for (int r = 0; r < frame_dim; r++, row++) {
+            for (int j = 0; j < frame_dim; j++) {
+                triplets.emplace_back(row, frame_index(i) + j, dist(rng));
+                triplets.emplace_back(row, frame_index(i + 1) + j, dist(rng));
+            }
+        }
+    }
+    int ext_index = (frames - 1) * frame_dim;
+    for (int l = 0; l < landmarks; l++) {
+        int obs = 2 + rng() % 4;
+        for (int k = 1; k <= obs && k < frames; k++) {
+            for (int r = 0; r < 2; r++, row++) {
+                for (int j = 0; j < POSE_EFF_SIZE; j++) {
+                    triplets.emplace_back(row, frame_index(0) + j, dist(rng));
+                    triplets.emplace_back(row, frame_index(k) + j, dist(rng));
+                    triplets.emplace_back(row, ext_index + j, dist(rng));
+                }
+                triplets.emplace_back(row, landmark_start + l, dist(rng));
+            }
+        }
+    }
+    SparseMat J(row, state_dim);
+    J.setFromTriplets(triplets.begin(), triplets.end());
+    VectorXd b = VectorXd::Random(row);
+    SparseMat I(state_dim, state_dim);
+    I.setIdentity();
+    H = SparseMat(J.transpose()) * J + 1e-3 * I;
+    g = J.transpose() * b;
+    layout = Vector3i(keep_dim, landmark_start, 1);
+}
+
+//Compare the Schur complements of the marginalization on recorded windows (written with debug_write_margin_matrix)
+//or synthetic windows.
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("dir,d", po::value<std::string>()->default_value(""), "output folder with margin_<n>_H/g/layout.txt")
+        ("windows,w", po::value<int>()->default_value(20), "num of synthetic windows if no dir")
+        ("frames,f", po::value<int>()->default_value(10), "frames per synthetic window")
+        ("landmarks,l", po::value<int>()->default_value(300), "removed landmarks per synthetic window")
+        ("skip-dense", "skip the dense schur complement");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    auto dir = vm["dir"].as<std::string>();
+    bool skip_dense = vm.count("skip-dense") > 0;
+    std::mt19937 rng(0);
+    double t_sparse = 0, t_dense = 0, t_landmark = 0, max_t_dense = 0, max_t_landmark = 0, max_err = 0;
+    int windows = 0;
+    for (int n = 0; ; n++) {
+        SparseMat H;
+        VectorXd g;
+        Vector3i layout;
+        if (!dir.empty()) {
+            auto prefix = dir + "/margin_" + std::to_string(n);
+            if (!std::ifstream(prefix + "_layout.txt").good()) {
+                break;
+            }
+            H = loadMatrix(prefix + "_H.txt").sparseView();
+            g = loadMatrix(prefix + "_g.txt").col(0);
+            MatrixXd _layout = loadMatrix(prefix + "_layout.txt");
+            layout = _layout.col(0).cast<int>();
+        } else {
+            if (n >= vm["windows"].as<int>()) {
+                break;
+            }
+            syntheticWindow(vm["frames"].as<int>(), vm["landmarks"].as<int>(), rng, H, g, layout);
+        }
+        int keep_dim = layout(0);
+        TicToc tic;
+        auto Ab_sparse = D2Common::Utility::schurComplement(H, g, keep_dim);
+        t_sparse += tic.toc();
+        tic.tic();
+        auto Ab_landmark = schurComplementLandmarks(H, g, keep_dim, layout(1), layout(2));
+        double t = tic.toc();
+        t_landmark += t;
+        max_t_landmark = std::max(max_t_landmark, t);
+        MatrixXd A_ref = Ab_sparse.first;
+        if (!skip_dense) {
+            tic.tic();
+            auto Ab_dense = D2Common::Utility::schurComplement(MatrixXd(H), g, keep_dim);
+            t = tic.toc();
+            t_dense += t;
+            max_t_dense = std::max(max_t_dense, t);
+            A_ref = Ab_dense.first;
+        }
+        double err = (Ab_landmark.first - A_ref).norm() / A_ref.norm();
+        max_err = std::max(max_err, err);
+        printf("window %d: dim %ld keep %d landmarks %d rel. err %.2e\n", n, H.rows(), keep_dim, (int)(H.rows() - layout(1))/layout(2), err);
+        windows ++;
+    }
+    if (windows == 0) {
+        printf("no windows\n");
+        return 0;
+    }
+    printf("sparse: avg %.2fms\n", t_sparse/windows);
+    if (!skip_dense) {
+        printf("dense: avg %.2fms max %.2fms\n", t_dense/windows, max_t_dense);
+    }
+    printf("landmark schur: avg %.2fms max %.2fms max rel. err %.2e\n", t_landmark/windows, max_t_landmark, max_err);
+    return 0;
+}
@@ -0,0 +1,244 @@
+#include "../src/estimator/d2estimator.hpp"
+#include "../src/MSCKF/MSCKF.hpp"
+#include "../src/network/d2vins_net.hpp"
+#include "../src/factors/projectionTwoFrameOneCamFactor.h"
+#include "../src/factors/projectionOneFrameTwoCamFactor.h"
+#include "../src/factors/projectionTwoFrameTwoCamFactor.h"
+#include "../src/factors/projectionTwoFrameOneCamDepthFactor.h"
+#include <d2common/integration_base.h>
+#include <d2common/utils.hpp>
+#include <d2frontend/d2frontend_params.h>
+#include <boost/program_options.hpp>
+#include <random>
+
+using namespace D2VINS;
+using D2Common::Utility::TicToc;
+
+const double FOCAL = 460.0;
+const int IMAGE_WIDTH = 640;
+const int IMAGE_HEIGHT = 480;
+
+//Ground truth of the body: static at the origin for init_time, then a smooth loop with roll, pitch and yaw.
+struct SyntheticTrajectory {
+    double init_time = 1.0;
+    double radius = 2.0;
+    double omega = 0.6;
+
+    double ramp(double t) const {
+        double x = std::min(std::max((t - init_time)/2.0, 0.0), 1.0);
+        return x * x * (3 - 2 * x);
+    }
+
+    Vector3d position(double t) const {
+        double s = ramp(t), tau = t - init_time;
+        return s * Vector3d(radius * sin(omega * tau), radius * (1 - cos(omega * tau)), 0.3 * sin(2 * omega * tau));
+    }
+
+    Matrix3d rotation(double t) const {
+        double s = ramp(t), tau = t - init_time;
+        double yaw = s * 0.5 * sin(omega * tau), pitch = s * 0.1 * cos(2 * omega * tau), roll = s * 0.1 * sin(3 * omega * tau);
+        return (AngleAxisd(yaw, Vector3d::UnitZ()) * AngleAxisd(pitch, Vector3d::UnitY()) * AngleAxisd(roll, Vector3d::UnitX())).toRotationMatrix();
+    }
+
+    IMUData imu(double t) const {
+        const double h = 1e-4;
+        IMUData data;
+        data.t = t;
+        Vector3d acc_w = (position(t + h) - 2 * position(t) + position(t - h)) / (h * h);
+        Matrix3d R = rotation(t);
+        Matrix3d omega_hat = R.transpose() * (rotation(t + h) - rotation(t - h)) / (2 * h);
+        data.acc = R.transpose() * (acc_w + IMUData::Gravity);
+        data.gyro = Vector3d(omega_hat(2, 1) - omega_hat(1, 2), omega_hat(0, 2) - omega_hat(2, 0), omega_hat(1, 0) - omega_hat(0, 1)) / 2;
+        return data;
+    }
+};
+
+void setupParams(const Swarm::Pose & extrinsic, double imu_freq, double image_freq) {
+    D2FrontEnd::params = new D2FrontEnd::D2FrontendParams;
+    params = new D2VINSConfig;
+    params->IMU_FREQ = imu_freq;
+    params->IMAGE_FREQ = image_freq;
+    params->max_imu_time_err = 1.5/imu_freq;
+    params->camera_num = 1;
+    params->camera_extrinsics = {extrinsic};
+    params->focal_length = FOCAL;
+    params->estimation_mode = D2VINSConfig::SINGLE_DRONE_MODE;
+    params->fuse_dep = false;
+    params->enable_loop = false;
+    params->verbose = false;
+    params->output_folder = "/tmp";
+    params->ceres_options.linear_solver_type = ceres::DENSE_SCHUR;
+    params->ceres_options.num_threads = 1;
+    params->ceres_options.trust_region_strategy_type = ceres::DOGLEG;
+    params->ceres_options.max_solver_time_in_seconds = params->solver_time;
+    params->ceres_options.max_num_iterations = 8;
+    Eigen::Matrix<double, 18, 18> noise = Eigen::Matrix<double, 18, 18>::Zero();
+    noise.block<3, 3>(0, 0) =  (params->acc_n * params->acc_n) * Eigen::Matrix3d::Identity();
+    noise.block<3, 3>(3, 3) =  (params->gyr_n * params->gyr_n) * Eigen::Matrix3d::Identity();
+    noise.block<3, 3>(6, 6) =  (params->acc_n * params->acc_n) * Eigen::Matrix3d::Identity();
+    noise.block<3, 3>(9, 9) =  (params->gyr_n * params->gyr_n) * Eigen::Matrix3d::Identity();
+    noise.block<3, 3>(12, 12) =  (params->acc_w * params->acc_w) * Eigen::Matrix3d::Identity();
+    noise.block<3, 3>(15, 15) =  (params->gyr_w * params->gyr_w) * Eigen::Matrix3d::Identity();
+    IntegrationBase::noise = noise;
+    ProjectionTwoFrameOneCamFactor::sqrt_info = FOCAL / 1.5 * Matrix2d::Identity();
+    ProjectionOneFrameTwoCamFactor::sqrt_info = FOCAL / 1.5 * Matrix2d::Identity();
+    ProjectionTwoFrameTwoCamFactor::sqrt_info = FOCAL / 1.5 * Matrix2d::Identity();
+    ProjectionTwoFrameOneCamDepthFactor::sqrt_info = FOCAL / 1.5 * Matrix3d::Identity();
+}
+
+struct EstimatorStats {
+    std::vector<double> latency;
+    double sq_err = 0;
+    int poses = 0;
+
+    void add(double t, const Swarm::Odometry & odom, const Vector3d & p_gt) {
+        latency.emplace_back(t);
+        sq_err += (odom.pos() - p_gt).squaredNorm();
+        poses ++;
+    }
+
+    void print(const char * name) {
+        if (latency.empty()) {
+            return;
+        }
+        std::vector<double> sorted = latency;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (auto t : sorted) {
+            sum += t;
+        }
+        printf("%s: frames %ld latency avg %.2fms p95 %.2fms max %.2fms ATE %.3fm\n", name, sorted.size(), sum/sorted.size(),
+            sorted[sorted.size()*95/100], sorted.back(), sqrt(sq_err/std::max(poses, 1)));
+    }
+};
+
+//Feed the same synthetic IMU and feature tracks to the MSCKF and the sliding window estimator (D2Estimator),
+//compare their per-frame latency and absolute trajectory error. The sliding window estimator publishes
+//its visualization, so it needs a ROS master; use --skip-sliding-window to run the MSCKF only.
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("duration,t", po::value<double>()->default_value(30.0), "duration of the sequence in seconds")
+        ("landmarks,l", po::value<int>()->default_value(1000), "num of landmarks on the walls")
+        ("imu-freq", po::value<double>()->default_value(400.0), "IMU rate")
+        ("image-freq", po::value<double>()->default_value(20.0), "image rate")
+        ("pixel-noise", po::value<double>()->default_value(0.5), "std of features in pixel")
+        ("imu-noise", po::value<double>()->default_value(1.0), "scale of the IMU noise to the config")
+        ("skip-sliding-window", "only run the MSCKF");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    double duration = vm["duration"].as<double>(), imu_freq = vm["imu-freq"].as<double>();
+    double image_freq = vm["image-freq"].as<double>(), pixel_noise = vm["pixel-noise"].as<double>();
+    double imu_noise = vm["imu-noise"].as<double>();
+    bool skip_sliding_window = vm.count("skip-sliding-window") > 0;
+
+    //Forward looking camera: z of camera is x of body
+    Matrix3d R_ic;
+    R_ic << 0, 0, 1, -1, 0, 0, 0, -1, 0;
+    Swarm::Pose extrinsic(Quaterniond(R_ic), Vector3d(0.1, 0, 0));
+    setupParams(extrinsic, imu_freq, image_freq);
+
+    D2Estimator * estimator = nullptr;
+    ros::NodeHandle * nh = nullptr;
+    if (!skip_sliding_window) {
+        ros::init(argc, argv, "msckf_benchmark", ros::init_options::AnonymousName);
+        nh = new ros::NodeHandle("~");
+        estimator = new D2Estimator(params->self_id);
+        auto net = new D2VINSNet(estimator, "udpm://224.0.0.251:7667?ttl=0");
+        estimator->init(*nh, net);
+    }
+    auto msckf_config = *params;
+    msckf_config.estimation_mode = D2VINSConfig::MSCKF_MODE;
+    MSCKF msckf(msckf_config);
+
+    //Landmarks on the walls, floor and ceiling of a room around the trajectory
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> normal;
+    std::vector<Vector3d> landmarks;
+    Vector3d room_min(-8, -8, -2), room_max(8, 8, 4);
+    for (int i = 0; i < vm["landmarks"].as<int>(); i++) {
+        Vector3d p;
+        for (int k = 0; k < 3; k++) {
+            p(k) = room_min(k) + (room_max(k) - room_min(k)) * uniform(rng);
+        }
+        int axis = rng() % 3;
+        p(axis) = rng() % 2 ? room_max(axis) : room_min(axis);
+        landmarks.emplace_back(p);
+    }
+
+    SyntheticTrajectory traj;
+    Vector3d bias_acc(0.05, -0.03, 0.02), bias_gyro(0.002, -0.003, 0.001);
+    double acc_std = params->acc_n * sqrt(imu_freq) * imu_noise, gyr_std = params->gyr_n * sqrt(imu_freq) * imu_noise;
+    EstimatorStats msckf_stats, sld_win_stats;
+    int imu_index = 0;
+    int frame_num = duration * image_freq;
+    for (int frame_id = 0; frame_id < frame_num; frame_id ++) {
+        double stamp = frame_id / image_freq;
+        //IMU just after the frame, so the frame is available
+        while (imu_index / imu_freq <= stamp + 2 / imu_freq) {
+            auto data = traj.imu(imu_index / imu_freq);
+            data.dt = 1 / imu_freq;
+            data.acc += bias_acc + acc_std * Vector3d(normal(rng), normal(rng), normal(rng));
+            data.gyro += bias_gyro + gyr_std * Vector3d(normal(rng), normal(rng), normal(rng));
+            msckf.inputImu(data);
+            if (estimator != nullptr) {
+                estimator->inputImu(data);
+            }
+            imu_index ++;
+        }
+
+        Matrix3d R_wc = traj.rotation(stamp) * R_ic;
+        Vector3d p_wc = traj.position(stamp) + traj.rotation(stamp) * extrinsic.pos();
+        VisualImageDescArray frame;
+        frame.frame_id = frame_id;
+        frame.stamp = stamp;
+        frame.drone_id = params->self_id;
+        frame.is_keyframe = true;
+        VisualImageDesc image;
+        image.frame_id = frame_id;
+        image.stamp = stamp;
+        image.drone_id = params->self_id;
+        image.camera_index = 0;
+        image.camera_id = D2Common::generateCameraId(params->self_id, 0);
+        for (int i = 0; i < landmarks.size(); i++) {
+            Vector3d p_c = R_wc.transpose() * (landmarks[i] - p_wc);
+            if (p_c.z() < 0.3) {
+                continue;
+            }
+            double u = FOCAL * p_c.x() / p_c.z() + IMAGE_WIDTH / 2 + pixel_noise * normal(rng);
+            double v = FOCAL * p_c.y() / p_c.z() + IMAGE_HEIGHT / 2 + pixel_noise * normal(rng);
+            if (u < 0 || u >= IMAGE_WIDTH || v < 0 || v >= IMAGE_HEIGHT) {
+                continue;
+            }
+            auto lm = LandmarkPerFrame::createLandmarkPerFrame(i, frame_id, stamp, LandmarkType::SuperPointLandmark,
+                params->self_id, 0, image.camera_id, cv::Point2f(u, v),
+                Vector3d((u - IMAGE_WIDTH / 2) / FOCAL, (v - IMAGE_HEIGHT / 2) / FOCAL, 1));
+            image.landmarks.emplace_back(lm);
+        }
+        frame.images.emplace_back(image);
+
+        Vector3d p_gt = traj.position(stamp);
+        auto msckf_frame = frame;
+        TicToc tic;
+        if (msckf.inputImage(msckf_frame)) {
+            msckf_stats.add(tic.toc(), msckf.getOdometry(), p_gt);
+        }
+        if (estimator != nullptr) {
+            tic.tic();
+            if (estimator->inputImage(frame)) {
+                sld_win_stats.add(tic.toc(), estimator->getOdometry(), p_gt);
+            }
+        }
+    }
+    msckf_stats.print("MSCKF");
+    sld_win_stats.print("Sliding window");
+    return 0;
+}